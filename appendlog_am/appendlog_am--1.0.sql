@@ -0,0 +1,13 @@
+/* appendlog_am/appendlog_am--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION appendlog_am" to load this file. \quit
+
+CREATE FUNCTION appendlog_am_handler(internal)
+RETURNS table_am_handler
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+-- Access method
+CREATE ACCESS METHOD appendlog_am TYPE TABLE HANDLER appendlog_am_handler;
+COMMENT ON ACCESS METHOD appendlog_am IS 'append-only log-structured table AM';
@@ -0,0 +1,1504 @@
+/*-------------------------------------------------------------------------
+ *
+ * appendlog_am.c
+ *	  append-only log-structured table access method code
+ *
+ * Portions Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  appendlog_am/appendlog_am.c
+ *
+ *
+ * NOTES
+ *	  This file introduces the table access method appendlog, built from
+ *	  the blackhole template, for insert-only tables. Tuples are packed
+ *	  densely one after the other in pages, as minimal tuples preceded
+ *	  by the only visibility information kept, the inserting transaction
+ *	  and command. There are no line pointers, so the space of tuples
+ *	  inserted by aborted transactions is never reused.
+ *
+ *	  The tuples appended to a page by an insertion, a single tuple or a
+ *	  whole batch of multi_insert, are WAL-logged with one generic WAL
+ *	  record holding only the bytes appended and the fields of the page
+ *	  updated, as the rest of the page does not change. A new page, or a
+ *	  page first modified after a checkpoint, gets a full-page image.
+ *
+ *	  VACUUM freezes the transaction IDs of old tuples, and marks the
+ *	  tuples of aborted transactions as dead. UPDATE, DELETE, row locks
+ *	  and indexes are not supported.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "access/detoast.h"
+#include "access/hio.h"
+#include "access/generic_xlog.h"
+#include "access/htup_details.h"
+#include "access/multixact.h"
+#include "access/tableam.h"
+#include "access/transam.h"
+#include "access/tsmapi.h"
+#include "access/xact.h"
+#include "access/xlog.h"
+#include "access/xloginsert.h"
+#include "catalog/index.h"
+#include "catalog/storage.h"
+#include "catalog/storage_xlog.h"
+#include "commands/vacuum.h"
+#include "executor/tuptable.h"
+#include "nodes/execnodes.h"
+#include "optimizer/plancat.h"
+#include "storage/bufmgr.h"
+#include "storage/bufpage.h"
+#include "storage/lmgr.h"
+#include "storage/procarray.h"
+#include "storage/smgr.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+PG_MODULE_MAGIC;
+
+PG_FUNCTION_INFO_V1(appendlog_am_handler);
+
+void		_PG_init(void);
+
+/*
+ * Header of a tuple stored in a page, followed by a minimal tuple at the
+ * next MAXALIGN'd position.
+ */
+typedef struct AppendlogTupleHeaderData
+{
+	TransactionId t_xmin;		/* inserting transaction, frozen, or invalid
+								 * for the tuples of aborted transactions */
+	CommandId	t_cid;			/* inserting command */
+} AppendlogTupleHeaderData;
+
+typedef AppendlogTupleHeaderData *AppendlogTupleHeader;
+
+#define APPENDLOG_TUPLE_HDRSZ	MAXALIGN(sizeof(AppendlogTupleHeaderData))
+
+/* Special space of the pages */
+typedef struct AppendlogPageOpaqueData
+{
+	uint32		ntuples;		/* number of tuples stored in the page */
+} AppendlogPageOpaqueData;
+
+typedef AppendlogPageOpaqueData *AppendlogPageOpaque;
+
+#define AppendlogPageGetOpaque(page) \
+	((AppendlogPageOpaque) PageGetSpecialPointer(page))
+
+/* Position of the first tuple of a page */
+#define APPENDLOG_FIRST_TUPLE	MAXALIGN(SizeOfPageHeaderData)
+
+/* Maximum size of a minimal tuple fitting in a page */
+#define APPENDLOG_MAX_TUPLE_SIZE \
+	(BLCKSZ - APPENDLOG_FIRST_TUPLE - \
+	 MAXALIGN(sizeof(AppendlogPageOpaqueData)) - APPENDLOG_TUPLE_HDRSZ)
+
+/* Maximum number of tuples in a page */
+#define APPENDLOG_MAX_TUPLES_PER_PAGE \
+	((BLCKSZ - APPENDLOG_FIRST_TUPLE) / \
+	 (APPENDLOG_TUPLE_HDRSZ + MAXALIGN(SizeofMinimalTupleHeader)))
+
+/* GUC variable */
+static int	appendlog_readahead = 32;
+
+/* Cache of the commit status of the last transaction checked by a scan */
+typedef struct AppendlogXidCache
+{
+	TransactionId xid;
+	bool		committed;
+} AppendlogXidCache;
+
+/* Base structures for scans */
+typedef struct AppendlogScanDescData
+{
+	TableScanDescData rs_base;	/* AM independent part of the descriptor */
+
+	BlockNumber nblocks;		/* number of blocks at the start of the scan */
+	BlockNumber curblock;		/* current block, or InvalidBlockNumber */
+	BlockNumber prefetch_block; /* next block to prefetch */
+	BufferAccessStrategy strategy;	/* access strategy for reads */
+	bool		started;		/* parallel scan started? */
+
+	/* copy of the current page, and positions of its tuples */
+	char	   *page;
+	int			ntuples;
+	int			curtuple;		/* next tuple to check */
+	uint16		offsets[APPENDLOG_MAX_TUPLES_PER_PAGE];
+
+	AppendlogXidCache xidcache;
+} AppendlogScanDescData;
+typedef struct AppendlogScanDescData *AppendlogScanDesc;
+
+static const TableAmRoutine appendlog_methods;
+
+
+/* ------------------------------------------------------------------------
+ * Visibility of tuples
+ * ------------------------------------------------------------------------
+ */
+
+/*
+ * Check if a tuple is visible to a snapshot, based on the transaction and
+ * the command that inserted it. The commit status of the transactions
+ * that are not in an MVCC snapshot is cached, as it cannot change.
+ */
+static bool
+appendlog_tuple_visible(AppendlogTupleHeader hdr, Snapshot snapshot,
+						AppendlogXidCache *cache)
+{
+	TransactionId xmin = hdr->t_xmin;
+
+	/* tuple of an aborted transaction, marked as such by VACUUM */
+	if (!TransactionIdIsValid(xmin))
+		return false;
+
+	if (TransactionIdEquals(xmin, FrozenTransactionId) ||
+		snapshot->snapshot_type == SNAPSHOT_ANY)
+		return true;
+
+	if (TransactionIdIsCurrentTransactionId(xmin))
+		return snapshot->snapshot_type != SNAPSHOT_MVCC ||
+			hdr->t_cid < snapshot->curcid;
+
+	if (snapshot->snapshot_type == SNAPSHOT_MVCC)
+	{
+		if (XidInMVCCSnapshot(xmin, snapshot))
+			return false;
+
+		if (cache != NULL && TransactionIdEquals(cache->xid, xmin))
+			return cache->committed;
+
+		if (cache != NULL)
+		{
+			cache->xid = xmin;
+			cache->committed = TransactionIdDidCommit(xmin);
+			return cache->committed;
+		}
+	}
+	else if (TransactionIdIsInProgress(xmin))
+		return false;
+
+	return TransactionIdDidCommit(xmin);
+}
+
+/*
+ * Build the positions of the tuples of a page.
+ */
+static int
+appendlog_page_offsets(Page page, uint16 *offsets)
+{
+	AppendlogPageOpaque opaque;
+	Size		pos = APPENDLOG_FIRST_TUPLE;
+	int			ntuples;
+	int			i;
+
+	if (PageIsNew(page))
+		return 0;
+
+	opaque = AppendlogPageGetOpaque(page);
+	ntuples = opaque->ntuples;
+	if (ntuples > APPENDLOG_MAX_TUPLES_PER_PAGE)
+		elog(ERROR, "invalid number of tuples %d in appendlog page", ntuples);
+
+	for (i = 0; i < ntuples; i++)
+	{
+		MinimalTuple tuple = (MinimalTuple) ((char *) page + pos +
+											 APPENDLOG_TUPLE_HDRSZ);
+
+		offsets[i] = (uint16) pos;
+		pos += APPENDLOG_TUPLE_HDRSZ + MAXALIGN(tuple->t_len);
+		if (pos > ((PageHeader) page)->pd_lower)
+			elog(ERROR, "tuple %d of appendlog page goes beyond its end", i);
+	}
+
+	return ntuples;
+}
+
+
+/* ------------------------------------------------------------------------
+ * Insertion of tuples
+ * ------------------------------------------------------------------------
+ */
+
+/*
+ * Get an exclusively-locked buffer with room for a tuple of the given
+ * size, the last page of the relation or a new one. *isnew is set if the
+ * page needs to be initialized.
+ */
+static Buffer
+appendlog_get_buffer(Relation rel, Size len, BufferAccessStrategy strategy,
+					 bool *isnew)
+{
+	BlockNumber blkno = RelationGetTargetBlock(rel);
+	Buffer		buffer;
+
+	*isnew = false;
+
+	if (!BlockNumberIsValid(blkno))
+	{
+		BlockNumber nblocks = RelationGetNumberOfBlocks(rel);
+
+		if (nblocks > 0)
+			blkno = nblocks - 1;
+	}
+
+	if (BlockNumberIsValid(blkno))
+	{
+		Page		page;
+
+		buffer = ReadBufferExtended(rel, MAIN_FORKNUM, blkno, RBM_NORMAL,
+									strategy);
+		LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+		page = BufferGetPage(buffer);
+
+		if (PageIsNew(page))
+		{
+			*isnew = true;
+			return buffer;
+		}
+		if (PageGetExactFreeSpace(page) >= len)
+			return buffer;
+
+		UnlockReleaseBuffer(buffer);
+	}
+
+	/* extend the relation with a new page */
+	LockRelationForExtension(rel, ExclusiveLock);
+	buffer = ReadBufferExtended(rel, MAIN_FORKNUM, P_NEW, RBM_ZERO_AND_LOCK,
+								strategy);
+	UnlockRelationForExtension(rel, ExclusiveLock);
+
+	RelationSetTargetBlock(rel, BufferGetBlockNumber(buffer));
+	*isnew = true;
+	return buffer;
+}
+
+/*
+ * Append tuples to a relation, with the given visibility information.
+ * The TIDs of the tuples are stored in tids if not NULL.
+ */
+static void
+appendlog_append(Relation rel, int ntuples, MinimalTuple *tuples,
+				 TransactionId *xmins, CommandId cid,
+				 BufferAccessStrategy strategy, ItemPointer tids)
+{
+	int			i;
+
+	/* check all the tuples before modifying anything */
+	for (i = 0; i < ntuples; i++)
+	{
+		if (tuples[i]->t_len > APPENDLOG_MAX_TUPLE_SIZE)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+					 errmsg("row is too big: size %zu, maximum size %zu",
+							(Size) tuples[i]->t_len,
+							(Size) APPENDLOG_MAX_TUPLE_SIZE)));
+	}
+
+	i = 0;
+	while (i < ntuples)
+	{
+		Buffer		buffer;
+		BlockNumber blkno;
+		GenericXLogState *state;
+		Page		page;
+		PageHeader	phdr;
+		AppendlogPageOpaque opaque;
+		bool		isnew;
+
+		buffer = appendlog_get_buffer(rel,
+									  APPENDLOG_TUPLE_HDRSZ +
+									  MAXALIGN(tuples[i]->t_len),
+									  strategy, &isnew);
+		blkno = BufferGetBlockNumber(buffer);
+
+		/*
+		 * The tuples are appended to a copy of the page, the delta with
+		 * the page being WAL-logged, so as only the bytes appended and the
+		 * header fields updated go to WAL.
+		 */
+		state = GenericXLogStart(rel);
+		page = GenericXLogRegisterBuffer(state, buffer,
+										 isnew ? GENERIC_XLOG_FULL_IMAGE : 0);
+		phdr = (PageHeader) page;
+
+		if (isnew)
+		{
+			PageInit(page, BLCKSZ, sizeof(AppendlogPageOpaqueData));
+			phdr->pd_lower = APPENDLOG_FIRST_TUPLE;
+		}
+
+		opaque = AppendlogPageGetOpaque(page);
+		while (i < ntuples)
+		{
+			Size		len = APPENDLOG_TUPLE_HDRSZ + MAXALIGN(tuples[i]->t_len);
+			AppendlogTupleHeader hdr;
+
+			if (PageGetExactFreeSpace(page) < len)
+				break;
+
+			hdr = (AppendlogTupleHeader) ((char *) page + phdr->pd_lower);
+			hdr->t_xmin = xmins[i];
+			hdr->t_cid = cid;
+			memcpy((char *) hdr + APPENDLOG_TUPLE_HDRSZ, tuples[i],
+				   tuples[i]->t_len);
+			phdr->pd_lower += len;
+			opaque->ntuples++;
+
+			if (tids != NULL)
+				ItemPointerSet(&tids[i], blkno, opaque->ntuples);
+			i++;
+		}
+
+		GenericXLogFinish(state);
+		UnlockReleaseBuffer(buffer);
+	}
+}
+
+/*
+ * Build the tuple stored for the contents of a slot. Values stored
+ * externally are detoasted, as the relation has no TOAST table and these
+ * values may go away with the relation they come from.
+ */
+static MinimalTuple
+appendlog_form_tuple(TupleTableSlot *slot, bool *shouldfree)
+{
+	TupleDesc	tupdesc = slot->tts_tupleDescriptor;
+	Datum	   *values = NULL;
+	MinimalTuple tuple;
+	int			attno;
+
+	slot_getallattrs(slot);
+
+	for (attno = 0; attno < tupdesc->natts; attno++)
+	{
+		Datum		value = slot->tts_values[attno];
+
+		if (slot->tts_isnull[attno] ||
+			TupleDescAttr(tupdesc, attno)->attlen != -1 ||
+			!VARATT_IS_EXTERNAL(DatumGetPointer(value)))
+			continue;
+
+		if (values == NULL)
+		{
+			values = (Datum *) palloc(sizeof(Datum) * tupdesc->natts);
+			memcpy(values, slot->tts_values, sizeof(Datum) * tupdesc->natts);
+		}
+		values[attno] = PointerGetDatum(detoast_external_attr((struct varlena *)
+															  DatumGetPointer(value)));
+	}
+
+	/* Nothing to detoast, use the tuple of the slot */
+	if (values == NULL)
+		return ExecFetchSlotMinimalTuple(slot, shouldfree);
+
+	tuple = heap_form_minimal_tuple(tupdesc, values, slot->tts_isnull);
+	*shouldfree = true;
+
+	for (attno = 0; attno < tupdesc->natts; attno++)
+	{
+		if (values[attno] != slot->tts_values[attno])
+			pfree(DatumGetPointer(values[attno]));
+	}
+	pfree(values);
+
+	return tuple;
+}
+
+/*
+ * Insert the contents of slots, as tuples of the current transaction.
+ */
+static void
+appendlog_insert_slots(Relation relation, TupleTableSlot **slots,
+					   int ntuples, CommandId cid, BulkInsertState bistate)
+{
+	TransactionId xid = GetCurrentTransactionId();
+	MinimalTuple *tuples;
+	TransactionId *xmins;
+	bool	   *shouldfree;
+	ItemPointerData *tids;
+	int			i;
+
+	tuples = (MinimalTuple *) palloc(sizeof(MinimalTuple) * ntuples);
+	xmins = (TransactionId *) palloc(sizeof(TransactionId) * ntuples);
+	shouldfree = (bool *) palloc(sizeof(bool) * ntuples);
+	tids = (ItemPointerData *) palloc(sizeof(ItemPointerData) * ntuples);
+
+	for (i = 0; i < ntuples; i++)
+	{
+		tuples[i] = appendlog_form_tuple(slots[i], &shouldfree[i]);
+		xmins[i] = xid;
+	}
+
+	appendlog_append(relation, ntuples, tuples, xmins, cid,
+					 bistate != NULL ? bistate->strategy : NULL, tids);
+
+	for (i = 0; i < ntuples; i++)
+	{
+		slots[i]->tts_tableOid = RelationGetRelid(relation);
+		slots[i]->tts_tid = tids[i];
+		if (shouldfree[i])
+			pfree(tuples[i]);
+	}
+
+	pfree(tuples);
+	pfree(xmins);
+	pfree(shouldfree);
+	pfree(tids);
+}
+
+
+/* ------------------------------------------------------------------------
+ * Slot related callbacks for appendlog AM
+ * ------------------------------------------------------------------------
+ */
+
+static const TupleTableSlotOps *
+appendlog_slot_callbacks(Relation relation)
+{
+	/* tuples are stored as minimal tuples */
+	return &TTSOpsMinimalTuple;
+}
+
+
+/* ------------------------------------------------------------------------
+ * Table Scan Callbacks for appendlog AM
+ * ------------------------------------------------------------------------
+ */
+
+/*
+ * Read a page into the copy of the scan, prefetching the next ones for
+ * serial scans.
+ */
+static void
+appendlog_scan_read_page(AppendlogScanDesc scan, BlockNumber blkno)
+{
+	Relation	rel = scan->rs_base.rs_rd;
+	Buffer		buffer;
+
+	if (scan->rs_base.rs_parallel == NULL && appendlog_readahead > 0)
+	{
+		if (scan->prefetch_block <= blkno)
+			scan->prefetch_block = blkno + 1;
+		while (scan->prefetch_block < scan->nblocks &&
+			   scan->prefetch_block <= blkno + appendlog_readahead)
+		{
+			(void) PrefetchBuffer(rel, MAIN_FORKNUM, scan->prefetch_block);
+			scan->prefetch_block++;
+		}
+	}
+
+	buffer = ReadBufferExtended(rel, MAIN_FORKNUM, blkno, RBM_NORMAL,
+								scan->strategy);
+	LockBuffer(buffer, BUFFER_LOCK_SHARE);
+	memcpy(scan->page, BufferGetPage(buffer), BLCKSZ);
+	UnlockReleaseBuffer(buffer);
+
+	scan->curblock = blkno;
+	scan->ntuples = appendlog_page_offsets((Page) scan->page, scan->offsets);
+	scan->curtuple = 0;
+}
+
+/*
+ * Move to the next block of a sequential scan. Returns false if there
+ * are no more blocks.
+ */
+static bool
+appendlog_scan_next_block(AppendlogScanDesc scan)
+{
+	BlockNumber blkno;
+
+	if (scan->rs_base.rs_parallel != NULL)
+	{
+		ParallelBlockTableScanDesc pbscan =
+		(ParallelBlockTableScanDesc) scan->rs_base.rs_parallel;
+
+		if (!scan->started)
+		{
+			table_block_parallelscan_startblock_init(scan->rs_base.rs_rd,
+													 pbscan);
+			scan->started = true;
+		}
+		blkno = table_block_parallelscan_nextpage(scan->rs_base.rs_rd,
+												  pbscan);
+	}
+	else if (!BlockNumberIsValid(scan->curblock))
+		blkno = 0;
+	else
+		blkno = scan->curblock + 1;
+
+	if (!BlockNumberIsValid(blkno) || blkno >= scan->nblocks)
+		return false;
+
+	appendlog_scan_read_page(scan, blkno);
+	return true;
+}
+
+static void
+appendlog_scan_init(AppendlogScanDesc scan)
+{
+	Relation	rel = scan->rs_base.rs_rd;
+
+	if (scan->rs_base.rs_parallel != NULL)
+		scan->nblocks = ((ParallelBlockTableScanDesc)
+						 scan->rs_base.rs_parallel)->phs_nblocks;
+	else
+		scan->nblocks = RelationGetNumberOfBlocks(rel);
+
+	scan->curblock = InvalidBlockNumber;
+	scan->prefetch_block = 0;
+	scan->started = false;
+	scan->ntuples = 0;
+	scan->curtuple = 0;
+
+	/* use a ring of buffers for large scans, like heap */
+	if ((scan->rs_base.rs_flags & SO_ALLOW_STRAT) != 0 &&
+		!RelationUsesLocalBuffers(rel) &&
+		scan->nblocks > NBuffers / 4)
+	{
+		if (scan->strategy == NULL)
+			scan->strategy = GetAccessStrategy(BAS_BULKREAD);
+	}
+	else if (scan->strategy != NULL)
+	{
+		FreeAccessStrategy(scan->strategy);
+		scan->strategy = NULL;
+	}
+}
+
+static TableScanDesc
+appendlog_scan_begin(Relation relation, Snapshot snapshot,
+					 int nkeys, ScanKey key,
+					 ParallelTableScanDesc parallel_scan,
+					 uint32 flags)
+{
+	AppendlogScanDesc scan;
+
+	scan = (AppendlogScanDesc) palloc(sizeof(AppendlogScanDescData));
+
+	scan->rs_base.rs_rd = relation;
+	scan->rs_base.rs_snapshot = snapshot;
+	scan->rs_base.rs_nkeys = nkeys;
+	scan->rs_base.rs_flags = flags;
+	scan->rs_base.rs_parallel = parallel_scan;
+
+	scan->page = palloc(BLCKSZ);
+	scan->strategy = NULL;
+	scan->xidcache.xid = InvalidTransactionId;
+	scan->xidcache.committed = false;
+	appendlog_scan_init(scan);
+
+	return (TableScanDesc) scan;
+}
+
+static void
+appendlog_scan_end(TableScanDesc sscan)
+{
+	AppendlogScanDesc scan = (AppendlogScanDesc) sscan;
+
+	if (scan->strategy != NULL)
+		FreeAccessStrategy(scan->strategy);
+	pfree(scan->page);
+	pfree(scan);
+}
+
+static void
+appendlog_scan_rescan(TableScanDesc sscan, ScanKey key, bool set_params,
+					  bool allow_strat, bool allow_sync, bool allow_pagemode)
+{
+	AppendlogScanDesc scan = (AppendlogScanDesc) sscan;
+
+	if (set_params)
+	{
+		if (allow_strat)
+			sscan->rs_flags |= SO_ALLOW_STRAT;
+		else
+			sscan->rs_flags &= ~SO_ALLOW_STRAT;
+	}
+
+	appendlog_scan_init(scan);
+}
+
+static bool
+appendlog_scan_getnextslot(TableScanDesc sscan, ScanDirection direction,
+						   TupleTableSlot *slot)
+{
+	AppendlogScanDesc scan = (AppendlogScanDesc) sscan;
+
+	for (;;)
+	{
+		while (scan->curtuple < scan->ntuples)
+		{
+			AppendlogTupleHeader hdr;
+			int			n = scan->curtuple++;
+
+			hdr = (AppendlogTupleHeader) (scan->page + scan->offsets[n]);
+			if (!appendlog_tuple_visible(hdr, sscan->rs_snapshot,
+										 &scan->xidcache))
+				continue;
+
+			ExecStoreMinimalTuple((MinimalTuple) ((char *) hdr +
+												  APPENDLOG_TUPLE_HDRSZ),
+								  slot, false);
+			slot->tts_tableOid = RelationGetRelid(sscan->rs_rd);
+			ItemPointerSet(&slot->tts_tid, scan->curblock, n + 1);
+			return true;
+		}
+
+		if (!appendlog_scan_next_block(scan))
+		{
+			ExecClearTuple(slot);
+			return false;
+		}
+	}
+}
+
+
+/* ------------------------------------------------------------------------
+ * Index Scan Callbacks for appendlog AM
+ * ------------------------------------------------------------------------
+ */
+
+static IndexFetchTableData *
+appendlog_index_fetch_begin(Relation rel)
+{
+	/* indexes are not supported */
+	return NULL;
+}
+
+static void
+appendlog_index_fetch_reset(IndexFetchTableData *scan)
+{
+	/* nothing to do here */
+}
+
+static void
+appendlog_index_fetch_end(IndexFetchTableData *scan)
+{
+	/* nothing to do here */
+}
+
+static bool
+appendlog_index_fetch_tuple(struct IndexFetchTableData *scan,
+							ItemPointer tid,
+							Snapshot snapshot,
+							TupleTableSlot *slot,
+							bool *call_again, bool *all_dead)
+{
+	/* indexes are not supported */
+	return false;
+}
+
+
+/* ------------------------------------------------------------------------
+ * Callbacks for non-modifying operations on individual tuples for
+ * appendlog AM.
+ * ------------------------------------------------------------------------
+ */
+
+/*
+ * Fetch the tuple at a TID into a slot if it is visible to a snapshot.
+ * The slot can be NULL to only check the visibility.
+ */
+static bool
+appendlog_fetch_tid(Relation relation, ItemPointer tid, Snapshot snapshot,
+					TupleTableSlot *slot)
+{
+	BlockNumber blkno = ItemPointerGetBlockNumber(tid);
+	OffsetNumber offnum = ItemPointerGetOffsetNumber(tid);
+	uint16		offsets[APPENDLOG_MAX_TUPLES_PER_PAGE];
+	AppendlogTupleHeader hdr;
+	Buffer		buffer;
+	Page		page;
+	int			ntuples;
+	bool		visible = false;
+
+	if (blkno >= RelationGetNumberOfBlocks(relation))
+		return false;
+
+	buffer = ReadBuffer(relation, blkno);
+	LockBuffer(buffer, BUFFER_LOCK_SHARE);
+	page = BufferGetPage(buffer);
+	ntuples = appendlog_page_offsets(page, offsets);
+
+	if (offnum >= FirstOffsetNumber && offnum <= ntuples)
+	{
+		hdr = (AppendlogTupleHeader) ((char *) page + offsets[offnum - 1]);
+		visible = appendlog_tuple_visible(hdr, snapshot, NULL);
+
+		if (visible && slot != NULL)
+		{
+			MinimalTuple tuple = (MinimalTuple) ((char *) hdr +
+												 APPENDLOG_TUPLE_HDRSZ);
+
+			ExecStoreMinimalTuple(heap_copy_minimal_tuple(tuple), slot, true);
+			slot->tts_tableOid = RelationGetRelid(relation);
+			slot->tts_tid = *tid;
+		}
+	}
+
+	UnlockReleaseBuffer(buffer);
+	return visible;
+}
+
+static bool
+appendlog_fetch_row_version(Relation relation,
+							ItemPointer tid,
+							Snapshot snapshot,
+							TupleTableSlot *slot)
+{
+	return appendlog_fetch_tid(relation, tid, snapshot, slot);
+}
+
+static void
+appendlog_get_latest_tid(TableScanDesc sscan,
+						 ItemPointer tid)
+{
+	/* tuples are never updated, so the TID is the latest one */
+}
+
+static bool
+appendlog_tuple_tid_valid(TableScanDesc sscan, ItemPointer tid)
+{
+	AppendlogScanDesc scan = (AppendlogScanDesc) sscan;
+
+	return ItemPointerIsValid(tid) &&
+		ItemPointerGetBlockNumber(tid) < scan->nblocks;
+}
+
+static bool
+appendlog_tuple_satisfies_snapshot(Relation rel, TupleTableSlot *slot,
+								   Snapshot snapshot)
+{
+	return appendlog_fetch_tid(rel, &slot->tts_tid, snapshot, NULL);
+}
+
+static TransactionId
+appendlog_compute_xid_horizon_for_tuples(Relation rel,
+										 ItemPointerData *tids,
+										 int nitems)
+{
+	return InvalidTransactionId;
+}
+
+
+/* ----------------------------------------------------------------------------
+ *  Functions for manipulations of physical tuples for appendlog AM.
+ * ----------------------------------------------------------------------------
+ */
+
+static void
+appendlog_tuple_insert(Relation relation, TupleTableSlot *slot,
+					   CommandId cid, int options, BulkInsertState bistate)
+{
+	appendlog_insert_slots(relation, &slot, 1, cid, bistate);
+}
+
+static void
+appendlog_tuple_insert_speculative(Relation relation, TupleTableSlot *slot,
+								   CommandId cid, int options,
+								   BulkInsertState bistate,
+								   uint32 specToken)
+{
+	/* same as a normal insert */
+	appendlog_tuple_insert(relation, slot, cid, options, bistate);
+}
+
+static void
+appendlog_tuple_complete_speculative(Relation relation, TupleTableSlot *slot,
+									 uint32 spekToken, bool succeeded)
+{
+	/* nothing to do */
+}
+
+static void
+appendlog_multi_insert(Relation relation, TupleTableSlot **slots,
+					   int ntuples, CommandId cid, int options,
+					   BulkInsertState bistate)
+{
+	appendlog_insert_slots(relation, slots, ntuples, cid, bistate);
+}
+
+static TM_Result
+appendlog_tuple_delete(Relation relation, ItemPointer tid, CommandId cid,
+					   Snapshot snapshot, Snapshot crosscheck, bool wait,
+					   TM_FailureData *tmfd, bool changingPart)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("appendlog_am does not support DELETE")));
+	return TM_Ok;				/* keep compiler quiet */
+}
+
+static TM_Result
+appendlog_tuple_update(Relation relation, ItemPointer otid,
+					   TupleTableSlot *slot, CommandId cid,
+					   Snapshot snapshot, Snapshot crosscheck,
+					   bool wait, TM_FailureData *tmfd,
+					   LockTupleMode *lockmode, bool *update_indexes)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("appendlog_am does not support UPDATE")));
+	return TM_Ok;				/* keep compiler quiet */
+}
+
+static TM_Result
+appendlog_tuple_lock(Relation relation, ItemPointer tid, Snapshot snapshot,
+					 TupleTableSlot *slot, CommandId cid, LockTupleMode mode,
+					 LockWaitPolicy wait_policy, uint8 flags,
+					 TM_FailureData *tmfd)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("appendlog_am does not support row locks")));
+	return TM_Ok;				/* keep compiler quiet */
+}
+
+static void
+appendlog_finish_bulk_insert(Relation relation, int options)
+{
+	/* pages are WAL-logged as the tuples are appended */
+}
+
+
+/* ------------------------------------------------------------------------
+ * DDL related callbacks for appendlog AM.
+ * ------------------------------------------------------------------------
+ */
+
+static void
+appendlog_relation_set_new_filenode(Relation rel,
+									const RelFileNode *newrnode,
+									char persistence,
+									TransactionId *freezeXid,
+									MultiXactId *minmulti)
+{
+	SMgrRelation srel;
+
+	/* no transaction older than this one can be in the new relation */
+	*freezeXid = RecentXmin;
+	*minmulti = GetOldestMultiXactId();
+
+	srel = RelationCreateStorage(*newrnode, persistence);
+
+	/* unlogged relations need an init fork, like heap */
+	if (persistence == RELPERSISTENCE_UNLOGGED)
+	{
+		smgrcreate(srel, INIT_FORKNUM, false);
+		log_smgrcreate(newrnode, INIT_FORKNUM);
+		smgrimmedsync(srel, INIT_FORKNUM);
+	}
+
+	smgrclose(srel);
+}
+
+static void
+appendlog_relation_nontransactional_truncate(Relation rel)
+{
+	RelationTruncate(rel, 0);
+}
+
+static void
+appendlog_copy_data(Relation rel, const RelFileNode *newrnode)
+{
+	SMgrRelation dstrel;
+	ForkNumber	forkNum;
+
+	dstrel = smgropen(*newrnode, rel->rd_backend);
+	RelationOpenSmgr(rel);
+
+	/*
+	 * The file is copied directly, so flush first the pages of the relation
+	 * in shared buffers.
+	 */
+	FlushRelationBuffers(rel);
+
+	RelationCreateStorage(*newrnode, rel->rd_rel->relpersistence);
+	RelationCopyStorage(rel->rd_smgr, dstrel, MAIN_FORKNUM,
+						rel->rd_rel->relpersistence);
+
+	/* copy the init fork of unlogged relations */
+	for (forkNum = MAIN_FORKNUM + 1; forkNum <= MAX_FORKNUM; forkNum++)
+	{
+		if (!smgrexists(rel->rd_smgr, forkNum))
+			continue;
+
+		smgrcreate(dstrel, forkNum, false);
+		if (rel->rd_rel->relpersistence == RELPERSISTENCE_PERMANENT ||
+			(rel->rd_rel->relpersistence == RELPERSISTENCE_UNLOGGED &&
+			 forkNum == INIT_FORKNUM))
+			log_smgrcreate(newrnode, forkNum);
+		RelationCopyStorage(rel->rd_smgr, dstrel, forkNum,
+							rel->rd_rel->relpersistence);
+	}
+
+	RelationDropStorage(rel);
+	smgrclose(dstrel);
+}
+
+static void
+appendlog_copy_for_cluster(Relation OldTable, Relation NewTable,
+						   Relation OldIndex, bool use_sort,
+						   TransactionId OldestXmin,
+						   TransactionId *xid_cutoff,
+						   MultiXactId *multi_cutoff,
+						   double *num_tuples,
+						   double *tups_vacuumed,
+						   double *tups_recently_dead)
+{
+	BlockNumber nblocks = RelationGetNumberOfBlocks(OldTable);
+	BufferAccessStrategy strategy = GetAccessStrategy(BAS_BULKREAD);
+	BufferAccessStrategy wstrategy = GetAccessStrategy(BAS_BULKWRITE);
+	char	   *pagecopy = palloc(BLCKSZ);
+	uint16		offsets[APPENDLOG_MAX_TUPLES_PER_PAGE];
+	MinimalTuple tuples[APPENDLOG_MAX_TUPLES_PER_PAGE];
+	TransactionId xmins[APPENDLOG_MAX_TUPLES_PER_PAGE];
+	BlockNumber blkno;
+
+	*num_tuples = 0;
+	*tups_vacuumed = 0;
+	*tups_recently_dead = 0;
+
+	/*
+	 * Copy the tuples page by page, discarding the ones of aborted
+	 * transactions and freezing the ones of committed transactions older
+	 * than the cutoff. There are no indexes, so no ordering to follow.
+	 */
+	for (blkno = 0; blkno < nblocks; blkno++)
+	{
+		Buffer		buffer;
+		int			ntuples;
+		int			nkept = 0;
+		int			i;
+
+		CHECK_FOR_INTERRUPTS();
+
+		buffer = ReadBufferExtended(OldTable, MAIN_FORKNUM, blkno,
+									RBM_NORMAL, strategy);
+		LockBuffer(buffer, BUFFER_LOCK_SHARE);
+		memcpy(pagecopy, BufferGetPage(buffer), BLCKSZ);
+		UnlockReleaseBuffer(buffer);
+
+		ntuples = appendlog_page_offsets((Page) pagecopy, offsets);
+		for (i = 0; i < ntuples; i++)
+		{
+			AppendlogTupleHeader hdr;
+			TransactionId xmin;
+
+			hdr = (AppendlogTupleHeader) (pagecopy + offsets[i]);
+			xmin = hdr->t_xmin;
+
+			if (!TransactionIdIsValid(xmin))
+			{
+				*tups_vacuumed += 1;
+				continue;
+			}
+
+			if (TransactionIdIsNormal(xmin) &&
+				!TransactionIdIsCurrentTransactionId(xmin) &&
+				!TransactionIdIsInProgress(xmin))
+			{
+				if (!TransactionIdDidCommit(xmin))
+				{
+					*tups_vacuumed += 1;
+					continue;
+				}
+				if (TransactionIdPrecedes(xmin, *xid_cutoff))
+					xmin = FrozenTransactionId;
+			}
+
+			tuples[nkept] = (MinimalTuple) ((char *) hdr +
+											APPENDLOG_TUPLE_HDRSZ);
+			xmins[nkept] = xmin;
+			nkept++;
+		}
+
+		appendlog_append(NewTable, nkept, tuples, xmins, FirstCommandId,
+						 wstrategy, NULL);
+		*num_tuples += nkept;
+	}
+
+	pfree(pagecopy);
+	FreeAccessStrategy(strategy);
+	FreeAccessStrategy(wstrategy);
+}
+
+/*
+ * VACUUM freezes the transaction IDs of the tuples older than the freeze
+ * limit and marks the tuples of aborted transactions as dead, so as the
+ * frozen limits of the relation can advance. The space of dead tuples is
+ * not reclaimed.
+ */
+static void
+appendlog_vacuum(Relation onerel, VacuumParams *params,
+				 BufferAccessStrategy bstrategy)
+{
+	TransactionId OldestXmin;
+	TransactionId FreezeLimit;
+	TransactionId xidFullScanLimit;
+	MultiXactId MultiXactCutoff;
+	MultiXactId mxactFullScanLimit;
+	BlockNumber nblocks;
+	BlockNumber blkno;
+	double		live_tuples = 0;
+	double		dead_tuples = 0;
+
+	vacuum_set_xid_limits(onerel,
+						  params->freeze_min_age,
+						  params->freeze_table_age,
+						  params->multixact_freeze_min_age,
+						  params->multixact_freeze_table_age,
+						  &OldestXmin, &FreezeLimit, &xidFullScanLimit,
+						  &MultiXactCutoff, &mxactFullScanLimit);
+
+	nblocks = RelationGetNumberOfBlocks(onerel);
+	for (blkno = 0; blkno < nblocks; blkno++)
+	{
+		uint16		offsets[APPENDLOG_MAX_TUPLES_PER_PAGE];
+		TransactionId newxmins[APPENDLOG_MAX_TUPLES_PER_PAGE];
+		Buffer		buffer;
+		Page		page;
+		int			ntuples;
+		int			nchanged = 0;
+		int			i;
+
+		vacuum_delay_point();
+
+		buffer = ReadBufferExtended(onerel, MAIN_FORKNUM, blkno, RBM_NORMAL,
+									bstrategy);
+		LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+		page = BufferGetPage(buffer);
+		ntuples = appendlog_page_offsets(page, offsets);
+
+		/* decide first what to change, as this can fail */
+		for (i = 0; i < ntuples; i++)
+		{
+			AppendlogTupleHeader hdr;
+			TransactionId xmin;
+
+			hdr = (AppendlogTupleHeader) ((char *) page + offsets[i]);
+			xmin = hdr->t_xmin;
+			newxmins[i] = xmin;
+
+			if (!TransactionIdIsNormal(xmin))
+			{
+				if (TransactionIdIsValid(xmin))
+					live_tuples += 1;
+				else
+					dead_tuples += 1;
+				continue;
+			}
+
+			/* transactions still running, or recent */
+			if (!TransactionIdPrecedes(xmin, OldestXmin))
+			{
+				live_tuples += 1;
+				continue;
+			}
+
+			if (!TransactionIdDidCommit(xmin))
+			{
+				newxmins[i] = InvalidTransactionId;
+				dead_tuples += 1;
+				nchanged++;
+				continue;
+			}
+
+			live_tuples += 1;
+			if (TransactionIdPrecedes(xmin, FreezeLimit))
+			{
+				newxmins[i] = FrozenTransactionId;
+				nchanged++;
+			}
+		}
+
+		if (nchanged > 0)
+		{
+			START_CRIT_SECTION();
+			for (i = 0; i < ntuples; i++)
+			{
+				AppendlogTupleHeader hdr;
+
+				hdr = (AppendlogTupleHeader) ((char *) page + offsets[i]);
+				hdr->t_xmin = newxmins[i];
+			}
+			MarkBufferDirty(buffer);
+			if (RelationNeedsWAL(onerel))
+				log_newpage_buffer(buffer, true);
+			END_CRIT_SECTION();
+		}
+
+		UnlockReleaseBuffer(buffer);
+	}
+
+	vac_update_relstats(onerel, nblocks, live_tuples, 0, false,
+						FreezeLimit, MultiXactCutoff, false);
+	pgstat_report_vacuum(RelationGetRelid(onerel),
+						 onerel->rd_rel->relisshared,
+						 live_tuples, dead_tuples);
+}
+
+static bool
+appendlog_scan_analyze_next_block(TableScanDesc sscan, BlockNumber blockno,
+								  BufferAccessStrategy bstrategy)
+{
+	AppendlogScanDesc scan = (AppendlogScanDesc) sscan;
+
+	scan->strategy = bstrategy;
+	appendlog_scan_read_page(scan, blockno);
+	scan->strategy = NULL;
+	return true;
+}
+
+static bool
+appendlog_scan_analyze_next_tuple(TableScanDesc sscan, TransactionId OldestXmin,
+								  double *liverows, double *deadrows,
+								  TupleTableSlot *slot)
+{
+	AppendlogScanDesc scan = (AppendlogScanDesc) sscan;
+
+	while (scan->curtuple < scan->ntuples)
+	{
+		AppendlogTupleHeader hdr;
+		TransactionId xmin;
+		int			n = scan->curtuple++;
+
+		hdr = (AppendlogTupleHeader) (scan->page + scan->offsets[n]);
+		xmin = hdr->t_xmin;
+
+		if (!TransactionIdIsValid(xmin))
+		{
+			*deadrows += 1;
+			continue;
+		}
+
+		/* tuples being inserted by other transactions are not counted */
+		if (TransactionIdIsNormal(xmin) &&
+			!TransactionIdIsCurrentTransactionId(xmin))
+		{
+			if (TransactionIdIsInProgress(xmin))
+				continue;
+			if (!TransactionIdDidCommit(xmin))
+			{
+				*deadrows += 1;
+				continue;
+			}
+		}
+
+		ExecStoreMinimalTuple((MinimalTuple) ((char *) hdr +
+											  APPENDLOG_TUPLE_HDRSZ),
+							  slot, false);
+		slot->tts_tableOid = RelationGetRelid(sscan->rs_rd);
+		ItemPointerSet(&slot->tts_tid, scan->curblock, n + 1);
+		*liverows += 1;
+		return true;
+	}
+
+	ExecClearTuple(slot);
+	return false;
+}
+
+static double
+appendlog_index_build_range_scan(Relation tableRelation,
+								 Relation indexRelation,
+								 IndexInfo *indexInfo,
+								 bool allow_sync,
+								 bool anyvisible,
+								 bool progress,
+								 BlockNumber start_blockno,
+								 BlockNumber numblocks,
+								 IndexBuildCallback callback,
+								 void *callback_state,
+								 TableScanDesc scan)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("appendlog_am does not support indexes")));
+	return 0;					/* keep compiler quiet */
+}
+
+static void
+appendlog_index_validate_scan(Relation tableRelation,
+							  Relation indexRelation,
+							  IndexInfo *indexInfo,
+							  Snapshot snapshot,
+							  ValidateIndexState *state)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("appendlog_am does not support indexes")));
+}
+
+
+/* ------------------------------------------------------------------------
+ * Miscellaneous callbacks for the appendlog AM
+ * ------------------------------------------------------------------------
+ */
+
+static uint64
+appendlog_relation_size(Relation rel, ForkNumber forkNumber)
+{
+	uint64		nblocks = 0;
+
+	RelationOpenSmgr(rel);
+
+	/* InvalidForkNumber means all the forks */
+	if (forkNumber == InvalidForkNumber)
+	{
+		ForkNumber	i;
+
+		for (i = 0; i <= MAX_FORKNUM; i++)
+		{
+			if (smgrexists(rel->rd_smgr, i))
+				nblocks += smgrnblocks(rel->rd_smgr, i);
+		}
+	}
+	else
+		nblocks = smgrnblocks(rel->rd_smgr, forkNumber);
+
+	return nblocks * BLCKSZ;
+}
+
+/*
+ * Check to see whether the table needs a TOAST table.
+ */
+static bool
+appendlog_relation_needs_toast_table(Relation rel)
+{
+	/* tuples larger than a page are not supported */
+	return false;
+}
+
+
+/* ------------------------------------------------------------------------
+ * Planner related callbacks for the appendlog AM
+ * ------------------------------------------------------------------------
+ */
+
+static void
+appendlog_estimate_rel_size(Relation rel, int32 *attr_widths,
+							BlockNumber *pages, double *tuples,
+							double *allvisfrac)
+{
+	BlockNumber curpages = RelationGetNumberOfBlocks(rel);
+	BlockNumber relpages = (BlockNumber) rel->rd_rel->relpages;
+	double		reltuples = (double) rel->rd_rel->reltuples;
+	double		density;
+
+	*pages = curpages;
+	*allvisfrac = 0;
+
+	if (curpages == 0)
+	{
+		*tuples = 0;
+		return;
+	}
+
+	/*
+	 * Use the density of the last ANALYZE or VACUUM if any, or estimate it
+	 * from the width of the tuples, which are packed with their header.
+	 */
+	if (relpages > 0)
+		density = reltuples / (double) relpages;
+	else
+	{
+		int32		tuple_width;
+
+		tuple_width = get_rel_data_width(rel, attr_widths);
+		tuple_width += APPENDLOG_TUPLE_HDRSZ + MAXALIGN(SizeofMinimalTupleHeader);
+		tuple_width = MAXALIGN(tuple_width);
+		density = (BLCKSZ - APPENDLOG_FIRST_TUPLE -
+				   MAXALIGN(sizeof(AppendlogPageOpaqueData))) / tuple_width;
+	}
+
+	*tuples = rint(density * (double) curpages);
+}
+
+
+/* ------------------------------------------------------------------------
+ * Executor related callbacks for the appendlog AM
+ * ------------------------------------------------------------------------
+ */
+
+static bool
+appendlog_scan_bitmap_next_block(TableScanDesc scan,
+								 TBMIterateResult *tbmres)
+{
+	/* no indexes, so no bitmaps */
+	return false;
+}
+
+static bool
+appendlog_scan_bitmap_next_tuple(TableScanDesc scan,
+								 TBMIterateResult *tbmres,
+								 TupleTableSlot *slot)
+{
+	/* no indexes, so no bitmaps */
+	return false;
+}
+
+static bool
+appendlog_scan_sample_next_block(TableScanDesc sscan,
+								 SampleScanState *scanstate)
+{
+	AppendlogScanDesc scan = (AppendlogScanDesc) sscan;
+	TsmRoutine *tsm = scanstate->tsmroutine;
+	BlockNumber blkno;
+
+	if (scan->nblocks == 0)
+		return false;
+
+	if (tsm->NextSampleBlock)
+		blkno = tsm->NextSampleBlock(scanstate, scan->nblocks);
+	else if (!BlockNumberIsValid(scan->curblock))
+		blkno = 0;
+	else if (scan->curblock + 1 < scan->nblocks)
+		blkno = scan->curblock + 1;
+	else
+		blkno = InvalidBlockNumber;
+
+	if (!BlockNumberIsValid(blkno))
+		return false;
+
+	appendlog_scan_read_page(scan, blkno);
+	return true;
+}
+
+static bool
+appendlog_scan_sample_next_tuple(TableScanDesc sscan,
+								 SampleScanState *scanstate,
+								 TupleTableSlot *slot)
+{
+	AppendlogScanDesc scan = (AppendlogScanDesc) sscan;
+	TsmRoutine *tsm = scanstate->tsmroutine;
+
+	for (;;)
+	{
+		AppendlogTupleHeader hdr;
+		OffsetNumber offnum;
+
+		offnum = tsm->NextSampleTuple(scanstate, scan->curblock,
+									  (OffsetNumber) scan->ntuples);
+		if (!OffsetNumberIsValid(offnum))
+		{
+			ExecClearTuple(slot);
+			return false;
+		}
+
+		hdr = (AppendlogTupleHeader) (scan->page + scan->offsets[offnum - 1]);
+		if (!appendlog_tuple_visible(hdr, sscan->rs_snapshot,
+									 &scan->xidcache))
+			continue;
+
+		ExecStoreMinimalTuple((MinimalTuple) ((char *) hdr +
+											  APPENDLOG_TUPLE_HDRSZ),
+							  slot, false);
+		slot->tts_tableOid = RelationGetRelid(sscan->rs_rd);
+		ItemPointerSet(&slot->tts_tid, scan->curblock, offnum);
+		return true;
+	}
+}
+
+
+/* ------------------------------------------------------------------------
+ * Definition of the appendlog table access method.
+ * ------------------------------------------------------------------------
+ */
+
+static const TableAmRoutine appendlog_methods = {
+	.type = T_TableAmRoutine,
+
+	.slot_callbacks = appendlog_slot_callbacks,
+
+	.scan_begin = appendlog_scan_begin,
+	.scan_end = appendlog_scan_end,
+	.scan_rescan = appendlog_scan_rescan,
+	.scan_getnextslot = appendlog_scan_getnextslot,
+
+	/* these are common helper functions */
+	.parallelscan_estimate = table_block_parallelscan_estimate,
+	.parallelscan_initialize = table_block_parallelscan_initialize,
+	.parallelscan_reinitialize = table_block_parallelscan_reinitialize,
+
+	.index_fetch_begin = appendlog_index_fetch_begin,
+	.index_fetch_reset = appendlog_index_fetch_reset,
+	.index_fetch_end = appendlog_index_fetch_end,
+	.index_fetch_tuple = appendlog_index_fetch_tuple,
+
+	.tuple_insert = appendlog_tuple_insert,
+	.tuple_insert_speculative = appendlog_tuple_insert_speculative,
+	.tuple_complete_speculative = appendlog_tuple_complete_speculative,
+	.multi_insert = appendlog_multi_insert,
+	.tuple_delete = appendlog_tuple_delete,
+	.tuple_update = appendlog_tuple_update,
+	.tuple_lock = appendlog_tuple_lock,
+	.finish_bulk_insert = appendlog_finish_bulk_insert,
+
+	.tuple_fetch_row_version = appendlog_fetch_row_version,
+	.tuple_get_latest_tid = appendlog_get_latest_tid,
+	.tuple_tid_valid = appendlog_tuple_tid_valid,
+	.tuple_satisfies_snapshot = appendlog_tuple_satisfies_snapshot,
+	.compute_xid_horizon_for_tuples = appendlog_compute_xid_horizon_for_tuples,
+
+	.relation_set_new_filenode = appendlog_relation_set_new_filenode,
+	.relation_nontransactional_truncate = appendlog_relation_nontransactional_truncate,
+	.relation_copy_data = appendlog_copy_data,
+	.relation_copy_for_cluster = appendlog_copy_for_cluster,
+	.relation_vacuum = appendlog_vacuum,
+	.scan_analyze_next_block = appendlog_scan_analyze_next_block,
+	.scan_analyze_next_tuple = appendlog_scan_analyze_next_tuple,
+	.index_build_range_scan = appendlog_index_build_range_scan,
+	.index_validate_scan = appendlog_index_validate_scan,
+
+	.relation_size = appendlog_relation_size,
+	.relation_needs_toast_table = appendlog_relation_needs_toast_table,
+
+	.relation_estimate_size = appendlog_estimate_rel_size,
+
+	.scan_bitmap_next_block = appendlog_scan_bitmap_next_block,
+	.scan_bitmap_next_tuple = appendlog_scan_bitmap_next_tuple,
+	.scan_sample_next_block = appendlog_scan_sample_next_block,
+	.scan_sample_next_tuple = appendlog_scan_sample_next_tuple
+};
+
+
+Datum
+appendlog_am_handler(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(&appendlog_methods);
+}
+
+/*
+ * Module load callback
+ */
+void
+_PG_init(void)
+{
+	DefineCustomIntVariable("appendlog_am.readahead",
+							"Number of blocks prefetched ahead by sequential scans.",
+							"Zero disables prefetching.",
+							&appendlog_readahead,
+							32,
+							0,
+							1024,
+							PGC_USERSET,
+							GUC_UNIT_BLOCKS,
+							NULL,
+							NULL,
+							NULL);
+
+}
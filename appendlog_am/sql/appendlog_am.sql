@@ -0,0 +1,76 @@
+CREATE EXTENSION appendlog_am;
+CREATE TABLE appendlog_tab (id int, val text) USING appendlog_am;
+SELECT * FROM appendlog_tab;
+INSERT INTO appendlog_tab VALUES (1, 'one'), (2, NULL);
+INSERT INTO appendlog_tab SELECT i, 'val' || i FROM generate_series(3, 1000) i;
+COPY appendlog_tab FROM stdin;
+1001	copy
+1002	\N
+\.
+SELECT count(*), sum(id), count(val) FROM appendlog_tab;
+SELECT * FROM appendlog_tab WHERE id <= 2 OR id > 1000 ORDER BY id;
+-- Rows of aborted transactions are not visible
+BEGIN;
+INSERT INTO appendlog_tab SELECT i, 'aborted' FROM generate_series(1, 100) i;
+SELECT count(*) FROM appendlog_tab;
+ROLLBACK;
+SELECT count(*) FROM appendlog_tab;
+-- Rows inserted by a command are not visible to itself
+INSERT INTO appendlog_tab SELECT id + 2000, val FROM appendlog_tab;
+SELECT count(*) FROM appendlog_tab;
+BEGIN;
+INSERT INTO appendlog_tab VALUES (5000, 'kept');
+SAVEPOINT s;
+INSERT INTO appendlog_tab VALUES (5001, 'rolled back');
+ROLLBACK TO SAVEPOINT s;
+COMMIT;
+SELECT * FROM appendlog_tab WHERE id >= 5000;
+-- Scans without readahead
+SET appendlog_am.readahead = 0;
+SELECT count(*), sum(id), count(val) FROM appendlog_tab;
+RESET appendlog_am.readahead;
+-- Unsupported operations
+UPDATE appendlog_tab SET val = 'updated' WHERE id = 1;
+DELETE FROM appendlog_tab WHERE id = 1;
+SELECT * FROM appendlog_tab WHERE id = 1 FOR UPDATE;
+CREATE INDEX appendlog_tab_idx ON appendlog_tab (id);
+INSERT INTO appendlog_tab VALUES (6000, repeat('x', 10000));
+-- Maintenance
+VACUUM (FREEZE) appendlog_tab;
+SELECT count(*), sum(id), count(val) FROM appendlog_tab;
+VACUUM FULL appendlog_tab;
+SELECT count(*), sum(id), count(val) FROM appendlog_tab;
+ANALYZE appendlog_tab;
+SELECT reltuples FROM pg_class WHERE oid = 'appendlog_tab'::regclass;
+SELECT count(*) FROM appendlog_tab TABLESAMPLE SYSTEM (100);
+TRUNCATE appendlog_tab;
+SELECT count(*) FROM appendlog_tab;
+INSERT INTO appendlog_tab VALUES (1, 'after truncate');
+SELECT * FROM appendlog_tab;
+-- Values stored externally are detoasted
+CREATE TEMP TABLE appendlog_heap (val text);
+ALTER TABLE appendlog_heap ALTER COLUMN val SET STORAGE EXTERNAL;
+INSERT INTO appendlog_heap VALUES (repeat('x', 3000));
+INSERT INTO appendlog_tab SELECT 2, val FROM appendlog_heap;
+DROP TABLE appendlog_heap;
+SELECT id, length(val) FROM appendlog_tab WHERE id = 2;
+DROP TABLE appendlog_tab;
+-- Transactions inserting single rows only WAL-log the bytes they append
+CREATE TABLE appendlog_wal (id int, val text) USING appendlog_am;
+SELECT pg_current_wal_insert_lsn() AS lsn_before \gset
+DO $$
+BEGIN
+  FOR i IN 1..100 LOOP
+    INSERT INTO appendlog_wal VALUES (i, 'single row');
+    COMMIT;
+  END LOOP;
+END $$;
+SELECT count(*),
+    pg_wal_lsn_diff(pg_current_wal_insert_lsn(), :'lsn_before') < 100000 AS wal_ok
+  FROM appendlog_wal;
+DROP TABLE appendlog_wal;
+-- Unlogged tables
+CREATE UNLOGGED TABLE appendlog_unlogged (a int) USING appendlog_am;
+INSERT INTO appendlog_unlogged SELECT generate_series(1, 100);
+SELECT count(*), sum(a) FROM appendlog_unlogged;
+DROP TABLE appendlog_unlogged;
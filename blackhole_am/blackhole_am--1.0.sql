@@ -11,3 +11,65 @@ LANGUAGE C;
 -- Access method
 CREATE ACCESS METHOD blackhole_am TYPE TABLE HANDLER blackhole_am_handler;
 COMMENT ON ACCESS METHOD blackhole_am IS 'template table AM eating all data';
+
+-- Statistics of tuples inserted, with blackhole_am.track_inserts
+CREATE FUNCTION blackhole_am_insert_stats(
+    OUT relid regclass,
+    OUT tuples bigint,
+    OUT bytes bigint,
+    OUT insert_calls bigint,
+    OUT multi_insert_calls bigint,
+    OUT min_batch int,
+    OUT max_batch int,
+    OUT elapsed_ns bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
+
+CREATE FUNCTION blackhole_am_insert_stats_reset()
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
+
+-- Generation of rows when scanning relations
+CREATE TABLE blackhole_am_generator (
+    relid regclass PRIMARY KEY,
+    nrows bigint NOT NULL CHECK (nrows >= 0),
+    seed bigint NOT NULL DEFAULT 0
+);
+
+CREATE TABLE blackhole_am_generator_column (
+    relid regclass REFERENCES blackhole_am_generator ON DELETE CASCADE,
+    attname name,
+    distribution text NOT NULL
+        CHECK (distribution IN ('sequence', 'uniform', 'constant', 'null')),
+    min_value bigint NOT NULL DEFAULT 0,
+    max_value bigint NOT NULL DEFAULT 0,
+    PRIMARY KEY (relid, attname)
+);
+
+SELECT pg_catalog.pg_extension_config_dump('blackhole_am_generator', '');
+SELECT pg_catalog.pg_extension_config_dump('blackhole_am_generator_column', '');
+GRANT SELECT ON blackhole_am_generator TO PUBLIC;
+GRANT SELECT ON blackhole_am_generator_column TO PUBLIC;
+
+-- Size estimates reported to the planner for relations
+CREATE TABLE blackhole_am_estimate (
+    relid regclass PRIMARY KEY,
+    tuples float8 NOT NULL CHECK (tuples >= 0),
+    pages bigint CHECK (pages >= 0),
+    allvisfrac float8 NOT NULL DEFAULT 0
+        CHECK (allvisfrac >= 0 AND allvisfrac <= 1)
+);
+
+CREATE TABLE blackhole_am_estimate_column (
+    relid regclass REFERENCES blackhole_am_estimate ON DELETE CASCADE,
+    attname name,
+    width int NOT NULL CHECK (width > 0),
+    PRIMARY KEY (relid, attname)
+);
+
+SELECT pg_catalog.pg_extension_config_dump('blackhole_am_estimate', '');
+SELECT pg_catalog.pg_extension_config_dump('blackhole_am_estimate_column', '');
+GRANT SELECT ON blackhole_am_estimate TO PUBLIC;
+GRANT SELECT ON blackhole_am_estimate_column TO PUBLIC;
@@ -16,6 +16,16 @@
  *	  be used as a template for other table access methods, and guarantees
  *	  that any data inserted into it gets sent to the void.
  *
+ *	  A relation registered in blackhole_am_generator produces instead of
+ *	  nothing a number of synthetic rows when scanned, computed from the
+ *	  row number and a seed with the distributions configured for each
+ *	  column, so as executor nodes can be benchmarked without any storage.
+ *
+ *	  When blackhole_am.track_inserts is enabled, the tuples received are
+ *	  counted per relation in backend-local memory before being discarded,
+ *	  making this access method a sink with no I/O to measure the cost of
+ *	  the executor when inserting data.
+ *
  *-------------------------------------------------------------------------
  */
 #include "postgres.h"
@@ -27,20 +37,101 @@
 #include "access/tableam.h"
 #include "access/heapam.h"
 #include "access/amapi.h"
+#include "access/htup_details.h"
 #include "catalog/index.h"
+#include "catalog/pg_type.h"
 #include "commands/vacuum.h"
+#include "executor/spi.h"
 #include "executor/tuptable.h"
+#include "funcapi.h"
+#include "optimizer/plancat.h"
+#include "portability/instr_time.h"
+#include "storage/bufpage.h"
+#include "storage/proc.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
 
 PG_MODULE_MAGIC;
 
 PG_FUNCTION_INFO_V1(blackhole_am_handler);
+PG_FUNCTION_INFO_V1(blackhole_am_insert_stats);
+PG_FUNCTION_INFO_V1(blackhole_am_insert_stats_reset);
+
+void		_PG_init(void);
+
+/* GUC variables */
+static bool blackhole_track_inserts = false;
+
+/* Statistics of the tuples received by a relation */
+typedef struct BlackholeInsertStats
+{
+	Oid			relid;			/* hash key, must be first */
+	int64		tuples;			/* tuples received */
+	int64		bytes;			/* size of the data of the tuples */
+	int64		insert_calls;	/* calls of tuple_insert */
+	int64		multi_insert_calls;	/* calls of multi_insert */
+	int			min_batch;		/* smallest batch of multi_insert */
+	int			max_batch;		/* largest batch of multi_insert */
+	LocalTransactionId lxid;	/* transaction of the current command */
+	CommandId	cid;			/* current command */
+	instr_time	first_insert;	/* when the current command began inserting */
+	instr_time	last_insert;	/* when it received its last tuple */
+	instr_time	elapsed;		/* time spent by the previous commands */
+} BlackholeInsertStats;
+
+/* Backend-local statistics, per relation */
+static HTAB *blackhole_insert_stats = NULL;
+
+/* Distributions of the values of a generated column */
+typedef enum BlackholeDistribution
+{
+	BLACKHOLE_DIST_SEQUENCE,	/* min_value + row number */
+	BLACKHOLE_DIST_UNIFORM,		/* uniform in [min_value, max_value] */
+	BLACKHOLE_DIST_CONSTANT,	/* always min_value */
+	BLACKHOLE_DIST_NULL			/* always NULL */
+} BlackholeDistribution;
+
+/* Generation of a column */
+typedef struct BlackholeColumnGen
+{
+	BlackholeDistribution dist;
+	int64		min_value;
+	int64		max_value;
+	Oid			typid;			/* type of the column */
+	int32		typmod;
+	Oid			typinput;		/* input function, for types with no fast
+								 * path */
+	Oid			typioparam;
+} BlackholeColumnGen;
+
+/*
+ * Generated rows are numbered as if stored in virtual blocks full of
+ * tuples, which are the units handed out to the workers of parallel scans.
+ */
+#define BLACKHOLE_ROWS_PER_BLOCK	MaxHeapTuplesPerPage
+
+/* Configuration of the generation of rows for a relation */
+typedef struct BlackholeGenerator
+{
+	int64		nrows;			/* number of rows */
+	int64		seed;			/* seed of random values */
+	int			natts;
+	BlackholeColumnGen columns[FLEXIBLE_ARRAY_MEMBER];
+} BlackholeGenerator;
 
 /* Base structures for scans */
 typedef struct BlackholeScanDescData
 {
 	TableScanDescData rs_base;	/* AM independent part of the descriptor */
 
-	/* Add more fields here as needed by the AM. */
+	BlackholeGenerator *gen;	/* generator, NULL if none */
+	int64		nextrow;		/* next row to generate */
+	int64		endrow;			/* end of the rows of the current range */
+	bool		started;		/* parallel scan started? */
+	MemoryContext rowcxt;		/* memory of the values of the current row */
 } BlackholeScanDescData;
 typedef struct BlackholeScanDescData *BlackholeScanDesc;
 
@@ -57,9 +148,10 @@ blackhole_slot_callbacks(Relation relation)
 {
 	/*
 	 * Here you would most likely want to invent your own set of
-	 * slot callbacks for your AM.
+	 * slot callbacks for your AM. Generated rows are built directly
+	 * in virtual slots.
 	 */
-	return &TTSOpsMinimalTuple;
+	return &TTSOpsVirtual;
 }
 
 /* ------------------------------------------------------------------------
@@ -67,6 +159,360 @@ blackhole_slot_callbacks(Relation relation)
  * ------------------------------------------------------------------------
  */
 
+/*
+ * Mix the bits of a 64-bit integer (splitmix64 finalizer).
+ */
+static inline uint64
+blackhole_mix(uint64 x)
+{
+	x += UINT64CONST(0x9E3779B97F4A7C15);
+	x = (x ^ (x >> 30)) * UINT64CONST(0xBF58476D1CE4E5B9);
+	x = (x ^ (x >> 27)) * UINT64CONST(0x94D049BB133111EB);
+	return x ^ (x >> 31);
+}
+
+/*
+ * Get the schema of the extension, where its tables are. Returns NULL if
+ * the extension is not installed. SPI must be connected.
+ */
+static char *
+blackhole_extension_schema(void)
+{
+	int			ret;
+
+	ret = SPI_execute("SELECT n.nspname FROM pg_catalog.pg_extension e "
+					  "JOIN pg_catalog.pg_namespace n ON n.oid = e.extnamespace "
+					  "WHERE e.extname = 'blackhole_am'", true, 1);
+	if (ret != SPI_OK_SELECT || SPI_processed != 1)
+		return NULL;
+	return SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+}
+
+/*
+ * Load the configuration of the generator of a relation from the tables
+ * of the extension. Returns NULL if the relation has none.
+ */
+static BlackholeGenerator *
+blackhole_load_generator(Relation relation)
+{
+	MemoryContext cxt = CurrentMemoryContext;
+	TupleDesc	tupdesc = RelationGetDescr(relation);
+	BlackholeGenerator *gen = NULL;
+	StringInfoData buf;
+	Oid			argtypes[1] = {OIDOID};
+	Datum		args[1];
+	char	   *nspname;
+	bool		isnull;
+	int			ret;
+	uint64		i;
+	int			attno;
+
+	SPI_connect();
+
+	nspname = blackhole_extension_schema();
+	if (nspname == NULL)
+	{
+		SPI_finish();
+		return NULL;
+	}
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf,
+					 "SELECT g.nrows, g.seed, c.attname, c.distribution, "
+					 "c.min_value, c.max_value "
+					 "FROM %s.blackhole_am_generator g "
+					 "LEFT JOIN %s.blackhole_am_generator_column c "
+					 "ON c.relid = g.relid "
+					 "WHERE g.relid = $1",
+					 quote_identifier(nspname), quote_identifier(nspname));
+	args[0] = ObjectIdGetDatum(RelationGetRelid(relation));
+	ret = SPI_execute_with_args(buf.data, 1, argtypes, args, NULL, true, 0);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "could not load generator of relation \"%s\"",
+			 RelationGetRelationName(relation));
+
+	if (SPI_processed == 0)
+	{
+		SPI_finish();
+		return NULL;
+	}
+
+	gen = (BlackholeGenerator *)
+		MemoryContextAllocZero(cxt, offsetof(BlackholeGenerator, columns) +
+							   sizeof(BlackholeColumnGen) * Max(tupdesc->natts, 1));
+	gen->nrows = DatumGetInt64(SPI_getbinval(SPI_tuptable->vals[0],
+											 SPI_tuptable->tupdesc, 1,
+											 &isnull));
+	gen->seed = DatumGetInt64(SPI_getbinval(SPI_tuptable->vals[0],
+											SPI_tuptable->tupdesc, 2,
+											&isnull));
+	gen->natts = tupdesc->natts;
+
+	/* Columns not configured are sequences starting at 1 */
+	for (attno = 0; attno < tupdesc->natts; attno++)
+	{
+		Form_pg_attribute attr = TupleDescAttr(tupdesc, attno);
+		BlackholeColumnGen *col = &gen->columns[attno];
+
+		col->dist = attr->attisdropped ? BLACKHOLE_DIST_NULL :
+			BLACKHOLE_DIST_SEQUENCE;
+		col->min_value = 1;
+		col->max_value = 1;
+		col->typid = attr->atttypid;
+		col->typmod = attr->atttypmod;
+		if (!attr->attisdropped)
+			getTypeInputInfo(attr->atttypid, &col->typinput,
+							 &col->typioparam);
+	}
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		HeapTuple	tuple = SPI_tuptable->vals[i];
+		TupleDesc	spi_tupdesc = SPI_tuptable->tupdesc;
+		char	   *attname;
+		char	   *dist;
+		AttrNumber	attnum;
+		BlackholeColumnGen *col;
+
+		attname = SPI_getvalue(tuple, spi_tupdesc, 3);
+		if (attname == NULL)
+			continue;			/* no columns configured */
+
+		attnum = get_attnum(RelationGetRelid(relation), attname);
+		if (attnum == InvalidAttrNumber || attnum < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_COLUMN),
+					 errmsg("column \"%s\" of generator does not exist in relation \"%s\"",
+							attname, RelationGetRelationName(relation))));
+
+		col = &gen->columns[attnum - 1];
+		dist = SPI_getvalue(tuple, spi_tupdesc, 4);
+		if (strcmp(dist, "sequence") == 0)
+			col->dist = BLACKHOLE_DIST_SEQUENCE;
+		else if (strcmp(dist, "uniform") == 0)
+			col->dist = BLACKHOLE_DIST_UNIFORM;
+		else if (strcmp(dist, "constant") == 0)
+			col->dist = BLACKHOLE_DIST_CONSTANT;
+		else if (strcmp(dist, "null") == 0)
+			col->dist = BLACKHOLE_DIST_NULL;
+		else
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("invalid distribution \"%s\" for column \"%s\"",
+							dist, attname)));
+
+		col->min_value = DatumGetInt64(SPI_getbinval(tuple, spi_tupdesc, 5,
+													 &isnull));
+		col->max_value = DatumGetInt64(SPI_getbinval(tuple, spi_tupdesc, 6,
+													 &isnull));
+		if (col->dist == BLACKHOLE_DIST_UNIFORM &&
+			col->max_value < col->min_value)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("maximum value lower than minimum value for column \"%s\"",
+							attname)));
+	}
+
+	SPI_finish();
+
+	return gen;
+}
+
+/*
+ * Load the size estimates of a relation from the tables of the extension,
+ * storing the widths of the columns configured in attr_widths, indexed
+ * by attribute number. *pages is set to -1 if not configured. Returns
+ * false if the relation has no estimates.
+ */
+static bool
+blackhole_load_estimate(Relation relation, int32 *attr_widths,
+						double *tuples, int64 *pages, double *allvisfrac)
+{
+	StringInfoData buf;
+	Oid			argtypes[1] = {OIDOID};
+	Datum		args[1];
+	char	   *nspname;
+	bool		isnull;
+	int			ret;
+	uint64		i;
+
+	SPI_connect();
+
+	nspname = blackhole_extension_schema();
+	if (nspname == NULL)
+	{
+		SPI_finish();
+		return false;
+	}
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf,
+					 "SELECT e.tuples, e.pages, e.allvisfrac, c.attname, c.width "
+					 "FROM %s.blackhole_am_estimate e "
+					 "LEFT JOIN %s.blackhole_am_estimate_column c "
+					 "ON c.relid = e.relid "
+					 "WHERE e.relid = $1",
+					 quote_identifier(nspname), quote_identifier(nspname));
+	args[0] = ObjectIdGetDatum(RelationGetRelid(relation));
+	ret = SPI_execute_with_args(buf.data, 1, argtypes, args, NULL, true, 0);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "could not load estimates of relation \"%s\"",
+			 RelationGetRelationName(relation));
+
+	if (SPI_processed == 0)
+	{
+		SPI_finish();
+		return false;
+	}
+
+	*tuples = DatumGetFloat8(SPI_getbinval(SPI_tuptable->vals[0],
+										   SPI_tuptable->tupdesc, 1,
+										   &isnull));
+	*pages = DatumGetInt64(SPI_getbinval(SPI_tuptable->vals[0],
+										 SPI_tuptable->tupdesc, 2,
+										 &isnull));
+	if (isnull)
+		*pages = -1;
+	*allvisfrac = DatumGetFloat8(SPI_getbinval(SPI_tuptable->vals[0],
+											   SPI_tuptable->tupdesc, 3,
+											   &isnull));
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		HeapTuple	tuple = SPI_tuptable->vals[i];
+		TupleDesc	spi_tupdesc = SPI_tuptable->tupdesc;
+		char	   *attname;
+		AttrNumber	attnum;
+
+		attname = SPI_getvalue(tuple, spi_tupdesc, 4);
+		if (attname == NULL)
+			continue;			/* no columns configured */
+
+		attnum = get_attnum(RelationGetRelid(relation), attname);
+		if (attnum == InvalidAttrNumber || attnum < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_COLUMN),
+					 errmsg("column \"%s\" of estimate does not exist in relation \"%s\"",
+							attname, RelationGetRelationName(relation))));
+
+		if (attr_widths != NULL)
+			attr_widths[attnum] = DatumGetInt32(SPI_getbinval(tuple,
+															  spi_tupdesc, 5,
+															  &isnull));
+	}
+
+	SPI_finish();
+
+	return true;
+}
+
+/*
+ * Number of virtual blocks of the rows of a generator.
+ */
+static BlockNumber
+blackhole_generator_nblocks(BlackholeGenerator *gen)
+{
+	int64		nblocks;
+
+	nblocks = (gen->nrows + BLACKHOLE_ROWS_PER_BLOCK - 1) /
+		BLACKHOLE_ROWS_PER_BLOCK;
+	return (BlockNumber) Min(nblocks, (int64) MaxBlockNumber);
+}
+
+/*
+ * Build the value of a column for a row from an integer.
+ */
+static Datum
+blackhole_make_datum(BlackholeColumnGen *col, int64 value)
+{
+	char		str[32];		/* enough for any int64 */
+
+	switch (col->typid)
+	{
+		case INT2OID:
+			return Int16GetDatum((int16) value);
+		case INT4OID:
+			return Int32GetDatum((int32) value);
+		case INT8OID:
+			return Int64GetDatum(value);
+		case FLOAT4OID:
+			return Float4GetDatum((float4) value);
+		case FLOAT8OID:
+			return Float8GetDatum((float8) value);
+		case BOOLOID:
+			return BoolGetDatum(value % 2 != 0);
+		case TEXTOID:
+		case VARCHAROID:
+			pg_lltoa(value, str);
+			return PointerGetDatum(cstring_to_text(str));
+		default:
+			/* use the input function of the type */
+			pg_lltoa(value, str);
+			return OidInputFunctionCall(col->typinput, str, col->typioparam,
+										col->typmod);
+	}
+}
+
+/*
+ * Fill a slot with the values of a generated row.
+ */
+static void
+blackhole_generate_row(BlackholeScanDesc scan, TupleTableSlot *slot,
+					   int64 row)
+{
+	BlackholeGenerator *gen = scan->gen;
+	MemoryContext oldcxt;
+	int			attno;
+
+	ExecClearTuple(slot);
+	MemoryContextReset(scan->rowcxt);
+	oldcxt = MemoryContextSwitchTo(scan->rowcxt);
+
+	for (attno = 0; attno < gen->natts; attno++)
+	{
+		BlackholeColumnGen *col = &gen->columns[attno];
+		int64		value;
+
+		switch (col->dist)
+		{
+			case BLACKHOLE_DIST_SEQUENCE:
+				value = col->min_value + row;
+				break;
+			case BLACKHOLE_DIST_UNIFORM:
+				{
+					uint64		range;
+					uint64		hash;
+
+					range = (uint64) col->max_value - (uint64) col->min_value + 1;
+					hash = blackhole_mix((uint64) gen->seed ^
+										 blackhole_mix(((uint64) row << 11) +
+													   attno + 1));
+					/* range wraps to 0 for the full range of int64 */
+					value = col->min_value +
+						(int64) (range == 0 ? hash : hash % range);
+				}
+				break;
+			case BLACKHOLE_DIST_CONSTANT:
+				value = col->min_value;
+				break;
+			case BLACKHOLE_DIST_NULL:
+			default:
+				slot->tts_values[attno] = (Datum) 0;
+				slot->tts_isnull[attno] = true;
+				continue;
+		}
+
+		slot->tts_values[attno] = blackhole_make_datum(col, value);
+		slot->tts_isnull[attno] = false;
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+
+	ItemPointerSet(&slot->tts_tid, row / BLACKHOLE_ROWS_PER_BLOCK,
+				   row % BLACKHOLE_ROWS_PER_BLOCK + 1);
+	ExecStoreVirtualTuple(slot);
+}
+
 static TableScanDesc
 blackhole_scan_begin(Relation relation, Snapshot snapshot,
 					 int nkeys, ScanKey key,
@@ -83,12 +529,39 @@ blackhole_scan_begin(Relation relation, Snapshot snapshot,
 	scan->rs_base.rs_flags = flags;
 	scan->rs_base.rs_parallel = parallel_scan;
 
-	return (TableScanDesc) scan;                                                                                                                                           }
+	/* Rows are generated only for sequential scans */
+	scan->gen = NULL;
+	scan->nextrow = 0;
+	scan->endrow = 0;
+	scan->started = false;
+	scan->rowcxt = NULL;
+	if ((flags & SO_TYPE_SEQSCAN) != 0)
+	{
+		scan->gen = blackhole_load_generator(relation);
+		if (scan->gen != NULL)
+		{
+			scan->rowcxt = AllocSetContextCreate(CurrentMemoryContext,
+												 "blackhole_am row",
+												 ALLOCSET_SMALL_SIZES);
+
+			/* a parallel scan gets its ranges of rows block by block */
+			if (parallel_scan == NULL)
+				scan->endrow = scan->gen->nrows;
+		}
+	}
+
+	return (TableScanDesc) scan;
+}
 
 static void
 blackhole_scan_end(TableScanDesc sscan)
 {
 	BlackholeScanDesc scan = (BlackholeScanDesc) sscan;
+
+	if (scan->rowcxt != NULL)
+		MemoryContextDelete(scan->rowcxt);
+	if (scan->gen != NULL)
+		pfree(scan->gen);
 	pfree(scan);
 }
 
@@ -96,15 +569,70 @@ static void
 blackhole_scan_rescan(TableScanDesc sscan, ScanKey key, bool set_params,
 					  bool allow_strat, bool allow_sync, bool allow_pagemode)
 {
-	/* nothing to do */
+	BlackholeScanDesc scan = (BlackholeScanDesc) sscan;
+
+	/* generate again from the first row */
+	scan->nextrow = 0;
+	scan->endrow = 0;
+	scan->started = false;
+	if (scan->gen != NULL && sscan->rs_parallel == NULL)
+		scan->endrow = scan->gen->nrows;
+}
+
+/*
+ * Move a parallel scan to the rows of the next block given by the
+ * parallel scan descriptor. Returns false if there are no more blocks.
+ */
+static bool
+blackhole_parallel_next_block(BlackholeScanDesc scan)
+{
+	Relation	rel = scan->rs_base.rs_rd;
+	ParallelBlockTableScanDesc pbscan =
+	(ParallelBlockTableScanDesc) scan->rs_base.rs_parallel;
+	BlockNumber blkno;
+
+	if (!scan->started)
+	{
+		table_block_parallelscan_startblock_init(rel, pbscan);
+		scan->started = true;
+	}
+
+	blkno = table_block_parallelscan_nextpage(rel, pbscan);
+	if (!BlockNumberIsValid(blkno))
+		return false;
+
+	scan->nextrow = (int64) blkno * BLACKHOLE_ROWS_PER_BLOCK;
+	scan->endrow = Min(scan->nextrow + BLACKHOLE_ROWS_PER_BLOCK,
+					   scan->gen->nrows);
+	return true;
 }
 
 static bool
 blackhole_scan_getnextslot(TableScanDesc sscan, ScanDirection direction,
 						   TupleTableSlot *slot)
 {
-	/* nothing to do */
-	return false;
+	BlackholeScanDesc scan = (BlackholeScanDesc) sscan;
+
+	/* nothing to do, except if rows are generated */
+	if (scan->gen == NULL)
+	{
+		ExecClearTuple(slot);
+		return false;
+	}
+
+	while (scan->nextrow >= scan->endrow)
+	{
+		if (sscan->rs_parallel == NULL ||
+			!blackhole_parallel_next_block(scan))
+		{
+			ExecClearTuple(slot);
+			return false;
+		}
+	}
+
+	blackhole_generate_row(scan, slot, scan->nextrow);
+	scan->nextrow++;
+	return true;
 }
 
 /* ------------------------------------------------------------------------
@@ -186,6 +714,183 @@ blackhole_compute_xid_horizon_for_tuples(Relation rel,
 	return InvalidTransactionId;
 }
 
+/* ------------------------------------------------------------------------
+ * Statistics of tuples inserted for blackhole AM
+ * ------------------------------------------------------------------------
+ */
+
+/*
+ * Get the statistics entry of a relation, creating it if necessary.
+ */
+static BlackholeInsertStats *
+blackhole_get_insert_stats(Relation relation)
+{
+	BlackholeInsertStats *stats;
+	Oid			relid = RelationGetRelid(relation);
+	bool		found;
+
+	if (blackhole_insert_stats == NULL)
+	{
+		HASHCTL		ctl;
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(BlackholeInsertStats);
+		ctl.hcxt = TopMemoryContext;
+		blackhole_insert_stats = hash_create("blackhole_am insert stats",
+											 64, &ctl,
+											 HASH_ELEM | HASH_BLOBS |
+											 HASH_CONTEXT);
+	}
+
+	stats = (BlackholeInsertStats *) hash_search(blackhole_insert_stats,
+												 &relid, HASH_ENTER, &found);
+	if (!found)
+	{
+		stats->tuples = 0;
+		stats->bytes = 0;
+		stats->insert_calls = 0;
+		stats->multi_insert_calls = 0;
+		stats->min_batch = 0;
+		stats->max_batch = 0;
+		stats->lxid = InvalidLocalTransactionId;
+		stats->cid = InvalidCommandId;
+		INSTR_TIME_SET_ZERO(stats->first_insert);
+		INSTR_TIME_SET_ZERO(stats->last_insert);
+		INSTR_TIME_SET_ZERO(stats->elapsed);
+	}
+
+	return stats;
+}
+
+/*
+ * Begin the insertion of tuples by a command. The time elapsed is only
+ * counted between the first and the last tuple of each command, so as the
+ * time spent between commands, idle or not, is ignored.
+ */
+static void
+blackhole_start_insert(BlackholeInsertStats *stats, CommandId cid)
+{
+	if (stats->lxid == MyProc->lxid && stats->cid == cid)
+		return;
+
+	/* new command, add the time of the previous one */
+	INSTR_TIME_ACCUM_DIFF(stats->elapsed, stats->last_insert,
+						  stats->first_insert);
+	stats->lxid = MyProc->lxid;
+	stats->cid = cid;
+	INSTR_TIME_SET_CURRENT(stats->first_insert);
+	stats->last_insert = stats->first_insert;
+}
+
+/*
+ * Account for the data of a tuple received.
+ */
+static void
+blackhole_count_tuple(BlackholeInsertStats *stats, TupleTableSlot *slot)
+{
+	slot_getallattrs(slot);
+	stats->tuples++;
+	stats->bytes += heap_compute_data_size(slot->tts_tupleDescriptor,
+										   slot->tts_values,
+										   slot->tts_isnull);
+}
+
+/*
+ * Report the statistics of the tuples received by each relation in the
+ * current session.
+ */
+Datum
+blackhole_am_insert_stats(PG_FUNCTION_ARGS)
+{
+#define BLACKHOLE_INSERT_STATS_COLS		8
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build tuple descriptor */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	if (blackhole_insert_stats != NULL)
+	{
+		HASH_SEQ_STATUS status;
+		BlackholeInsertStats *stats;
+
+		hash_seq_init(&status, blackhole_insert_stats);
+		while ((stats = hash_seq_search(&status)) != NULL)
+		{
+			Datum		values[BLACKHOLE_INSERT_STATS_COLS];
+			bool		nulls[BLACKHOLE_INSERT_STATS_COLS];
+			instr_time	elapsed;
+
+			MemSet(nulls, 0, sizeof(nulls));
+
+			elapsed = stats->elapsed;
+			INSTR_TIME_ACCUM_DIFF(elapsed, stats->last_insert,
+								  stats->first_insert);
+
+			values[0] = ObjectIdGetDatum(stats->relid);
+			values[1] = Int64GetDatum(stats->tuples);
+			values[2] = Int64GetDatum(stats->bytes);
+			values[3] = Int64GetDatum(stats->insert_calls);
+			values[4] = Int64GetDatum(stats->multi_insert_calls);
+			if (stats->multi_insert_calls > 0)
+			{
+				values[5] = Int32GetDatum(stats->min_batch);
+				values[6] = Int32GetDatum(stats->max_batch);
+			}
+			else
+				nulls[5] = nulls[6] = true;
+			values[7] = Int64GetDatum((int64) (INSTR_TIME_GET_DOUBLE(elapsed) * 1000000000.0));
+
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+	}
+
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * Reset the statistics of the tuples received in the current session.
+ */
+Datum
+blackhole_am_insert_stats_reset(PG_FUNCTION_ARGS)
+{
+	if (blackhole_insert_stats != NULL)
+	{
+		hash_destroy(blackhole_insert_stats);
+		blackhole_insert_stats = NULL;
+	}
+
+	PG_RETURN_VOID();
+}
+
+
 /* ----------------------------------------------------------------------------
  *  Functions for manipulations of physical tuples for blackhole AM.
  * ----------------------------------------------------------------------------
@@ -195,7 +900,17 @@ static void
 blackhole_tuple_insert(Relation relation, TupleTableSlot *slot,
 					   CommandId cid, int options, BulkInsertState bistate)
 {
-	/* nothing to do */
+	BlackholeInsertStats *stats;
+
+	/* nothing to do, except counting if requested */
+	if (!blackhole_track_inserts)
+		return;
+
+	stats = blackhole_get_insert_stats(relation);
+	blackhole_start_insert(stats, cid);
+	stats->insert_calls++;
+	blackhole_count_tuple(stats, slot);
+	INSTR_TIME_SET_CURRENT(stats->last_insert);
 }
 
 static void
@@ -204,7 +919,8 @@ blackhole_tuple_insert_speculative(Relation relation, TupleTableSlot *slot,
 								   BulkInsertState bistate,
 								   uint32 specToken)
 {
-	/* nothing to do */
+	/* same as a normal insert */
+	blackhole_tuple_insert(relation, slot, cid, options, bistate);
 }
 
 static void
@@ -219,7 +935,23 @@ blackhole_multi_insert(Relation relation, TupleTableSlot **slots,
 					   int ntuples, CommandId cid, int options,
 					   BulkInsertState bistate)
 {
-	/* nothing to do */
+	BlackholeInsertStats *stats;
+	int			i;
+
+	/* nothing to do, except counting if requested */
+	if (!blackhole_track_inserts)
+		return;
+
+	stats = blackhole_get_insert_stats(relation);
+	blackhole_start_insert(stats, cid);
+	if (stats->multi_insert_calls == 0 || ntuples < stats->min_batch)
+		stats->min_batch = ntuples;
+	if (ntuples > stats->max_batch)
+		stats->max_batch = ntuples;
+	stats->multi_insert_calls++;
+	for (i = 0; i < ntuples; i++)
+		blackhole_count_tuple(stats, slots[i]);
+	INSTR_TIME_SET_CURRENT(stats->last_insert);
 }
 
 static TM_Result
@@ -360,8 +1092,24 @@ blackhole_index_validate_scan(Relation tableRelation,
 static uint64
 blackhole_relation_size(Relation rel, ForkNumber forkNumber)
 {
-	/* there is nothing */
-	return 0;
+	BlackholeGenerator *gen;
+	uint64		nblocks;
+
+	/*
+	 * There is nothing, except for the virtual blocks of generated rows,
+	 * which parallel scans rely on to distribute the rows to workers.
+	 */
+	if (forkNumber != MAIN_FORKNUM && forkNumber != InvalidForkNumber)
+		return 0;
+
+	gen = blackhole_load_generator(rel);
+	if (gen == NULL)
+		return 0;
+
+	nblocks = blackhole_generator_nblocks(gen);
+	pfree(gen);
+
+	return nblocks * BLCKSZ;
 }
 
 /*
@@ -385,11 +1133,46 @@ blackhole_estimate_rel_size(Relation rel, int32 *attr_widths,
 							BlockNumber *pages, double *tuples,
 							double *allvisfrac)
 {
-	/* no data available */
-	*attr_widths = 0;
+	BlackholeGenerator *gen;
+	int64		est_pages;
+
 	*tuples = 0;
 	*allvisfrac = 0;
 	*pages = 0;
+
+	/*
+	 * Estimates configured for the relation come first, so as plans can
+	 * look like the ones of a table of the given size. The widths of the
+	 * columns not configured are left to the planner, like for heap.
+	 */
+	if (blackhole_load_estimate(rel, attr_widths, tuples, &est_pages,
+								allvisfrac))
+	{
+		if (est_pages < 0)
+		{
+			int32		tuple_width;
+			double		density;
+
+			/* number of pages the tuples would fill with heap */
+			tuple_width = get_rel_data_width(rel, attr_widths);
+			tuple_width += MAXALIGN(SizeofHeapTupleHeader);
+			tuple_width += sizeof(ItemIdData);
+			/* note: integer division is intentional here */
+			density = (BLCKSZ - SizeOfPageHeaderData) / tuple_width;
+			est_pages = (int64) ceil(*tuples / Max(density, 1));
+		}
+		*pages = (BlockNumber) Min(est_pages, (int64) MaxBlockNumber);
+		return;
+	}
+
+	/* no data available, except for generated rows */
+	gen = blackhole_load_generator(rel);
+	if (gen != NULL)
+	{
+		*tuples = (double) gen->nrows;
+		*pages = blackhole_generator_nblocks(gen);
+		pfree(gen);
+	}
 }
 
 
@@ -500,3 +1283,21 @@ blackhole_am_handler(PG_FUNCTION_ARGS)
 {
 	PG_RETURN_POINTER(&blackhole_methods);
 }
+
+/*
+ * Module load callback
+ */
+void
+_PG_init(void)
+{
+	DefineCustomBoolVariable("blackhole_am.track_inserts",
+							 "Tracks statistics of tuples inserted into blackhole tables.",
+							 "Statistics are kept per relation in the session.",
+							 &blackhole_track_inserts,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+}
@@ -7,3 +7,70 @@ UPDATE blackhole_tab SET a = 0 WHERE a = 1;
 SELECT * FROM blackhole_tab;
 DELETE FROM blackhole_tab WHERE a = 1;
 SELECT * FROM blackhole_tab;
+-- Statistics of tuples inserted
+SET blackhole_am.track_inserts = on;
+INSERT INTO blackhole_tab VALUES (1);
+-- The time between commands is not counted
+SELECT pg_sleep(0.5);
+INSERT INTO blackhole_tab SELECT generate_series(1, 10);
+COPY blackhole_tab FROM stdin;
+1
+2
+3
+\.
+SELECT relid, tuples, bytes, insert_calls, multi_insert_calls,
+    min_batch, max_batch, elapsed_ns > 0 AND elapsed_ns < 500000000 AS elapsed_ok
+  FROM blackhole_am_insert_stats();
+-- Nothing tracked when disabled
+RESET blackhole_am.track_inserts;
+INSERT INTO blackhole_tab VALUES (1);
+SELECT relid, tuples FROM blackhole_am_insert_stats();
+SELECT blackhole_am_insert_stats_reset();
+SELECT count(*) FROM blackhole_am_insert_stats();
+-- Generation of rows
+CREATE TABLE blackhole_gen (id int, val int, name text, flag bool, nul int)
+  USING blackhole_am;
+INSERT INTO blackhole_am_generator VALUES ('blackhole_gen', 5, 42);
+INSERT INTO blackhole_am_generator_column VALUES
+  ('blackhole_gen', 'val', 'uniform', 1, 100),
+  ('blackhole_gen', 'name', 'constant', 7, 0),
+  ('blackhole_gen', 'nul', 'null', 0, 0);
+SELECT * FROM blackhole_gen;
+-- Same rows for each scan
+SELECT count(*) FROM (SELECT * FROM blackhole_gen
+  EXCEPT ALL SELECT * FROM blackhole_gen) s;
+UPDATE blackhole_am_generator SET nrows = 10000 WHERE relid = 'blackhole_gen'::regclass;
+SELECT count(*), sum(id), min(val), max(val) FROM blackhole_gen;
+-- Virtual blocks of generated rows, and parallel scans
+ANALYZE blackhole_gen;
+SELECT relpages FROM pg_class WHERE oid = 'blackhole_gen'::regclass;
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+EXPLAIN (COSTS OFF)
+  SELECT count(*), sum(id), min(val), max(val) FROM blackhole_gen;
+SELECT count(*), sum(id), min(val), max(val) FROM blackhole_gen;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+-- Errors
+INSERT INTO blackhole_am_generator_column VALUES
+  ('blackhole_gen', 'nonexistent', 'sequence', 0, 0);
+SELECT * FROM blackhole_gen;
+DELETE FROM blackhole_am_generator WHERE relid = 'blackhole_gen'::regclass;
+SELECT count(*) FROM blackhole_gen;
+DROP TABLE blackhole_gen;
+-- Size estimates for the planner
+CREATE TABLE blackhole_est (id int, payload text) USING blackhole_am;
+EXPLAIN SELECT * FROM blackhole_est;
+INSERT INTO blackhole_am_estimate (relid, tuples) VALUES ('blackhole_est', 100000);
+INSERT INTO blackhole_am_estimate_column VALUES ('blackhole_est', 'payload', 100);
+EXPLAIN SELECT * FROM blackhole_est;
+UPDATE blackhole_am_estimate SET pages = 10 WHERE relid = 'blackhole_est'::regclass;
+EXPLAIN SELECT * FROM blackhole_est;
+INSERT INTO blackhole_am_estimate_column VALUES ('blackhole_est', 'nonexistent', 10);
+EXPLAIN SELECT * FROM blackhole_est;
+DELETE FROM blackhole_am_estimate WHERE relid = 'blackhole_est'::regclass;
+DROP TABLE blackhole_est;
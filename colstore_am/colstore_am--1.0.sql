@@ -0,0 +1,19 @@
+/* colstore_am/colstore_am--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION colstore_am" to load this file. \quit
+
+CREATE FUNCTION colstore_am_handler(internal)
+RETURNS table_am_handler
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+-- Access method
+CREATE ACCESS METHOD colstore_am TYPE TABLE HANDLER colstore_am_handler;
+COMMENT ON ACCESS METHOD colstore_am IS 'in-memory columnar table AM';
+
+-- Memory allocated for the data of a relation
+CREATE FUNCTION colstore_am_memory(regclass)
+RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
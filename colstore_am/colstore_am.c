@@ -0,0 +1,1554 @@
+/*-------------------------------------------------------------------------
+ *
+ * colstore_am.c
+ *	  in-memory columnar table access method code
+ *
+ * Portions Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  colstore_am/colstore_am.c
+ *
+ *
+ * NOTES
+ *	  This file introduces the table access method colstore, built from
+ *	  the blackhole template, which stores the data of a relation in
+ *	  memory with one array of values per column, with no page layout and
+ *	  no visibility checks. Scans return rows in a custom slot type whose
+ *	  attributes are fetched from the column arrays only when the executor
+ *	  asks for them, so as only the columns needed are deformed.
+ *
+ *	  The data is kept in memory local to the session, hence only
+ *	  temporary relations can use this access method. Rows inserted by a
+ *	  transaction or a subtransaction are discarded if it aborts, with the
+ *	  memory of their values. UPDATE, DELETE, row locks and indexes are not
+ *	  supported.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "access/detoast.h"
+#include "access/htup_details.h"
+#include "access/multixact.h"
+#include "access/relation.h"
+#include "access/tableam.h"
+#include "access/tsmapi.h"
+#include "access/xact.h"
+#include "catalog/index.h"
+#include "catalog/objectaccess.h"
+#include "catalog/pg_class.h"
+#include "commands/vacuum.h"
+#include "executor/tuptable.h"
+#include "nodes/execnodes.h"
+#include "storage/relfilenode.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/expandeddatum.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+
+PG_MODULE_MAGIC;
+
+PG_FUNCTION_INFO_V1(colstore_am_handler);
+PG_FUNCTION_INFO_V1(colstore_am_memory);
+
+void		_PG_init(void);
+
+/*
+ * Rows are numbered as if stored in virtual blocks full of tuples, giving
+ * their TIDs and the size of the relation reported to the planner.
+ */
+#define COLSTORE_ROWS_PER_BLOCK		MaxHeapTuplesPerPage
+
+/* Minimum number of rows allocated in the arrays of a relation */
+#define COLSTORE_MIN_CAPACITY		1024
+
+/* Values of a column */
+typedef struct ColstoreColumn
+{
+	int64		firstrow;		/* first row stored, values of the rows
+								 * before this one are missing */
+	bool		byval;			/* values passed by value? */
+	Datum	   *values;
+	bool	   *isnull;
+} ColstoreColumn;
+
+/* Data of a relation, stored in the session */
+typedef struct ColstoreTable
+{
+	RelFileNode node;			/* hash key, must be first */
+	MemoryContext cxt;			/* memory of the data */
+	int			natts;			/* number of columns */
+	int64		nrows;			/* number of rows */
+	int64		capacity;		/* rows allocated in each column */
+	ColstoreColumn *columns;
+	int			committed_natts;	/* number of columns at transaction start */
+	int64		committed_nrows;	/* number of rows at transaction start */
+	List	   *savepoints;		/* ColstoreSavepoint of each subtransaction,
+								 * innermost first */
+	SubTransactionId create_subid;	/* subtransaction creating the data, or
+									 * InvalidSubTransactionId */
+	SubTransactionId drop_subid;	/* subtransaction dropping the data, or
+									 * InvalidSubTransactionId */
+} ColstoreTable;
+
+/* Size of the data of a relation when a subtransaction started */
+typedef struct ColstoreSavepoint
+{
+	SubTransactionId subid;
+	int			natts;
+	int64		nrows;
+} ColstoreSavepoint;
+
+/* Relations of the session, indexed by relfilenode */
+static HTAB *colstore_tables = NULL;
+
+/* Saved hook value in case of unload */
+static object_access_hook_type prev_object_access_hook = NULL;
+
+/* Base structures for scans */
+typedef struct ColstoreScanDescData
+{
+	TableScanDescData rs_base;	/* AM independent part of the descriptor */
+
+	ColstoreTable *table;		/* data of the relation, NULL if none */
+	int64		nrows;			/* rows visible to the scan */
+	int64		nextrow;		/* next row to return */
+	int64		endrow;			/* end of the rows of the current range */
+	BlockNumber curblock;		/* current block of sample scans */
+} ColstoreScanDescData;
+typedef struct ColstoreScanDescData *ColstoreScanDesc;
+
+static const TableAmRoutine colstore_methods;
+
+
+/* ------------------------------------------------------------------------
+ * Storage of the data of relations
+ * ------------------------------------------------------------------------
+ */
+
+/*
+ * Number of virtual blocks of a number of rows.
+ */
+static BlockNumber
+colstore_nblocks(int64 nrows)
+{
+	int64		nblocks;
+
+	nblocks = (nrows + COLSTORE_ROWS_PER_BLOCK - 1) / COLSTORE_ROWS_PER_BLOCK;
+	return (BlockNumber) Min(nblocks, (int64) MaxBlockNumber);
+}
+
+static inline void
+colstore_row_to_tid(int64 row, ItemPointer tid)
+{
+	ItemPointerSet(tid, row / COLSTORE_ROWS_PER_BLOCK,
+				   row % COLSTORE_ROWS_PER_BLOCK + 1);
+}
+
+static inline int64
+colstore_tid_to_row(ItemPointer tid)
+{
+	return (int64) ItemPointerGetBlockNumber(tid) * COLSTORE_ROWS_PER_BLOCK +
+		ItemPointerGetOffsetNumber(tid) - 1;
+}
+
+/*
+ * Look for the data of a relfilenode, creating it if requested.
+ */
+static ColstoreTable *
+colstore_get_table(const RelFileNode *node, bool create)
+{
+	ColstoreTable *table;
+	bool		found;
+
+	if (colstore_tables == NULL)
+	{
+		HASHCTL		ctl;
+
+		if (!create)
+			return NULL;
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(RelFileNode);
+		ctl.entrysize = sizeof(ColstoreTable);
+		colstore_tables = hash_create("colstore_am tables", 16, &ctl,
+									  HASH_ELEM | HASH_BLOBS);
+	}
+
+	table = (ColstoreTable *) hash_search(colstore_tables, node,
+										  create ? HASH_ENTER : HASH_FIND,
+										  &found);
+	if (table == NULL || found)
+		return table;
+
+	table->cxt = AllocSetContextCreate(TopMemoryContext,
+									   "colstore_am table",
+									   ALLOCSET_DEFAULT_SIZES);
+	table->natts = 0;
+	table->nrows = 0;
+	table->capacity = 0;
+	table->columns = NULL;
+	table->committed_natts = 0;
+	table->committed_nrows = 0;
+	table->savepoints = NIL;
+	table->create_subid = GetCurrentSubTransactionId();
+	table->drop_subid = InvalidSubTransactionId;
+	return table;
+}
+
+/*
+ * Discard all the data of a relation.
+ */
+static void
+colstore_reset_table(ColstoreTable *table)
+{
+	ListCell   *lc;
+
+	MemoryContextReset(table->cxt);
+	table->natts = 0;
+	table->nrows = 0;
+	table->capacity = 0;
+	table->columns = NULL;
+	table->committed_natts = 0;
+	table->committed_nrows = 0;
+
+	/* nothing is left to discard if a subtransaction aborts */
+	foreach(lc, table->savepoints)
+	{
+		ColstoreSavepoint *savepoint = (ColstoreSavepoint *) lfirst(lc);
+
+		savepoint->natts = 0;
+		savepoint->nrows = 0;
+	}
+}
+
+static void
+colstore_free_table(ColstoreTable *table)
+{
+	MemoryContextDelete(table->cxt);
+	hash_search(colstore_tables, &table->node, HASH_REMOVE, NULL);
+}
+
+/*
+ * Discard the rows and the columns of a relation beyond a number of
+ * columns and rows, freeing the values they use. The arrays of the
+ * columns kept are not shrunk.
+ */
+static void
+colstore_discard_rows(ColstoreTable *table, int natts, int64 nrows)
+{
+	int			attno;
+
+	for (attno = 0; attno < table->natts; attno++)
+	{
+		ColstoreColumn *col = &table->columns[attno];
+		int64		row;
+
+		if (!col->byval)
+		{
+			for (row = Max(col->firstrow, attno < natts ? nrows : 0);
+				 row < table->nrows; row++)
+			{
+				if (!col->isnull[row])
+					pfree(DatumGetPointer(col->values[row]));
+			}
+		}
+
+		/* columns added are initialized again if added back */
+		if (attno >= natts && col->values != NULL)
+		{
+			pfree(col->values);
+			pfree(col->isnull);
+			col->values = NULL;
+			col->isnull = NULL;
+		}
+	}
+
+	table->natts = Min(table->natts, natts);
+	table->nrows = Min(table->nrows, nrows);
+}
+
+/*
+ * Make sure that the arrays of a relation have room for the columns of a
+ * tuple descriptor and a number of rows.
+ */
+static void
+colstore_reserve(ColstoreTable *table, TupleDesc tupdesc, int64 nrows)
+{
+	int			natts = tupdesc->natts;
+	int			attno;
+
+	/* columns added since the first rows have been inserted */
+	if (natts > table->natts)
+	{
+		if (table->columns == NULL)
+			table->columns = (ColstoreColumn *)
+				MemoryContextAlloc(table->cxt, sizeof(ColstoreColumn) * natts);
+		else
+			table->columns = (ColstoreColumn *)
+				repalloc(table->columns, sizeof(ColstoreColumn) * natts);
+
+		for (attno = table->natts; attno < natts; attno++)
+		{
+			ColstoreColumn *col = &table->columns[attno];
+
+			col->firstrow = table->nrows;
+			col->byval = TupleDescAttr(tupdesc, attno)->attbyval;
+			col->values = NULL;
+			col->isnull = NULL;
+			if (table->capacity > 0)
+			{
+				col->values = (Datum *)
+					MemoryContextAllocHuge(table->cxt,
+										   sizeof(Datum) * table->capacity);
+				col->isnull = (bool *)
+					MemoryContextAllocHuge(table->cxt,
+										   sizeof(bool) * table->capacity);
+			}
+		}
+		table->natts = natts;
+	}
+
+	if (nrows > table->capacity)
+	{
+		int64		capacity = Max(table->capacity, COLSTORE_MIN_CAPACITY);
+
+		while (capacity < nrows)
+			capacity *= 2;
+
+		for (attno = 0; attno < table->natts; attno++)
+		{
+			ColstoreColumn *col = &table->columns[attno];
+
+			if (col->values == NULL)
+			{
+				col->values = (Datum *)
+					MemoryContextAllocHuge(table->cxt,
+										   sizeof(Datum) * capacity);
+				col->isnull = (bool *)
+					MemoryContextAllocHuge(table->cxt,
+										   sizeof(bool) * capacity);
+			}
+			else
+			{
+				col->values = (Datum *)
+					repalloc_huge(col->values, sizeof(Datum) * capacity);
+				col->isnull = (bool *)
+					repalloc_huge(col->isnull, sizeof(bool) * capacity);
+			}
+		}
+		table->capacity = capacity;
+	}
+}
+
+/*
+ * Append the contents of a slot to the data of a relation. Values passed
+ * by reference are copied into the memory of the relation, external
+ * values being detoasted.
+ */
+static void
+colstore_append(ColstoreTable *table, TupleTableSlot *slot)
+{
+	TupleDesc	tupdesc = slot->tts_tupleDescriptor;
+	int64		row = table->nrows;
+	MemoryContext oldcxt;
+	int			attno;
+
+	slot_getallattrs(slot);
+	colstore_reserve(table, tupdesc, row + 1);
+
+	oldcxt = MemoryContextSwitchTo(table->cxt);
+	for (attno = 0; attno < tupdesc->natts; attno++)
+	{
+		Form_pg_attribute attr = TupleDescAttr(tupdesc, attno);
+		ColstoreColumn *col = &table->columns[attno];
+		Datum		value = slot->tts_values[attno];
+
+		if (slot->tts_isnull[attno] || attr->attisdropped)
+		{
+			col->values[row] = (Datum) 0;
+			col->isnull[row] = true;
+			continue;
+		}
+
+		if (!attr->attbyval)
+		{
+			if (attr->attlen == -1 &&
+				VARATT_IS_EXTERNAL(DatumGetPointer(value)))
+				value = PointerGetDatum(detoast_external_attr((struct varlena *)
+															  DatumGetPointer(value)));
+			else
+				value = datumCopy(value, false, attr->attlen);
+		}
+
+		col->values[row] = value;
+		col->isnull[row] = false;
+	}
+	MemoryContextSwitchTo(oldcxt);
+
+	table->nrows++;
+	colstore_row_to_tid(row, &slot->tts_tid);
+}
+
+/*
+ * Fetch into a slot the values of a range of attributes of a row.
+ */
+static void
+colstore_fetch_values(ColstoreTable *table, int64 row, TupleTableSlot *slot,
+					  int firstatt, int lastatt)
+{
+	int			attno;
+
+	for (attno = firstatt; attno < lastatt; attno++)
+	{
+		ColstoreColumn *col;
+
+		/* columns added after the row has been inserted */
+		if (attno >= table->natts || row < table->columns[attno].firstrow)
+		{
+			slot_getmissingattrs(slot, attno, attno + 1);
+			continue;
+		}
+
+		col = &table->columns[attno];
+		slot->tts_values[attno] = col->values[row];
+		slot->tts_isnull[attno] = col->isnull[row];
+	}
+}
+
+/*
+ * Copy all the rows of a relation into another one.
+ */
+static void
+colstore_copy_rows(ColstoreTable *src, ColstoreTable *dst, TupleDesc tupdesc)
+{
+	TupleTableSlot *slot;
+	int64		row;
+
+	slot = MakeSingleTupleTableSlot(tupdesc, &TTSOpsVirtual);
+	colstore_reserve(dst, tupdesc, dst->nrows + src->nrows);
+
+	for (row = 0; row < src->nrows; row++)
+	{
+		ExecClearTuple(slot);
+		colstore_fetch_values(src, row, slot, 0, tupdesc->natts);
+		ExecStoreVirtualTuple(slot);
+		colstore_append(dst, slot);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+}
+
+/*
+ * Transaction callback, keeping the rows of committed transactions and
+ * freeing the data of the relations dropped.
+ */
+static void
+colstore_xact_callback(XactEvent event, void *arg)
+{
+	HASH_SEQ_STATUS status;
+	ColstoreTable *table;
+
+	if (colstore_tables == NULL)
+		return;
+
+	switch (event)
+	{
+		case XACT_EVENT_COMMIT:
+			hash_seq_init(&status, colstore_tables);
+			while ((table = (ColstoreTable *) hash_seq_search(&status)) != NULL)
+			{
+				if (table->drop_subid != InvalidSubTransactionId)
+				{
+					colstore_free_table(table);
+					continue;
+				}
+				table->committed_natts = table->natts;
+				table->committed_nrows = table->nrows;
+				table->savepoints = NIL;
+				table->create_subid = InvalidSubTransactionId;
+			}
+			break;
+		case XACT_EVENT_ABORT:
+			hash_seq_init(&status, colstore_tables);
+			while ((table = (ColstoreTable *) hash_seq_search(&status)) != NULL)
+			{
+				if (table->create_subid != InvalidSubTransactionId)
+				{
+					colstore_free_table(table);
+					continue;
+				}
+				colstore_discard_rows(table, table->committed_natts,
+									  table->committed_nrows);
+				table->savepoints = NIL;
+				table->drop_subid = InvalidSubTransactionId;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Subtransaction callback, saving the size of the data of each relation
+ * when a subtransaction starts so as the rows it inserts are discarded if
+ * it aborts.
+ */
+static void
+colstore_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+						  SubTransactionId parentSubid, void *arg)
+{
+	HASH_SEQ_STATUS status;
+	ColstoreTable *table;
+	ColstoreSavepoint *savepoint;
+	MemoryContext oldcxt;
+
+	if (colstore_tables == NULL)
+		return;
+
+	switch (event)
+	{
+		case SUBXACT_EVENT_START_SUB:
+			/* the list is reset at the end of the transaction */
+			oldcxt = MemoryContextSwitchTo(TopTransactionContext);
+			hash_seq_init(&status, colstore_tables);
+			while ((table = (ColstoreTable *) hash_seq_search(&status)) != NULL)
+			{
+				savepoint = (ColstoreSavepoint *)
+					palloc(sizeof(ColstoreSavepoint));
+				savepoint->subid = mySubid;
+				savepoint->natts = table->natts;
+				savepoint->nrows = table->nrows;
+				table->savepoints = lcons(savepoint, table->savepoints);
+			}
+			MemoryContextSwitchTo(oldcxt);
+			break;
+		case SUBXACT_EVENT_COMMIT_SUB:
+			hash_seq_init(&status, colstore_tables);
+			while ((table = (ColstoreTable *) hash_seq_search(&status)) != NULL)
+			{
+				if (table->create_subid == mySubid)
+					table->create_subid = parentSubid;
+				if (table->drop_subid == mySubid)
+					table->drop_subid = parentSubid;
+				if (table->savepoints == NIL)
+					continue;
+				savepoint = (ColstoreSavepoint *) linitial(table->savepoints);
+				if (savepoint->subid == mySubid)
+					table->savepoints = list_delete_first(table->savepoints);
+			}
+			break;
+		case SUBXACT_EVENT_ABORT_SUB:
+			hash_seq_init(&status, colstore_tables);
+			while ((table = (ColstoreTable *) hash_seq_search(&status)) != NULL)
+			{
+				if (table->create_subid == mySubid)
+				{
+					colstore_free_table(table);
+					continue;
+				}
+				if (table->drop_subid == mySubid)
+					table->drop_subid = InvalidSubTransactionId;
+				if (table->savepoints == NIL)
+					continue;
+				savepoint = (ColstoreSavepoint *) linitial(table->savepoints);
+				if (savepoint->subid != mySubid)
+					continue;
+				colstore_discard_rows(table, savepoint->natts, savepoint->nrows);
+				table->savepoints = list_delete_first(table->savepoints);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Object access hook, tracking the relations dropped, whose data is
+ * freed when the transaction commits.
+ */
+static void
+colstore_object_access(ObjectAccessType access, Oid classId, Oid objectId,
+					   int subId, void *arg)
+{
+	if (prev_object_access_hook)
+		(*prev_object_access_hook) (access, classId, objectId, subId, arg);
+
+	if (access == OAT_DROP && classId == RelationRelationId &&
+		subId == 0 && colstore_tables != NULL)
+	{
+		HeapTuple	tuple;
+		Form_pg_class classForm;
+		RelFileNode node;
+		ColstoreTable *table;
+
+		tuple = SearchSysCache1(RELOID, ObjectIdGetDatum(objectId));
+		if (!HeapTupleIsValid(tuple))
+			return;
+		classForm = (Form_pg_class) GETSTRUCT(tuple);
+
+		node.spcNode = OidIsValid(classForm->reltablespace) ?
+			classForm->reltablespace : MyDatabaseTableSpace;
+		node.dbNode = MyDatabaseId;
+		node.relNode = classForm->relfilenode;
+		ReleaseSysCache(tuple);
+
+		table = colstore_get_table(&node, false);
+		if (table != NULL)
+			table->drop_subid = GetCurrentSubTransactionId();
+	}
+}
+
+
+/* ------------------------------------------------------------------------
+ * Slot related callbacks for colstore AM
+ * ------------------------------------------------------------------------
+ */
+
+/*
+ * Slot pointing to a row of a relation, whose attributes are fetched
+ * from the column arrays on demand. Once materialized, or if filled by
+ * the caller, it behaves like a virtual slot.
+ */
+typedef struct ColstoreTupleTableSlot
+{
+	TupleTableSlot base;
+
+	ColstoreTable *table;		/* data of the row, NULL if not a row */
+	int64		row;			/* row number */
+	char	   *data;			/* data of the values when materialized */
+} ColstoreTupleTableSlot;
+
+static const TupleTableSlotOps TTSOpsColstore;
+
+static void
+tts_colstore_init(TupleTableSlot *slot)
+{
+}
+
+static void
+tts_colstore_release(TupleTableSlot *slot)
+{
+}
+
+static void
+tts_colstore_clear(TupleTableSlot *slot)
+{
+	ColstoreTupleTableSlot *cslot = (ColstoreTupleTableSlot *) slot;
+
+	if (unlikely(TTS_SHOULDFREE(slot)))
+	{
+		pfree(cslot->data);
+		cslot->data = NULL;
+		slot->tts_flags &= ~TTS_FLAG_SHOULDFREE;
+	}
+
+	cslot->table = NULL;
+	slot->tts_nvalid = 0;
+	slot->tts_flags |= TTS_FLAG_EMPTY;
+	ItemPointerSetInvalid(&slot->tts_tid);
+}
+
+static void
+tts_colstore_getsomeattrs(TupleTableSlot *slot, int natts)
+{
+	ColstoreTupleTableSlot *cslot = (ColstoreTupleTableSlot *) slot;
+
+	Assert(!TTS_EMPTY(slot));
+
+	if (cslot->table == NULL)
+		elog(ERROR, "colstore tuple table slot has no row to fetch attributes from");
+
+	colstore_fetch_values(cslot->table, cslot->row, slot,
+						  slot->tts_nvalid, natts);
+	slot->tts_nvalid = natts;
+}
+
+static Datum
+tts_colstore_getsysattr(TupleTableSlot *slot, int attnum, bool *isnull)
+{
+	Assert(!TTS_EMPTY(slot));
+
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("cannot retrieve a system column in this context")));
+
+	return 0;					/* silence compiler warnings */
+}
+
+/*
+ * Materialize the slot, copying the values passed by reference into the
+ * memory of the slot, as done for virtual slots.
+ */
+static void
+tts_colstore_materialize(TupleTableSlot *slot)
+{
+	ColstoreTupleTableSlot *cslot = (ColstoreTupleTableSlot *) slot;
+	TupleDesc	desc = slot->tts_tupleDescriptor;
+	Size		sz = 0;
+	char	   *data;
+	int			natt;
+
+	/* already materialized */
+	if (TTS_SHOULDFREE(slot))
+		return;
+
+	/* fetch all the values of the row, which is then not needed anymore */
+	if (cslot->table != NULL)
+	{
+		tts_colstore_getsomeattrs(slot, desc->natts);
+		cslot->table = NULL;
+	}
+
+	/* compute size of memory required */
+	for (natt = 0; natt < desc->natts; natt++)
+	{
+		Form_pg_attribute att = TupleDescAttr(desc, natt);
+		Datum		val;
+
+		if (att->attbyval || slot->tts_isnull[natt])
+			continue;
+
+		val = slot->tts_values[natt];
+
+		sz = att_align_nominal(sz, att->attalign);
+		if (att->attlen == -1 &&
+			VARATT_IS_EXTERNAL_EXPANDED(DatumGetPointer(val)))
+			sz += EOH_get_flat_size(DatumGetEOHP(val));
+		else
+			sz = att_addlength_datum(sz, att->attlen, val);
+	}
+
+	/* all data is byval */
+	if (sz == 0)
+		return;
+
+	data = cslot->data = MemoryContextAlloc(slot->tts_mcxt, sz);
+	slot->tts_flags |= TTS_FLAG_SHOULDFREE;
+
+	/* and copy all attributes into the pre-allocated space */
+	for (natt = 0; natt < desc->natts; natt++)
+	{
+		Form_pg_attribute att = TupleDescAttr(desc, natt);
+		Datum		val;
+
+		if (att->attbyval || slot->tts_isnull[natt])
+			continue;
+
+		val = slot->tts_values[natt];
+
+		data = (char *) att_align_nominal(data, att->attalign);
+		if (att->attlen == -1 &&
+			VARATT_IS_EXTERNAL_EXPANDED(DatumGetPointer(val)))
+		{
+			ExpandedObjectHeader *eoh = DatumGetEOHP(val);
+			Size		data_length = EOH_get_flat_size(eoh);
+
+			EOH_flatten_into(eoh, data, data_length);
+			slot->tts_values[natt] = PointerGetDatum(data);
+			data += data_length;
+		}
+		else
+		{
+			Size		data_length = 0;
+
+			data_length = att_addlength_datum(data_length, att->attlen, val);
+			memcpy(data, DatumGetPointer(val), data_length);
+			slot->tts_values[natt] = PointerGetDatum(data);
+			data += data_length;
+		}
+	}
+}
+
+static void
+tts_colstore_copyslot(TupleTableSlot *dstslot, TupleTableSlot *srcslot)
+{
+	TupleDesc	srcdesc = srcslot->tts_tupleDescriptor;
+
+	Assert(srcdesc->natts <= dstslot->tts_tupleDescriptor->natts);
+
+	tts_colstore_clear(dstslot);
+
+	slot_getallattrs(srcslot);
+
+	for (int natt = 0; natt < srcdesc->natts; natt++)
+	{
+		dstslot->tts_values[natt] = srcslot->tts_values[natt];
+		dstslot->tts_isnull[natt] = srcslot->tts_isnull[natt];
+	}
+
+	dstslot->tts_nvalid = srcdesc->natts;
+	dstslot->tts_flags &= ~TTS_FLAG_EMPTY;
+
+	/* make sure storage doesn't depend on external memory */
+	tts_colstore_materialize(dstslot);
+}
+
+static HeapTuple
+tts_colstore_copy_heap_tuple(TupleTableSlot *slot)
+{
+	Assert(!TTS_EMPTY(slot));
+
+	slot_getallattrs(slot);
+	return heap_form_tuple(slot->tts_tupleDescriptor,
+						   slot->tts_values,
+						   slot->tts_isnull);
+}
+
+static MinimalTuple
+tts_colstore_copy_minimal_tuple(TupleTableSlot *slot)
+{
+	Assert(!TTS_EMPTY(slot));
+
+	slot_getallattrs(slot);
+	return heap_form_minimal_tuple(slot->tts_tupleDescriptor,
+								   slot->tts_values,
+								   slot->tts_isnull);
+}
+
+static const TupleTableSlotOps TTSOpsColstore = {
+	.base_slot_size = sizeof(ColstoreTupleTableSlot),
+	.init = tts_colstore_init,
+	.release = tts_colstore_release,
+	.clear = tts_colstore_clear,
+	.getsomeattrs = tts_colstore_getsomeattrs,
+	.getsysattr = tts_colstore_getsysattr,
+	.materialize = tts_colstore_materialize,
+	.copyslot = tts_colstore_copyslot,
+
+	/*
+	 * A row is not stored as a tuple, so it cannot be returned without
+	 * forming a new one.
+	 */
+	.get_heap_tuple = NULL,
+	.get_minimal_tuple = NULL,
+	.copy_heap_tuple = tts_colstore_copy_heap_tuple,
+	.copy_minimal_tuple = tts_colstore_copy_minimal_tuple
+};
+
+/*
+ * Store a row of a relation into a slot. Slots of the AM only point to
+ * the row, other slots get all the values.
+ */
+static void
+colstore_store_row(ColstoreTable *table, int64 row, TupleTableSlot *slot)
+{
+	ExecClearTuple(slot);
+
+	if (slot->tts_ops == &TTSOpsColstore)
+	{
+		ColstoreTupleTableSlot *cslot = (ColstoreTupleTableSlot *) slot;
+
+		cslot->table = table;
+		cslot->row = row;
+		slot->tts_flags &= ~TTS_FLAG_EMPTY;
+		slot->tts_nvalid = 0;
+	}
+	else
+	{
+		colstore_fetch_values(table, row, slot, 0,
+							  slot->tts_tupleDescriptor->natts);
+		ExecStoreVirtualTuple(slot);
+	}
+
+	colstore_row_to_tid(row, &slot->tts_tid);
+}
+
+static const TupleTableSlotOps *
+colstore_slot_callbacks(Relation relation)
+{
+	return &TTSOpsColstore;
+}
+
+
+/* ------------------------------------------------------------------------
+ * Table Scan Callbacks for colstore AM
+ * ------------------------------------------------------------------------
+ */
+
+static TableScanDesc
+colstore_scan_begin(Relation relation, Snapshot snapshot,
+					int nkeys, ScanKey key,
+					ParallelTableScanDesc parallel_scan,
+					uint32 flags)
+{
+	ColstoreScanDesc scan;
+
+	/* temporary relations are never scanned in parallel */
+	if (parallel_scan != NULL)
+		elog(ERROR, "parallel scans are not supported by colstore_am");
+
+	scan = (ColstoreScanDesc) palloc(sizeof(ColstoreScanDescData));
+
+	scan->rs_base.rs_rd = relation;
+	scan->rs_base.rs_snapshot = snapshot;
+	scan->rs_base.rs_nkeys = nkeys;
+	scan->rs_base.rs_flags = flags;
+	scan->rs_base.rs_parallel = parallel_scan;
+
+	/* rows inserted after the scan has begun are not visible */
+	scan->table = colstore_get_table(&relation->rd_node, false);
+	scan->nrows = scan->table != NULL ? scan->table->nrows : 0;
+	scan->nextrow = 0;
+	scan->endrow = scan->nrows;
+	scan->curblock = InvalidBlockNumber;
+
+	/* analyze and sample scans get their rows block by block */
+	if ((flags & (SO_TYPE_ANALYZE | SO_TYPE_SAMPLESCAN)) != 0)
+		scan->endrow = 0;
+
+	return (TableScanDesc) scan;
+}
+
+static void
+colstore_scan_end(TableScanDesc sscan)
+{
+	pfree(sscan);
+}
+
+static void
+colstore_scan_rescan(TableScanDesc sscan, ScanKey key, bool set_params,
+					 bool allow_strat, bool allow_sync, bool allow_pagemode)
+{
+	ColstoreScanDesc scan = (ColstoreScanDesc) sscan;
+
+	scan->nextrow = 0;
+	scan->curblock = InvalidBlockNumber;
+	if ((sscan->rs_flags & (SO_TYPE_ANALYZE | SO_TYPE_SAMPLESCAN)) == 0)
+		scan->endrow = scan->nrows;
+	else
+		scan->endrow = 0;
+}
+
+static bool
+colstore_scan_getnextslot(TableScanDesc sscan, ScanDirection direction,
+						  TupleTableSlot *slot)
+{
+	ColstoreScanDesc scan = (ColstoreScanDesc) sscan;
+
+	if (scan->nextrow >= scan->endrow)
+	{
+		ExecClearTuple(slot);
+		return false;
+	}
+
+	colstore_store_row(scan->table, scan->nextrow, slot);
+	scan->nextrow++;
+	return true;
+}
+
+/*
+ * Set the range of rows of a scan to a block, returning false if it is
+ * beyond the end of the rows visible.
+ */
+static bool
+colstore_scan_set_block(ColstoreScanDesc scan, BlockNumber blockno)
+{
+	int64		firstrow = (int64) blockno * COLSTORE_ROWS_PER_BLOCK;
+
+	if (firstrow >= scan->nrows)
+		return false;
+
+	scan->curblock = blockno;
+	scan->nextrow = firstrow;
+	scan->endrow = Min(firstrow + COLSTORE_ROWS_PER_BLOCK, scan->nrows);
+	return true;
+}
+
+
+/* ------------------------------------------------------------------------
+ * Index Scan Callbacks for colstore AM
+ * ------------------------------------------------------------------------
+ */
+
+static IndexFetchTableData *
+colstore_index_fetch_begin(Relation rel)
+{
+	/* indexes are not supported */
+	return NULL;
+}
+
+static void
+colstore_index_fetch_reset(IndexFetchTableData *scan)
+{
+	/* nothing to do here */
+}
+
+static void
+colstore_index_fetch_end(IndexFetchTableData *scan)
+{
+	/* nothing to do here */
+}
+
+static bool
+colstore_index_fetch_tuple(struct IndexFetchTableData *scan,
+						   ItemPointer tid,
+						   Snapshot snapshot,
+						   TupleTableSlot *slot,
+						   bool *call_again, bool *all_dead)
+{
+	/* indexes are not supported */
+	return false;
+}
+
+
+/* ------------------------------------------------------------------------
+ * Callbacks for non-modifying operations on individual tuples for
+ * colstore AM.
+ * ------------------------------------------------------------------------
+ */
+
+static bool
+colstore_fetch_row_version(Relation relation,
+						   ItemPointer tid,
+						   Snapshot snapshot,
+						   TupleTableSlot *slot)
+{
+	ColstoreTable *table = colstore_get_table(&relation->rd_node, false);
+	int64		row = colstore_tid_to_row(tid);
+
+	if (table == NULL || row >= table->nrows)
+		return false;
+
+	colstore_store_row(table, row, slot);
+	slot->tts_tableOid = RelationGetRelid(relation);
+	return true;
+}
+
+static void
+colstore_get_latest_tid(TableScanDesc sscan,
+						ItemPointer tid)
+{
+	/* rows are never updated, so the TID is the latest one */
+}
+
+static bool
+colstore_tuple_tid_valid(TableScanDesc sscan, ItemPointer tid)
+{
+	ColstoreScanDesc scan = (ColstoreScanDesc) sscan;
+
+	return colstore_tid_to_row(tid) < scan->nrows;
+}
+
+static bool
+colstore_tuple_satisfies_snapshot(Relation rel, TupleTableSlot *slot,
+								  Snapshot snapshot)
+{
+	/* there are no visibility checks */
+	return true;
+}
+
+static TransactionId
+colstore_compute_xid_horizon_for_tuples(Relation rel,
+										ItemPointerData *tids,
+										int nitems)
+{
+	return InvalidTransactionId;
+}
+
+
+/* ----------------------------------------------------------------------------
+ *  Functions for manipulations of physical tuples for colstore AM.
+ * ----------------------------------------------------------------------------
+ */
+
+static void
+colstore_tuple_insert(Relation relation, TupleTableSlot *slot,
+					  CommandId cid, int options, BulkInsertState bistate)
+{
+	ColstoreTable *table = colstore_get_table(&relation->rd_node, true);
+
+	colstore_append(table, slot);
+	slot->tts_tableOid = RelationGetRelid(relation);
+}
+
+static void
+colstore_tuple_insert_speculative(Relation relation, TupleTableSlot *slot,
+								  CommandId cid, int options,
+								  BulkInsertState bistate,
+								  uint32 specToken)
+{
+	/* same as a normal insert */
+	colstore_tuple_insert(relation, slot, cid, options, bistate);
+}
+
+static void
+colstore_tuple_complete_speculative(Relation relation, TupleTableSlot *slot,
+									uint32 spekToken, bool succeeded)
+{
+	/* nothing to do */
+}
+
+static void
+colstore_multi_insert(Relation relation, TupleTableSlot **slots,
+					  int ntuples, CommandId cid, int options,
+					  BulkInsertState bistate)
+{
+	ColstoreTable *table = colstore_get_table(&relation->rd_node, true);
+	int			i;
+
+	/* allocate the arrays once for the whole batch */
+	colstore_reserve(table, RelationGetDescr(relation),
+					 table->nrows + ntuples);
+
+	for (i = 0; i < ntuples; i++)
+	{
+		colstore_append(table, slots[i]);
+		slots[i]->tts_tableOid = RelationGetRelid(relation);
+	}
+}
+
+static TM_Result
+colstore_tuple_delete(Relation relation, ItemPointer tid, CommandId cid,
+					  Snapshot snapshot, Snapshot crosscheck, bool wait,
+					  TM_FailureData *tmfd, bool changingPart)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("colstore_am does not support DELETE")));
+	return TM_Ok;				/* keep compiler quiet */
+}
+
+static TM_Result
+colstore_tuple_update(Relation relation, ItemPointer otid,
+					  TupleTableSlot *slot, CommandId cid,
+					  Snapshot snapshot, Snapshot crosscheck,
+					  bool wait, TM_FailureData *tmfd,
+					  LockTupleMode *lockmode, bool *update_indexes)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("colstore_am does not support UPDATE")));
+	return TM_Ok;				/* keep compiler quiet */
+}
+
+static TM_Result
+colstore_tuple_lock(Relation relation, ItemPointer tid, Snapshot snapshot,
+					TupleTableSlot *slot, CommandId cid, LockTupleMode mode,
+					LockWaitPolicy wait_policy, uint8 flags,
+					TM_FailureData *tmfd)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("colstore_am does not support row locks")));
+	return TM_Ok;				/* keep compiler quiet */
+}
+
+static void
+colstore_finish_bulk_insert(Relation relation, int options)
+{
+	/* nothing to do */
+}
+
+
+/* ------------------------------------------------------------------------
+ * DDL related callbacks for colstore AM.
+ * ------------------------------------------------------------------------
+ */
+
+static void
+colstore_relation_set_new_filenode(Relation rel,
+								   const RelFileNode *newrnode,
+								   char persistence,
+								   TransactionId *freezeXid,
+								   MultiXactId *minmulti)
+{
+	ColstoreTable *table;
+
+	/* the data is only visible to the session */
+	if (persistence != RELPERSISTENCE_TEMP)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("colstore_am only supports temporary tables")));
+
+	/* no transaction IDs are stored, so all the past ones are frozen */
+	*freezeXid = RecentXmin;
+	*minmulti = GetOldestMultiXactId();
+
+	/*
+	 * The data of the previous relfilenode, if any, is freed when the
+	 * transaction commits, and kept if it aborts.
+	 */
+	if (!RelFileNodeEquals(rel->rd_node, *newrnode))
+	{
+		table = colstore_get_table(&rel->rd_node, false);
+		if (table != NULL)
+			table->drop_subid = GetCurrentSubTransactionId();
+	}
+
+	table = colstore_get_table(newrnode, true);
+	colstore_reset_table(table);
+	table->create_subid = GetCurrentSubTransactionId();
+}
+
+static void
+colstore_relation_nontransactional_truncate(Relation rel)
+{
+	ColstoreTable *table = colstore_get_table(&rel->rd_node, false);
+
+	if (table != NULL)
+		colstore_reset_table(table);
+}
+
+static void
+colstore_copy_data(Relation rel, const RelFileNode *newrnode)
+{
+	ColstoreTable *src = colstore_get_table(&rel->rd_node, false);
+	ColstoreTable *dst = colstore_get_table(newrnode, true);
+
+	/* the data of the old relfilenode is freed once committed */
+	if (src != NULL)
+	{
+		colstore_copy_rows(src, dst, RelationGetDescr(rel));
+		src->drop_subid = GetCurrentSubTransactionId();
+	}
+}
+
+static void
+colstore_copy_for_cluster(Relation OldTable, Relation NewTable,
+						  Relation OldIndex, bool use_sort,
+						  TransactionId OldestXmin,
+						  TransactionId *xid_cutoff,
+						  MultiXactId *multi_cutoff,
+						  double *num_tuples,
+						  double *tups_vacuumed,
+						  double *tups_recently_dead)
+{
+	ColstoreTable *src = colstore_get_table(&OldTable->rd_node, false);
+	ColstoreTable *dst = colstore_get_table(&NewTable->rd_node, true);
+
+	/*
+	 * There are no dead rows and no indexes, so rows are copied as they
+	 * are. The old relfilenode is dropped with the transient relation,
+	 * once swapped.
+	 */
+	*num_tuples = 0;
+	*tups_vacuumed = 0;
+	*tups_recently_dead = 0;
+
+	if (src == NULL)
+		return;
+
+	colstore_copy_rows(src, dst, RelationGetDescr(OldTable));
+	*num_tuples = (double) src->nrows;
+}
+
+static void
+colstore_vacuum(Relation onerel, VacuumParams *params,
+				BufferAccessStrategy bstrategy)
+{
+	ColstoreTable *table = colstore_get_table(&onerel->rd_node, false);
+	int64		nrows = table != NULL ? table->nrows : 0;
+
+	/*
+	 * No dead rows, so there is nothing to clean up. As no transaction IDs
+	 * are stored, the frozen limits can always advance.
+	 */
+	vac_update_relstats(onerel, colstore_nblocks(nrows), (double) nrows, 0,
+						false, RecentXmin, GetOldestMultiXactId(), false);
+}
+
+static bool
+colstore_scan_analyze_next_block(TableScanDesc sscan, BlockNumber blockno,
+								 BufferAccessStrategy bstrategy)
+{
+	return colstore_scan_set_block((ColstoreScanDesc) sscan, blockno);
+}
+
+static bool
+colstore_scan_analyze_next_tuple(TableScanDesc sscan, TransactionId OldestXmin,
+								 double *liverows, double *deadrows,
+								 TupleTableSlot *slot)
+{
+	ColstoreScanDesc scan = (ColstoreScanDesc) sscan;
+
+	if (scan->nextrow >= scan->endrow)
+		return false;
+
+	/* all rows are live */
+	colstore_store_row(scan->table, scan->nextrow, slot);
+	scan->nextrow++;
+	*liverows += 1;
+	return true;
+}
+
+static double
+colstore_index_build_range_scan(Relation tableRelation,
+								Relation indexRelation,
+								IndexInfo *indexInfo,
+								bool allow_sync,
+								bool anyvisible,
+								bool progress,
+								BlockNumber start_blockno,
+								BlockNumber numblocks,
+								IndexBuildCallback callback,
+								void *callback_state,
+								TableScanDesc scan)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("colstore_am does not support indexes")));
+	return 0;					/* keep compiler quiet */
+}
+
+static void
+colstore_index_validate_scan(Relation tableRelation,
+							 Relation indexRelation,
+							 IndexInfo *indexInfo,
+							 Snapshot snapshot,
+							 ValidateIndexState *state)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("colstore_am does not support indexes")));
+}
+
+
+/* ------------------------------------------------------------------------
+ * Miscellaneous callbacks for the colstore AM
+ * ------------------------------------------------------------------------
+ */
+
+static uint64
+colstore_relation_size(Relation rel, ForkNumber forkNumber)
+{
+	ColstoreTable *table;
+
+	/* only the main fork has virtual blocks */
+	if (forkNumber != MAIN_FORKNUM && forkNumber != InvalidForkNumber)
+		return 0;
+
+	table = colstore_get_table(&rel->rd_node, false);
+	if (table == NULL)
+		return 0;
+
+	return (uint64) colstore_nblocks(table->nrows) * BLCKSZ;
+}
+
+/*
+ * Check to see whether the table needs a TOAST table.
+ */
+static bool
+colstore_relation_needs_toast_table(Relation rel)
+{
+	/* values are stored detoasted in memory */
+	return false;
+}
+
+
+/* ------------------------------------------------------------------------
+ * Planner related callbacks for the colstore AM
+ * ------------------------------------------------------------------------
+ */
+
+static void
+colstore_estimate_rel_size(Relation rel, int32 *attr_widths,
+						   BlockNumber *pages, double *tuples,
+						   double *allvisfrac)
+{
+	ColstoreTable *table = colstore_get_table(&rel->rd_node, false);
+
+	/* the number of rows is known exactly, widths are left to the planner */
+	*tuples = table != NULL ? (double) table->nrows : 0;
+	*pages = table != NULL ? colstore_nblocks(table->nrows) : 0;
+	*allvisfrac = 0;
+}
+
+
+/* ------------------------------------------------------------------------
+ * Executor related callbacks for the colstore AM
+ * ------------------------------------------------------------------------
+ */
+
+static bool
+colstore_scan_bitmap_next_block(TableScanDesc scan,
+								TBMIterateResult *tbmres)
+{
+	/* no indexes, so no bitmaps */
+	return false;
+}
+
+static bool
+colstore_scan_bitmap_next_tuple(TableScanDesc scan,
+								TBMIterateResult *tbmres,
+								TupleTableSlot *slot)
+{
+	/* no indexes, so no bitmaps */
+	return false;
+}
+
+static bool
+colstore_scan_sample_next_block(TableScanDesc sscan,
+								SampleScanState *scanstate)
+{
+	ColstoreScanDesc scan = (ColstoreScanDesc) sscan;
+	TsmRoutine *tsm = scanstate->tsmroutine;
+	BlockNumber nblocks = colstore_nblocks(scan->nrows);
+	BlockNumber blockno;
+
+	if (nblocks == 0)
+		return false;
+
+	if (tsm->NextSampleBlock)
+		blockno = tsm->NextSampleBlock(scanstate, nblocks);
+	else if (!BlockNumberIsValid(scan->curblock))
+		blockno = 0;
+	else if (scan->curblock + 1 < nblocks)
+		blockno = scan->curblock + 1;
+	else
+		blockno = InvalidBlockNumber;
+
+	if (!BlockNumberIsValid(blockno))
+		return false;
+
+	return colstore_scan_set_block(scan, blockno);
+}
+
+static bool
+colstore_scan_sample_next_tuple(TableScanDesc sscan,
+								SampleScanState *scanstate,
+								TupleTableSlot *slot)
+{
+	ColstoreScanDesc scan = (ColstoreScanDesc) sscan;
+	TsmRoutine *tsm = scanstate->tsmroutine;
+	int64		firstrow = (int64) scan->curblock * COLSTORE_ROWS_PER_BLOCK;
+	OffsetNumber maxoffset = (OffsetNumber) (scan->endrow - firstrow);
+	OffsetNumber offset;
+
+	offset = tsm->NextSampleTuple(scanstate, scan->curblock, maxoffset);
+	if (!OffsetNumberIsValid(offset))
+	{
+		ExecClearTuple(slot);
+		return false;
+	}
+
+	colstore_store_row(scan->table, firstrow + offset - 1, slot);
+	return true;
+}
+
+
+/* ------------------------------------------------------------------------
+ * SQL functions for the colstore AM
+ * ------------------------------------------------------------------------
+ */
+
+/*
+ * colstore_am_memory
+ *
+ * Return the memory allocated for the data of a relation.
+ */
+Datum
+colstore_am_memory(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	Relation	rel;
+	ColstoreTable *table;
+	int64		size = 0;
+
+	rel = relation_open(relid, AccessShareLock);
+
+	if (rel->rd_tableam != &colstore_methods)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("relation \"%s\" does not use colstore_am",
+						RelationGetRelationName(rel))));
+
+	table = colstore_get_table(&rel->rd_node, false);
+	if (table != NULL)
+		size = (int64) MemoryContextMemAllocated(table->cxt, true);
+
+	relation_close(rel, AccessShareLock);
+
+	PG_RETURN_INT64(size);
+}
+
+
+/* ------------------------------------------------------------------------
+ * Definition of the colstore table access method.
+ * ------------------------------------------------------------------------
+ */
+
+static const TableAmRoutine colstore_methods = {
+	.type = T_TableAmRoutine,
+
+	.slot_callbacks = colstore_slot_callbacks,
+
+	.scan_begin = colstore_scan_begin,
+	.scan_end = colstore_scan_end,
+	.scan_rescan = colstore_scan_rescan,
+	.scan_getnextslot = colstore_scan_getnextslot,
+
+	/* these are common helper functions */
+	.parallelscan_estimate = table_block_parallelscan_estimate,
+	.parallelscan_initialize = table_block_parallelscan_initialize,
+	.parallelscan_reinitialize = table_block_parallelscan_reinitialize,
+
+	.index_fetch_begin = colstore_index_fetch_begin,
+	.index_fetch_reset = colstore_index_fetch_reset,
+	.index_fetch_end = colstore_index_fetch_end,
+	.index_fetch_tuple = colstore_index_fetch_tuple,
+
+	.tuple_insert = colstore_tuple_insert,
+	.tuple_insert_speculative = colstore_tuple_insert_speculative,
+	.tuple_complete_speculative = colstore_tuple_complete_speculative,
+	.multi_insert = colstore_multi_insert,
+	.tuple_delete = colstore_tuple_delete,
+	.tuple_update = colstore_tuple_update,
+	.tuple_lock = colstore_tuple_lock,
+	.finish_bulk_insert = colstore_finish_bulk_insert,
+
+	.tuple_fetch_row_version = colstore_fetch_row_version,
+	.tuple_get_latest_tid = colstore_get_latest_tid,
+	.tuple_tid_valid = colstore_tuple_tid_valid,
+	.tuple_satisfies_snapshot = colstore_tuple_satisfies_snapshot,
+	.compute_xid_horizon_for_tuples = colstore_compute_xid_horizon_for_tuples,
+
+	.relation_set_new_filenode = colstore_relation_set_new_filenode,
+	.relation_nontransactional_truncate = colstore_relation_nontransactional_truncate,
+	.relation_copy_data = colstore_copy_data,
+	.relation_copy_for_cluster = colstore_copy_for_cluster,
+	.relation_vacuum = colstore_vacuum,
+	.scan_analyze_next_block = colstore_scan_analyze_next_block,
+	.scan_analyze_next_tuple = colstore_scan_analyze_next_tuple,
+	.index_build_range_scan = colstore_index_build_range_scan,
+	.index_validate_scan = colstore_index_validate_scan,
+
+	.relation_size = colstore_relation_size,
+	.relation_needs_toast_table = colstore_relation_needs_toast_table,
+
+	.relation_estimate_size = colstore_estimate_rel_size,
+
+	.scan_bitmap_next_block = colstore_scan_bitmap_next_block,
+	.scan_bitmap_next_tuple = colstore_scan_bitmap_next_tuple,
+	.scan_sample_next_block = colstore_scan_sample_next_block,
+	.scan_sample_next_tuple = colstore_scan_sample_next_tuple
+};
+
+
+Datum
+colstore_am_handler(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(&colstore_methods);
+}
+
+/*
+ * Module load callback
+ */
+void
+_PG_init(void)
+{
+	RegisterXactCallback(colstore_xact_callback, NULL);
+	RegisterSubXactCallback(colstore_subxact_callback, NULL);
+
+	prev_object_access_hook = object_access_hook;
+	object_access_hook = colstore_object_access;
+}
@@ -0,0 +1,71 @@
+CREATE EXTENSION colstore_am;
+-- Only temporary tables are supported
+CREATE TABLE colstore_perm (a int) USING colstore_am;
+CREATE TEMP TABLE colstore_tab (a int, b text, c float8) USING colstore_am;
+SELECT * FROM colstore_tab;
+INSERT INTO colstore_tab VALUES (1, 'one', 1.5), (2, NULL, 2.5);
+INSERT INTO colstore_tab SELECT i, 'val' || i, i / 2.0
+  FROM generate_series(3, 1000) i;
+COPY colstore_tab FROM stdin;
+1001	copy	0.5
+1002	\N	\N
+\.
+SELECT count(*), sum(a), count(b), sum(c) FROM colstore_tab;
+SELECT * FROM colstore_tab WHERE a <= 3 OR a > 1000 ORDER BY a;
+-- Rows inserted by an aborted transaction are discarded
+BEGIN;
+INSERT INTO colstore_tab VALUES (0, 'aborted', 0);
+SELECT count(*) FROM colstore_tab;
+ROLLBACK;
+SELECT count(*) FROM colstore_tab;
+-- Rows inserted by a subtransaction rolled back are discarded, and the
+-- memory of their values is freed
+BEGIN;
+INSERT INTO colstore_tab VALUES (0, 'released', 0);
+SAVEPOINT s1;
+INSERT INTO colstore_tab VALUES (0, 'released', 0);
+RELEASE s1;
+SELECT colstore_am_memory('colstore_tab') AS mem_before \gset
+SAVEPOINT s2;
+INSERT INTO colstore_tab VALUES (0, repeat('x', 100000), 0);
+SELECT count(*) FROM colstore_tab;
+ROLLBACK TO s2;
+SELECT count(*), colstore_am_memory('colstore_tab') = :mem_before AS memory_freed
+  FROM colstore_tab;
+ROLLBACK;
+SELECT count(*) FROM colstore_tab;
+-- Columns added after rows have been inserted
+ALTER TABLE colstore_tab ADD COLUMN d int DEFAULT 42;
+INSERT INTO colstore_tab VALUES (1003, 'new', 3, 7);
+SELECT * FROM colstore_tab WHERE a IN (1, 1003) ORDER BY a;
+-- Toasted values are stored detoasted
+CREATE TEMP TABLE colstore_heap (b text);
+ALTER TABLE colstore_heap ALTER COLUMN b SET STORAGE EXTERNAL;
+INSERT INTO colstore_heap VALUES (repeat('x', 100000));
+INSERT INTO colstore_tab (a, b) SELECT 2000, b FROM colstore_heap;
+DROP TABLE colstore_heap;
+SELECT a, length(b), c, d FROM colstore_tab WHERE a = 2000;
+-- Unsupported operations
+UPDATE colstore_tab SET b = 'none' WHERE a = 1;
+DELETE FROM colstore_tab WHERE a = 1;
+SELECT * FROM colstore_tab WHERE a = 1 FOR UPDATE;
+CREATE INDEX ON colstore_tab (a);
+-- Statistics and sampling
+ANALYZE colstore_tab;
+SELECT relpages, reltuples FROM pg_class WHERE oid = 'colstore_tab'::regclass;
+SELECT count(*) FROM colstore_tab TABLESAMPLE SYSTEM (100);
+-- Rewrites keep all the rows
+VACUUM FULL colstore_tab;
+SELECT count(*), sum(a) FROM colstore_tab;
+ALTER TABLE colstore_tab ALTER COLUMN a TYPE bigint;
+SELECT count(*), sum(a) FROM colstore_tab;
+SELECT colstore_am_memory('colstore_tab') > 0 AS has_memory;
+-- Truncation, rolled back and committed
+BEGIN;
+TRUNCATE colstore_tab;
+SELECT count(*) FROM colstore_tab;
+ROLLBACK;
+SELECT count(*) FROM colstore_tab;
+TRUNCATE colstore_tab;
+SELECT count(*) FROM colstore_tab;
+DROP TABLE colstore_tab;
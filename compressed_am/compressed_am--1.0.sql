@@ -0,0 +1,13 @@
+/* compressed_am/compressed_am--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION compressed_am" to load this file. \quit
+
+CREATE FUNCTION compressed_am_handler(internal)
+RETURNS table_am_handler
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+-- Access method
+CREATE ACCESS METHOD compressed_am TYPE TABLE HANDLER compressed_am_handler;
+COMMENT ON ACCESS METHOD compressed_am IS 'compressed block storage table AM';
@@ -0,0 +1,2178 @@
+/*-------------------------------------------------------------------------
+ *
+ * compressed_am.c
+ *	  compressed block storage table access method code
+ *
+ * Portions Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  compressed_am/compressed_am.c
+ *
+ *
+ * NOTES
+ *	  This file introduces the table access method compressed, built from
+ *	  the blackhole template, for insert-only tables mostly scanned, like
+ *	  archives. Tuples are gathered in memory in fixed-size logical pages,
+ *	  which are compressed when full, or when the inserting transaction
+ *	  commits, and written as chunks spread over as many physical blocks
+ *	  as needed. Each chunk is written and WAL-logged at once with
+ *	  full-page images of its blocks, and is never modified afterwards,
+ *	  except for the transaction ID of its header, frozen by VACUUM.
+ *
+ *	  Chunks read are decompressed into a page cache local to each
+ *	  backend, so as repeated scans of the same chunks only need to read
+ *	  the first block of each chunk, holding its header.
+ *
+ *	  Tuples not yet written get TIDs in a range of block numbers above
+ *	  the ones of real blocks, allowing AFTER triggers to fetch them in
+ *	  the inserting transaction. UPDATE, DELETE, row locks and indexes
+ *	  are not supported.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#ifdef COMPRESSED_AM_LZ4
+#include <lz4.h>
+#endif
+
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "access/detoast.h"
+#include "access/htup_details.h"
+#include "access/multixact.h"
+#include "access/relation.h"
+#include "access/tableam.h"
+#include "access/transam.h"
+#include "access/tsmapi.h"
+#include "access/xact.h"
+#include "access/xloginsert.h"
+#include "catalog/index.h"
+#include "catalog/pg_control.h"
+#include "catalog/storage.h"
+#include "catalog/storage_xlog.h"
+#include "commands/vacuum.h"
+#include "common/pg_lzcompress.h"
+#include "executor/tuptable.h"
+#include "lib/ilist.h"
+#include "nodes/execnodes.h"
+#include "optimizer/plancat.h"
+#include "storage/bufmgr.h"
+#include "storage/bufpage.h"
+#include "storage/lmgr.h"
+#include "storage/procarray.h"
+#include "storage/smgr.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+PG_MODULE_MAGIC;
+
+PG_FUNCTION_INFO_V1(compressed_am_handler);
+
+void		_PG_init(void);
+
+/* Size of the logical pages, before compression */
+#define COMPRESSED_LOGICAL_PAGE_SIZE	(16 * BLCKSZ)
+
+/* Compression methods of chunks */
+#define COMPRESSED_METHOD_NONE		0
+#define COMPRESSED_METHOD_PGLZ		1
+#define COMPRESSED_METHOD_LZ4		2
+
+/*
+ * Header of a chunk, at the beginning of its first block. Only xmin
+ * can change once a chunk has been written.
+ */
+typedef struct CompressedChunkHeaderData
+{
+	TransactionId xmin;			/* inserting transaction, frozen, or invalid
+								 * for chunks of aborted transactions */
+	uint16		ntuples;		/* number of tuples in the logical page */
+	uint8		method;			/* compression method */
+	uint8		nblocks;		/* number of blocks of the chunk */
+	uint32		rawsize;		/* size of the logical page */
+	uint32		storedsize;		/* size of the data stored */
+} CompressedChunkHeaderData;
+
+typedef CompressedChunkHeaderData *CompressedChunkHeader;
+
+/* Special space of the blocks */
+typedef struct CompressedPageOpaqueData
+{
+	uint16		flags;			/* see below */
+	uint16		unused;
+} CompressedPageOpaqueData;
+
+typedef CompressedPageOpaqueData *CompressedPageOpaque;
+
+#define COMPRESSED_CHUNK_START	0x0001	/* first block of a chunk */
+#define COMPRESSED_CHUNK_NEXT	0x0002	/* following block of a chunk */
+
+#define CompressedPageGetOpaque(page) \
+	((CompressedPageOpaque) PageGetSpecialPointer(page))
+
+/* Positions of the data stored in blocks */
+#define COMPRESSED_FIRST_DATA \
+	(MAXALIGN(SizeOfPageHeaderData) + MAXALIGN(sizeof(CompressedChunkHeaderData)))
+#define COMPRESSED_NEXT_DATA	MAXALIGN(SizeOfPageHeaderData)
+#define COMPRESSED_DATA_END \
+	(BLCKSZ - MAXALIGN(sizeof(CompressedPageOpaqueData)))
+
+/*
+ * Header of a tuple in a logical page, followed by a minimal tuple at the
+ * next MAXALIGN'd position. The inserting command is only used for the
+ * visibility of the tuples in their own transaction.
+ */
+typedef struct CompressedTupleHeaderData
+{
+	CommandId	t_cid;
+} CompressedTupleHeaderData;
+
+typedef CompressedTupleHeaderData *CompressedTupleHeader;
+
+#define COMPRESSED_TUPLE_HDRSZ	MAXALIGN(sizeof(CompressedTupleHeaderData))
+
+/* Maximum size of a minimal tuple */
+#define COMPRESSED_MAX_TUPLE_SIZE \
+	(COMPRESSED_LOGICAL_PAGE_SIZE - COMPRESSED_TUPLE_HDRSZ)
+
+/* Maximum number of tuples in a logical page, to keep TIDs sane */
+#define COMPRESSED_MAX_TUPLES	MaxOffsetNumber
+
+/*
+ * TIDs of tuples still pending in memory use block numbers from this one,
+ * one per logical page written by the transaction.
+ */
+#define COMPRESSED_PENDING_BLOCK_BASE	((BlockNumber) 0xFF000000)
+
+/* GUC variables */
+static int	compressed_compression = COMPRESSED_METHOD_PGLZ;
+static int	compressed_cache_size = 16384;	/* kB */
+
+static const struct config_enum_entry compressed_compression_options[] = {
+	{"pglz", COMPRESSED_METHOD_PGLZ, false},
+#ifdef COMPRESSED_AM_LZ4
+	{"lz4", COMPRESSED_METHOD_LZ4, false},
+#endif
+	{NULL, 0, false}
+};
+
+/*
+ * Logical page being filled with the tuples inserted in a relation by the
+ * current transaction. This is allocated in TopTransactionContext.
+ */
+typedef struct CompressedPending
+{
+	Oid			relid;			/* hash key */
+	RelFileNode node;			/* storage the tuples belong to */
+	TransactionId xid;			/* transaction inserting the tuples */
+	int			ntuples;		/* number of tuples */
+	Size		used;			/* bytes used in data */
+	char	   *data;			/* logical page */
+	uint32		generation;		/* number of logical pages flushed */
+	BlockNumber *flushed;		/* chunk of each logical page flushed */
+	uint32		maxflushed;		/* allocated size of flushed */
+} CompressedPending;
+
+static HTAB *compressed_pending = NULL;
+
+/* Cache of decompressed logical pages */
+typedef struct CompressedCacheKey
+{
+	RelFileNode node;
+	BlockNumber blkno;			/* first block of the chunk */
+} CompressedCacheKey;
+
+typedef struct CompressedCacheEntry
+{
+	CompressedCacheKey key;		/* hash key */
+	Oid			relid;			/* relation, for invalidations */
+	int			pincount;		/* number of scans using the entry */
+	bool		stale;			/* to remove once not pinned anymore */
+	uint32		rawsize;		/* size of data */
+	char	   *data;			/* decompressed logical page */
+	dlist_node	lru_node;		/* position in LRU list, recent first */
+} CompressedCacheEntry;
+
+static MemoryContext compressed_cache_cxt = NULL;
+static HTAB *compressed_cache = NULL;
+static dlist_head compressed_cache_lru;
+static Size compressed_cache_used = 0;
+
+/* Visibility of a chunk */
+typedef enum CompressedChunkVisibility
+{
+	COMPRESSED_CHUNK_INVISIBLE,
+	COMPRESSED_CHUNK_VISIBLE,
+	COMPRESSED_CHUNK_CHECK_CID	/* current transaction, check each tuple */
+} CompressedChunkVisibility;
+
+/* Base structures for scans */
+typedef struct CompressedScanDescData
+{
+	TableScanDescData rs_base;	/* AM independent part of the descriptor */
+
+	BlockNumber nblocks;		/* number of blocks at the start of the scan */
+	BlockNumber curblock;		/* first block of the current chunk */
+	BlockNumber nextblock;		/* next block of serial scans */
+	BufferAccessStrategy strategy;	/* access strategy for reads */
+	bool		started;		/* parallel scan started? */
+
+	/* current chunk, pinned in the cache */
+	CompressedCacheEntry *entry;
+	CompressedChunkVisibility visibility;
+	int			ntuples;
+	int			curtuple;		/* next tuple to check */
+	uint32		offsets[COMPRESSED_MAX_TUPLES];
+
+	int			ndead;			/* dead tuples of the block, for ANALYZE */
+} CompressedScanDescData;
+typedef struct CompressedScanDescData *CompressedScanDesc;
+
+static const TableAmRoutine compressed_methods;
+
+
+/* ------------------------------------------------------------------------
+ * Visibility of chunks
+ * ------------------------------------------------------------------------
+ */
+
+/*
+ * Check if the tuples of a chunk are visible to a snapshot, based on the
+ * transaction that inserted them. All the tuples of a chunk share the same
+ * transaction, so only the tuples of the current transaction need to be
+ * checked one by one.
+ */
+static CompressedChunkVisibility
+compressed_chunk_visibility(TransactionId xmin, Snapshot snapshot)
+{
+	/* chunk of an aborted transaction, marked as such by VACUUM */
+	if (!TransactionIdIsValid(xmin))
+		return COMPRESSED_CHUNK_INVISIBLE;
+
+	if (TransactionIdEquals(xmin, FrozenTransactionId) ||
+		snapshot->snapshot_type == SNAPSHOT_ANY)
+		return COMPRESSED_CHUNK_VISIBLE;
+
+	if (TransactionIdIsCurrentTransactionId(xmin))
+		return snapshot->snapshot_type == SNAPSHOT_MVCC ?
+			COMPRESSED_CHUNK_CHECK_CID : COMPRESSED_CHUNK_VISIBLE;
+
+	if (snapshot->snapshot_type == SNAPSHOT_MVCC)
+	{
+		if (XidInMVCCSnapshot(xmin, snapshot))
+			return COMPRESSED_CHUNK_INVISIBLE;
+	}
+	else if (TransactionIdIsInProgress(xmin))
+		return COMPRESSED_CHUNK_INVISIBLE;
+
+	return TransactionIdDidCommit(xmin) ?
+		COMPRESSED_CHUNK_VISIBLE : COMPRESSED_CHUNK_INVISIBLE;
+}
+
+static bool
+compressed_tuple_visible(CompressedTupleHeader hdr,
+						 CompressedChunkVisibility visibility,
+						 Snapshot snapshot)
+{
+	if (visibility == COMPRESSED_CHUNK_CHECK_CID)
+		return hdr->t_cid < snapshot->curcid;
+	return visibility == COMPRESSED_CHUNK_VISIBLE;
+}
+
+/*
+ * Build the positions of the tuples of a logical page.
+ */
+static void
+compressed_page_offsets(const char *data, uint32 rawsize, int ntuples,
+						uint32 *offsets)
+{
+	uint32		pos = 0;
+	int			i;
+
+	for (i = 0; i < ntuples; i++)
+	{
+		MinimalTuple tuple;
+
+		if (pos + COMPRESSED_TUPLE_HDRSZ + SizeofMinimalTupleHeader > rawsize)
+			elog(ERROR, "tuple %d of compressed logical page goes beyond its end",
+				 i);
+
+		tuple = (MinimalTuple) (data + pos + COMPRESSED_TUPLE_HDRSZ);
+		offsets[i] = pos;
+		pos += COMPRESSED_TUPLE_HDRSZ + MAXALIGN(tuple->t_len);
+	}
+}
+
+
+/* ------------------------------------------------------------------------
+ * Cache of decompressed logical pages
+ * ------------------------------------------------------------------------
+ */
+
+static void
+compressed_cache_remove(CompressedCacheEntry *entry)
+{
+	dlist_delete(&entry->lru_node);
+	compressed_cache_used -= entry->rawsize;
+	pfree(entry->data);
+	hash_search(compressed_cache, &entry->key, HASH_REMOVE, NULL);
+}
+
+/*
+ * Evict the least recently used entries not pinned, until the cache fits
+ * in compressed_am.cache_size.
+ */
+static void
+compressed_cache_evict(void)
+{
+	Size		limit = (Size) compressed_cache_size * 1024;
+	dlist_node *node;
+
+	node = dlist_is_empty(&compressed_cache_lru) ? NULL :
+		dlist_tail_node(&compressed_cache_lru);
+	while (node != NULL && compressed_cache_used > limit)
+	{
+		CompressedCacheEntry *entry;
+		dlist_node *prev;
+
+		entry = dlist_container(CompressedCacheEntry, lru_node, node);
+		prev = dlist_has_prev(&compressed_cache_lru, node) ?
+			dlist_prev_node(&compressed_cache_lru, node) : NULL;
+
+		if (entry->pincount == 0)
+			compressed_cache_remove(entry);
+		node = prev;
+	}
+}
+
+static void
+compressed_cache_unpin(CompressedCacheEntry *entry)
+{
+	Assert(entry->pincount > 0);
+	entry->pincount--;
+
+	if (entry->pincount == 0 && entry->stale)
+		compressed_cache_remove(entry);
+	else
+		compressed_cache_evict();
+}
+
+/*
+ * Forget the pins of all the entries, at the end of a transaction. Scans
+ * interrupted by an error do not release theirs.
+ */
+static void
+compressed_cache_reset_pins(void)
+{
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &compressed_cache_lru)
+	{
+		CompressedCacheEntry *entry;
+
+		entry = dlist_container(CompressedCacheEntry, lru_node, iter.cur);
+		entry->pincount = 0;
+		if (entry->stale)
+			compressed_cache_remove(entry);
+	}
+	compressed_cache_evict();
+}
+
+/*
+ * Remove the entries of a relation, or of all relations if relid is
+ * InvalidOid, as its storage may have been removed and its relfilenode
+ * reused.
+ */
+static void
+compressed_cache_invalidate(Oid relid, const RelFileNode *node)
+{
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &compressed_cache_lru)
+	{
+		CompressedCacheEntry *entry;
+
+		entry = dlist_container(CompressedCacheEntry, lru_node, iter.cur);
+		if (OidIsValid(relid) && entry->relid != relid)
+			continue;
+		if (node != NULL && !RelFileNodeEquals(entry->key.node, *node))
+			continue;
+
+		if (entry->pincount > 0)
+			entry->stale = true;
+		else
+			compressed_cache_remove(entry);
+	}
+}
+
+static void
+compressed_relcache_callback(Datum arg, Oid relid)
+{
+	compressed_cache_invalidate(relid, NULL);
+}
+
+
+/* ------------------------------------------------------------------------
+ * Reads and writes of chunks
+ * ------------------------------------------------------------------------
+ */
+
+/* Number of blocks needed to store a chunk */
+static int
+compressed_chunk_nblocks(uint32 storedsize)
+{
+	Size		first = COMPRESSED_DATA_END - COMPRESSED_FIRST_DATA;
+	Size		next = COMPRESSED_DATA_END - COMPRESSED_NEXT_DATA;
+
+	if (storedsize <= first)
+		return 1;
+	return 1 + (storedsize - first + next - 1) / next;
+}
+
+/*
+ * Write a chunk at the end of a relation, WAL-logging all its blocks with
+ * full-page images in a single record. Returns its first block.
+ */
+static BlockNumber
+compressed_store_chunk(Relation rel, CompressedChunkHeader hdr,
+					   const char *data)
+{
+	Buffer		buffers[XLR_MAX_BLOCK_ID];
+	bool		needwal = RelationNeedsWAL(rel);
+	BlockNumber blkno;
+	uint32		pos = 0;
+	int			nblocks = hdr->nblocks;
+	int			i;
+
+	Assert(nblocks > 0 && nblocks <= XLR_MAX_BLOCK_ID);
+
+	if (needwal)
+		XLogEnsureRecordSpace(nblocks - 1, 0);
+
+	/* extend the relation with consecutive blocks */
+	LockRelationForExtension(rel, ExclusiveLock);
+	for (i = 0; i < nblocks; i++)
+		buffers[i] = ReadBufferExtended(rel, MAIN_FORKNUM, P_NEW,
+										RBM_ZERO_AND_LOCK, NULL);
+	UnlockRelationForExtension(rel, ExclusiveLock);
+
+	blkno = BufferGetBlockNumber(buffers[0]);
+
+	START_CRIT_SECTION();
+
+	for (i = 0; i < nblocks; i++)
+	{
+		Page		page = BufferGetPage(buffers[i]);
+		PageHeader	phdr = (PageHeader) page;
+		Size		start;
+		Size		len;
+
+		Assert(BufferGetBlockNumber(buffers[i]) == blkno + i);
+
+		PageInit(page, BLCKSZ, sizeof(CompressedPageOpaqueData));
+		if (i == 0)
+		{
+			memcpy((char *) page + MAXALIGN(SizeOfPageHeaderData), hdr,
+				   sizeof(CompressedChunkHeaderData));
+			start = COMPRESSED_FIRST_DATA;
+			CompressedPageGetOpaque(page)->flags = COMPRESSED_CHUNK_START;
+		}
+		else
+		{
+			start = COMPRESSED_NEXT_DATA;
+			CompressedPageGetOpaque(page)->flags = COMPRESSED_CHUNK_NEXT;
+		}
+
+		len = Min(COMPRESSED_DATA_END - start, hdr->storedsize - pos);
+		memcpy((char *) page + start, data + pos, len);
+		pos += len;
+
+		/* the hole after the data is left out of full-page images */
+		phdr->pd_lower = start + len;
+		MarkBufferDirty(buffers[i]);
+	}
+
+	if (needwal)
+	{
+		XLogRecPtr	recptr;
+
+		XLogBeginInsert();
+		for (i = 0; i < nblocks; i++)
+			XLogRegisterBuffer(i, buffers[i],
+							   REGBUF_FORCE_IMAGE | REGBUF_STANDARD);
+		recptr = XLogInsert(RM_XLOG_ID, XLOG_FPI);
+
+		for (i = 0; i < nblocks; i++)
+			PageSetLSN(BufferGetPage(buffers[i]), recptr);
+	}
+
+	END_CRIT_SECTION();
+
+	for (i = 0; i < nblocks; i++)
+		UnlockReleaseBuffer(buffers[i]);
+
+	return blkno;
+}
+
+/*
+ * Compress a logical page and write it as a new chunk. The page is stored
+ * as-is if it does not compress.
+ */
+static BlockNumber
+compressed_write_chunk(Relation rel, TransactionId xmin, int ntuples,
+					   const char *raw, uint32 rawsize)
+{
+	CompressedChunkHeaderData hdr;
+	char	   *compressed = NULL;
+	int32		len = -1;
+	BlockNumber blkno;
+
+	switch (compressed_compression)
+	{
+		case COMPRESSED_METHOD_PGLZ:
+			compressed = palloc(PGLZ_MAX_OUTPUT(rawsize));
+			len = pglz_compress(raw, rawsize, compressed,
+								PGLZ_strategy_default);
+			break;
+#ifdef COMPRESSED_AM_LZ4
+		case COMPRESSED_METHOD_LZ4:
+			compressed = palloc(LZ4_compressBound(rawsize));
+			len = LZ4_compress_default(raw, compressed, rawsize,
+									   LZ4_compressBound(rawsize));
+			if (len <= 0)
+				len = -1;
+			break;
+#endif
+		default:
+			elog(ERROR, "invalid compression method %d",
+				 compressed_compression);
+	}
+
+	hdr.xmin = xmin;
+	hdr.ntuples = ntuples;
+	hdr.rawsize = rawsize;
+	if (len >= 0 && (uint32) len < rawsize)
+	{
+		hdr.method = compressed_compression;
+		hdr.storedsize = len;
+	}
+	else
+	{
+		hdr.method = COMPRESSED_METHOD_NONE;
+		hdr.storedsize = rawsize;
+	}
+	hdr.nblocks = compressed_chunk_nblocks(hdr.storedsize);
+
+	blkno = compressed_store_chunk(rel, &hdr,
+								   hdr.method == COMPRESSED_METHOD_NONE ?
+								   raw : compressed);
+
+	if (compressed != NULL)
+		pfree(compressed);
+	return blkno;
+}
+
+/*
+ * Read the header of the chunk starting at a block. Returns false if the
+ * block does not start a chunk.
+ */
+static bool
+compressed_read_header(Relation rel, BlockNumber blkno,
+					   BufferAccessStrategy strategy,
+					   CompressedChunkHeader hdr)
+{
+	Buffer		buffer;
+	Page		page;
+	bool		found = false;
+
+	buffer = ReadBufferExtended(rel, MAIN_FORKNUM, blkno, RBM_NORMAL,
+								strategy);
+	LockBuffer(buffer, BUFFER_LOCK_SHARE);
+	page = BufferGetPage(buffer);
+
+	if (!PageIsNew(page) &&
+		(CompressedPageGetOpaque(page)->flags & COMPRESSED_CHUNK_START) != 0)
+	{
+		memcpy(hdr, (char *) page + MAXALIGN(SizeOfPageHeaderData),
+			   sizeof(CompressedChunkHeaderData));
+		found = true;
+	}
+
+	UnlockReleaseBuffer(buffer);
+
+	if (found &&
+		(hdr->nblocks == 0 || hdr->nblocks > XLR_MAX_BLOCK_ID ||
+		 hdr->rawsize > COMPRESSED_LOGICAL_PAGE_SIZE ||
+		 hdr->ntuples > COMPRESSED_MAX_TUPLES ||
+		 hdr->nblocks != compressed_chunk_nblocks(hdr->storedsize)))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid chunk header in block %u of relation \"%s\"",
+						blkno, RelationGetRelationName(rel))));
+
+	return found;
+}
+
+/*
+ * Read the data stored in the blocks of a chunk.
+ */
+static char *
+compressed_read_stored(Relation rel, BlockNumber blkno,
+					   CompressedChunkHeader hdr,
+					   BufferAccessStrategy strategy)
+{
+	char	   *stored = palloc(hdr->storedsize);
+	uint32		pos = 0;
+	int			i;
+
+	for (i = 0; i < hdr->nblocks; i++)
+	{
+		Buffer		buffer;
+		Page		page;
+		Size		start = (i == 0) ? COMPRESSED_FIRST_DATA : COMPRESSED_NEXT_DATA;
+		Size		len;
+
+		buffer = ReadBufferExtended(rel, MAIN_FORKNUM, blkno + i, RBM_NORMAL,
+									strategy);
+		LockBuffer(buffer, BUFFER_LOCK_SHARE);
+		page = BufferGetPage(buffer);
+
+		if (PageIsNew(page) ||
+			CompressedPageGetOpaque(page)->flags !=
+			(i == 0 ? COMPRESSED_CHUNK_START : COMPRESSED_CHUNK_NEXT))
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_CORRUPTED),
+					 errmsg("unexpected block %u in chunk of relation \"%s\"",
+							blkno + i, RelationGetRelationName(rel))));
+
+		len = Min(COMPRESSED_DATA_END - start, hdr->storedsize - pos);
+		memcpy(stored + pos, (char *) page + start, len);
+		pos += len;
+
+		UnlockReleaseBuffer(buffer);
+	}
+
+	return stored;
+}
+
+/*
+ * Get the logical page of a chunk from the cache, reading and decompressing
+ * it if not cached. The entry returned is pinned.
+ */
+static CompressedCacheEntry *
+compressed_load_chunk(Relation rel, BlockNumber blkno,
+					  CompressedChunkHeader hdr,
+					  BufferAccessStrategy strategy)
+{
+	CompressedCacheKey key;
+	CompressedCacheEntry *entry;
+	char	   *stored;
+	char	   *data;
+	bool		found;
+
+	MemSet(&key, 0, sizeof(key));
+	key.node = rel->rd_node;
+	key.blkno = blkno;
+
+	entry = (CompressedCacheEntry *) hash_search(compressed_cache, &key,
+												 HASH_FIND, NULL);
+	if (entry != NULL)
+	{
+		dlist_move_head(&compressed_cache_lru, &entry->lru_node);
+		entry->pincount++;
+		return entry;
+	}
+
+	stored = compressed_read_stored(rel, blkno, hdr, strategy);
+	data = MemoryContextAlloc(compressed_cache_cxt, Max(hdr->rawsize, 1));
+
+	switch (hdr->method)
+	{
+		case COMPRESSED_METHOD_NONE:
+			memcpy(data, stored, hdr->rawsize);
+			break;
+		case COMPRESSED_METHOD_PGLZ:
+			if (pglz_decompress(stored, hdr->storedsize, data,
+								hdr->rawsize, true) != hdr->rawsize)
+				ereport(ERROR,
+						(errcode(ERRCODE_DATA_CORRUPTED),
+						 errmsg("could not decompress chunk at block %u of relation \"%s\"",
+								blkno, RelationGetRelationName(rel))));
+			break;
+		case COMPRESSED_METHOD_LZ4:
+#ifdef COMPRESSED_AM_LZ4
+			if (LZ4_decompress_safe(stored, data, hdr->storedsize,
+									hdr->rawsize) != hdr->rawsize)
+				ereport(ERROR,
+						(errcode(ERRCODE_DATA_CORRUPTED),
+						 errmsg("could not decompress chunk at block %u of relation \"%s\"",
+								blkno, RelationGetRelationName(rel))));
+#else
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("compression method lz4 not supported"),
+					 errdetail("This build does not support compression with lz4.")));
+#endif
+			break;
+		default:
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_CORRUPTED),
+					 errmsg("invalid compression method %d in chunk at block %u of relation \"%s\"",
+							hdr->method, blkno,
+							RelationGetRelationName(rel))));
+	}
+	pfree(stored);
+
+	entry = (CompressedCacheEntry *) hash_search(compressed_cache, &key,
+												 HASH_ENTER, &found);
+	Assert(!found);
+	entry->relid = RelationGetRelid(rel);
+	entry->pincount = 1;
+	entry->stale = false;
+	entry->rawsize = hdr->rawsize;
+	entry->data = data;
+	dlist_push_head(&compressed_cache_lru, &entry->lru_node);
+	compressed_cache_used += entry->rawsize;
+
+	compressed_cache_evict();
+	return entry;
+}
+
+
+/* ------------------------------------------------------------------------
+ * Logical pages pending in memory
+ * ------------------------------------------------------------------------
+ */
+
+/*
+ * Start a new logical page for a relation, remembering where the previous
+ * one has been written for its TIDs, or InvalidBlockNumber if discarded.
+ */
+static void
+compressed_close_pending(CompressedPending *pending, BlockNumber blkno)
+{
+	if (pending->ntuples == 0)
+		return;
+
+	if (pending->generation >= pending->maxflushed)
+	{
+		pending->maxflushed *= 2;
+		pending->flushed = (BlockNumber *)
+			repalloc(pending->flushed,
+					 sizeof(BlockNumber) * pending->maxflushed);
+	}
+	pending->flushed[pending->generation] = blkno;
+
+	pending->generation++;
+	pending->ntuples = 0;
+	pending->used = 0;
+}
+
+/*
+ * Get the logical page being filled for a relation, creating it if
+ * requested. The tuples of a storage replaced by TRUNCATE are discarded.
+ */
+static CompressedPending *
+compressed_get_pending(Relation rel, bool create)
+{
+	Oid			relid = RelationGetRelid(rel);
+	CompressedPending *pending;
+	bool		found;
+
+	if (compressed_pending == NULL)
+	{
+		HASHCTL		ctl;
+
+		if (!create)
+			return NULL;
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(CompressedPending);
+		ctl.hcxt = TopTransactionContext;
+		compressed_pending = hash_create("compressed_am pending pages",
+										 16, &ctl,
+										 HASH_ELEM | HASH_BLOBS |
+										 HASH_CONTEXT);
+	}
+
+	pending = (CompressedPending *) hash_search(compressed_pending, &relid,
+												create ? HASH_ENTER : HASH_FIND,
+												&found);
+	if (pending == NULL)
+		return NULL;
+
+	if (!found)
+	{
+		pending->node = rel->rd_node;
+		pending->xid = InvalidTransactionId;
+		pending->ntuples = 0;
+		pending->used = 0;
+		pending->data = MemoryContextAlloc(TopTransactionContext,
+										   COMPRESSED_LOGICAL_PAGE_SIZE);
+		pending->generation = 0;
+		pending->maxflushed = 16;
+		pending->flushed = (BlockNumber *)
+			MemoryContextAlloc(TopTransactionContext,
+							   sizeof(BlockNumber) * pending->maxflushed);
+	}
+	else if (!RelFileNodeEquals(pending->node, rel->rd_node))
+	{
+		/* storage replaced, so its tuples are gone */
+		pending->node = rel->rd_node;
+		compressed_close_pending(pending, InvalidBlockNumber);
+	}
+
+	return pending;
+}
+
+/*
+ * Close the logical page being filled for a relation, writing it unless
+ * its transaction has been rolled back.
+ */
+static void
+compressed_flush_pending(Relation rel, CompressedPending *pending)
+{
+	BlockNumber blkno = InvalidBlockNumber;
+
+	if (pending->ntuples == 0)
+		return;
+
+	if (pending->generation >=
+		MaxBlockNumber - COMPRESSED_PENDING_BLOCK_BASE)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("too many logical pages written in a single transaction for relation \"%s\"",
+						RelationGetRelationName(rel))));
+
+	if (TransactionIdIsCurrentTransactionId(pending->xid))
+		blkno = compressed_write_chunk(rel, pending->xid, pending->ntuples,
+									   pending->data, pending->used);
+
+	compressed_close_pending(pending, blkno);
+}
+
+/*
+ * Write the logical pages pending for all relations, when committing.
+ */
+static void
+compressed_flush_all_pending(void)
+{
+	HASH_SEQ_STATUS status;
+	CompressedPending *pending;
+
+	if (compressed_pending == NULL)
+		return;
+
+	hash_seq_init(&status, compressed_pending);
+	while ((pending = (CompressedPending *) hash_seq_search(&status)) != NULL)
+	{
+		Relation	rel;
+
+		if (pending->ntuples == 0)
+			continue;
+
+		/* the relation may have been dropped by this transaction */
+		rel = try_relation_open(pending->relid, NoLock);
+		if (rel == NULL)
+			continue;
+
+		if (RelFileNodeEquals(pending->node, rel->rd_node))
+			compressed_flush_pending(rel, pending);
+		relation_close(rel, NoLock);
+	}
+}
+
+static void
+compressed_xact_callback(XactEvent event, void *arg)
+{
+	switch (event)
+	{
+		case XACT_EVENT_PRE_COMMIT:
+		case XACT_EVENT_PRE_PREPARE:
+			compressed_flush_all_pending();
+			break;
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PREPARE:
+			/* memory is released with TopTransactionContext */
+			compressed_pending = NULL;
+			compressed_cache_reset_pins();
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Build the tuple stored for the contents of a slot. Values stored
+ * externally are detoasted, as the relation has no TOAST table and these
+ * values may go away with the relation they come from.
+ */
+static MinimalTuple
+compressed_form_tuple(TupleTableSlot *slot, bool *shouldfree)
+{
+	TupleDesc	tupdesc = slot->tts_tupleDescriptor;
+	Datum	   *values = NULL;
+	MinimalTuple tuple;
+	int			attno;
+
+	slot_getallattrs(slot);
+
+	for (attno = 0; attno < tupdesc->natts; attno++)
+	{
+		Datum		value = slot->tts_values[attno];
+
+		if (slot->tts_isnull[attno] ||
+			TupleDescAttr(tupdesc, attno)->attlen != -1 ||
+			!VARATT_IS_EXTERNAL(DatumGetPointer(value)))
+			continue;
+
+		if (values == NULL)
+		{
+			values = (Datum *) palloc(sizeof(Datum) * tupdesc->natts);
+			memcpy(values, slot->tts_values, sizeof(Datum) * tupdesc->natts);
+		}
+		values[attno] = PointerGetDatum(detoast_external_attr((struct varlena *)
+															  DatumGetPointer(value)));
+	}
+
+	/* Nothing to detoast, use the tuple of the slot */
+	if (values == NULL)
+		return ExecFetchSlotMinimalTuple(slot, shouldfree);
+
+	tuple = heap_form_minimal_tuple(tupdesc, values, slot->tts_isnull);
+	*shouldfree = true;
+
+	for (attno = 0; attno < tupdesc->natts; attno++)
+	{
+		if (values[attno] != slot->tts_values[attno])
+			pfree(DatumGetPointer(values[attno]));
+	}
+	pfree(values);
+
+	return tuple;
+}
+
+/*
+ * Insert the contents of slots in the logical page pending for the
+ * relation, writing it each time it gets full.
+ */
+static void
+compressed_insert_slots(Relation relation, TupleTableSlot **slots,
+						int ntuples, CommandId cid)
+{
+	TransactionId xid = GetCurrentTransactionId();
+	CompressedPending *pending = compressed_get_pending(relation, true);
+	int			i;
+
+	for (i = 0; i < ntuples; i++)
+	{
+		TupleTableSlot *slot = slots[i];
+		MinimalTuple tuple;
+		CompressedTupleHeader hdr;
+		bool		shouldfree;
+		Size		len;
+
+		tuple = compressed_form_tuple(slot, &shouldfree);
+		if (tuple->t_len > COMPRESSED_MAX_TUPLE_SIZE)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+					 errmsg("row is too big: size %zu, maximum size %zu",
+							(Size) tuple->t_len,
+							(Size) COMPRESSED_MAX_TUPLE_SIZE)));
+		len = COMPRESSED_TUPLE_HDRSZ + MAXALIGN(tuple->t_len);
+
+		/* a logical page only holds tuples of a single transaction */
+		if (pending->ntuples > 0 &&
+			(pending->used + len > COMPRESSED_LOGICAL_PAGE_SIZE ||
+			 pending->ntuples >= COMPRESSED_MAX_TUPLES ||
+			 !TransactionIdEquals(pending->xid, xid)))
+			compressed_flush_pending(relation, pending);
+
+		pending->xid = xid;
+		hdr = (CompressedTupleHeader) (pending->data + pending->used);
+		hdr->t_cid = cid;
+		memcpy((char *) hdr + COMPRESSED_TUPLE_HDRSZ, tuple, tuple->t_len);
+		pending->used += len;
+		pending->ntuples++;
+
+		slot->tts_tableOid = RelationGetRelid(relation);
+		ItemPointerSet(&slot->tts_tid,
+					   COMPRESSED_PENDING_BLOCK_BASE + pending->generation,
+					   pending->ntuples);
+
+		if (shouldfree)
+			pfree(tuple);
+	}
+}
+
+
+/* ------------------------------------------------------------------------
+ * Slot related callbacks for compressed AM
+ * ------------------------------------------------------------------------
+ */
+
+static const TupleTableSlotOps *
+compressed_slot_callbacks(Relation relation)
+{
+	/* tuples are stored as minimal tuples */
+	return &TTSOpsMinimalTuple;
+}
+
+
+/* ------------------------------------------------------------------------
+ * Table Scan Callbacks for compressed AM
+ * ------------------------------------------------------------------------
+ */
+
+static void
+compressed_scan_release_chunk(CompressedScanDesc scan)
+{
+	if (scan->entry != NULL)
+		compressed_cache_unpin(scan->entry);
+	scan->entry = NULL;
+	scan->ntuples = 0;
+	scan->curtuple = 0;
+	scan->ndead = 0;
+}
+
+/*
+ * Load the chunk starting at a block, if its tuples can be visible. Returns
+ * false if the block does not start a chunk.
+ */
+static bool
+compressed_scan_load_chunk(CompressedScanDesc scan, BlockNumber blkno)
+{
+	Relation	rel = scan->rs_base.rs_rd;
+	CompressedChunkHeaderData hdr;
+
+	compressed_scan_release_chunk(scan);
+	scan->curblock = blkno;
+
+	if (!compressed_read_header(rel, blkno, scan->strategy, &hdr))
+		return false;
+
+	scan->nextblock = blkno + hdr.nblocks;
+	scan->visibility = compressed_chunk_visibility(hdr.xmin,
+												   scan->rs_base.rs_snapshot);
+	if (scan->visibility == COMPRESSED_CHUNK_INVISIBLE)
+		return true;
+
+	scan->entry = compressed_load_chunk(rel, blkno, &hdr, scan->strategy);
+	scan->ntuples = hdr.ntuples;
+	compressed_page_offsets(scan->entry->data, scan->entry->rawsize,
+							scan->ntuples, scan->offsets);
+	return true;
+}
+
+/*
+ * Move to the next chunk of a sequential scan. Returns false if there are
+ * no more blocks. Parallel scans get blocks one at a time, skipping the
+ * ones not starting a chunk.
+ */
+static bool
+compressed_scan_next_chunk(CompressedScanDesc scan)
+{
+	for (;;)
+	{
+		BlockNumber blkno;
+
+		if (scan->rs_base.rs_parallel != NULL)
+		{
+			ParallelBlockTableScanDesc pbscan =
+			(ParallelBlockTableScanDesc) scan->rs_base.rs_parallel;
+
+			if (!scan->started)
+			{
+				table_block_parallelscan_startblock_init(scan->rs_base.rs_rd,
+														 pbscan);
+				scan->started = true;
+			}
+			blkno = table_block_parallelscan_nextpage(scan->rs_base.rs_rd,
+													  pbscan);
+		}
+		else
+			blkno = scan->nextblock;
+
+		if (!BlockNumberIsValid(blkno) || blkno >= scan->nblocks)
+		{
+			compressed_scan_release_chunk(scan);
+			return false;
+		}
+
+		if (compressed_scan_load_chunk(scan, blkno))
+			return true;
+
+		scan->nextblock = blkno + 1;
+	}
+}
+
+static void
+compressed_scan_init(CompressedScanDesc scan)
+{
+	Relation	rel = scan->rs_base.rs_rd;
+	CompressedPending *pending;
+
+	/*
+	 * Make the tuples inserted by previous commands available. For parallel
+	 * scans, this has been done by compressed_parallelscan_initialize().
+	 */
+	pending = compressed_get_pending(rel, false);
+	if (pending != NULL)
+		compressed_flush_pending(rel, pending);
+
+	if (scan->rs_base.rs_parallel != NULL)
+		scan->nblocks = ((ParallelBlockTableScanDesc)
+						 scan->rs_base.rs_parallel)->phs_nblocks;
+	else
+		scan->nblocks = RelationGetNumberOfBlocks(rel);
+
+	compressed_scan_release_chunk(scan);
+	scan->curblock = InvalidBlockNumber;
+	scan->nextblock = 0;
+	scan->started = false;
+
+	/* use a ring of buffers for large scans, like heap */
+	if ((scan->rs_base.rs_flags & SO_ALLOW_STRAT) != 0 &&
+		!RelationUsesLocalBuffers(rel) &&
+		scan->nblocks > NBuffers / 4)
+	{
+		if (scan->strategy == NULL)
+			scan->strategy = GetAccessStrategy(BAS_BULKREAD);
+	}
+	else if (scan->strategy != NULL)
+	{
+		FreeAccessStrategy(scan->strategy);
+		scan->strategy = NULL;
+	}
+}
+
+/*
+ * Initialize a parallel scan. The tuples pending in memory are written
+ * first, as the workers cannot see them and the number of blocks scanned
+ * is fixed here, before the leader begins its own scan.
+ */
+static Size
+compressed_parallelscan_initialize(Relation rel, ParallelTableScanDesc pscan)
+{
+	CompressedPending *pending;
+
+	pending = compressed_get_pending(rel, false);
+	if (pending != NULL)
+		compressed_flush_pending(rel, pending);
+
+	return table_block_parallelscan_initialize(rel, pscan);
+}
+
+static TableScanDesc
+compressed_scan_begin(Relation relation, Snapshot snapshot,
+					  int nkeys, ScanKey key,
+					  ParallelTableScanDesc parallel_scan,
+					  uint32 flags)
+{
+	CompressedScanDesc scan;
+
+	scan = (CompressedScanDesc) palloc(sizeof(CompressedScanDescData));
+
+	scan->rs_base.rs_rd = relation;
+	scan->rs_base.rs_snapshot = snapshot;
+	scan->rs_base.rs_nkeys = nkeys;
+	scan->rs_base.rs_flags = flags;
+	scan->rs_base.rs_parallel = parallel_scan;
+
+	scan->strategy = NULL;
+	scan->entry = NULL;
+	compressed_scan_init(scan);
+
+	return (TableScanDesc) scan;
+}
+
+static void
+compressed_scan_end(TableScanDesc sscan)
+{
+	CompressedScanDesc scan = (CompressedScanDesc) sscan;
+
+	compressed_scan_release_chunk(scan);
+	if (scan->strategy != NULL)
+		FreeAccessStrategy(scan->strategy);
+	pfree(scan);
+}
+
+static void
+compressed_scan_rescan(TableScanDesc sscan, ScanKey key, bool set_params,
+					   bool allow_strat, bool allow_sync, bool allow_pagemode)
+{
+	CompressedScanDesc scan = (CompressedScanDesc) sscan;
+
+	if (set_params)
+	{
+		if (allow_strat)
+			sscan->rs_flags |= SO_ALLOW_STRAT;
+		else
+			sscan->rs_flags &= ~SO_ALLOW_STRAT;
+	}
+
+	compressed_scan_init(scan);
+}
+
+static bool
+compressed_scan_getnextslot(TableScanDesc sscan, ScanDirection direction,
+							TupleTableSlot *slot)
+{
+	CompressedScanDesc scan = (CompressedScanDesc) sscan;
+
+	for (;;)
+	{
+		while (scan->curtuple < scan->ntuples)
+		{
+			CompressedTupleHeader hdr;
+			int			n = scan->curtuple++;
+
+			hdr = (CompressedTupleHeader) (scan->entry->data +
+										   scan->offsets[n]);
+			if (!compressed_tuple_visible(hdr, scan->visibility,
+										  sscan->rs_snapshot))
+				continue;
+
+			ExecStoreMinimalTuple((MinimalTuple) ((char *) hdr +
+												  COMPRESSED_TUPLE_HDRSZ),
+								  slot, false);
+			slot->tts_tableOid = RelationGetRelid(sscan->rs_rd);
+			ItemPointerSet(&slot->tts_tid, scan->curblock, n + 1);
+			return true;
+		}
+
+		if (!compressed_scan_next_chunk(scan))
+		{
+			ExecClearTuple(slot);
+			return false;
+		}
+	}
+}
+
+
+/* ------------------------------------------------------------------------
+ * Index Scan Callbacks for compressed AM
+ * ------------------------------------------------------------------------
+ */
+
+static IndexFetchTableData *
+compressed_index_fetch_begin(Relation rel)
+{
+	/* indexes are not supported */
+	return NULL;
+}
+
+static void
+compressed_index_fetch_reset(IndexFetchTableData *scan)
+{
+	/* nothing to do here */
+}
+
+static void
+compressed_index_fetch_end(IndexFetchTableData *scan)
+{
+	/* nothing to do here */
+}
+
+static bool
+compressed_index_fetch_tuple(struct IndexFetchTableData *scan,
+							 ItemPointer tid,
+							 Snapshot snapshot,
+							 TupleTableSlot *slot,
+							 bool *call_again, bool *all_dead)
+{
+	/* indexes are not supported */
+	return false;
+}
+
+
+/* ------------------------------------------------------------------------
+ * Callbacks for non-modifying operations on individual tuples for
+ * compressed AM.
+ * ------------------------------------------------------------------------
+ */
+
+/*
+ * Find the tuple at an offset of a logical page.
+ */
+static CompressedTupleHeader
+compressed_page_tuple(char *data, uint32 rawsize, int ntuples,
+					  OffsetNumber offnum)
+{
+	uint32		pos = 0;
+	int			i;
+
+	if (offnum < FirstOffsetNumber || offnum > ntuples)
+		return NULL;
+
+	for (i = 1; i < offnum; i++)
+	{
+		MinimalTuple tuple = (MinimalTuple) (data + pos +
+											 COMPRESSED_TUPLE_HDRSZ);
+
+		pos += COMPRESSED_TUPLE_HDRSZ + MAXALIGN(tuple->t_len);
+		if (pos >= rawsize)
+			return NULL;
+	}
+
+	return (CompressedTupleHeader) (data + pos);
+}
+
+static void
+compressed_store_fetched(Relation relation, CompressedTupleHeader hdr,
+						 ItemPointer tid, TupleTableSlot *slot)
+{
+	MinimalTuple tuple = (MinimalTuple) ((char *) hdr +
+										 COMPRESSED_TUPLE_HDRSZ);
+
+	ExecStoreMinimalTuple(heap_copy_minimal_tuple(tuple), slot, true);
+	slot->tts_tableOid = RelationGetRelid(relation);
+	slot->tts_tid = *tid;
+}
+
+/*
+ * Fetch the tuple at a TID into a slot if it is visible to a snapshot,
+ * looking for tuples still pending in memory if needed. The slot can be
+ * NULL to only check the visibility.
+ */
+static bool
+compressed_fetch_tid(Relation relation, ItemPointer tid, Snapshot snapshot,
+					 TupleTableSlot *slot)
+{
+	BlockNumber blkno = ItemPointerGetBlockNumber(tid);
+	OffsetNumber offnum = ItemPointerGetOffsetNumber(tid);
+	CompressedChunkHeaderData chunk;
+	CompressedChunkVisibility visibility;
+	CompressedCacheEntry *entry;
+	CompressedTupleHeader hdr;
+	bool		visible;
+
+	if (blkno >= COMPRESSED_PENDING_BLOCK_BASE)
+	{
+		uint32		generation = blkno - COMPRESSED_PENDING_BLOCK_BASE;
+		CompressedPending *pending = compressed_get_pending(relation, false);
+
+		if (pending == NULL || generation > pending->generation)
+			return false;
+
+		if (generation == pending->generation)
+		{
+			/* only the inserting transaction can see the tuple */
+			if (!TransactionIdIsCurrentTransactionId(pending->xid))
+				return false;
+			hdr = compressed_page_tuple(pending->data, pending->used,
+										pending->ntuples, offnum);
+			if (hdr == NULL)
+				return false;
+
+			visibility = compressed_chunk_visibility(pending->xid, snapshot);
+			visible = compressed_tuple_visible(hdr, visibility, snapshot);
+			if (visible && slot != NULL)
+				compressed_store_fetched(relation, hdr, tid, slot);
+			return visible;
+		}
+
+		/* the logical page has been written since */
+		blkno = pending->flushed[generation];
+		if (!BlockNumberIsValid(blkno))
+			return false;
+	}
+
+	if (blkno >= RelationGetNumberOfBlocks(relation) ||
+		!compressed_read_header(relation, blkno, NULL, &chunk))
+		return false;
+
+	visibility = compressed_chunk_visibility(chunk.xmin, snapshot);
+	if (visibility == COMPRESSED_CHUNK_INVISIBLE)
+		return false;
+
+	entry = compressed_load_chunk(relation, blkno, &chunk, NULL);
+	hdr = compressed_page_tuple(entry->data, entry->rawsize, chunk.ntuples,
+								offnum);
+	visible = hdr != NULL &&
+		compressed_tuple_visible(hdr, visibility, snapshot);
+	if (visible && slot != NULL)
+		compressed_store_fetched(relation, hdr, tid, slot);
+	compressed_cache_unpin(entry);
+
+	return visible;
+}
+
+static bool
+compressed_fetch_row_version(Relation relation,
+							 ItemPointer tid,
+							 Snapshot snapshot,
+							 TupleTableSlot *slot)
+{
+	return compressed_fetch_tid(relation, tid, snapshot, slot);
+}
+
+static void
+compressed_get_latest_tid(TableScanDesc sscan,
+						  ItemPointer tid)
+{
+	/* tuples are never updated, so the TID is the latest one */
+}
+
+static bool
+compressed_tuple_tid_valid(TableScanDesc sscan, ItemPointer tid)
+{
+	CompressedScanDesc scan = (CompressedScanDesc) sscan;
+	BlockNumber blkno = ItemPointerGetBlockNumber(tid);
+
+	return ItemPointerIsValid(tid) &&
+		(blkno < scan->nblocks || blkno >= COMPRESSED_PENDING_BLOCK_BASE);
+}
+
+static bool
+compressed_tuple_satisfies_snapshot(Relation rel, TupleTableSlot *slot,
+									Snapshot snapshot)
+{
+	return compressed_fetch_tid(rel, &slot->tts_tid, snapshot, NULL);
+}
+
+static TransactionId
+compressed_compute_xid_horizon_for_tuples(Relation rel,
+										  ItemPointerData *tids,
+										  int nitems)
+{
+	return InvalidTransactionId;
+}
+
+
+/* ----------------------------------------------------------------------------
+ *  Functions for manipulations of physical tuples for compressed AM.
+ * ----------------------------------------------------------------------------
+ */
+
+static void
+compressed_tuple_insert(Relation relation, TupleTableSlot *slot,
+						CommandId cid, int options, BulkInsertState bistate)
+{
+	compressed_insert_slots(relation, &slot, 1, cid);
+}
+
+static void
+compressed_tuple_insert_speculative(Relation relation, TupleTableSlot *slot,
+									CommandId cid, int options,
+									BulkInsertState bistate,
+									uint32 specToken)
+{
+	/* same as a normal insert */
+	compressed_tuple_insert(relation, slot, cid, options, bistate);
+}
+
+static void
+compressed_tuple_complete_speculative(Relation relation, TupleTableSlot *slot,
+									  uint32 spekToken, bool succeeded)
+{
+	/* nothing to do */
+}
+
+static void
+compressed_multi_insert(Relation relation, TupleTableSlot **slots,
+						int ntuples, CommandId cid, int options,
+						BulkInsertState bistate)
+{
+	compressed_insert_slots(relation, slots, ntuples, cid);
+}
+
+static TM_Result
+compressed_tuple_delete(Relation relation, ItemPointer tid, CommandId cid,
+						Snapshot snapshot, Snapshot crosscheck, bool wait,
+						TM_FailureData *tmfd, bool changingPart)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("compressed_am does not support DELETE")));
+	return TM_Ok;				/* keep compiler quiet */
+}
+
+static TM_Result
+compressed_tuple_update(Relation relation, ItemPointer otid,
+						TupleTableSlot *slot, CommandId cid,
+						Snapshot snapshot, Snapshot crosscheck,
+						bool wait, TM_FailureData *tmfd,
+						LockTupleMode *lockmode, bool *update_indexes)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("compressed_am does not support UPDATE")));
+	return TM_Ok;				/* keep compiler quiet */
+}
+
+static TM_Result
+compressed_tuple_lock(Relation relation, ItemPointer tid, Snapshot snapshot,
+					  TupleTableSlot *slot, CommandId cid, LockTupleMode mode,
+					  LockWaitPolicy wait_policy, uint8 flags,
+					  TM_FailureData *tmfd)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("compressed_am does not support row locks")));
+	return TM_Ok;				/* keep compiler quiet */
+}
+
+static void
+compressed_finish_bulk_insert(Relation relation, int options)
+{
+	/* logical pages are written when full or at commit */
+}
+
+
+/* ------------------------------------------------------------------------
+ * DDL related callbacks for compressed AM.
+ * ------------------------------------------------------------------------
+ */
+
+static void
+compressed_relation_set_new_filenode(Relation rel,
+									 const RelFileNode *newrnode,
+									 char persistence,
+									 TransactionId *freezeXid,
+									 MultiXactId *minmulti)
+{
+	SMgrRelation srel;
+
+	/* no transaction older than this one can be in the new relation */
+	*freezeXid = RecentXmin;
+	*minmulti = GetOldestMultiXactId();
+
+	srel = RelationCreateStorage(*newrnode, persistence);
+
+	/* unlogged relations need an init fork, like heap */
+	if (persistence == RELPERSISTENCE_UNLOGGED)
+	{
+		smgrcreate(srel, INIT_FORKNUM, false);
+		log_smgrcreate(newrnode, INIT_FORKNUM);
+		smgrimmedsync(srel, INIT_FORKNUM);
+	}
+
+	smgrclose(srel);
+}
+
+static void
+compressed_relation_nontransactional_truncate(Relation rel)
+{
+	CompressedPending *pending = compressed_get_pending(rel, false);
+
+	if (pending != NULL)
+		compressed_close_pending(pending, InvalidBlockNumber);
+
+	/* the blocks of the relation are going to be reused */
+	compressed_cache_invalidate(InvalidOid, &rel->rd_node);
+	RelationTruncate(rel, 0);
+}
+
+static void
+compressed_copy_data(Relation rel, const RelFileNode *newrnode)
+{
+	CompressedPending *pending;
+	SMgrRelation dstrel;
+	ForkNumber	forkNum;
+
+	/* write first the tuples still in memory */
+	pending = compressed_get_pending(rel, false);
+	if (pending != NULL)
+		compressed_flush_pending(rel, pending);
+
+	dstrel = smgropen(*newrnode, rel->rd_backend);
+	RelationOpenSmgr(rel);
+
+	/*
+	 * The file is copied directly, so flush first the pages of the relation
+	 * in shared buffers.
+	 */
+	FlushRelationBuffers(rel);
+
+	RelationCreateStorage(*newrnode, rel->rd_rel->relpersistence);
+	RelationCopyStorage(rel->rd_smgr, dstrel, MAIN_FORKNUM,
+						rel->rd_rel->relpersistence);
+
+	/* copy the init fork of unlogged relations */
+	for (forkNum = MAIN_FORKNUM + 1; forkNum <= MAX_FORKNUM; forkNum++)
+	{
+		if (!smgrexists(rel->rd_smgr, forkNum))
+			continue;
+
+		smgrcreate(dstrel, forkNum, false);
+		if (rel->rd_rel->relpersistence == RELPERSISTENCE_PERMANENT ||
+			(rel->rd_rel->relpersistence == RELPERSISTENCE_UNLOGGED &&
+			 forkNum == INIT_FORKNUM))
+			log_smgrcreate(newrnode, forkNum);
+		RelationCopyStorage(rel->rd_smgr, dstrel, forkNum,
+							rel->rd_rel->relpersistence);
+	}
+
+	RelationDropStorage(rel);
+	smgrclose(dstrel);
+}
+
+/*
+ * Chunks are copied as they are stored, without decompressing them,
+ * discarding the ones of aborted transactions and freezing the ones of
+ * committed transactions older than the cutoff.
+ */
+static void
+compressed_copy_for_cluster(Relation OldTable, Relation NewTable,
+							Relation OldIndex, bool use_sort,
+							TransactionId OldestXmin,
+							TransactionId *xid_cutoff,
+							MultiXactId *multi_cutoff,
+							double *num_tuples,
+							double *tups_vacuumed,
+							double *tups_recently_dead)
+{
+	BlockNumber nblocks = RelationGetNumberOfBlocks(OldTable);
+	BufferAccessStrategy strategy = GetAccessStrategy(BAS_BULKREAD);
+	BlockNumber blkno = 0;
+
+	*num_tuples = 0;
+	*tups_vacuumed = 0;
+	*tups_recently_dead = 0;
+
+	while (blkno < nblocks)
+	{
+		CompressedChunkHeaderData hdr;
+		TransactionId xmin;
+		char	   *stored;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (!compressed_read_header(OldTable, blkno, strategy, &hdr))
+		{
+			blkno++;
+			continue;
+		}
+
+		xmin = hdr.xmin;
+		if (TransactionIdIsNormal(xmin) &&
+			!TransactionIdIsCurrentTransactionId(xmin) &&
+			!TransactionIdIsInProgress(xmin))
+		{
+			if (!TransactionIdDidCommit(xmin))
+				xmin = InvalidTransactionId;
+			else if (TransactionIdPrecedes(xmin, *xid_cutoff))
+				xmin = FrozenTransactionId;
+		}
+
+		if (!TransactionIdIsValid(xmin))
+		{
+			*tups_vacuumed += hdr.ntuples;
+			blkno += hdr.nblocks;
+			continue;
+		}
+
+		stored = compressed_read_stored(OldTable, blkno, &hdr, strategy);
+		hdr.xmin = xmin;
+		(void) compressed_store_chunk(NewTable, &hdr, stored);
+		pfree(stored);
+
+		*num_tuples += hdr.ntuples;
+		blkno += hdr.nblocks;
+	}
+
+	FreeAccessStrategy(strategy);
+}
+
+/*
+ * VACUUM freezes the transaction IDs of the chunks older than the freeze
+ * limit and marks the chunks of aborted transactions as dead, updating
+ * only their first block. The space of dead chunks is not reclaimed.
+ */
+static void
+compressed_vacuum(Relation onerel, VacuumParams *params,
+				  BufferAccessStrategy bstrategy)
+{
+	TransactionId OldestXmin;
+	TransactionId FreezeLimit;
+	TransactionId xidFullScanLimit;
+	MultiXactId MultiXactCutoff;
+	MultiXactId mxactFullScanLimit;
+	BlockNumber nblocks;
+	BlockNumber blkno = 0;
+	double		live_tuples = 0;
+	double		dead_tuples = 0;
+
+	vacuum_set_xid_limits(onerel,
+						  params->freeze_min_age,
+						  params->freeze_table_age,
+						  params->multixact_freeze_min_age,
+						  params->multixact_freeze_table_age,
+						  &OldestXmin, &FreezeLimit, &xidFullScanLimit,
+						  &MultiXactCutoff, &mxactFullScanLimit);
+
+	nblocks = RelationGetNumberOfBlocks(onerel);
+	while (blkno < nblocks)
+	{
+		CompressedChunkHeader hdr;
+		TransactionId xmin;
+		TransactionId newxmin;
+		Buffer		buffer;
+		Page		page;
+		int			chunk_nblocks;
+
+		vacuum_delay_point();
+
+		buffer = ReadBufferExtended(onerel, MAIN_FORKNUM, blkno, RBM_NORMAL,
+									bstrategy);
+		LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+		page = BufferGetPage(buffer);
+
+		if (PageIsNew(page) ||
+			(CompressedPageGetOpaque(page)->flags & COMPRESSED_CHUNK_START) == 0)
+		{
+			UnlockReleaseBuffer(buffer);
+			blkno++;
+			continue;
+		}
+
+		hdr = (CompressedChunkHeader) ((char *) page +
+									   MAXALIGN(SizeOfPageHeaderData));
+		xmin = newxmin = hdr->xmin;
+		chunk_nblocks = Max(hdr->nblocks, 1);
+
+		/* chunks of recent transactions are left alone */
+		if (TransactionIdIsNormal(xmin) &&
+			TransactionIdPrecedes(xmin, OldestXmin))
+		{
+			if (!TransactionIdDidCommit(xmin))
+				newxmin = InvalidTransactionId;
+			else if (TransactionIdPrecedes(xmin, FreezeLimit))
+				newxmin = FrozenTransactionId;
+		}
+
+		if (TransactionIdIsValid(newxmin))
+			live_tuples += hdr->ntuples;
+		else
+			dead_tuples += hdr->ntuples;
+
+		if (!TransactionIdEquals(xmin, newxmin))
+		{
+			START_CRIT_SECTION();
+			hdr->xmin = newxmin;
+			MarkBufferDirty(buffer);
+			if (RelationNeedsWAL(onerel))
+				log_newpage_buffer(buffer, true);
+			END_CRIT_SECTION();
+		}
+
+		UnlockReleaseBuffer(buffer);
+		blkno += chunk_nblocks;
+	}
+
+	vac_update_relstats(onerel, nblocks, live_tuples, 0, false,
+						FreezeLimit, MultiXactCutoff, false);
+	pgstat_report_vacuum(RelationGetRelid(onerel),
+						 onerel->rd_rel->relisshared,
+						 live_tuples, dead_tuples);
+}
+
+/*
+ * ANALYZE scans have no snapshot, so the tuples of each chunk are counted
+ * here based on the status of their transaction.
+ */
+static bool
+compressed_scan_analyze_next_block(TableScanDesc sscan, BlockNumber blockno,
+								   BufferAccessStrategy bstrategy)
+{
+	CompressedScanDesc scan = (CompressedScanDesc) sscan;
+	Relation	rel = sscan->rs_rd;
+	CompressedChunkHeaderData hdr;
+	TransactionId xmin;
+
+	compressed_scan_release_chunk(scan);
+	scan->curblock = blockno;
+
+	if (!compressed_read_header(rel, blockno, bstrategy, &hdr))
+		return true;
+
+	xmin = hdr.xmin;
+	if (TransactionIdIsNormal(xmin) &&
+		!TransactionIdIsCurrentTransactionId(xmin))
+	{
+		/* tuples being inserted by other transactions are not counted */
+		if (TransactionIdIsInProgress(xmin))
+			return true;
+		if (!TransactionIdDidCommit(xmin))
+			xmin = InvalidTransactionId;
+	}
+
+	if (!TransactionIdIsValid(xmin))
+	{
+		scan->ndead = hdr.ntuples;
+		return true;
+	}
+
+	scan->entry = compressed_load_chunk(rel, blockno, &hdr, bstrategy);
+	scan->ntuples = hdr.ntuples;
+	compressed_page_offsets(scan->entry->data, scan->entry->rawsize,
+							scan->ntuples, scan->offsets);
+	return true;
+}
+
+static bool
+compressed_scan_analyze_next_tuple(TableScanDesc sscan, TransactionId OldestXmin,
+								   double *liverows, double *deadrows,
+								   TupleTableSlot *slot)
+{
+	CompressedScanDesc scan = (CompressedScanDesc) sscan;
+
+	*deadrows += scan->ndead;
+	scan->ndead = 0;
+
+	if (scan->curtuple < scan->ntuples)
+	{
+		int			n = scan->curtuple++;
+
+		ExecStoreMinimalTuple((MinimalTuple) (scan->entry->data +
+											  scan->offsets[n] +
+											  COMPRESSED_TUPLE_HDRSZ),
+							  slot, false);
+		slot->tts_tableOid = RelationGetRelid(sscan->rs_rd);
+		ItemPointerSet(&slot->tts_tid, scan->curblock, n + 1);
+		*liverows += 1;
+		return true;
+	}
+
+	ExecClearTuple(slot);
+	return false;
+}
+
+static double
+compressed_index_build_range_scan(Relation tableRelation,
+								  Relation indexRelation,
+								  IndexInfo *indexInfo,
+								  bool allow_sync,
+								  bool anyvisible,
+								  bool progress,
+								  BlockNumber start_blockno,
+								  BlockNumber numblocks,
+								  IndexBuildCallback callback,
+								  void *callback_state,
+								  TableScanDesc scan)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("compressed_am does not support indexes")));
+	return 0;					/* keep compiler quiet */
+}
+
+static void
+compressed_index_validate_scan(Relation tableRelation,
+							   Relation indexRelation,
+							   IndexInfo *indexInfo,
+							   Snapshot snapshot,
+							   ValidateIndexState *state)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("compressed_am does not support indexes")));
+}
+
+
+/* ------------------------------------------------------------------------
+ * Miscellaneous callbacks for the compressed AM
+ * ------------------------------------------------------------------------
+ */
+
+static uint64
+compressed_relation_size(Relation rel, ForkNumber forkNumber)
+{
+	uint64		nblocks = 0;
+
+	RelationOpenSmgr(rel);
+
+	/* InvalidForkNumber means all the forks */
+	if (forkNumber == InvalidForkNumber)
+	{
+		ForkNumber	i;
+
+		for (i = 0; i <= MAX_FORKNUM; i++)
+		{
+			if (smgrexists(rel->rd_smgr, i))
+				nblocks += smgrnblocks(rel->rd_smgr, i);
+		}
+	}
+	else
+		nblocks = smgrnblocks(rel->rd_smgr, forkNumber);
+
+	return nblocks * BLCKSZ;
+}
+
+/*
+ * Check to see whether the table needs a TOAST table.
+ */
+static bool
+compressed_relation_needs_toast_table(Relation rel)
+{
+	/* rows are compressed with their logical page instead */
+	return false;
+}
+
+
+/* ------------------------------------------------------------------------
+ * Planner related callbacks for the compressed AM
+ * ------------------------------------------------------------------------
+ */
+
+static void
+compressed_estimate_rel_size(Relation rel, int32 *attr_widths,
+							 BlockNumber *pages, double *tuples,
+							 double *allvisfrac)
+{
+	BlockNumber curpages = RelationGetNumberOfBlocks(rel);
+	BlockNumber relpages = (BlockNumber) rel->rd_rel->relpages;
+	double		reltuples = (double) rel->rd_rel->reltuples;
+	double		density;
+
+	*pages = curpages;
+	*allvisfrac = 0;
+
+	if (curpages == 0)
+	{
+		*tuples = 0;
+		return;
+	}
+
+	/*
+	 * Use the density of the last ANALYZE or VACUUM if any, which accounts
+	 * for compression, or estimate it from the width of the tuples as if
+	 * they were not compressed.
+	 */
+	if (relpages > 0)
+		density = reltuples / (double) relpages;
+	else
+	{
+		int32		tuple_width;
+
+		tuple_width = get_rel_data_width(rel, attr_widths);
+		tuple_width += COMPRESSED_TUPLE_HDRSZ + MAXALIGN(SizeofMinimalTupleHeader);
+		tuple_width = MAXALIGN(tuple_width);
+		density = (COMPRESSED_DATA_END - COMPRESSED_NEXT_DATA) / tuple_width;
+	}
+
+	*tuples = rint(density * (double) curpages);
+}
+
+
+/* ------------------------------------------------------------------------
+ * Executor related callbacks for the compressed AM
+ * ------------------------------------------------------------------------
+ */
+
+static bool
+compressed_scan_bitmap_next_block(TableScanDesc scan,
+								  TBMIterateResult *tbmres)
+{
+	/* no indexes, so no bitmaps */
+	return false;
+}
+
+static bool
+compressed_scan_bitmap_next_tuple(TableScanDesc scan,
+								  TBMIterateResult *tbmres,
+								  TupleTableSlot *slot)
+{
+	/* no indexes, so no bitmaps */
+	return false;
+}
+
+static bool
+compressed_scan_sample_next_block(TableScanDesc sscan,
+								  SampleScanState *scanstate)
+{
+	CompressedScanDesc scan = (CompressedScanDesc) sscan;
+	TsmRoutine *tsm = scanstate->tsmroutine;
+	BlockNumber blkno;
+
+	if (scan->nblocks == 0)
+		return false;
+
+	/*
+	 * Sampled blocks not starting a chunk have no tuples, as they are part
+	 * of the chunk of a previous block.
+	 */
+	if (tsm->NextSampleBlock)
+		blkno = tsm->NextSampleBlock(scanstate, scan->nblocks);
+	else if (!BlockNumberIsValid(scan->curblock))
+		blkno = 0;
+	else if (scan->curblock + 1 < scan->nblocks)
+		blkno = scan->curblock + 1;
+	else
+		blkno = InvalidBlockNumber;
+
+	if (!BlockNumberIsValid(blkno))
+	{
+		compressed_scan_release_chunk(scan);
+		return false;
+	}
+
+	(void) compressed_scan_load_chunk(scan, blkno);
+	return true;
+}
+
+static bool
+compressed_scan_sample_next_tuple(TableScanDesc sscan,
+								  SampleScanState *scanstate,
+								  TupleTableSlot *slot)
+{
+	CompressedScanDesc scan = (CompressedScanDesc) sscan;
+	TsmRoutine *tsm = scanstate->tsmroutine;
+
+	for (;;)
+	{
+		CompressedTupleHeader hdr;
+		OffsetNumber offnum;
+
+		offnum = tsm->NextSampleTuple(scanstate, scan->curblock,
+									  (OffsetNumber) scan->ntuples);
+		if (!OffsetNumberIsValid(offnum))
+		{
+			ExecClearTuple(slot);
+			return false;
+		}
+
+		hdr = (CompressedTupleHeader) (scan->entry->data +
+									   scan->offsets[offnum - 1]);
+		if (!compressed_tuple_visible(hdr, scan->visibility,
+									  sscan->rs_snapshot))
+			continue;
+
+		ExecStoreMinimalTuple((MinimalTuple) ((char *) hdr +
+											  COMPRESSED_TUPLE_HDRSZ),
+							  slot, false);
+		slot->tts_tableOid = RelationGetRelid(sscan->rs_rd);
+		ItemPointerSet(&slot->tts_tid, scan->curblock, offnum);
+		return true;
+	}
+}
+
+
+/* ------------------------------------------------------------------------
+ * Definition of the compressed table access method.
+ * ------------------------------------------------------------------------
+ */
+
+static const TableAmRoutine compressed_methods = {
+	.type = T_TableAmRoutine,
+
+	.slot_callbacks = compressed_slot_callbacks,
+
+	.scan_begin = compressed_scan_begin,
+	.scan_end = compressed_scan_end,
+	.scan_rescan = compressed_scan_rescan,
+	.scan_getnextslot = compressed_scan_getnextslot,
+
+	/* these are common helper functions */
+	.parallelscan_estimate = table_block_parallelscan_estimate,
+	.parallelscan_initialize = compressed_parallelscan_initialize,
+	.parallelscan_reinitialize = table_block_parallelscan_reinitialize,
+
+	.index_fetch_begin = compressed_index_fetch_begin,
+	.index_fetch_reset = compressed_index_fetch_reset,
+	.index_fetch_end = compressed_index_fetch_end,
+	.index_fetch_tuple = compressed_index_fetch_tuple,
+
+	.tuple_insert = compressed_tuple_insert,
+	.tuple_insert_speculative = compressed_tuple_insert_speculative,
+	.tuple_complete_speculative = compressed_tuple_complete_speculative,
+	.multi_insert = compressed_multi_insert,
+	.tuple_delete = compressed_tuple_delete,
+	.tuple_update = compressed_tuple_update,
+	.tuple_lock = compressed_tuple_lock,
+	.finish_bulk_insert = compressed_finish_bulk_insert,
+
+	.tuple_fetch_row_version = compressed_fetch_row_version,
+	.tuple_get_latest_tid = compressed_get_latest_tid,
+	.tuple_tid_valid = compressed_tuple_tid_valid,
+	.tuple_satisfies_snapshot = compressed_tuple_satisfies_snapshot,
+	.compute_xid_horizon_for_tuples = compressed_compute_xid_horizon_for_tuples,
+
+	.relation_set_new_filenode = compressed_relation_set_new_filenode,
+	.relation_nontransactional_truncate = compressed_relation_nontransactional_truncate,
+	.relation_copy_data = compressed_copy_data,
+	.relation_copy_for_cluster = compressed_copy_for_cluster,
+	.relation_vacuum = compressed_vacuum,
+	.scan_analyze_next_block = compressed_scan_analyze_next_block,
+	.scan_analyze_next_tuple = compressed_scan_analyze_next_tuple,
+	.index_build_range_scan = compressed_index_build_range_scan,
+	.index_validate_scan = compressed_index_validate_scan,
+
+	.relation_size = compressed_relation_size,
+	.relation_needs_toast_table = compressed_relation_needs_toast_table,
+
+	.relation_estimate_size = compressed_estimate_rel_size,
+
+	.scan_bitmap_next_block = compressed_scan_bitmap_next_block,
+	.scan_bitmap_next_tuple = compressed_scan_bitmap_next_tuple,
+	.scan_sample_next_block = compressed_scan_sample_next_block,
+	.scan_sample_next_tuple = compressed_scan_sample_next_tuple
+};
+
+
+Datum
+compressed_am_handler(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(&compressed_methods);
+}
+
+/*
+ * Module load callback
+ */
+void
+_PG_init(void)
+{
+	HASHCTL		ctl;
+
+	DefineCustomEnumVariable("compressed_am.compression",
+							 "Compression method of the logical pages written.",
+							 NULL,
+							 &compressed_compression,
+							 COMPRESSED_METHOD_PGLZ,
+							 compressed_compression_options,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("compressed_am.cache_size",
+							"Memory used to cache decompressed logical pages.",
+							"Zero disables the cache.",
+							&compressed_cache_size,
+							16384,
+							0,
+							MAX_KILOBYTES,
+							PGC_USERSET,
+							GUC_UNIT_KB,
+							NULL,
+							NULL,
+							NULL);
+
+	compressed_cache_cxt = AllocSetContextCreate(TopMemoryContext,
+												 "compressed_am page cache",
+												 ALLOCSET_DEFAULT_SIZES);
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(CompressedCacheKey);
+	ctl.entrysize = sizeof(CompressedCacheEntry);
+	ctl.hcxt = compressed_cache_cxt;
+	compressed_cache = hash_create("compressed_am page cache", 64, &ctl,
+								   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	dlist_init(&compressed_cache_lru);
+
+	RegisterXactCallback(compressed_xact_callback, NULL);
+	CacheRegisterRelcacheCallback(compressed_relcache_callback, (Datum) 0);
+}
@@ -0,0 +1,86 @@
+CREATE EXTENSION compressed_am;
+CREATE TABLE compressed_tab (id int, val text) USING compressed_am;
+SELECT * FROM compressed_tab;
+INSERT INTO compressed_tab VALUES (1, 'one'), (2, NULL);
+SELECT * FROM compressed_tab ORDER BY id;
+INSERT INTO compressed_tab SELECT i, 'archived row ' || i
+  FROM generate_series(3, 10000) i;
+SELECT count(*), sum(id), count(val) FROM compressed_tab;
+-- Rows inserted by a command are not visible to itself
+INSERT INTO compressed_tab SELECT id + 10000, val FROM compressed_tab;
+SELECT count(*), sum(id), count(val) FROM compressed_tab;
+-- Same results with the page cache filled, and without it
+SELECT count(*), sum(id), count(val) FROM compressed_tab;
+SET compressed_am.cache_size = 0;
+SELECT count(*), sum(id), count(val) FROM compressed_tab;
+RESET compressed_am.cache_size;
+-- Parallel scans include the rows pending in memory, written before the
+-- number of blocks to scan is fixed
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+EXPLAIN (COSTS OFF)
+  SELECT count(*), sum(id), count(val) FROM compressed_tab;
+BEGIN;
+INSERT INTO compressed_tab VALUES (30000, 'pending');
+SELECT count(*), sum(id), count(val) FROM compressed_tab;
+ROLLBACK;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+-- Storage is smaller than heap
+CREATE TABLE compressed_heap (id int, val text);
+INSERT INTO compressed_heap SELECT * FROM compressed_tab;
+SELECT pg_relation_size('compressed_tab') * 2 <
+  pg_relation_size('compressed_heap') AS smaller;
+DROP TABLE compressed_heap;
+-- Rows of aborted transactions are not visible
+BEGIN;
+INSERT INTO compressed_tab SELECT i, 'aborted' FROM generate_series(1, 100) i;
+SELECT count(*) FROM compressed_tab;
+ROLLBACK;
+SELECT count(*) FROM compressed_tab;
+BEGIN;
+INSERT INTO compressed_tab VALUES (50000, 'kept');
+SAVEPOINT s;
+INSERT INTO compressed_tab VALUES (50001, 'rolled back');
+ROLLBACK TO SAVEPOINT s;
+INSERT INTO compressed_tab VALUES (50002, 'kept too');
+COMMIT;
+SELECT * FROM compressed_tab WHERE id >= 50000 ORDER BY id;
+-- AFTER triggers fetch rows not written yet
+CREATE FUNCTION compressed_trig() RETURNS trigger LANGUAGE plpgsql AS $$
+BEGIN
+  RAISE NOTICE 'inserted % %', NEW.id, NEW.val;
+  RETURN NULL;
+END $$;
+CREATE TRIGGER compressed_trig AFTER INSERT ON compressed_tab
+  FOR EACH ROW EXECUTE FUNCTION compressed_trig();
+INSERT INTO compressed_tab VALUES (60000, 'trigger'), (60001, 'trigger');
+DROP TRIGGER compressed_trig ON compressed_tab;
+DROP FUNCTION compressed_trig();
+-- Unsupported operations
+UPDATE compressed_tab SET val = 'updated' WHERE id = 1;
+DELETE FROM compressed_tab WHERE id = 1;
+SELECT * FROM compressed_tab WHERE id = 1 FOR UPDATE;
+CREATE INDEX compressed_tab_idx ON compressed_tab (id);
+-- Maintenance
+VACUUM (FREEZE) compressed_tab;
+SELECT count(*), sum(id), count(val) FROM compressed_tab;
+VACUUM FULL compressed_tab;
+SELECT count(*), sum(id), count(val) FROM compressed_tab;
+ANALYZE compressed_tab;
+SELECT reltuples FROM pg_class WHERE oid = 'compressed_tab'::regclass;
+SELECT count(*) FROM compressed_tab TABLESAMPLE SYSTEM (100);
+TRUNCATE compressed_tab;
+SELECT count(*) FROM compressed_tab;
+-- Values stored externally are detoasted
+CREATE TEMP TABLE compressed_heap (val text);
+ALTER TABLE compressed_heap ALTER COLUMN val SET STORAGE EXTERNAL;
+INSERT INTO compressed_heap VALUES (repeat('x', 100000));
+INSERT INTO compressed_tab SELECT 2, val FROM compressed_heap;
+DROP TABLE compressed_heap;
+SELECT id, length(val) FROM compressed_tab WHERE id = 2;
+DROP TABLE compressed_tab;
@@ -0,0 +1,133 @@
+#!/bin/bash
+#-------------------------------------------------------------------------
+#
+# bench_pg_wal_blocks.sh
+#		Benchmark of WAL parsing throughput for pg_wal_blocks.
+#
+# This script runs pg_wal_blocks on each workload of a corpus generated
+# by gen_wal_corpus.sh, for each combination of reader mode, number of
+# threads and output mode requested, and reports the rate of records and
+# of WAL parsed, using the best time of a number of runs. It also checks
+# that all the combinations produce the same output for a given workload
+# and output mode, so as it can be used as a regression test of changes
+# in the reader or in the aggregation of blocks.
+#
+# Copyright (c) 1996-2020, PostgreSQL Global Development Group
+#
+# IDENTIFICATION
+#		pg_wal_blocks/bench_pg_wal_blocks.sh
+#
+#-------------------------------------------------------------------------
+
+set -e
+
+# Default values
+PROGRAM="pg_wal_blocks"
+CORPUSDIR="$(pwd)/wal_corpus/corpus"
+READERS="mmap,buffered"
+JOBS="1,2,4,8"
+MODES="blocks,stats"
+RUNS=3
+
+usage()
+{
+	cat <<EOF
+Usage: $0 [OPTION]...
+
+Options:
+  -p PROGRAM     pg_wal_blocks binary to use (default: $PROGRAM)
+  -d DIRECTORY   corpus generated by gen_wal_corpus.sh
+                 (default: $CORPUSDIR)
+  -r LIST        comma-separated list of reader modes among "mmap" and
+                 "buffered" (default: $READERS)
+  -j LIST        comma-separated list of numbers of threads
+                 (default: $JOBS)
+  -m LIST        comma-separated list of output modes among "blocks"
+                 and "stats" (default: $MODES)
+  -n RUNS        number of runs of each combination, the best one being
+                 reported (default: $RUNS)
+  -h             show this help, then exit
+EOF
+}
+
+while getopts "p:d:r:j:m:n:h" opt; do
+	case $opt in
+		p) PROGRAM="$OPTARG" ;;
+		d) CORPUSDIR="$OPTARG" ;;
+		r) READERS="$OPTARG" ;;
+		j) JOBS="$OPTARG" ;;
+		m) MODES="$OPTARG" ;;
+		n) RUNS="$OPTARG" ;;
+		h) usage; exit 0 ;;
+		*) usage; exit 1 ;;
+	esac
+done
+
+if [ ! -d "$CORPUSDIR" ]; then
+	echo "$0: corpus directory \"$CORPUSDIR\" does not exist" >&2
+	exit 1
+fi
+
+OUTDIR=$(mktemp -d)
+trap 'rm -rf "$OUTDIR"' EXIT
+FAILED=0
+
+# Current time, in nanoseconds
+now_ns()
+{
+	date +%s%N
+}
+
+printf "%-10s %-8s %-9s %-5s %-10s %-10s %-14s %-10s\n" \
+	"workload" "mode" "reader" "jobs" "records" "time_ms" "records/s" "MB/s"
+
+for workload_dir in "$CORPUSDIR"/*/; do
+	workload=$(basename "$workload_dir")
+	segsize_mb=$(sed -n 's/^segment_size_mb = //p' "$workload_dir/corpus.info")
+	segments=$(ls "$workload_dir" | grep -c '^[0-9A-F]\{24\}$' || true)
+	wal_mb=$((segments * ${segsize_mb:-16}))
+
+	# Number of records of the workload, from the total of --stats, as -v
+	# would slow down parsing by reporting each block.
+	records=$("$PROGRAM" --stats "$workload_dir" | awk '$1 == "Total" { print $2 }')
+
+	for mode in ${MODES//,/ }; do
+		reference=""
+
+		for reader in ${READERS//,/ }; do
+			for jobs in ${JOBS//,/ }; do
+				options="--jobs=$jobs"
+				[ "$reader" = "buffered" ] && options="$options --no-mmap"
+				[ "$mode" = "stats" ] && options="$options --stats"
+				output="$OUTDIR/${workload}_${mode}_${reader}_${jobs}.out"
+				best=""
+
+				for run in $(seq 1 $RUNS); do
+					start=$(now_ns)
+					"$PROGRAM" $options "$workload_dir" > "$output"
+					end=$(now_ns)
+					elapsed=$(((end - start) / 1000))
+					if [ -z "$best" ] || [ $elapsed -lt $best ]; then
+						best=$elapsed
+					fi
+				done
+
+				printf "%-10s %-8s %-9s %-5s %-10s %-10s %-14s %-10s\n" \
+					"$workload" "$mode" "$reader" "$jobs" "$records" \
+					$(awk -v us=$best -v r=$records -v mb=$wal_mb 'BEGIN {
+						s = us / 1000000;
+						printf "%.1f %.0f %.1f", us / 1000, r / s, mb / s }')
+
+				# All the combinations should give the same output
+				if [ -z "$reference" ]; then
+					reference="$output"
+				elif ! cmp -s "$reference" "$output"; then
+					echo "$0: output of $workload with $reader reader and $jobs jobs differs from $(basename "$reference")" >&2
+					FAILED=1
+				fi
+			done
+		done
+	done
+done
+
+exit $FAILED
@@ -0,0 +1,542 @@
+/*-------------------------------------------------------------------------
+ *
+ * blockmap.c
+ *		Sets of relation blocks touched by WAL records
+ *
+ * Blocks are tracked per relation fork in a hash table. For each fork,
+ * the blocks touched are first appended to a small buffer, skipping
+ * repeated references to the same block, which are frequent in WAL. Once
+ * this buffer is full, it is sorted and merged into a sorted array of
+ * ranges of consecutive blocks. This keeps the cost of each reference
+ * low, and the memory used proportional to the number of ranges rather
+ * than to the number of references.
+ *
+ * Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		pg_wal_blocks/blockmap.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres_fe.h"
+
+#include "common/hashfn.h"
+#include "port/pg_crc32c.h"
+
+#include "pg_wal_blocks.h"
+
+/* Number of blocks buffered for a fork before merging them into ranges */
+#define BLOCKMAP_PENDING_SIZE	1024
+
+/* Range of consecutive blocks, both included */
+typedef struct BlockRange
+{
+	BlockNumber start;
+	BlockNumber end;
+} BlockRange;
+
+typedef struct BlockMapKey
+{
+	RelFileNode rnode;
+	ForkNumber	forknum;
+} BlockMapKey;
+
+typedef struct BlockMapEntry
+{
+	BlockMapKey key;			/* hash key, must be first */
+	char		status;			/* hash status */
+	BlockNumber last;			/* last block added */
+	int			npending;		/* blocks not merged yet */
+	BlockNumber *pending;
+	int			nranges;
+	int			maxranges;
+	BlockRange *ranges;			/* sorted, not overlapping */
+} BlockMapEntry;
+
+#define SH_PREFIX		blockhash
+#define SH_ELEMENT_TYPE	BlockMapEntry
+#define SH_KEY_TYPE		BlockMapKey
+#define	SH_KEY			key
+#define SH_HASH_KEY(tb, key) \
+	hash_bytes((const unsigned char *) &(key), sizeof(BlockMapKey))
+#define SH_EQUAL(tb, a, b)	(memcmp(&(a), &(b), sizeof(BlockMapKey)) == 0)
+#define	SH_SCOPE		static inline
+#define SH_RAW_ALLOCATOR	pg_malloc0
+#define SH_DECLARE
+#define SH_DEFINE
+#include "lib/simplehash.h"
+
+struct BlockMap
+{
+	blockhash_hash *hash;
+};
+
+/*
+ * Create an empty set of blocks.
+ */
+BlockMap *
+blockmap_create(void)
+{
+	BlockMap   *map = pg_malloc0(sizeof(BlockMap));
+
+	map->hash = blockhash_create(1024, NULL);
+	return map;
+}
+
+static int
+blockmap_cmp_block(const void *a, const void *b)
+{
+	BlockNumber ba = *((const BlockNumber *) a);
+	BlockNumber bb = *((const BlockNumber *) b);
+
+	if (ba < bb)
+		return -1;
+	if (ba > bb)
+		return 1;
+	return 0;
+}
+
+/*
+ * Append a range of blocks to an array of ranges, extending the last range
+ * if possible. Ranges need to be appended in order.
+ */
+static void
+blockmap_append_range(BlockRange **ranges, int *nranges, int *maxranges,
+					  BlockNumber start, BlockNumber end)
+{
+	if (*nranges > 0)
+	{
+		BlockRange *last = &(*ranges)[*nranges - 1];
+
+		/* Overlapping or adjacent to the last range */
+		if (last->end == InvalidBlockNumber || start <= last->end + 1)
+		{
+			if (end > last->end)
+				last->end = end;
+			return;
+		}
+	}
+
+	if (*nranges >= *maxranges)
+	{
+		*maxranges = *maxranges == 0 ? 16 : *maxranges * 2;
+		*ranges = pg_realloc(*ranges, sizeof(BlockRange) * *maxranges);
+	}
+	(*ranges)[*nranges].start = start;
+	(*ranges)[*nranges].end = end;
+	(*nranges)++;
+}
+
+/*
+ * Merge an array of sorted ranges into the ranges of an entry.
+ */
+static void
+blockmap_merge_ranges(BlockMapEntry *entry, BlockRange *ranges, int nranges)
+{
+	BlockRange *merged = NULL;
+	int			nmerged = 0;
+	int			maxmerged = 0;
+	int			i = 0;
+	int			j = 0;
+
+	while (i < entry->nranges || j < nranges)
+	{
+		BlockRange *next;
+
+		if (j >= nranges ||
+			(i < entry->nranges && entry->ranges[i].start <= ranges[j].start))
+			next = &entry->ranges[i++];
+		else
+			next = &ranges[j++];
+
+		blockmap_append_range(&merged, &nmerged, &maxmerged,
+							  next->start, next->end);
+	}
+
+	pg_free(entry->ranges);
+	entry->ranges = merged;
+	entry->nranges = nmerged;
+	entry->maxranges = maxmerged;
+}
+
+/*
+ * Merge the pending blocks of an entry into its ranges.
+ */
+static void
+blockmap_flush_pending(BlockMapEntry *entry)
+{
+	BlockRange *ranges = NULL;
+	int			nranges = 0;
+	int			maxranges = 0;
+	int			i;
+
+	if (entry->npending == 0)
+		return;
+
+	qsort(entry->pending, entry->npending, sizeof(BlockNumber),
+		  blockmap_cmp_block);
+	for (i = 0; i < entry->npending; i++)
+		blockmap_append_range(&ranges, &nranges, &maxranges,
+							  entry->pending[i], entry->pending[i]);
+	entry->npending = 0;
+
+	blockmap_merge_ranges(entry, ranges, nranges);
+	pg_free(ranges);
+}
+
+/*
+ * Track a block touched.
+ */
+void
+blockmap_add(BlockMap *map, const RelFileNode *rnode, ForkNumber forknum,
+			 BlockNumber blkno)
+{
+	BlockMapKey key;
+	BlockMapEntry *entry;
+	bool		found;
+
+	/* zero the key, as it is hashed and compared as raw bytes */
+	memset(&key, 0, sizeof(BlockMapKey));
+	key.rnode = *rnode;
+	key.forknum = forknum;
+
+	entry = blockhash_insert(map->hash, key, &found);
+	if (!found)
+	{
+		entry->pending = pg_malloc(sizeof(BlockNumber) * BLOCKMAP_PENDING_SIZE);
+		entry->npending = 0;
+		entry->nranges = 0;
+		entry->maxranges = 0;
+		entry->ranges = NULL;
+	}
+	else if (entry->last == blkno)
+		return;
+
+	entry->last = blkno;
+	entry->pending[entry->npending++] = blkno;
+	if (entry->npending >= BLOCKMAP_PENDING_SIZE)
+		blockmap_flush_pending(entry);
+}
+
+/*
+ * Merge all the blocks of a set into another one. The source set is left
+ * with all its blocks merged into ranges.
+ */
+void
+blockmap_merge(BlockMap *dst, BlockMap *src)
+{
+	BlockMapEntry *entry;
+	blockhash_iterator iter;
+
+	blockhash_start_iterate(src->hash, &iter);
+	while ((entry = blockhash_iterate(src->hash, &iter)) != NULL)
+	{
+		BlockMapEntry *dst_entry;
+		bool		found;
+
+		blockmap_flush_pending(entry);
+
+		dst_entry = blockhash_insert(dst->hash, entry->key, &found);
+		if (!found)
+		{
+			dst_entry->pending = pg_malloc(sizeof(BlockNumber) *
+										   BLOCKMAP_PENDING_SIZE);
+			dst_entry->npending = 0;
+			dst_entry->last = entry->last;
+			dst_entry->nranges = 0;
+			dst_entry->maxranges = 0;
+			dst_entry->ranges = NULL;
+		}
+
+		blockmap_merge_ranges(dst_entry, entry->ranges, entry->nranges);
+	}
+}
+
+/*
+ * Remove from a set the relation forks not passing a filter.
+ */
+void
+blockmap_filter(BlockMap *map,
+				bool (*include) (const RelFileNode *rnode, ForkNumber forknum))
+{
+	BlockMapEntry *entry;
+	blockhash_iterator iter;
+
+	/* deleting the current element is fine while iterating */
+	blockhash_start_iterate(map->hash, &iter);
+	while ((entry = blockhash_iterate(map->hash, &iter)) != NULL)
+	{
+		BlockMapKey key;
+
+		if (include(&entry->key.rnode, entry->key.forknum))
+			continue;
+
+		key = entry->key;
+		pg_free(entry->pending);
+		pg_free(entry->ranges);
+		blockhash_delete(map->hash, key);
+	}
+}
+
+static int
+blockmap_cmp_entry(const void *a, const void *b)
+{
+	const BlockMapEntry *ea = *((BlockMapEntry *const *) a);
+	const BlockMapEntry *eb = *((BlockMapEntry *const *) b);
+
+	if (ea->key.rnode.spcNode != eb->key.rnode.spcNode)
+		return ea->key.rnode.spcNode < eb->key.rnode.spcNode ? -1 : 1;
+	if (ea->key.rnode.dbNode != eb->key.rnode.dbNode)
+		return ea->key.rnode.dbNode < eb->key.rnode.dbNode ? -1 : 1;
+	if (ea->key.rnode.relNode != eb->key.rnode.relNode)
+		return ea->key.rnode.relNode < eb->key.rnode.relNode ? -1 : 1;
+	if (ea->key.forknum != eb->key.forknum)
+		return ea->key.forknum < eb->key.forknum ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Get all the entries of a set, sorted by relation and fork, with their
+ * pending blocks merged.
+ */
+static BlockMapEntry **
+blockmap_sorted_entries(BlockMap *map, int *nentries)
+{
+	BlockMapEntry **entries;
+	BlockMapEntry *entry;
+	blockhash_iterator iter;
+	int			n = 0;
+
+	entries = pg_malloc(sizeof(BlockMapEntry *) *
+						Max(map->hash->members, 1));
+	blockhash_start_iterate(map->hash, &iter);
+	while ((entry = blockhash_iterate(map->hash, &iter)) != NULL)
+	{
+		blockmap_flush_pending(entry);
+		entries[n++] = entry;
+	}
+	qsort(entries, n, sizeof(BlockMapEntry *), blockmap_cmp_entry);
+
+	*nentries = n;
+	return entries;
+}
+
+/*
+ * Write a value to a file, updating the checksum of the data written.
+ */
+static bool
+blockmap_fwrite(const void *data, size_t len, FILE *out, pg_crc32c *crc)
+{
+	COMP_CRC32C(*crc, data, len);
+	return fwrite(data, len, 1, out) == 1;
+}
+
+/*
+ * Read a value from a file, updating the checksum of the data read.
+ */
+static bool
+blockmap_fread(void *data, size_t len, FILE *in, pg_crc32c *crc)
+{
+	if (fread(data, len, 1, in) != 1)
+		return false;
+	COMP_CRC32C(*crc, data, len);
+	return true;
+}
+
+/*
+ * Save a set of blocks to a file, in a binary format that can be read
+ * back with blockmap_load(). The data is followed by its CRC-32C. Returns
+ * false on write failure, with errno set.
+ */
+bool
+blockmap_save(BlockMap *map, FILE *out)
+{
+	BlockMapEntry **entries;
+	int			nentries;
+	uint32		count;
+	pg_crc32c	crc;
+	bool		result = true;
+	int			i;
+
+	entries = blockmap_sorted_entries(map, &nentries);
+
+	INIT_CRC32C(crc);
+	count = nentries;
+	if (!blockmap_fwrite(&count, sizeof(uint32), out, &crc))
+		result = false;
+
+	for (i = 0; i < nentries && result; i++)
+	{
+		BlockMapEntry *entry = entries[i];
+		uint32		nranges = entry->nranges;
+
+		if (!blockmap_fwrite(&entry->key, sizeof(BlockMapKey), out, &crc) ||
+			!blockmap_fwrite(&nranges, sizeof(uint32), out, &crc) ||
+			!blockmap_fwrite(entry->ranges, sizeof(BlockRange) * nranges,
+							 out, &crc))
+			result = false;
+	}
+
+	FIN_CRC32C(crc);
+	if (result && fwrite(&crc, sizeof(pg_crc32c), 1, out) != 1)
+		result = false;
+
+	pg_free(entries);
+	return result;
+}
+
+/*
+ * Load a set of blocks saved with blockmap_save(), merging its blocks
+ * into an existing set. Returns false if the data could not be read or
+ * is corrupted, in which case some blocks may have been merged already.
+ */
+bool
+blockmap_load(BlockMap *map, FILE *in)
+{
+	BlockRange *ranges = NULL;
+	uint32		maxranges = 0;
+	uint32		count;
+	pg_crc32c	crc;
+	pg_crc32c	saved_crc;
+	bool		result = true;
+	uint32		i;
+
+	INIT_CRC32C(crc);
+	if (!blockmap_fread(&count, sizeof(uint32), in, &crc))
+		return false;
+
+	for (i = 0; i < count && result; i++)
+	{
+		BlockMapKey key;
+		BlockMapEntry *entry;
+		uint32		nranges;
+		bool		found;
+
+		if (!blockmap_fread(&key, sizeof(BlockMapKey), in, &crc) ||
+			!blockmap_fread(&nranges, sizeof(uint32), in, &crc) ||
+			key.forknum < 0 || key.forknum > MAX_FORKNUM)
+		{
+			result = false;
+			break;
+		}
+
+		if (nranges > maxranges)
+		{
+			maxranges = nranges;
+			ranges = pg_realloc(ranges, sizeof(BlockRange) * maxranges);
+		}
+		if (nranges > 0 &&
+			!blockmap_fread(ranges, sizeof(BlockRange) * nranges, in, &crc))
+		{
+			result = false;
+			break;
+		}
+
+		entry = blockhash_insert(map->hash, key, &found);
+		if (!found)
+		{
+			entry->pending = pg_malloc(sizeof(BlockNumber) *
+									   BLOCKMAP_PENDING_SIZE);
+			entry->npending = 0;
+			entry->last = nranges > 0 ? ranges[nranges - 1].end :
+				InvalidBlockNumber;
+			entry->nranges = 0;
+			entry->maxranges = 0;
+			entry->ranges = NULL;
+		}
+		blockmap_merge_ranges(entry, ranges, nranges);
+	}
+
+	FIN_CRC32C(crc);
+	if (result &&
+		(fread(&saved_crc, sizeof(pg_crc32c), 1, in) != 1 ||
+		 !EQ_CRC32C(crc, saved_crc)))
+		result = false;
+
+	pg_free(ranges);
+	return result;
+}
+
+/*
+ * Write a summary of the blocks touched, per relation fork.
+ */
+void
+blockmap_write(BlockMap *map, FILE *out, BlockMapFormat format)
+{
+	BlockMapEntry **entries;
+	int			nentries;
+	int			i;
+	int			j;
+
+	entries = blockmap_sorted_entries(map, &nentries);
+
+	if (format == BLOCKMAP_FORMAT_JSON)
+		fprintf(out, "{\"relations\": [");
+
+	for (i = 0; i < nentries; i++)
+	{
+		BlockMapEntry *entry = entries[i];
+		uint64		nblocks = 0;
+
+		for (j = 0; j < entry->nranges; j++)
+			nblocks += (uint64) entry->ranges[j].end -
+				entry->ranges[j].start + 1;
+
+		if (format == BLOCKMAP_FORMAT_JSON)
+		{
+			fprintf(out, "%s\n{\"tablespace\": %u, \"database\": %u, "
+					"\"relfilenode\": %u, \"fork\": \"%s\", "
+					"\"blocks\": " UINT64_FORMAT ", \"ranges\": [",
+					i == 0 ? "" : ",",
+					entry->key.rnode.spcNode, entry->key.rnode.dbNode,
+					entry->key.rnode.relNode, forkNames[entry->key.forknum],
+					nblocks);
+			for (j = 0; j < entry->nranges; j++)
+				fprintf(out, "%s[%u, %u]", j == 0 ? "" : ", ",
+						entry->ranges[j].start, entry->ranges[j].end);
+			fprintf(out, "]}");
+		}
+		else
+		{
+			fprintf(out, "%u/%u/%u %s blocks=" UINT64_FORMAT " ranges=",
+					entry->key.rnode.spcNode, entry->key.rnode.dbNode,
+					entry->key.rnode.relNode, forkNames[entry->key.forknum],
+					nblocks);
+			for (j = 0; j < entry->nranges; j++)
+			{
+				if (entry->ranges[j].start == entry->ranges[j].end)
+					fprintf(out, "%s%u", j == 0 ? "" : ",",
+							entry->ranges[j].start);
+				else
+					fprintf(out, "%s%u-%u", j == 0 ? "" : ",",
+							entry->ranges[j].start, entry->ranges[j].end);
+			}
+			fprintf(out, "\n");
+		}
+	}
+
+	if (format == BLOCKMAP_FORMAT_JSON)
+		fprintf(out, "\n]}\n");
+
+	pg_free(entries);
+}
+
+/*
+ * Free a set of blocks.
+ */
+void
+blockmap_free(BlockMap *map)
+{
+	BlockMapEntry *entry;
+	blockhash_iterator iter;
+
+	blockhash_start_iterate(map->hash, &iter);
+	while ((entry = blockhash_iterate(map->hash, &iter)) != NULL)
+	{
+		pg_free(entry->pending);
+		pg_free(entry->ranges);
+	}
+	blockhash_destroy(map->hash);
+	pg_free(map);
+}
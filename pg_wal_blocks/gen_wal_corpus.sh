@@ -0,0 +1,229 @@
+#!/bin/bash
+#-------------------------------------------------------------------------
+#
+# gen_wal_corpus.sh
+#		Generator of WAL corpora for pg_wal_blocks.
+#
+# This script creates a cluster with WAL archiving enabled, and runs a set
+# of workloads on it, keeping for each one the WAL segments it generated
+# in its own directory of the corpus. Workloads run with a single client
+# and a fixed random seed, so as the same operations are done each time
+# the corpus is generated. The segments of each workload are followed by
+# a file named "corpus.info" describing them.
+#
+# The binaries of PostgreSQL need to be in PATH or defined with -b.
+#
+# Copyright (c) 1996-2020, PostgreSQL Global Development Group
+#
+# IDENTIFICATION
+#		pg_wal_blocks/gen_wal_corpus.sh
+#
+#-------------------------------------------------------------------------
+
+set -e
+
+# Default values
+BINDIR=""
+BASEDIR="$(pwd)/wal_corpus"
+PORT=5450
+SCALE=10
+TRANSACTIONS=20000
+WORKLOADS="pgbench,bulk,fpi"
+SEGSIZE=16
+SEED=42
+
+usage()
+{
+	cat <<EOF
+Usage: $0 [OPTION]...
+
+Options:
+  -b BINDIR      location of PostgreSQL binaries (default: PATH)
+  -d DIRECTORY   base directory for the cluster and the corpus
+                 (default: $BASEDIR)
+  -p PORT        port of the cluster (default: $PORT)
+  -s SCALE       pgbench scale factor (default: $SCALE)
+  -t NUM         number of transactions of the pgbench and fpi
+                 workloads (default: $TRANSACTIONS)
+  -w LIST        comma-separated list of workloads among "pgbench",
+                 "bulk" and "fpi" (default: $WORKLOADS)
+  -S SIZE        WAL segment size, in megabytes (default: $SEGSIZE)
+  -r SEED        random seed of the workloads (default: $SEED)
+  -h             show this help, then exit
+
+Workloads:
+  pgbench        TPC-B like transactions of pgbench
+  bulk           bulk load of a new table, then CREATE INDEX and VACUUM
+  fpi            updates spread over a large table, with a checkpoint
+                 every 1000 transactions, generating full-page images
+EOF
+}
+
+while getopts "b:d:p:s:t:w:S:r:h" opt; do
+	case $opt in
+		b) BINDIR="$OPTARG/" ;;
+		d) BASEDIR="$OPTARG" ;;
+		p) PORT="$OPTARG" ;;
+		s) SCALE="$OPTARG" ;;
+		t) TRANSACTIONS="$OPTARG" ;;
+		w) WORKLOADS="$OPTARG" ;;
+		S) SEGSIZE="$OPTARG" ;;
+		r) SEED="$OPTARG" ;;
+		h) usage; exit 0 ;;
+		*) usage; exit 1 ;;
+	esac
+done
+
+for workload in ${WORKLOADS//,/ }; do
+	case $workload in
+		pgbench|bulk|fpi) ;;
+		*)
+			echo "$0: incorrect workload \"$workload\"" >&2
+			exit 1
+			;;
+	esac
+done
+
+DATADIR="$BASEDIR/data"
+ARCHIVEDIR="$BASEDIR/archive"
+CORPUSDIR="$BASEDIR/corpus"
+SOCKDIR="$BASEDIR"
+DBNAME=corpus
+
+run_psql()
+{
+	"${BINDIR}psql" -X -q -A -t -h "$SOCKDIR" -p $PORT -d $DBNAME -c "$1"
+}
+
+stop_cluster()
+{
+	"${BINDIR}pg_ctl" -D "$DATADIR" -m fast stop > /dev/null 2>&1 || true
+}
+trap stop_cluster EXIT
+
+echo "Setting up cluster in $BASEDIR"
+rm -rf "$BASEDIR"
+mkdir -p "$ARCHIVEDIR" "$CORPUSDIR"
+
+"${BINDIR}initdb" -D "$DATADIR" --no-sync --wal-segsize=$SEGSIZE > /dev/null
+cat >> "$DATADIR/postgresql.conf" <<EOF
+port = $PORT
+listen_addresses = ''
+unix_socket_directories = '$SOCKDIR'
+archive_mode = on
+archive_command = 'cp %p $ARCHIVEDIR/%f'
+full_page_writes = on
+checkpoint_timeout = 1h
+max_wal_size = 10GB
+synchronous_commit = off
+autovacuum = off
+log_min_messages = warning
+EOF
+"${BINDIR}pg_ctl" -D "$DATADIR" -w -l "$DATADIR/server.log" start > /dev/null
+"${BINDIR}createdb" -h "$SOCKDIR" -p $PORT $DBNAME
+
+# Wait until a segment has been archived.
+wait_for_archive()
+{
+	local segment=$1
+
+	while [ ! -f "$ARCHIVEDIR/$segment" ]; do
+		sleep 0.2
+	done
+}
+
+# Begin the WAL of a workload in a new segment, returning its name.
+begin_workload()
+{
+	run_psql "CHECKPOINT;"
+	run_psql "SELECT pg_walfile_name(pg_switch_wal());" > /dev/null
+	run_psql "SELECT pg_walfile_name(pg_current_wal_lsn());"
+}
+
+# Switch to a new segment at the end of a workload, and copy all the
+# segments it generated to its directory in the corpus.
+end_workload()
+{
+	local workload=$1
+	local start_segment=$2
+	local start_lsn=$3
+	local end_lsn
+	local end_segment
+	local dir="$CORPUSDIR/$workload"
+	local count=0
+
+	end_lsn=$(run_psql "SELECT pg_current_wal_lsn();")
+	end_segment=$(run_psql "SELECT pg_walfile_name('$end_lsn');")
+	run_psql "SELECT pg_switch_wal();" > /dev/null
+	wait_for_archive "$end_segment"
+
+	mkdir -p "$dir"
+	for segment in $(ls "$ARCHIVEDIR" | sort); do
+		if [[ "$segment" < "$start_segment" || "$segment" > "$end_segment" ]]; then
+			continue
+		fi
+		cp "$ARCHIVEDIR/$segment" "$dir/"
+		count=$((count + 1))
+	done
+
+	cat > "$dir/corpus.info" <<EOF
+workload = $workload
+start_lsn = $start_lsn
+end_lsn = $end_lsn
+segments = $count
+segment_size_mb = $SEGSIZE
+seed = $SEED
+EOF
+	echo "Workload $workload: $count segments from $start_lsn to $end_lsn"
+}
+
+for workload in ${WORKLOADS//,/ }; do
+	case $workload in
+		pgbench)
+			"${BINDIR}pgbench" -i -q -s $SCALE -h "$SOCKDIR" -p $PORT $DBNAME \
+				> "$BASEDIR/pgbench_init.log" 2>&1
+			start_segment=$(begin_workload)
+			start_lsn=$(run_psql "SELECT pg_current_wal_lsn();")
+			"${BINDIR}pgbench" -n -c 1 -t $TRANSACTIONS --random-seed=$SEED \
+				-h "$SOCKDIR" -p $PORT $DBNAME > "$BASEDIR/pgbench.log"
+			;;
+		bulk)
+			start_segment=$(begin_workload)
+			start_lsn=$(run_psql "SELECT pg_current_wal_lsn();")
+			run_psql "CREATE TABLE bulk_data (id int, val text, ts timestamptz);
+				INSERT INTO bulk_data
+					SELECT i, md5(i::text), '2020-01-01'::timestamptz + i * interval '1s'
+					FROM generate_series(1, $((SCALE * 100000))) i;
+				CREATE INDEX bulk_data_id ON bulk_data (id);
+				VACUUM bulk_data;"
+			;;
+		fpi)
+			run_psql "CREATE TABLE fpi_data (id int PRIMARY KEY, val int)
+				WITH (fillfactor = 50);
+				INSERT INTO fpi_data SELECT i, 0
+					FROM generate_series(1, $((SCALE * 100000))) i;
+				VACUUM fpi_data;"
+			cat > "$BASEDIR/fpi.sql" <<EOF
+\\set id random(1, $((SCALE * 100000)))
+UPDATE fpi_data SET val = val + 1 WHERE id = :id;
+EOF
+			start_segment=$(begin_workload)
+			start_lsn=$(run_psql "SELECT pg_current_wal_lsn();")
+			# Updates spread randomly across the table generate a full-page
+			# image for most of them after each checkpoint.
+			remaining=$TRANSACTIONS
+			while [ $remaining -gt 0 ]; do
+				batch=$((remaining < 1000 ? remaining : 1000))
+				"${BINDIR}pgbench" -n -c 1 -t $batch --random-seed=$((SEED + remaining)) \
+					-f "$BASEDIR/fpi.sql" -h "$SOCKDIR" -p $PORT $DBNAME \
+					>> "$BASEDIR/fpi.log"
+				run_psql "CHECKPOINT;"
+				remaining=$((remaining - batch))
+			done
+			;;
+	esac
+
+	end_workload $workload $start_segment $start_lsn
+done
+
+echo "Corpus is in $CORPUSDIR."
@@ -0,0 +1,443 @@
+/*-------------------------------------------------------------------------
+ *
+ * journal.c
+ *		On-disk journal of relation blocks touched by WAL records
+ *
+ * The journal is a directory of files, each one holding the set of blocks
+ * touched by the WAL records in an interval of LSNs, from the beginning
+ * of a record to the end of another one. When following WAL, an interval
+ * ends at each checkpoint record, and the interval still in progress is
+ * saved in a separate file, rewritten each time the end of the WAL
+ * available is reached.
+ *
+ * Files have a level, intervals ending at checkpoints being at level 0.
+ * When there are more than JOURNAL_COMPACT_FILES files at a level, the
+ * oldest ones are merged into a single file covering all their intervals
+ * at the next level. The journal keeps this way a number of files
+ * logarithmic with the amount of WAL tracked, recent intervals being
+ * precise and older ones coarser.
+ *
+ * Looking for the blocks touched since an LSN merges the files whose
+ * interval ends after it. With coarser intervals, more blocks than
+ * necessary may be returned, but never less.
+ *
+ * Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		pg_wal_blocks/journal.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres_fe.h"
+
+#include <dirent.h>
+
+#include "common/file_utils.h"
+
+#include "pg_wal_blocks.h"
+
+/* Number of files at a level triggering their merge into the next level */
+#define JOURNAL_COMPACT_FILES	16
+
+/* Name of the file of the interval in progress */
+#define JOURNAL_CURRENT_FILE	"current.blocks"
+
+#define JOURNAL_MAGIC			0x50574A31	/* "PWJ1" */
+#define JOURNAL_VERSION			1
+
+/* Header of each journal file, followed by the set of blocks */
+typedef struct JournalHeader
+{
+	uint32		magic;
+	uint32		version;
+	XLogRecPtr	start_lsn;		/* beginning of interval */
+	XLogRecPtr	end_lsn;		/* end of interval */
+	TimeLineID	tli;			/* timeline at end of interval */
+	uint32		level;			/* compaction level */
+} JournalHeader;
+
+/* A journal file, as found in the journal directory */
+typedef struct JournalFile
+{
+	char		fname[MAXPGPATH];
+	XLogRecPtr	start_lsn;
+	XLogRecPtr	end_lsn;
+	uint32		level;
+} JournalFile;
+
+/*
+ * Write a journal file, atomically replacing any existing file with the
+ * same name. Exits on failure.
+ */
+static void
+journal_write_file(const char *directory, const char *fname, BlockMap *map,
+				   XLogRecPtr start_lsn, XLogRecPtr end_lsn, TimeLineID tli,
+				   uint32 level)
+{
+	char		path[MAXPGPATH];
+	char		tmppath[MAXPGPATH];
+	JournalHeader header;
+	FILE	   *out;
+
+	snprintf(path, MAXPGPATH, "%s/%s", directory, fname);
+	snprintf(tmppath, MAXPGPATH, "%s.tmp", path);
+
+	out = fopen(tmppath, PG_BINARY_W);
+	if (out == NULL)
+	{
+		fprintf(stderr, "%s: could not create file \"%s\": %s\n",
+				progname, tmppath, strerror(errno));
+		exit(1);
+	}
+
+	memset(&header, 0, sizeof(JournalHeader));
+	header.magic = JOURNAL_MAGIC;
+	header.version = JOURNAL_VERSION;
+	header.start_lsn = start_lsn;
+	header.end_lsn = end_lsn;
+	header.tli = tli;
+	header.level = level;
+
+	if (fwrite(&header, sizeof(JournalHeader), 1, out) != 1 ||
+		!blockmap_save(map, out) ||
+		fclose(out) != 0)
+	{
+		fprintf(stderr, "%s: could not write file \"%s\": %s\n",
+				progname, tmppath, strerror(errno));
+		exit(1);
+	}
+
+	if (durable_rename(tmppath, path) != 0)
+		exit(1);
+}
+
+/*
+ * Read the header of a journal file, and merge its blocks into a set if
+ * map is not NULL. Returns false if the file is not a valid journal file.
+ */
+static bool
+journal_read_file(const char *directory, const char *fname,
+				  JournalHeader *header, BlockMap *map)
+{
+	char		path[MAXPGPATH];
+	FILE	   *in;
+	bool		result;
+
+	snprintf(path, MAXPGPATH, "%s/%s", directory, fname);
+	in = fopen(path, PG_BINARY_R);
+	if (in == NULL)
+	{
+		fprintf(stderr, "%s: could not open file \"%s\": %s\n",
+				progname, path, strerror(errno));
+		return false;
+	}
+
+	result = fread(header, sizeof(JournalHeader), 1, in) == 1 &&
+		header->magic == JOURNAL_MAGIC &&
+		header->version == JOURNAL_VERSION;
+	if (result && map != NULL)
+		result = blockmap_load(map, in);
+	fclose(in);
+
+	if (!result)
+		fprintf(stderr, "%s: invalid journal file \"%s\"\n", progname, path);
+	return result;
+}
+
+static int
+journal_file_cmp(const void *a, const void *b)
+{
+	const JournalFile *fa = (const JournalFile *) a;
+	const JournalFile *fb = (const JournalFile *) b;
+
+	if (fa->start_lsn != fb->start_lsn)
+		return fa->start_lsn < fb->start_lsn ? -1 : 1;
+	if (fa->end_lsn != fb->end_lsn)
+		return fa->end_lsn < fb->end_lsn ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Get the list of closed intervals of the journal, sorted by LSN. The
+ * interval in progress is not included.
+ */
+static JournalFile *
+journal_list_files(const char *directory, int *nfiles)
+{
+	DIR		   *dir;
+	struct dirent *de;
+	JournalFile *files = NULL;
+	int			maxfiles = 0;
+	int			n = 0;
+
+	dir = opendir(directory);
+	if (dir == NULL)
+	{
+		fprintf(stderr, "%s: could not open directory \"%s\": %s\n",
+				progname, directory, strerror(errno));
+		exit(1);
+	}
+
+	while (errno = 0, (de = readdir(dir)) != NULL)
+	{
+		uint32		start_hi,
+					start_lo,
+					end_hi,
+					end_lo,
+					level;
+		char		suffix[8];
+
+		if (sscanf(de->d_name, "%08X%08X-%08X%08X-L%u.%7s",
+				   &start_hi, &start_lo, &end_hi, &end_lo, &level,
+				   suffix) != 6 ||
+			strcmp(suffix, "blocks") != 0)
+			continue;
+
+		if (n >= maxfiles)
+		{
+			maxfiles = maxfiles == 0 ? 64 : maxfiles * 2;
+			files = pg_realloc(files, sizeof(JournalFile) * maxfiles);
+		}
+		strlcpy(files[n].fname, de->d_name, MAXPGPATH);
+		files[n].start_lsn = ((uint64) start_hi) << 32 | start_lo;
+		files[n].end_lsn = ((uint64) end_hi) << 32 | end_lo;
+		files[n].level = level;
+		n++;
+	}
+
+	if (errno)
+	{
+		fprintf(stderr, "%s: could not read directory \"%s\": %s\n",
+				progname, directory, strerror(errno));
+		exit(1);
+	}
+	closedir(dir);
+
+	if (n > 0)
+		qsort(files, n, sizeof(JournalFile), journal_file_cmp);
+	*nfiles = n;
+	return files;
+}
+
+/*
+ * Merge the oldest files of each level with too many files into the next
+ * level.
+ */
+static void
+journal_compact(const char *directory)
+{
+	uint32		level = 0;
+	uint32		maxlevel = 0;
+
+	for (;;)
+	{
+		JournalFile *files;
+		int			nfiles;
+		int			first = -1;
+		int			count = 0;
+		int			i;
+		BlockMap   *map;
+		JournalHeader header;
+		char		fname[MAXPGPATH];
+		TimeLineID	tli = 0;
+
+		files = journal_list_files(directory, &nfiles);
+		for (i = 0; i < nfiles; i++)
+		{
+			maxlevel = Max(maxlevel, files[i].level);
+			if (files[i].level != level)
+				continue;
+			if (first < 0)
+				first = i;
+			count++;
+		}
+
+		if (count <= JOURNAL_COMPACT_FILES)
+		{
+			pg_free(files);
+			if (level >= maxlevel)
+				break;
+			level++;
+			continue;
+		}
+
+		/* Merge the oldest files of this level */
+		map = blockmap_create();
+		count = 0;
+		for (i = first; i < nfiles && count < JOURNAL_COMPACT_FILES; i++)
+		{
+			if (files[i].level != level)
+				continue;
+			if (!journal_read_file(directory, files[i].fname, &header, map))
+				exit(1);
+			tli = header.tli;
+			count++;
+		}
+
+		snprintf(fname, MAXPGPATH, "%08X%08X-%08X%08X-L%u.blocks",
+				 (uint32) (files[first].start_lsn >> 32),
+				 (uint32) files[first].start_lsn,
+				 (uint32) (files[i - 1].end_lsn >> 32),
+				 (uint32) files[i - 1].end_lsn,
+				 level + 1);
+		journal_write_file(directory, fname, map, files[first].start_lsn,
+						   files[i - 1].end_lsn, tli, level + 1);
+		blockmap_free(map);
+
+		/* The merged file is durable, so remove the files it replaces */
+		count = 0;
+		for (i = first; i < nfiles && count < JOURNAL_COMPACT_FILES; i++)
+		{
+			char		path[MAXPGPATH];
+
+			if (files[i].level != level)
+				continue;
+			snprintf(path, MAXPGPATH, "%s/%s", directory, files[i].fname);
+			if (unlink(path) != 0)
+			{
+				fprintf(stderr, "%s: could not remove file \"%s\": %s\n",
+						progname, path, strerror(errno));
+				exit(1);
+			}
+			count++;
+		}
+
+		pg_free(files);
+	}
+}
+
+/*
+ * Save the blocks touched in an interval ending at a checkpoint, then
+ * compact the journal. The file of the interval in progress is removed,
+ * as the new interval covers it.
+ */
+void
+journal_add_interval(const char *directory, BlockMap *map,
+					 XLogRecPtr start_lsn, XLogRecPtr end_lsn, TimeLineID tli)
+{
+	char		fname[MAXPGPATH];
+	char		path[MAXPGPATH];
+
+	snprintf(fname, MAXPGPATH, "%08X%08X-%08X%08X-L0.blocks",
+			 (uint32) (start_lsn >> 32), (uint32) start_lsn,
+			 (uint32) (end_lsn >> 32), (uint32) end_lsn);
+	journal_write_file(directory, fname, map, start_lsn, end_lsn, tli, 0);
+
+	snprintf(path, MAXPGPATH, "%s/%s", directory, JOURNAL_CURRENT_FILE);
+	if (unlink(path) != 0 && errno != ENOENT)
+	{
+		fprintf(stderr, "%s: could not remove file \"%s\": %s\n",
+				progname, path, strerror(errno));
+		exit(1);
+	}
+
+	journal_compact(directory);
+}
+
+/*
+ * Save the blocks touched in the interval in progress.
+ */
+void
+journal_save_current(const char *directory, BlockMap *map,
+					 XLogRecPtr start_lsn, XLogRecPtr end_lsn, TimeLineID tli)
+{
+	journal_write_file(directory, JOURNAL_CURRENT_FILE, map, start_lsn,
+					   end_lsn, tli, 0);
+}
+
+/*
+ * Get the position where the journal ends, to resume following WAL. If
+ * the interval in progress was saved, its blocks are merged into map so
+ * as they are not lost. Returns false if the journal is empty.
+ */
+bool
+journal_get_end(const char *directory, BlockMap *map,
+				XLogRecPtr *start_lsn, XLogRecPtr *end_lsn, TimeLineID *tli)
+{
+	JournalFile *files;
+	JournalHeader header;
+	int			nfiles;
+	char		path[MAXPGPATH];
+	bool		found = false;
+
+	files = journal_list_files(directory, &nfiles);
+	if (nfiles > 0)
+	{
+		if (!journal_read_file(directory, files[nfiles - 1].fname, &header,
+							   NULL))
+			exit(1);
+		*start_lsn = *end_lsn = header.end_lsn;
+		*tli = header.tli;
+		found = true;
+	}
+	pg_free(files);
+
+	snprintf(path, MAXPGPATH, "%s/%s", directory, JOURNAL_CURRENT_FILE);
+	if (access(path, F_OK) == 0)
+	{
+		BlockMap   *current = blockmap_create();
+
+		if (!journal_read_file(directory, JOURNAL_CURRENT_FILE, &header,
+							   current))
+			exit(1);
+
+		/* Ignore an interval already closed before a crash */
+		if (!found || header.start_lsn >= *end_lsn)
+		{
+			blockmap_merge(map, current);
+			*start_lsn = header.start_lsn;
+			*end_lsn = header.end_lsn;
+			*tli = header.tli;
+			found = true;
+		}
+		blockmap_free(current);
+	}
+
+	return found;
+}
+
+/*
+ * Merge into a set all the blocks touched since an LSN. Returns false if
+ * the journal does not cover the LSN, in which case the set is
+ * incomplete.
+ */
+bool
+journal_blocks_since(const char *directory, XLogRecPtr since, BlockMap *map)
+{
+	JournalFile *files;
+	JournalHeader header;
+	int			nfiles;
+	int			i;
+	char		path[MAXPGPATH];
+	bool		covered;
+
+	files = journal_list_files(directory, &nfiles);
+	covered = nfiles > 0 && files[0].start_lsn <= since;
+
+	for (i = 0; i < nfiles; i++)
+	{
+		if (files[i].end_lsn <= since)
+			continue;
+		if (!journal_read_file(directory, files[i].fname, &header, map))
+			exit(1);
+	}
+	pg_free(files);
+
+	snprintf(path, MAXPGPATH, "%s/%s", directory, JOURNAL_CURRENT_FILE);
+	if (access(path, F_OK) == 0)
+	{
+		BlockMap   *current = blockmap_create();
+
+		if (!journal_read_file(directory, JOURNAL_CURRENT_FILE, &header,
+							   current))
+			exit(1);
+		if (header.end_lsn > since)
+			blockmap_merge(map, current);
+		if (nfiles == 0 && header.start_lsn <= since)
+			covered = true;
+		blockmap_free(current);
+	}
+
+	return covered;
+}
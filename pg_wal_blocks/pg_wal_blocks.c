@@ -3,6 +3,13 @@
  * pg_wal_blocks.c
  *		Tracker of relation blocks touched by WAL records
  *
+ * The WAL segments given in input are split into ranges of consecutive
+ * segments on the same timeline, themselves split into tasks of contiguous
+ * segments distributed across a pool of threads. Each thread parses the
+ * records beginning in the segments of its tasks, following the records
+ * crossing into the next segment of the range, and tracks the blocks
+ * touched in its own set, all the sets being merged at the end.
+ *
  * Copyright (c) 1996-2020, PostgreSQL Global Development Group
  *
  * IDENTIFICATION
@@ -14,8 +21,24 @@
 #include "postgres_fe.h"
 #include "getopt_long.h"
 
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#ifdef ENABLE_THREAD_SAFETY
+#ifdef WIN32
+#include "pthread-win32.h"
+#else
+#include <pthread.h>
+#endif
+#endif
+
+#include "access/rmgr.h"
 #include "access/xlogdefs.h"
 #include "access/xlog_internal.h"
+#include "catalog/pg_control.h"
+
+#include "pg_wal_blocks.h"
 
 #define PG_WAL_BLOCKS_VERSION "0.1"
 
@@ -23,19 +46,91 @@ const char *progname;
 
 /* Global parameters */
 static bool verbose = false;
-static char *full_path = NULL;
-static uint32 WalSegSz = DEFAULT_XLOG_SEG_SIZE;	/* should be settable */
+static BlockMapFormat output_format = BLOCKMAP_FORMAT_TEXT;
+static int	num_jobs = 1;
+static bool use_mmap = true;
+static bool stats_mode = false;
+static uint32 WalSegSz = 0;		/* detected from segments if not set */
+
+/* Filters of the blocks tracked, applied before adding them to any set */
+static bool fork_included[MAX_FORKNUM + 1] = {true};	/* main only */
+static Oid	filter_tablespace = InvalidOid;
+static Oid	filter_database = InvalidOid;
+static Oid *filter_relfilenodes = NULL;	/* sorted */
+static int	nfilter_relfilenodes = 0;
+
+/* Parameters of the journal of blocks */
+static char *journal_directory = NULL;
+static bool follow = false;
+static XLogRecPtr since_lsn = InvalidXLogRecPtr;
+
+/* Interval between two checks for new WAL with --follow, in microseconds */
+#define FOLLOW_POLL_INTERVAL	1000000L
+
+static volatile sig_atomic_t follow_stop = false;
+
+/* Directory where the WAL segments to parse are, NULL if current one */
+static char *wal_directory = NULL;
+
+/* Segments to parse, sorted by timeline and segment number */
+typedef struct WalSegment
+{
+	TimeLineID	tli;
+	XLogSegNo	segno;
+} WalSegment;
+static WalSegment *segments = NULL;
+static int	nsegments = 0;
+
+/*
+ * Task of a thread: records beginning in the segments from startseg to
+ * endseg are parsed, and the records crossing the end of endseg are
+ * followed up to lastseg, the last segment of the range of consecutive
+ * segments available.
+ *
+ * Reading stops at the first invalid record, which is the end of valid
+ * WAL when parsing a live pg_wal, whose last segments are partially
+ * written or recycled. This is only known once all the tasks are done,
+ * as no later task of the same range can find valid records then.
+ */
+typedef struct WalTask
+{
+	TimeLineID	tli;
+	XLogSegNo	startseg;
+	XLogSegNo	endseg;
+	XLogSegNo	lastseg;
+	bool		found;			/* were valid records found? */
+	XLogRecPtr	end_of_wal;		/* where reading stopped, if before the end
+								 * of the task */
+	char	   *errormsg;		/* why reading stopped there */
+} WalTask;
+static WalTask *tasks = NULL;
+static int	ntasks = 0;
+static int	next_task = 0;		/* next task to assign */
 
-/* Data regarding input WAL to parse */
-static XLogSegNo segno = 0;
+#ifdef ENABLE_THREAD_SAFETY
+static pthread_mutex_t task_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
-/* Parsing status */
-static int xlogreadfd = -1; /* File descriptor of opened WAL segment */
+/* State of each thread */
+typedef struct WorkerState
+{
+	int			id;
+	BlockMap   *blockmap;		/* blocks touched */
+	WalStats   *stats;			/* statistics of records, with --stats */
+	uint64		nrecords;		/* number of records parsed */
+#ifdef ENABLE_THREAD_SAFETY
+	pthread_t	thread;
+#endif
+} WorkerState;
 
 /* Structures for XLOG reader callback */
 typedef struct XLogReadBlockPrivate
 {
-	const char	   *full_path;
+	TimeLineID	tli;			/* timeline of segments to read */
+	XLogSegNo	lastseg;		/* last segment that can be read */
+	WalFile		file;			/* opened segment */
+	XLogSegNo	segno;			/* segment number of opened segment */
+	bool		follow;			/* following WAL as it is written? */
 } XLogReadBlockPrivate;
 static int XLogReadPageBlock(XLogReaderState *xlogreader,
 							 XLogRecPtr targetPagePtr,
@@ -46,9 +141,39 @@ static void
 usage(const char *progname)
 {
 	printf("%s tracks relation blocks touched by WAL records.\n\n", progname);
-	printf("Usage:\n %s [OPTION] [WAL_SEGMENT]...\n\n", progname);
+	printf("Usage:\n %s [OPTION]... STARTSEG [ENDSEG]\n", progname);
+	printf(" %s [OPTION]... DIRECTORY\n", progname);
+	printf(" %s --journal=DIR --follow [OPTION]... DIRECTORY\n", progname);
+	printf(" %s --journal=DIR --since=LSN [OPTION]...\n\n", progname);
+	printf("With STARTSEG and ENDSEG, all the segments between both of them\n"
+		   "are parsed, ENDSEG being looked at in the directory of STARTSEG.\n"
+		   "With DIRECTORY, all the segments it includes are parsed.\n\n");
 	printf("Options:\n");
-	printf("  -v             write some progress messages as well\n");
+	printf("  -f, --format=FORMAT  output format of the summary of blocks,\n"
+		   "                       \"text\" (default) or \"json\"\n");
+	printf("      --forks=LIST     comma-separated list of forks to track,\n"
+		   "                       among main (default), fsm, vm, init, or all\n");
+	printf("      --tablespace=OID track only blocks of this tablespace\n");
+	printf("      --database=OID   track only blocks of this database\n");
+	printf("      --relfilenode=OID[,OID...]\n"
+		   "                       track only blocks of these relfilenodes\n");
+	printf("  -j, --jobs=NUM       number of threads parsing segments in\n"
+		   "                       parallel (default: 1)\n");
+	printf("      --no-mmap        read segments with buffered reads instead\n"
+		   "                       of mapping them in memory\n");
+	printf("  -s, --wal-segsize=SIZE\n"
+		   "                       size of WAL segments, in megabytes, read\n"
+		   "                       from the first segment if not set\n");
+	printf("      --stats          write statistics of records per type and\n"
+		   "                       of full-page images per relation instead\n"
+		   "                       of the summary of blocks\n");
+	printf("      --journal=DIR    directory of the journal of blocks, for\n"
+		   "                       --follow and --since\n");
+	printf("      --follow         follow WAL in DIRECTORY as it is written,\n"
+		   "                       saving the blocks touched in the journal\n");
+	printf("      --since=LSN      write the summary of blocks touched since\n"
+		   "                       LSN, as saved in the journal\n");
+	printf("  -v             write each block reference to stderr as well\n");
 	printf("  -V, --version  output version information, then exit\n");
 	printf("  -?, --help     show this help, then exit\n");
 	printf("\n");
@@ -85,6 +210,110 @@ split_path(const char *path, char **dir, char **fname)
 	}
 }
 
+/*
+ * Build the path of a WAL segment.
+ */
+static void
+segment_path(char *path, TimeLineID tli, XLogSegNo segno)
+{
+	char		fname[MAXFNAMELEN];
+
+	XLogFileName(fname, tli, segno, WalSegSz);
+	snprintf(path, MAXPGPATH, "%s%s",
+			 wal_directory ? wal_directory : "", fname);
+}
+
+/*
+ * Detect the WAL segment size from the long page header at the beginning
+ * of a segment, if it was not given by the caller.
+ */
+static void
+detect_segment_size(const char *path)
+{
+	PGAlignedXLogBlock buf;
+	XLogLongPageHeader longhdr = (XLogLongPageHeader) buf.data;
+	int			fd;
+	int			r;
+
+	if (WalSegSz != 0)
+		return;
+
+	fd = open(path, O_RDONLY | PG_BINARY, 0);
+	if (fd < 0)
+	{
+		fprintf(stderr, "could not open file \"%s\": %s\n",
+				path, strerror(errno));
+		exit(1);
+	}
+
+	r = read(fd, buf.data, XLOG_BLCKSZ);
+	if (r != XLOG_BLCKSZ)
+	{
+		if (r < 0)
+			fprintf(stderr, "could not read file \"%s\": %s\n",
+					path, strerror(errno));
+		else
+			fprintf(stderr, "could not read file \"%s\": read %d of %d\n",
+					path, r, XLOG_BLCKSZ);
+		exit(1);
+	}
+	close(fd);
+
+	if (longhdr->std.xlp_magic != XLOG_PAGE_MAGIC ||
+		(longhdr->std.xlp_info & XLP_LONG_HEADER) == 0)
+	{
+		fprintf(stderr, "%s: file \"%s\" does not begin with a valid WAL page header, use --wal-segsize\n",
+				progname, path);
+		exit(1);
+	}
+
+	if (!IsValidWalSegSize(longhdr->xlp_seg_size))
+	{
+		fprintf(stderr, "%s: invalid WAL segment size %u in file \"%s\", use --wal-segsize\n",
+				progname, longhdr->xlp_seg_size, path);
+		exit(1);
+	}
+
+	WalSegSz = longhdr->xlp_seg_size;
+}
+
+/*
+ * Find the timeline of a segment when following WAL, the newest one at
+ * least as new as the given timeline. Returns 0 if the segment does not
+ * exist yet.
+ */
+static TimeLineID
+follow_segment_tli(XLogSegNo segno, TimeLineID tli)
+{
+	DIR		   *dir;
+	struct dirent *de;
+	TimeLineID	result = 0;
+
+	dir = opendir(wal_directory);
+	if (dir == NULL)
+	{
+		fprintf(stderr, "%s: could not open directory \"%s\": %s\n",
+				progname, wal_directory, strerror(errno));
+		exit(1);
+	}
+
+	while ((de = readdir(dir)) != NULL)
+	{
+		TimeLineID	file_tli;
+		XLogSegNo	file_segno;
+
+		if (!IsXLogFileName(de->d_name))
+			continue;
+
+		XLogFromFileName(de->d_name, &file_tli, &file_segno, WalSegSz);
+		if (file_segno == segno && file_tli >= tli && file_tli > result)
+			result = file_tli;
+	}
+	closedir(dir);
+
+	return result;
+}
+
 /* XLogreader callback function, to read a WAL page */
 static int
 XLogReadPageBlock(XLogReaderState *xlogreader, XLogRecPtr targetPagePtr,
@@ -93,45 +322,175 @@ XLogReadPageBlock(XLogReaderState *xlogreader, XLogRecPtr targetPagePtr,
 	XLogReadBlockPrivate *private =
 		(XLogReadBlockPrivate *) xlogreader->private_data;
 	uint32      targetPageOff;
+	XLogSegNo	targetSegNo;
+	char		path[MAXPGPATH];
 
-	targetPageOff = targetPagePtr % WalSegSz;
+	XLByteToSeg(targetPagePtr, targetSegNo, WalSegSz);
+	targetPageOff = XLogSegmentOffset(targetPagePtr, WalSegSz);
 
-	if (xlogreadfd < 0)
+	/* No more segments available */
+	if (targetSegNo > private->lastseg)
+		return -1;
+
+	/* Switch to the segment of the page if necessary */
+	if (private->file.fd >= 0 && private->segno != targetSegNo)
+		walfile_close(&private->file);
+
+	/*
+	 * When following WAL, the next segment may not be written yet, and may
+	 * be on a newer timeline after a promotion.
+	 */
+	if (private->follow && private->file.fd < 0)
 	{
-		xlogreadfd = open(private->full_path, O_RDONLY | PG_BINARY, 0);
+		TimeLineID	tli = follow_segment_tli(targetSegNo, private->tli);
+
+		if (tli == 0)
+			return -1;
+		private->tli = tli;
+	}
+
+	segment_path(path, private->tli, targetSegNo);
 
-		if (xlogreadfd < 0)
+	if (private->file.fd < 0)
+	{
+		if (!walfile_open(&private->file, path, WalSegSz, use_mmap))
 		{
 			fprintf(stderr, "could not open file \"%s\": %s\n",
-					private->full_path,
-					strerror(errno));
+					path, strerror(errno));
 			return -1;
 		}
+		private->segno = targetSegNo;
 	}
 
 	/*
 	 * At this point, we have the right segment open.
 	 */
-	Assert(xlogreadfd != -1);
+	Assert(private->file.fd != -1);
 
 	/* Read the requested page */
-	if (lseek(xlogreadfd, (off_t) targetPageOff, SEEK_SET) < 0)
+	if (!walfile_read_page(&private->file, targetPageOff, readBuf))
 	{
-		fprintf(stderr, "could not seek in file \"%s\": %s\n",
-				private->full_path,
-				strerror(errno));
+		if (errno == 0)
+			fprintf(stderr, "could not read from file \"%s\": read past end of file\n",
+					path);
+		else
+			fprintf(stderr, "could not read from file \"%s\": %s\n",
+					path, strerror(errno));
 		return -1;
 	}
 
-	if (read(xlogreadfd, readBuf, XLOG_BLCKSZ) != XLOG_BLCKSZ)
-	{
-		fprintf(stderr, "could not read from file \"%s\": %s\n",
-				private->full_path,
-				strerror(errno));
+	return XLOG_BLCKSZ;
+}
+
+static int
+oid_cmp(const void *a, const void *b)
+{
+	Oid			oa = *((const Oid *) a);
+	Oid			ob = *((const Oid *) b);
+
+	if (oa < ob)
 		return -1;
+	if (oa > ob)
+		return 1;
+	return 0;
+}
+
+/*
+ * Check if a block of a relation fork passes the filters.
+ */
+static bool
+block_is_included(const RelFileNode *rnode, ForkNumber forknum)
+{
+	if (!fork_included[forknum])
+		return false;
+	if (OidIsValid(filter_tablespace) && rnode->spcNode != filter_tablespace)
+		return false;
+	if (OidIsValid(filter_database) && rnode->dbNode != filter_database)
+		return false;
+	if (nfilter_relfilenodes > 0 &&
+		bsearch(&rnode->relNode, filter_relfilenodes, nfilter_relfilenodes,
+				sizeof(Oid), oid_cmp) == NULL)
+		return false;
+	return true;
+}
+
+/*
+ * Parse an OID given as option value, exiting on failure.
+ */
+static Oid
+parse_oid(const char *str, const char *option)
+{
+	char	   *endptr;
+	unsigned long val;
+
+	errno = 0;
+	val = strtoul(str, &endptr, 10);
+	if (*str == '\0' || *endptr != '\0' || errno != 0 ||
+		val == InvalidOid || val > PG_UINT32_MAX)
+	{
+		fprintf(stderr, "%s: invalid OID \"%s\" for option %s\n",
+				progname, str, option);
+		exit(1);
 	}
+	return (Oid) val;
+}
 
-	return XLOG_BLCKSZ;
+/*
+ * Parse a comma-separated list of fork names, or "all".
+ */
+static void
+parse_forks(const char *str)
+{
+	char	   *list = pg_strdup(str);
+	char	   *name;
+	int			i;
+
+	for (i = 0; i <= MAX_FORKNUM; i++)
+		fork_included[i] = false;
+
+	for (name = strtok(list, ","); name != NULL; name = strtok(NULL, ","))
+	{
+		ForkNumber	forknum;
+
+		if (strcmp(name, "all") == 0)
+		{
+			for (i = 0; i <= MAX_FORKNUM; i++)
+				fork_included[i] = true;
+			continue;
+		}
+
+		forknum = forkname_to_number(name);
+		if (forknum == InvalidForkNumber)
+		{
+			fprintf(stderr, "%s: invalid fork name \"%s\"\n",
+					progname, name);
+			exit(1);
+		}
+		fork_included[forknum] = true;
+	}
+
+	pg_free(list);
+}
+
+/*
+ * Parse a comma-separated list of relfilenodes, adding them to the
+ * filter.
+ */
+static void
+parse_relfilenodes(const char *str)
+{
+	char	   *list = pg_strdup(str);
+	char	   *item;
+
+	for (item = strtok(list, ","); item != NULL; item = strtok(NULL, ","))
+	{
+		filter_relfilenodes = pg_realloc(filter_relfilenodes,
+										 sizeof(Oid) * (nfilter_relfilenodes + 1));
+		filter_relfilenodes[nfilter_relfilenodes++] =
+			parse_oid(item, "--relfilenode");
+	}
+
+	pg_free(list);
 }
 
 /*
@@ -139,7 +498,7 @@ XLogReadPageBlock(XLogReaderState *xlogreader, XLogRecPtr targetPagePtr,
  * Extract block information for given record.
  */
 static void
-extract_block_info(XLogReaderState *record)
+extract_block_info(XLogReaderState *record, BlockMap *blockmap)
 {
 	int block_id;
 
@@ -152,59 +511,459 @@ extract_block_info(XLogReaderState *record)
 		if (!XLogRecGetBlockTag(record, block_id, &rnode, &forknum, &blkno))
 			continue;
 
-		/* We only care about the main fork */
-		if (forknum != MAIN_FORKNUM)
+		if (!block_is_included(&rnode, forknum))
 			continue;
 
-		/*
-		 * Print information of block touched.
-		 * TODO: more advanced logic (really needed?)
-		 */
-		fprintf(stderr, "Block touched: dboid = %u, relid = %u, block = %u\n",
-				rnode.dbNode, rnode.relNode, blkno);
+		blockmap_add(blockmap, &rnode, forknum, blkno);
+
+		if (verbose)
+			fprintf(stderr, "Block touched: dboid = %u, relid = %u, fork = %s, block = %u\n",
+					rnode.dbNode, rnode.relNode, forkNames[forknum], blkno);
 	}
 }
 
 /*
  * do_wal_parsing
- * Central part where the actual parsing work happens.
+ * Central part where the actual parsing work happens, for one task.
  */
 static void
-do_wal_parsing(void)
+do_wal_parsing(WalTask *task, WorkerState *worker)
 {
 	XLogReadBlockPrivate private;
 	XLogRecord *record;
 	XLogReaderState *xlogreader;
 	char *errormsg;
 	XLogRecPtr first_record;
+	XLogRecPtr record_start;
+	XLogRecPtr end_record;
 
-	private.full_path = full_path;
+	private.tli = task->tli;
+	private.lastseg = task->lastseg;
+	private.file.fd = -1;
+	private.segno = 0;
+	private.follow = false;
 
-	/* Set the first record to look at */
-	XLogSegNoOffsetToRecPtr(segno, 0, WalSegSz, first_record);
+	/* Set the first record to look at, and where to stop */
+	XLogSegNoOffsetToRecPtr(task->startseg, 0, WalSegSz, first_record);
+	XLogSegNoOffsetToRecPtr(task->endseg + 1, 0, WalSegSz, end_record);
 	xlogreader = XLogReaderAllocate(WalSegSz, NULL, XLogReadPageBlock,
 									&private);
-	first_record = XLogFindNextRecord(xlogreader, first_record);
+	if (xlogreader == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", progname);
+		exit(1);
+	}
 
-	XLogBeginRead(xlogreader, first_record);
-	/* Loop through all the records */
-	do
+	task->found = false;
+	task->end_of_wal = InvalidXLogRecPtr;
+	task->errormsg = NULL;
+
+	record_start = XLogFindNextRecord(xlogreader, first_record);
+	if (XLogRecPtrIsInvalid(record_start))
+	{
+		task->end_of_wal = first_record;
+		task->errormsg = pg_strdup("could not find a valid record");
+	}
+	else if (record_start < end_record)
 	{
-		/* Move on to next record */
-		record = XLogReadRecord(xlogreader, &errormsg);
-		if (errormsg)
-			fprintf(stderr, "error reading xlog record: %s\n", errormsg);
+		XLogBeginRead(xlogreader, record_start);
+
+		/* Loop through all the records beginning in the task's segments */
+		while ((record = XLogReadRecord(xlogreader, &errormsg)) != NULL)
+		{
+			if (xlogreader->ReadRecPtr >= end_record)
+				break;
 
-		/* extract block information for this record */
-		extract_block_info(xlogreader);
-	} while (record != NULL);
+			worker->nrecords++;
+			task->found = true;
+
+			/* account for this record, or extract its block information */
+			if (stats_mode)
+				walstats_add(worker->stats, xlogreader);
+			else
+				extract_block_info(xlogreader, worker->blockmap);
+		}
+
+		if (record == NULL)
+		{
+			task->end_of_wal = xlogreader->EndRecPtr;
+			task->errormsg = pg_strdup(errormsg ? errormsg :
+									   "could not read record");
+		}
+	}
 
 	XLogReaderFree(xlogreader);
-	if (xlogreadfd != -1)
+	if (private.file.fd != -1)
+		walfile_close(&private.file);
+}
+
+/*
+ * Check where reading stopped in each range of consecutive segments. The
+ * first invalid record of a range is the end of valid WAL, which is fine,
+ * unless a later task of the same range found valid records, in which
+ * case the WAL is corrupted. Returns false in this case.
+ */
+static bool
+check_end_of_wal(void)
+{
+	WalTask    *end_task = NULL;
+	bool		result = true;
+	int			i;
+
+	for (i = 0; i <= ntasks; i++)
+	{
+		WalTask    *task = i < ntasks ? &tasks[i] : NULL;
+
+		/* Tasks of a range are consecutive, and share their last segment */
+		if (end_task != NULL &&
+			(task == NULL || end_task->tli != task->tli ||
+			 end_task->lastseg != task->lastseg))
+		{
+			if (verbose)
+				fprintf(stderr, "%s: end of WAL at %X/%X on timeline %u: %s\n",
+						progname, (uint32) (end_task->end_of_wal >> 32),
+						(uint32) end_task->end_of_wal, end_task->tli,
+						end_task->errormsg);
+			end_task = NULL;
+		}
+
+		if (task == NULL)
+			break;
+
+		if (end_task != NULL && task->found)
+		{
+			fprintf(stderr, "%s: error reading WAL record at %X/%X on timeline %u: %s\n",
+					progname, (uint32) (end_task->end_of_wal >> 32),
+					(uint32) end_task->end_of_wal, end_task->tli,
+					end_task->errormsg);
+			result = false;
+			end_task = NULL;
+		}
+
+		if (end_task == NULL && !XLogRecPtrIsInvalid(task->end_of_wal))
+			end_task = task;
+	}
+
+	return result;
+}
+
+/*
+ * Main routine of each thread, processing tasks until none are left.
+ */
+static void *
+worker_main(void *arg)
+{
+	WorkerState *worker = (WorkerState *) arg;
+
+	for (;;)
+	{
+		WalTask    *task = NULL;
+
+#ifdef ENABLE_THREAD_SAFETY
+		pthread_mutex_lock(&task_lock);
+#endif
+		if (next_task < ntasks)
+			task = &tasks[next_task++];
+#ifdef ENABLE_THREAD_SAFETY
+		pthread_mutex_unlock(&task_lock);
+#endif
+
+		if (task == NULL)
+			break;
+
+		do_wal_parsing(task, worker);
+	}
+
+	return NULL;
+}
+
+static int
+segment_cmp(const void *a, const void *b)
+{
+	const WalSegment *sa = (const WalSegment *) a;
+	const WalSegment *sb = (const WalSegment *) b;
+
+	if (sa->tli != sb->tli)
+		return sa->tli < sb->tli ? -1 : 1;
+	if (sa->segno != sb->segno)
+		return sa->segno < sb->segno ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Add a segment to the list of segments to parse.
+ */
+static void
+add_segment(TimeLineID tli, XLogSegNo segno)
+{
+	static int	maxsegments = 0;
+
+	if (nsegments >= maxsegments)
+	{
+		maxsegments = maxsegments == 0 ? 64 : maxsegments * 2;
+		segments = pg_realloc(segments, sizeof(WalSegment) * maxsegments);
+	}
+	segments[nsegments].tli = tli;
+	segments[nsegments].segno = segno;
+	nsegments++;
+}
+
+/*
+ * Build the list of segments from all the segments of a directory.
+ */
+static void
+scan_directory(const char *directory)
+{
+	DIR		   *dir;
+	struct dirent *de;
+
+	dir = opendir(directory);
+	if (dir == NULL)
+	{
+		fprintf(stderr, "%s: could not open directory \"%s\": %s\n",
+				progname, directory, strerror(errno));
+		exit(1);
+	}
+
+	while (errno = 0, (de = readdir(dir)) != NULL)
+	{
+		TimeLineID	tli;
+		XLogSegNo	segno;
+
+		if (!IsXLogFileName(de->d_name))
+			continue;
+
+		if (WalSegSz == 0)
+		{
+			char		path[MAXPGPATH];
+
+			snprintf(path, MAXPGPATH, "%s/%s", directory, de->d_name);
+			detect_segment_size(path);
+		}
+
+		XLogFromFileName(de->d_name, &tli, &segno, WalSegSz);
+		add_segment(tli, segno);
+	}
+
+	if (errno)
+	{
+		fprintf(stderr, "%s: could not read directory \"%s\": %s\n",
+				progname, directory, strerror(errno));
+		exit(1);
+	}
+	closedir(dir);
+
+	if (nsegments == 0)
 	{
-		close(xlogreadfd);
-		xlogreadfd = -1;
+		fprintf(stderr, "%s: no WAL segments found in directory \"%s\"\n",
+				progname, directory);
+		exit(1);
 	}
+
+	qsort(segments, nsegments, sizeof(WalSegment), segment_cmp);
+}
+
+/*
+ * Split the list of segments into ranges of consecutive segments on the
+ * same timeline, then each range into tasks, so as the work can be
+ * balanced across all the threads.
+ */
+static void
+build_tasks(void)
+{
+	int			start = 0;
+
+	tasks = pg_malloc(sizeof(WalTask) * nsegments);
+
+	while (start < nsegments)
+	{
+		int			end = start;
+		int			len;
+		int			per_task;
+		int			i;
+
+		/* Find the end of the range */
+		while (end + 1 < nsegments &&
+			   segments[end + 1].tli == segments[start].tli &&
+			   segments[end + 1].segno == segments[end].segno + 1)
+			end++;
+
+		len = end - start + 1;
+		per_task = (len + num_jobs - 1) / num_jobs;
+
+		for (i = start; i <= end; i += per_task)
+		{
+			WalTask    *task = &tasks[ntasks++];
+
+			task->tli = segments[start].tli;
+			task->startseg = segments[i].segno;
+			task->endseg = segments[Min(i + per_task - 1, end)].segno;
+			task->lastseg = segments[end].segno;
+		}
+
+		start = end + 1;
+	}
+}
+
+/*
+ * Signal handler for --follow, to stop at the next record.
+ */
+static void
+follow_sigterm(SIGNAL_ARGS)
+{
+	follow_stop = true;
+}
+
+/*
+ * Follow WAL as it is written in the WAL directory, maintaining the journal
+ * of blocks touched. An interval of the journal ends at each checkpoint
+ * record, and the interval in progress is saved each time the end of the
+ * WAL available is reached. This resumes where the journal ends, or at the
+ * first record of the oldest segment of the directory.
+ */
+static void
+follow_wal(void)
+{
+	BlockMap   *blockmap = blockmap_create();
+	XLogRecPtr	interval_start;
+	XLogRecPtr	next_lsn;
+	XLogRecPtr	saved_lsn = InvalidXLogRecPtr;
+	TimeLineID	tli;
+	bool		need_find = false;
+
+	if (journal_get_end(journal_directory, blockmap, &interval_start,
+						&next_lsn, &tli))
+	{
+		XLogSegNo	segno;
+
+		/* Check that the WAL has not been recycled since */
+		XLByteToSeg(next_lsn, segno, WalSegSz);
+		if (follow_segment_tli(segno, tli) == 0 &&
+			segments[nsegments - 1].segno > segno)
+		{
+			fprintf(stderr, "%s: WAL at %X/%X where the journal ends is not available anymore\n",
+					progname, (uint32) (next_lsn >> 32), (uint32) next_lsn);
+			exit(1);
+		}
+		saved_lsn = next_lsn;
+	}
+	else
+	{
+		/* Begin at the first record of the oldest segment */
+		tli = segments[0].tli;
+		XLogSegNoOffsetToRecPtr(segments[0].segno, 0, WalSegSz, next_lsn);
+		interval_start = next_lsn;
+		need_find = true;
+	}
+
+	if (verbose)
+		fprintf(stderr, "%s: following WAL from %X/%X\n", progname,
+				(uint32) (next_lsn >> 32), (uint32) next_lsn);
+
+	pqsignal(SIGINT, follow_sigterm);
+	pqsignal(SIGTERM, follow_sigterm);
+
+	while (!follow_stop)
+	{
+		XLogReadBlockPrivate private;
+		XLogReaderState *xlogreader;
+		XLogRecord *record = NULL;
+		char	   *errormsg = NULL;
+
+		/*
+		 * Use a new reader at each round, so as no data cached from a page
+		 * that was still being written is used.
+		 */
+		private.tli = tli;
+		private.lastseg = PG_UINT64_MAX;
+		private.file.fd = -1;
+		private.segno = 0;
+		private.follow = true;
+		xlogreader = XLogReaderAllocate(WalSegSz, NULL, XLogReadPageBlock,
+										&private);
+		if (xlogreader == NULL)
+		{
+			fprintf(stderr, "%s: out of memory\n", progname);
+			exit(1);
+		}
+
+		if (need_find)
+		{
+			XLogRecPtr	first_record;
+
+			first_record = XLogFindNextRecord(xlogreader, next_lsn);
+			if (!XLogRecPtrIsInvalid(first_record))
+			{
+				next_lsn = interval_start = first_record;
+				need_find = false;
+			}
+		}
+
+		if (!need_find)
+		{
+			XLogBeginRead(xlogreader, next_lsn);
+
+			while (!follow_stop &&
+				   (record = XLogReadRecord(xlogreader, &errormsg)) != NULL)
+			{
+				uint8		info = XLogRecGetInfo(xlogreader) & ~XLR_INFO_MASK;
+
+				extract_block_info(xlogreader, blockmap);
+				next_lsn = xlogreader->EndRecPtr;
+				tli = private.tli;
+
+				/* A checkpoint ends the current interval */
+				if (XLogRecGetRmid(xlogreader) == RM_XLOG_ID &&
+					(info == XLOG_CHECKPOINT_SHUTDOWN ||
+					 info == XLOG_CHECKPOINT_ONLINE))
+				{
+					journal_add_interval(journal_directory, blockmap,
+										 interval_start, next_lsn, tli);
+					blockmap_free(blockmap);
+					blockmap = blockmap_create();
+					interval_start = saved_lsn = next_lsn;
+				}
+			}
+		}
+
+		if (record == NULL && errormsg != NULL && verbose)
+			fprintf(stderr, "%s: end of WAL available at %X/%X: %s\n",
+					progname, (uint32) (next_lsn >> 32), (uint32) next_lsn,
+					errormsg);
+
+		XLogReaderFree(xlogreader);
+		if (private.file.fd != -1)
+			walfile_close(&private.file);
+
+		/* Save the interval in progress, if anything new was read */
+		if (!need_find && next_lsn != saved_lsn)
+		{
+			journal_save_current(journal_directory, blockmap, interval_start,
+								 next_lsn, tli);
+			saved_lsn = next_lsn;
+		}
+
+		if (!follow_stop)
+			pg_usleep(FOLLOW_POLL_INTERVAL);
+	}
+
+	blockmap_free(blockmap);
+}
+
+/*
+ * Parse an LSN in the usual %X/%X format.
+ */
+static bool
+parse_lsn(const char *str, XLogRecPtr *lsn)
+{
+	uint32		hi,
+				lo;
+	int			n;
+
+	if (sscanf(str, "%X/%X%n", &hi, &lo, &n) != 2 || str[n] != '\0')
+		return false;
+	*lsn = ((uint64) hi) << 32 | lo;
+	return true;
 }
 
 int
@@ -214,10 +973,29 @@ main(int argc, char **argv)
 		{"help", no_argument, NULL, '?'},
 		{"version", no_argument, NULL, 'V'},
 		{"verbose", no_argument, NULL, 'v'},
+		{"format", required_argument, NULL, 'f'},
+		{"jobs", required_argument, NULL, 'j'},
+		{"no-mmap", no_argument, NULL, 1},
+		{"wal-segsize", required_argument, NULL, 's'},
+		{"stats", no_argument, NULL, 2},
+		{"journal", required_argument, NULL, 3},
+		{"follow", no_argument, NULL, 4},
+		{"since", required_argument, NULL, 5},
+		{"forks", required_argument, NULL, 6},
+		{"tablespace", required_argument, NULL, 7},
+		{"database", required_argument, NULL, 8},
+		{"relfilenode", required_argument, NULL, 9},
 		{NULL, 0, NULL, 0}
 	};
 	int		c;
 	int		option_index;
+	struct stat st;
+	WorkerState *workers;
+	BlockMap   *blockmap;
+	WalStats   *stats;
+	uint64		nrecords = 0;
+	bool		failed;
+	int		i;
 
 	progname = get_progname(argv[0]);
 
@@ -242,20 +1020,149 @@ main(int argc, char **argv)
 		}
 	}
 
-	while ((c = getopt_long(argc, argv, "v", long_options, &option_index)) != -1)
+	while ((c = getopt_long(argc, argv, "f:j:s:v", long_options, &option_index)) != -1)
 	{
 		switch (c)
 		{
 			case '?':
 				fprintf(stderr, _("Try \"%s --help\" for more information.\n"), progname);
 				exit(1);
+			case 'f':
+				if (strcmp(optarg, "text") == 0)
+					output_format = BLOCKMAP_FORMAT_TEXT;
+				else if (strcmp(optarg, "json") == 0)
+					output_format = BLOCKMAP_FORMAT_JSON;
+				else
+				{
+					fprintf(stderr, "%s: invalid output format \"%s\"\n",
+							progname, optarg);
+					exit(1);
+				}
+				break;
+			case 'j':
+				num_jobs = atoi(optarg);
+				if (num_jobs <= 0)
+				{
+					fprintf(stderr, "%s: invalid number of jobs \"%s\"\n",
+							progname, optarg);
+					exit(1);
+				}
+#ifndef ENABLE_THREAD_SAFETY
+				if (num_jobs > 1)
+				{
+					fprintf(stderr, "%s: threads are not supported on this platform\n",
+							progname);
+					exit(1);
+				}
+#endif
+				break;
+			case 's':
+				{
+					char	   *endptr;
+					long		segsize_mb;
+
+					segsize_mb = strtol(optarg, &endptr, 10);
+					if (*endptr != '\0' || segsize_mb <= 0 ||
+						segsize_mb > 1024 ||
+						!IsValidWalSegSize(segsize_mb * 1024 * 1024))
+					{
+						fprintf(stderr, "%s: --wal-segsize must be a power of 2 between 1 and 1024\n",
+								progname);
+						exit(1);
+					}
+					WalSegSz = segsize_mb * 1024 * 1024;
+				}
+				break;
 			case 'v':
 				verbose = true;
 				break;
+			case 1:
+				use_mmap = false;
+				break;
+			case 2:
+				stats_mode = true;
+				break;
+			case 3:
+				journal_directory = pg_strdup(optarg);
+				break;
+			case 4:
+				follow = true;
+				break;
+			case 5:
+				if (!parse_lsn(optarg, &since_lsn))
+				{
+					fprintf(stderr, "%s: invalid LSN \"%s\"\n",
+							progname, optarg);
+					exit(1);
+				}
+				break;
+			case 6:
+				parse_forks(optarg);
+				break;
+			case 7:
+				filter_tablespace = parse_oid(optarg, "--tablespace");
+				break;
+			case 8:
+				filter_database = parse_oid(optarg, "--database");
+				break;
+			case 9:
+				parse_relfilenodes(optarg);
+				break;
 		}
 	}
 
-	if ((optind + 1) < argc)
+	if (nfilter_relfilenodes > 1)
+		qsort(filter_relfilenodes, nfilter_relfilenodes, sizeof(Oid),
+			  oid_cmp);
+
+	if ((follow || !XLogRecPtrIsInvalid(since_lsn)) &&
+		journal_directory == NULL)
+	{
+		fprintf(stderr, "%s: --journal is required with --follow and --since\n",
+				progname);
+		exit(1);
+	}
+	if (journal_directory != NULL && !follow &&
+		XLogRecPtrIsInvalid(since_lsn))
+	{
+		fprintf(stderr, "%s: --journal requires --follow or --since\n",
+				progname);
+		exit(1);
+	}
+	if (follow && (stats_mode || num_jobs > 1 ||
+				   !XLogRecPtrIsInvalid(since_lsn)))
+	{
+		fprintf(stderr, "%s: --follow cannot be used with --stats, --jobs or --since\n",
+				progname);
+		exit(1);
+	}
+
+	/* Blocks touched since an LSN, only from the journal */
+	if (!XLogRecPtrIsInvalid(since_lsn))
+	{
+		if (optind < argc)
+		{
+			fprintf(stderr,
+					"%s: too many command-line arguments (first is \"%s\")\n",
+					progname, argv[optind]);
+			exit(1);
+		}
+
+		blockmap = blockmap_create();
+		if (!journal_blocks_since(journal_directory, since_lsn, blockmap))
+		{
+			fprintf(stderr, "%s: journal does not cover WAL since %X/%X\n",
+					progname, (uint32) (since_lsn >> 32),
+					(uint32) since_lsn);
+			exit(1);
+		}
+		blockmap_filter(blockmap, block_is_included);
+		blockmap_write(blockmap, stdout, output_format);
+		blockmap_free(blockmap);
+		exit(0);
+	}
+
+	if ((optind + 2) < argc)
 	{
 		fprintf(stderr,
 				"%s: too many command-line arguments (first is \"%s\")\n",
@@ -263,37 +1170,171 @@ main(int argc, char **argv)
 		exit(1);
 	}
 
-	/* parse files as start/end boundaries, extract path if not specified */
-	if (optind < argc)
+	if (optind >= argc)
 	{
-		char	   *directory = NULL;
-		char	   *fname = NULL;
-		int			fd;
-		TimeLineID	timeline_id;
+		fprintf(stderr, "%s: no input file defined.\n", progname);
+		exit(1);
+	}
 
-		full_path = pg_strdup(argv[optind]);
+	if (stat(argv[optind], &st) == 0 && S_ISDIR(st.st_mode))
+	{
+		/* parse all the segments of a directory */
+		if (optind + 1 < argc)
+		{
+			fprintf(stderr, "%s: no end segment allowed with a directory\n",
+					progname);
+			exit(1);
+		}
 
-		split_path(full_path, &directory, &fname);
+		wal_directory = psprintf("%s/", argv[optind]);
+		scan_directory(argv[optind]);
 
-		fd = open(full_path, O_RDONLY | PG_BINARY, 0);
-		if (fd < 0)
+		if (follow)
 		{
-			fprintf(stderr, "could not open file \"%s\"", fname);
+			follow_wal();
+			exit(0);
+		}
+	}
+	else if (follow)
+	{
+		fprintf(stderr, "%s: --follow requires a directory\n", progname);
+		exit(1);
+	}
+	else
+	{
+		/* parse files as start/end boundaries, extract path if not specified */
+		char	   *fname = NULL;
+		TimeLineID	start_tli;
+		XLogSegNo	start_segno;
+		XLogSegNo	end_segno;
+		XLogSegNo	segno;
+
+		split_path(argv[optind], &wal_directory, &fname);
+		if (!IsXLogFileName(fname))
+		{
+			fprintf(stderr, "%s: invalid WAL segment name \"%s\"\n",
+					progname, fname);
 			exit(1);
 		}
-		close(fd);
 
 		/* parse timeline and segment number from file name */
-		XLogFromFileName(fname, &timeline_id, &segno, WalSegSz);
+		detect_segment_size(argv[optind]);
+		XLogFromFileName(fname, &start_tli, &start_segno, WalSegSz);
+		end_segno = start_segno;
+
+		if (optind + 1 < argc)
+		{
+			char	   *end_dir = NULL;
+			char	   *end_fname = NULL;
+			TimeLineID	end_tli;
+
+			split_path(argv[optind + 1], &end_dir, &end_fname);
+			if (!IsXLogFileName(end_fname))
+			{
+				fprintf(stderr, "%s: invalid WAL segment name \"%s\"\n",
+						progname, end_fname);
+				exit(1);
+			}
+
+			XLogFromFileName(end_fname, &end_tli, &end_segno, WalSegSz);
+			if (end_tli != start_tli || end_segno < start_segno)
+			{
+				fprintf(stderr, "%s: end segment \"%s\" does not follow start segment \"%s\" on the same timeline\n",
+						progname, end_fname, fname);
+				exit(1);
+			}
+		}
+
+		/* check that all the segments are present */
+		for (segno = start_segno; segno <= end_segno; segno++)
+		{
+			char		path[MAXPGPATH];
+			int			fd;
+
+			segment_path(path, start_tli, segno);
+			fd = open(path, O_RDONLY | PG_BINARY, 0);
+			if (fd < 0)
+			{
+				fprintf(stderr, "could not open file \"%s\": %s\n",
+						path, strerror(errno));
+				exit(1);
+			}
+			close(fd);
+
+			add_segment(start_tli, segno);
+		}
 	}
 
-	if (full_path == NULL)
+	build_tasks();
+
+	/* Files to parse are here, so begin */
+	num_jobs = Min(num_jobs, ntasks);
+	workers = pg_malloc0(sizeof(WorkerState) * num_jobs);
+	for (i = 0; i < num_jobs; i++)
 	{
-		fprintf(stderr, "%s: no input file defined.\n", progname);
-		exit(1);
+		workers[i].id = i;
+		workers[i].blockmap = blockmap_create();
+		if (stats_mode)
+			workers[i].stats = walstats_create();
+	}
+
+#ifdef ENABLE_THREAD_SAFETY
+	for (i = 1; i < num_jobs; i++)
+	{
+		int			err;
+
+		err = pthread_create(&workers[i].thread, NULL, worker_main,
+							 &workers[i]);
+		if (err != 0)
+		{
+			fprintf(stderr, "%s: could not create thread: %s\n",
+					progname, strerror(err));
+			exit(1);
+		}
 	}
+#endif
+
+	/* The main thread takes its share of the work */
+	worker_main(&workers[0]);
 
-	/* File to parse is here, so begin */
-	do_wal_parsing();
-	exit(0);
+#ifdef ENABLE_THREAD_SAFETY
+	for (i = 1; i < num_jobs; i++)
+		pthread_join(workers[i].thread, NULL);
+#endif
+
+	/* Reaching the end of valid WAL is fine, not corruption in its middle */
+	failed = !check_end_of_wal();
+
+	/* Merge the results of all the threads */
+	blockmap = workers[0].blockmap;
+	stats = workers[0].stats;
+	for (i = 0; i < num_jobs; i++)
+	{
+		nrecords += workers[i].nrecords;
+		if (i > 0)
+		{
+			blockmap_merge(blockmap, workers[i].blockmap);
+			blockmap_free(workers[i].blockmap);
+			if (stats_mode)
+			{
+				walstats_merge(stats, workers[i].stats);
+				walstats_free(workers[i].stats);
+			}
+		}
+	}
+
+	if (verbose)
+		fprintf(stderr, "%s: parsed " UINT64_FORMAT " records in %d segments of %u bytes\n",
+				progname, nrecords, nsegments, WalSegSz);
+
+	/* Print the statistics of records, or the summary of blocks touched */
+	if (stats_mode)
+	{
+		walstats_write(stats, stdout, output_format);
+		walstats_free(stats);
+	}
+	else
+		blockmap_write(blockmap, stdout, output_format);
+	blockmap_free(blockmap);
+	exit(failed ? 1 : 0);
 }
@@ -0,0 +1,87 @@
+/*-------------------------------------------------------------------------
+ *
+ * pg_wal_blocks.h
+ *		Declarations shared across the files of pg_wal_blocks.
+ *
+ * Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		pg_wal_blocks/pg_wal_blocks.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PG_WAL_BLOCKS_H
+#define PG_WAL_BLOCKS_H
+
+#include "access/xlogreader.h"
+#include "common/relpath.h"
+#include "storage/block.h"
+#include "storage/relfilenode.h"
+
+/* pg_wal_blocks.c */
+extern const char *progname;
+
+/* Output formats of the summary of blocks */
+typedef enum BlockMapFormat
+{
+	BLOCKMAP_FORMAT_TEXT,
+	BLOCKMAP_FORMAT_JSON
+} BlockMapFormat;
+
+/* Opaque set of blocks touched, per relation fork */
+typedef struct BlockMap BlockMap;
+
+/* Opaque statistics of WAL records */
+typedef struct WalStats WalStats;
+
+/* Opened WAL segment, see walfile.c */
+typedef struct WalFile
+{
+	int			fd;				/* file descriptor */
+	uint32		size;			/* segment size */
+	char	   *mapped;			/* mapping of the segment, or NULL */
+	char	   *buffer;			/* buffer if not mapped */
+	uint32		bufstart;		/* segment offset of buffer */
+	uint32		buflen;			/* valid bytes in buffer */
+} WalFile;
+
+/* blockmap.c */
+extern BlockMap *blockmap_create(void);
+extern void blockmap_add(BlockMap *map, const RelFileNode *rnode,
+						 ForkNumber forknum, BlockNumber blkno);
+extern void blockmap_merge(BlockMap *dst, BlockMap *src);
+extern void blockmap_filter(BlockMap *map,
+							bool (*include) (const RelFileNode *rnode,
+											 ForkNumber forknum));
+extern bool blockmap_save(BlockMap *map, FILE *out);
+extern bool blockmap_load(BlockMap *map, FILE *in);
+extern void blockmap_write(BlockMap *map, FILE *out, BlockMapFormat format);
+extern void blockmap_free(BlockMap *map);
+
+/* journal.c */
+extern void journal_add_interval(const char *directory, BlockMap *map,
+								 XLogRecPtr start_lsn, XLogRecPtr end_lsn,
+								 TimeLineID tli);
+extern void journal_save_current(const char *directory, BlockMap *map,
+								 XLogRecPtr start_lsn, XLogRecPtr end_lsn,
+								 TimeLineID tli);
+extern bool journal_get_end(const char *directory, BlockMap *map,
+							XLogRecPtr *start_lsn, XLogRecPtr *end_lsn,
+							TimeLineID *tli);
+extern bool journal_blocks_since(const char *directory, XLogRecPtr since,
+								 BlockMap *map);
+
+/* stats.c */
+extern WalStats *walstats_create(void);
+extern void walstats_add(WalStats *stats, XLogReaderState *record);
+extern void walstats_merge(WalStats *dst, WalStats *src);
+extern void walstats_write(WalStats *stats, FILE *out, BlockMapFormat format);
+extern void walstats_free(WalStats *stats);
+
+/* walfile.c */
+extern bool walfile_open(WalFile *file, const char *path, uint32 segsize,
+						 bool use_mmap);
+extern bool walfile_read_page(WalFile *file, uint32 offset, char *buf);
+extern void walfile_close(WalFile *file);
+
+#endif							/* PG_WAL_BLOCKS_H */
@@ -0,0 +1,398 @@
+/*-------------------------------------------------------------------------
+ *
+ * stats.c
+ *		Statistics of WAL records and full-page images
+ *
+ * Records are counted per resource manager and record type, with the
+ * total size of the records, the size of their main data, the number of
+ * block references, and the number and size of full-page images. Full-
+ * page images are also counted per relation fork, to find the relations
+ * generating most of them.
+ *
+ * Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		pg_wal_blocks/stats.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres_fe.h"
+
+#include "access/brin_xlog.h"
+#include "access/clog.h"
+#include "access/commit_ts.h"
+#include "access/generic_xlog.h"
+#include "access/ginxlog.h"
+#include "access/gistxlog.h"
+#include "access/hash_xlog.h"
+#include "access/heapam_xlog.h"
+#include "access/multixact.h"
+#include "access/nbtxlog.h"
+#include "access/rmgr.h"
+#include "access/spgxlog.h"
+#include "access/xact.h"
+#include "access/xlog_internal.h"
+#include "access/xlogreader.h"
+#include "catalog/storage_xlog.h"
+#include "commands/dbcommands_xlog.h"
+#include "commands/sequence.h"
+#include "commands/tablespace.h"
+#include "common/hashfn.h"
+#include "replication/message.h"
+#include "replication/origin.h"
+#include "storage/standbydefs.h"
+#include "utils/relmapper.h"
+
+#include "pg_wal_blocks.h"
+
+/* Number of relations reported with the most full-page images */
+#define STATS_TOP_RELATIONS		10
+
+/* Record types are in the four high bits of xl_info */
+#define STATS_MAX_RECORD_TYPES	16
+
+/* Names of resource managers, and routines to get names of record types */
+typedef struct RmgrStatsDesc
+{
+	const char *rm_name;
+	const char *(*rm_identify) (uint8 info);
+} RmgrStatsDesc;
+
+#define PG_RMGR(symname,name,redo,desc,identify,startup,cleanup,mask) \
+	{ name, identify },
+
+static const RmgrStatsDesc RmgrStatsDescTable[RM_MAX_ID + 1] = {
+#include "access/rmgrlist.h"
+};
+
+typedef struct RecordStats
+{
+	uint64		count;			/* number of records */
+	uint64		rec_len;		/* total size of records */
+	uint64		data_len;		/* size of main data */
+	uint64		nblocks;		/* number of block references */
+	uint64		fpi_count;		/* number of full-page images */
+	uint64		fpi_len;		/* size of full-page images */
+} RecordStats;
+
+typedef struct RelationStatsKey
+{
+	RelFileNode rnode;
+	ForkNumber	forknum;
+} RelationStatsKey;
+
+typedef struct RelationStatsEntry
+{
+	RelationStatsKey key;		/* hash key, must be first */
+	char		status;			/* hash status */
+	uint64		fpi_count;
+	uint64		fpi_len;
+} RelationStatsEntry;
+
+#define SH_PREFIX		relstats
+#define SH_ELEMENT_TYPE	RelationStatsEntry
+#define SH_KEY_TYPE		RelationStatsKey
+#define	SH_KEY			key
+#define SH_HASH_KEY(tb, key) \
+	hash_bytes((const unsigned char *) &(key), sizeof(RelationStatsKey))
+#define SH_EQUAL(tb, a, b)	(memcmp(&(a), &(b), sizeof(RelationStatsKey)) == 0)
+#define	SH_SCOPE		static inline
+#define SH_RAW_ALLOCATOR	pg_malloc0
+#define SH_DECLARE
+#define SH_DEFINE
+#include "lib/simplehash.h"
+
+struct WalStats
+{
+	RecordStats records[RM_MAX_ID + 1][STATS_MAX_RECORD_TYPES];
+	relstats_hash *relations;
+};
+
+/*
+ * Create empty statistics.
+ */
+WalStats *
+walstats_create(void)
+{
+	WalStats   *stats = pg_malloc0(sizeof(WalStats));
+
+	stats->relations = relstats_create(256, NULL);
+	return stats;
+}
+
+/*
+ * Add the full-page images of a relation fork.
+ */
+static void
+walstats_add_relation(WalStats *stats, const RelationStatsKey *key,
+					  uint64 fpi_count, uint64 fpi_len)
+{
+	RelationStatsEntry *entry;
+	bool		found;
+
+	entry = relstats_insert(stats->relations, *key, &found);
+	if (!found)
+	{
+		entry->fpi_count = 0;
+		entry->fpi_len = 0;
+	}
+	entry->fpi_count += fpi_count;
+	entry->fpi_len += fpi_len;
+}
+
+/*
+ * Account for a record.
+ */
+void
+walstats_add(WalStats *stats, XLogReaderState *record)
+{
+	RmgrId		rmid = XLogRecGetRmid(record);
+	uint8		info = XLogRecGetInfo(record);
+	RecordStats *recstats;
+	int			block_id;
+
+	/*
+	 * The high bit of the info of transaction records is a flag, not part
+	 * of the record type, so mask it like pg_waldump does.
+	 */
+	if (rmid == RM_XACT_ID)
+		info &= XLOG_XACT_OPMASK;
+	recstats = &stats->records[rmid][info >> 4];
+
+	recstats->count++;
+	recstats->rec_len += XLogRecGetTotalLen(record);
+	recstats->data_len += XLogRecGetDataLen(record);
+
+	for (block_id = 0; block_id <= record->max_block_id; block_id++)
+	{
+		RelationStatsKey key;
+		BlockNumber blkno;
+
+		if (!XLogRecHasBlockRef(record, block_id))
+			continue;
+
+		recstats->nblocks++;
+
+		if (!XLogRecHasBlockImage(record, block_id))
+			continue;
+
+		recstats->fpi_count++;
+		recstats->fpi_len += record->blocks[block_id].bimg_len;
+
+		/* zero the key, as it is hashed and compared as raw bytes */
+		memset(&key, 0, sizeof(RelationStatsKey));
+		XLogRecGetBlockTag(record, block_id, &key.rnode, &key.forknum,
+						   &blkno);
+		walstats_add_relation(stats, &key, 1,
+							  record->blocks[block_id].bimg_len);
+	}
+}
+
+/*
+ * Merge statistics into another set.
+ */
+void
+walstats_merge(WalStats *dst, WalStats *src)
+{
+	RelationStatsEntry *entry;
+	relstats_iterator iter;
+	int			rmid;
+	int			recid;
+
+	for (rmid = 0; rmid <= RM_MAX_ID; rmid++)
+	{
+		for (recid = 0; recid < STATS_MAX_RECORD_TYPES; recid++)
+		{
+			RecordStats *d = &dst->records[rmid][recid];
+			RecordStats *s = &src->records[rmid][recid];
+
+			d->count += s->count;
+			d->rec_len += s->rec_len;
+			d->data_len += s->data_len;
+			d->nblocks += s->nblocks;
+			d->fpi_count += s->fpi_count;
+			d->fpi_len += s->fpi_len;
+		}
+	}
+
+	relstats_start_iterate(src->relations, &iter);
+	while ((entry = relstats_iterate(src->relations, &iter)) != NULL)
+		walstats_add_relation(dst, &entry->key, entry->fpi_count,
+							  entry->fpi_len);
+}
+
+static int
+walstats_cmp_relation(const void *a, const void *b)
+{
+	const RelationStatsEntry *ea = *((RelationStatsEntry *const *) a);
+	const RelationStatsEntry *eb = *((RelationStatsEntry *const *) b);
+
+	/* most full-page images first */
+	if (ea->fpi_count != eb->fpi_count)
+		return ea->fpi_count > eb->fpi_count ? -1 : 1;
+	if (ea->fpi_len != eb->fpi_len)
+		return ea->fpi_len > eb->fpi_len ? -1 : 1;
+	return memcmp(&ea->key, &eb->key, sizeof(RelationStatsKey));
+}
+
+/*
+ * Get the name of a record type of a resource manager.
+ */
+static void
+walstats_record_type(char *name, size_t len, int rmid, int recid)
+{
+	const char *id = RmgrStatsDescTable[rmid].rm_identify(recid << 4);
+
+	if (id != NULL)
+		strlcpy(name, id, len);
+	else
+		snprintf(name, len, "UNKNOWN (%x)", recid << 4);
+}
+
+/*
+ * Write the statistics, per record type, then for the relations with the
+ * most full-page images.
+ */
+void
+walstats_write(WalStats *stats, FILE *out, BlockMapFormat format)
+{
+	RelationStatsEntry **relations;
+	RelationStatsEntry *entry;
+	relstats_iterator iter;
+	RecordStats total;
+	int			nrelations = 0;
+	int			rmid;
+	int			recid;
+	int			i;
+	bool		first = true;
+
+	memset(&total, 0, sizeof(RecordStats));
+
+	if (format == BLOCKMAP_FORMAT_JSON)
+		fprintf(out, "{\"records\": [");
+	else
+		fprintf(out, "%-40s %12s %14s %14s %12s %12s %14s\n",
+				"Type", "N", "Record size", "Data size", "Blocks",
+				"FPI", "FPI size");
+
+	for (rmid = 0; rmid <= RM_MAX_ID; rmid++)
+	{
+		for (recid = 0; recid < STATS_MAX_RECORD_TYPES; recid++)
+		{
+			RecordStats *s = &stats->records[rmid][recid];
+			char		type[64];
+			char		name[128];
+
+			if (s->count == 0)
+				continue;
+
+			total.count += s->count;
+			total.rec_len += s->rec_len;
+			total.data_len += s->data_len;
+			total.nblocks += s->nblocks;
+			total.fpi_count += s->fpi_count;
+			total.fpi_len += s->fpi_len;
+
+			walstats_record_type(type, sizeof(type), rmid, recid);
+			snprintf(name, sizeof(name), "%s/%s",
+					 RmgrStatsDescTable[rmid].rm_name, type);
+
+			if (format == BLOCKMAP_FORMAT_JSON)
+				fprintf(out, "%s\n{\"rmgr\": \"%s\", \"type\": \"%s\", "
+						"\"count\": " UINT64_FORMAT ", "
+						"\"record_size\": " UINT64_FORMAT ", "
+						"\"data_size\": " UINT64_FORMAT ", "
+						"\"blocks\": " UINT64_FORMAT ", "
+						"\"fpi\": " UINT64_FORMAT ", "
+						"\"fpi_size\": " UINT64_FORMAT "}",
+						first ? "" : ",",
+						RmgrStatsDescTable[rmid].rm_name, type,
+						s->count, s->rec_len, s->data_len, s->nblocks,
+						s->fpi_count, s->fpi_len);
+			else
+				fprintf(out, "%-40s %12" INT64_MODIFIER "u "
+						"%14" INT64_MODIFIER "u %14" INT64_MODIFIER "u "
+						"%12" INT64_MODIFIER "u %12" INT64_MODIFIER "u "
+						"%14" INT64_MODIFIER "u\n",
+						name, s->count, s->rec_len, s->data_len,
+						s->nblocks, s->fpi_count, s->fpi_len);
+			first = false;
+		}
+	}
+
+	/* Relations with the most full-page images */
+	relations = pg_malloc(sizeof(RelationStatsEntry *) *
+						  Max(stats->relations->members, 1));
+	relstats_start_iterate(stats->relations, &iter);
+	while ((entry = relstats_iterate(stats->relations, &iter)) != NULL)
+		relations[nrelations++] = entry;
+	qsort(relations, nrelations, sizeof(RelationStatsEntry *),
+		  walstats_cmp_relation);
+	nrelations = Min(nrelations, STATS_TOP_RELATIONS);
+
+	if (format == BLOCKMAP_FORMAT_JSON)
+	{
+		fprintf(out, "\n],\n\"total\": {\"count\": " UINT64_FORMAT ", "
+				"\"record_size\": " UINT64_FORMAT ", "
+				"\"data_size\": " UINT64_FORMAT ", "
+				"\"blocks\": " UINT64_FORMAT ", "
+				"\"fpi\": " UINT64_FORMAT ", "
+				"\"fpi_size\": " UINT64_FORMAT "},\n\"fpi_relations\": [",
+				total.count, total.rec_len, total.data_len, total.nblocks,
+				total.fpi_count, total.fpi_len);
+		for (i = 0; i < nrelations; i++)
+			fprintf(out, "%s\n{\"tablespace\": %u, \"database\": %u, "
+					"\"relfilenode\": %u, \"fork\": \"%s\", "
+					"\"fpi\": " UINT64_FORMAT ", "
+					"\"fpi_size\": " UINT64_FORMAT "}",
+					i == 0 ? "" : ",",
+					relations[i]->key.rnode.spcNode,
+					relations[i]->key.rnode.dbNode,
+					relations[i]->key.rnode.relNode,
+					forkNames[relations[i]->key.forknum],
+					relations[i]->fpi_count, relations[i]->fpi_len);
+		fprintf(out, "\n]}\n");
+	}
+	else
+	{
+		fprintf(out, "%-40s %12" INT64_MODIFIER "u "
+				"%14" INT64_MODIFIER "u %14" INT64_MODIFIER "u "
+				"%12" INT64_MODIFIER "u %12" INT64_MODIFIER "u "
+				"%14" INT64_MODIFIER "u\n",
+				"Total", total.count, total.rec_len, total.data_len,
+				total.nblocks, total.fpi_count, total.fpi_len);
+
+		if (nrelations > 0)
+		{
+			fprintf(out, "\n%-40s %12s %14s\n",
+					"Relation", "FPI", "FPI size");
+			for (i = 0; i < nrelations; i++)
+			{
+				char		relname[128];
+
+				snprintf(relname, sizeof(relname), "%u/%u/%u %s",
+						 relations[i]->key.rnode.spcNode,
+						 relations[i]->key.rnode.dbNode,
+						 relations[i]->key.rnode.relNode,
+						 forkNames[relations[i]->key.forknum]);
+				fprintf(out, "%-40s %12" INT64_MODIFIER "u "
+						"%14" INT64_MODIFIER "u\n",
+						relname, relations[i]->fpi_count,
+						relations[i]->fpi_len);
+			}
+		}
+	}
+
+	pg_free(relations);
+}
+
+/*
+ * Free statistics.
+ */
+void
+walstats_free(WalStats *stats)
+{
+	relstats_destroy(stats->relations);
+	pg_free(stats);
+}
@@ -0,0 +1,149 @@
+/*-------------------------------------------------------------------------
+ *
+ * walfile.c
+ *		Access to the pages of WAL segments
+ *
+ * The WAL reader requests one page at a time, so reading each page with
+ * its own system calls makes their cost dominate on fast storage. When
+ * possible, the whole segment is mapped in memory and pages are copied
+ * from the mapping, the kernel being told that access is sequential. If
+ * the segment cannot be mapped, because the platform or the filesystem
+ * does not support it, because the file is shorter than a segment, or
+ * because this has been disabled by the caller, pages are served from a
+ * large buffer refilled with a single read at a time.
+ *
+ * Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		pg_wal_blocks/walfile.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres_fe.h"
+
+#include <sys/stat.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+#include "access/xlog_internal.h"
+
+#include "pg_wal_blocks.h"
+
+/* Size of the buffer used when a segment is not mapped */
+#define WALFILE_BUFFER_SIZE		(1024 * 1024)
+
+/*
+ * Open a WAL segment of the given size, mapping it if use_mmap is true.
+ * Returns false on failure, with errno set.
+ */
+bool
+walfile_open(WalFile *file, const char *path, uint32 segsize, bool use_mmap)
+{
+#ifndef WIN32
+	struct stat st;
+#endif
+
+	file->fd = open(path, O_RDONLY | PG_BINARY, 0);
+	if (file->fd < 0)
+		return false;
+
+	file->size = segsize;
+	file->mapped = NULL;
+	file->buffer = NULL;
+	file->bufstart = 0;
+	file->buflen = 0;
+
+#ifndef WIN32
+	/*
+	 * Only map files covering a full segment, as accessing the mapping
+	 * beyond the end of a file would raise SIGBUS.
+	 */
+	if (use_mmap && fstat(file->fd, &st) == 0 && st.st_size >= segsize)
+	{
+		void	   *ptr;
+
+		ptr = mmap(NULL, segsize, PROT_READ, MAP_SHARED, file->fd, 0);
+		if (ptr != MAP_FAILED)
+		{
+			file->mapped = (char *) ptr;
+#ifdef MADV_SEQUENTIAL
+			(void) madvise(ptr, segsize, MADV_SEQUENTIAL);
+#endif
+			return true;
+		}
+	}
+#endif
+
+	file->buffer = pg_malloc(Min(WALFILE_BUFFER_SIZE, segsize));
+	return true;
+}
+
+/*
+ * Copy a page of a WAL segment into buf. Returns false on failure, with
+ * errno set, or set to 0 if the file was too short.
+ */
+bool
+walfile_read_page(WalFile *file, uint32 offset, char *buf)
+{
+	if (offset + XLOG_BLCKSZ > file->size)
+	{
+		errno = 0;
+		return false;
+	}
+
+	if (file->mapped != NULL)
+	{
+		memcpy(buf, file->mapped + offset, XLOG_BLCKSZ);
+		return true;
+	}
+
+	/* Refill the buffer if the page is not in it */
+	if (offset < file->bufstart ||
+		offset + XLOG_BLCKSZ > file->bufstart + file->buflen)
+	{
+		uint32		bufsize = Min(WALFILE_BUFFER_SIZE, file->size);
+		int			nread;
+
+		/* Align the buffer so as sequential reads use full buffers */
+		file->bufstart = offset - (offset % bufsize);
+		file->buflen = 0;
+
+		nread = pg_pread(file->fd, file->buffer,
+						 Min(bufsize, file->size - file->bufstart),
+						 file->bufstart);
+		if (nread < 0)
+			return false;
+		file->buflen = nread;
+
+		if (offset + XLOG_BLCKSZ > file->bufstart + file->buflen)
+		{
+			errno = 0;
+			return false;
+		}
+	}
+
+	memcpy(buf, file->buffer + (offset - file->bufstart), XLOG_BLCKSZ);
+	return true;
+}
+
+/*
+ * Close a WAL segment, releasing its mapping or buffer.
+ */
+void
+walfile_close(WalFile *file)
+{
+#ifndef WIN32
+	if (file->mapped != NULL)
+		(void) munmap(file->mapped, file->size);
+#endif
+	if (file->buffer != NULL)
+		pg_free(file->buffer);
+	if (file->fd >= 0)
+		close(file->fd);
+
+	file->fd = -1;
+	file->mapped = NULL;
+	file->buffer = NULL;
+}
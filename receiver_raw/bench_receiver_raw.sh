@@ -0,0 +1,294 @@
+#!/bin/bash
+#-------------------------------------------------------------------------
+#
+# bench_receiver_raw.sh
+#		Local loopback benchmark for receiver_raw.
+#
+# This script creates a source where a workload is generated with pgbench,
+# decoded by decoder_raw, and applied by receiver_raw on a target. The
+# source and the target can be two databases of the same cluster, or two
+# separate clusters on the same host. For each combination of idle time
+# and sync mode requested, it reports the rate of rows applied and
+# percentiles of end-to-end lag, measured on the rows changed.
+#
+# Both decoder_raw and receiver_raw need to be installed, with the binaries
+# of PostgreSQL in PATH or defined with -b.
+#
+# Copyright (c) 1996-2020, PostgreSQL Global Development Group
+#
+# IDENTIFICATION
+#		receiver_raw/bench_receiver_raw.sh
+#
+#-------------------------------------------------------------------------
+
+set -e
+
+# Default values
+BINDIR=""
+BASEDIR="$(pwd)/bench_receiver_raw"
+MODE="single"
+PORT=5440
+DURATION=30
+CLIENTS=4
+WORKLOAD="insert"
+IDLE_TIMES="100"
+SYNC_MODES="on"
+ROWS_PER_XACT=1
+
+usage()
+{
+	cat <<EOF
+Usage: $0 [OPTION]...
+
+Options:
+  -b BINDIR      location of PostgreSQL binaries (default: PATH)
+  -d DIRECTORY   base directory for data folders (default: $BASEDIR)
+  -m MODE        "single" to replicate into a second database of the same
+                 cluster, "dual" to use two clusters (default: $MODE)
+  -p PORT        port of the source, the target uses PORT+1 in "dual"
+                 mode (default: $PORT)
+  -T SECONDS     duration of each workload run (default: $DURATION)
+  -c CLIENTS     number of pgbench clients (default: $CLIENTS)
+  -w WORKLOAD    "insert", "update" or "mixed" (default: $WORKLOAD)
+  -r ROWS        rows changed per transaction (default: $ROWS_PER_XACT)
+  -i LIST        comma-separated list of receiver_raw.idle_time values
+                 to compare, in ms, driving the batch sizes (default: $IDLE_TIMES)
+  -s LIST        comma-separated list of receiver_raw.sync_mode values
+                 to compare (default: $SYNC_MODES)
+  -h             show this help, then exit
+EOF
+}
+
+while getopts "b:d:m:p:T:c:w:r:i:s:h" opt; do
+	case $opt in
+		b) BINDIR="$OPTARG/" ;;
+		d) BASEDIR="$OPTARG" ;;
+		m) MODE="$OPTARG" ;;
+		p) PORT="$OPTARG" ;;
+		T) DURATION="$OPTARG" ;;
+		c) CLIENTS="$OPTARG" ;;
+		w) WORKLOAD="$OPTARG" ;;
+		r) ROWS_PER_XACT="$OPTARG" ;;
+		i) IDLE_TIMES="$OPTARG" ;;
+		s) SYNC_MODES="$OPTARG" ;;
+		h) usage; exit 0 ;;
+		*) usage; exit 1 ;;
+	esac
+done
+
+case $MODE in
+	single)
+		SOURCE_DATA="$BASEDIR/data"
+		TARGET_DATA="$SOURCE_DATA"
+		TARGET_PORT=$PORT
+		;;
+	dual)
+		SOURCE_DATA="$BASEDIR/source"
+		TARGET_DATA="$BASEDIR/target"
+		TARGET_PORT=$((PORT + 1))
+		;;
+	*)
+		echo "$0: incorrect mode \"$MODE\"" >&2
+		exit 1
+		;;
+esac
+
+case $WORKLOAD in
+	insert|update|mixed) ;;
+	*)
+		echo "$0: incorrect workload \"$WORKLOAD\"" >&2
+		exit 1
+		;;
+esac
+
+SOCKDIR="$BASEDIR"
+SOURCE_DB=bench_source
+TARGET_DB=bench_target
+SLOT=receiver_raw_bench
+
+# Wrappers to run queries on each side
+source_psql()
+{
+	"${BINDIR}psql" -X -q -A -t -h "$SOCKDIR" -p $PORT -d $SOURCE_DB -c "$1"
+}
+target_psql()
+{
+	"${BINDIR}psql" -X -q -A -t -h "$SOCKDIR" -p $TARGET_PORT -d $TARGET_DB -c "$1"
+}
+
+stop_clusters()
+{
+	"${BINDIR}pg_ctl" -D "$SOURCE_DATA" -m fast stop > /dev/null 2>&1 || true
+	if [ "$MODE" = "dual" ]; then
+		"${BINDIR}pg_ctl" -D "$TARGET_DATA" -m fast stop > /dev/null 2>&1 || true
+	fi
+}
+trap stop_clusters EXIT
+
+init_cluster()
+{
+	local datadir=$1
+	local port=$2
+
+	"${BINDIR}initdb" -D "$datadir" --no-sync > /dev/null
+	cat >> "$datadir/postgresql.conf" <<EOF
+port = $port
+listen_addresses = ''
+unix_socket_directories = '$SOCKDIR'
+wal_level = logical
+max_replication_slots = 4
+max_wal_senders = 4
+max_worker_processes = 16
+synchronous_commit = off
+log_min_messages = warning
+EOF
+	"${BINDIR}pg_ctl" -D "$datadir" -w -l "$datadir/server.log" start > /dev/null
+}
+
+# Schema of the benchmark table. The target has an extra column tracking
+# when each row has been applied, filled by its default as the INSERT
+# queries generated by decoder_raw list all the columns of the source, and
+# by a trigger for updates.
+SCHEMA="CREATE TABLE bench_data (id bigint PRIMARY KEY, val int,
+	created_at timestamptz DEFAULT clock_timestamp())"
+
+echo "Setting up clusters in $BASEDIR ($MODE mode)"
+rm -rf "$BASEDIR"
+mkdir -p "$BASEDIR"
+
+init_cluster "$SOURCE_DATA" $PORT
+if [ "$MODE" = "dual" ]; then
+	init_cluster "$TARGET_DATA" $TARGET_PORT
+fi
+
+"${BINDIR}createdb" -h "$SOCKDIR" -p $PORT $SOURCE_DB
+"${BINDIR}createdb" -h "$SOCKDIR" -p $TARGET_PORT $TARGET_DB
+source_psql "CREATE SEQUENCE bench_data_id_seq;
+	$SCHEMA;
+	ALTER TABLE bench_data ALTER COLUMN id SET DEFAULT nextval('bench_data_id_seq');"
+target_psql "$SCHEMA;
+	ALTER TABLE bench_data ADD COLUMN applied_at timestamptz
+		DEFAULT clock_timestamp();
+	CREATE FUNCTION bench_data_applied() RETURNS trigger AS
+		\$\$ BEGIN NEW.applied_at := clock_timestamp(); RETURN NEW; END \$\$
+		LANGUAGE plpgsql;
+	CREATE TRIGGER bench_data_applied BEFORE UPDATE ON bench_data
+		FOR EACH ROW EXECUTE FUNCTION bench_data_applied();"
+source_psql "SELECT pg_create_logical_replication_slot('$SLOT', 'decoder_raw');" > /dev/null
+
+# Now enable receiver_raw on the target
+cat >> "$TARGET_DATA/postgresql.conf" <<EOF
+shared_preload_libraries = 'receiver_raw'
+receiver_raw.database = '$TARGET_DB'
+receiver_raw.slot_name = '$SLOT'
+receiver_raw.conn_string = 'replication=database dbname=$SOURCE_DB host=$SOCKDIR port=$PORT application_name=receiver_raw'
+EOF
+"${BINDIR}pg_ctl" -D "$TARGET_DATA" -w -l "$TARGET_DATA/server.log" restart > /dev/null
+
+# pgbench scripts of the workloads
+INSERT_SCRIPT="$BASEDIR/insert.sql"
+UPDATE_SCRIPT="$BASEDIR/update.sql"
+cat > "$INSERT_SCRIPT" <<EOF
+INSERT INTO bench_data (val)
+	SELECT (random() * 1000000)::int FROM generate_series(1, $ROWS_PER_XACT);
+EOF
+cat > "$UPDATE_SCRIPT" <<EOF
+\\set id random(1, 10000)
+UPDATE bench_data SET val = val + 1, created_at = clock_timestamp()
+	WHERE id BETWEEN :id AND :id + $ROWS_PER_XACT - 1;
+EOF
+
+# Wait until the target has caught up with everything done on the source.
+wait_for_catchup()
+{
+	local source_count
+	local target_count
+
+	source_count=$(source_psql "SELECT count(*) || '/' || coalesce(sum(val), 0) FROM bench_data")
+	while true; do
+		target_count=$(target_psql "SELECT count(*) || '/' || coalesce(sum(val), 0) FROM bench_data")
+		if [ "$source_count" = "$target_count" ]; then
+			break
+		fi
+		sleep 0.2
+	done
+}
+
+# Reset both sides, the truncation is not replicated.
+reset_tables()
+{
+	wait_for_catchup
+	source_psql "TRUNCATE bench_data;"
+	source_psql "ALTER SEQUENCE bench_data_id_seq RESTART;"
+	target_psql "TRUNCATE bench_data;"
+	if [ "$WORKLOAD" != "insert" ]; then
+		# Base data for updates, replicated as the rest
+		source_psql "INSERT INTO bench_data (val)
+			SELECT 0 FROM generate_series(1, 10000 + $ROWS_PER_XACT);"
+		wait_for_catchup
+		source_psql "VACUUM ANALYZE bench_data;"
+		target_psql "VACUUM ANALYZE bench_data;"
+	fi
+}
+
+# Warm up, making sure that the worker is streaming
+echo "Waiting for receiver_raw to stream changes"
+source_psql "INSERT INTO bench_data (val) VALUES (0);"
+wait_for_catchup
+
+printf "%-10s %-6s %-10s %-12s %-10s %-10s %-10s %-10s\n" \
+	"idle_time" "sync" "changes" "changes/s" "lag_p50" "lag_p90" "lag_p99" "lag_max"
+
+for idle_time in ${IDLE_TIMES//,/ }; do
+	for sync_mode in ${SYNC_MODES//,/ }; do
+		target_psql "ALTER SYSTEM SET receiver_raw.idle_time = $idle_time;"
+		target_psql "ALTER SYSTEM SET receiver_raw.sync_mode = $sync_mode;"
+		target_psql "SELECT pg_reload_conf();" > /dev/null
+		reset_tables
+		target_psql "SELECT pg_stat_reset();" > /dev/null
+		START_TS=$(source_psql "SELECT clock_timestamp();")
+
+		case $WORKLOAD in
+			insert)
+				SCRIPTS="-f $INSERT_SCRIPT"
+				;;
+			update)
+				SCRIPTS="-f $UPDATE_SCRIPT"
+				;;
+			mixed)
+				SCRIPTS="-f $INSERT_SCRIPT@1 -f $UPDATE_SCRIPT@1"
+				;;
+		esac
+
+		"${BINDIR}pgbench" -n -h "$SOCKDIR" -p $PORT -c $CLIENTS -j $CLIENTS \
+			-T $DURATION $SCRIPTS $SOURCE_DB > "$BASEDIR/pgbench_${idle_time}_${sync_mode}.log"
+		wait_for_catchup
+		# Let statistics reach the collector
+		sleep 1
+
+		# Lag is measured on the last change of each row done while the
+		# workload was running, the rate on all the changes applied.
+		RESULT=$(target_psql "
+			WITH lag AS (
+				SELECT extract(epoch FROM applied_at - created_at) * 1000 AS ms
+				FROM bench_data WHERE created_at >= '$START_TS'),
+			window_apply AS (
+				SELECT extract(epoch FROM max(applied_at) - min(applied_at)) AS secs
+				FROM bench_data WHERE created_at >= '$START_TS'),
+			changes AS (
+				SELECT n_tup_ins + n_tup_upd + n_tup_del AS total
+				FROM pg_stat_user_tables WHERE relname = 'bench_data')
+			SELECT c.total || ' ' ||
+				round((c.total / greatest(w.secs, $DURATION))::numeric, 1) || ' ' ||
+				round(percentile_cont(0.5) WITHIN GROUP (ORDER BY l.ms)::numeric, 2) || ' ' ||
+				round(percentile_cont(0.9) WITHIN GROUP (ORDER BY l.ms)::numeric, 2) || ' ' ||
+				round(percentile_cont(0.99) WITHIN GROUP (ORDER BY l.ms)::numeric, 2) || ' ' ||
+				round(max(l.ms)::numeric, 2)
+			FROM lag l, window_apply w, changes c
+			GROUP BY c.total, w.secs;")
+		printf "%-10s %-6s %-10s %-12s %-10s %-10s %-10s %-10s\n" \
+			"$idle_time" "$sync_mode" $RESULT
+	done
+done
+
+echo "Lag values are in ms. Logs are in $BASEDIR."
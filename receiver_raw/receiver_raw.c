@@ -16,20 +16,32 @@
 /* Some general headers for custom bgworker facility */
 #include "postgres.h"
 
+#include <sys/socket.h>
 #include <sys/time.h>
 
 #include "fmgr.h"
 #include "libpq-fe.h"
 #include "pqexpbuffer.h"
+#include "access/genam.h"
+#include "access/table.h"
 #include "access/xact.h"
+#include "catalog/namespace.h"
 #include "lib/stringinfo.h"
+#include "nodes/bitmapset.h"
+#include "parser/parser.h"
 #include "pgstat.h"
 #include "executor/spi.h"
 #include "postmaster/bgworker.h"
 #include "storage/ipc.h"
 #include "storage/latch.h"
 #include "storage/proc.h"
+#include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+#include "utils/resowner.h"
 #include "utils/snapmgr.h"
 
 /* Allow load of this module in shared libs */
@@ -43,12 +55,36 @@ void receiver_raw_main(Datum main_arg);
 static volatile sig_atomic_t got_sigterm = false;
 static volatile sig_atomic_t got_sighup = false;
 
+/*
+ * Conflict handling modes, deciding what to do with a change that fails
+ * to apply.
+ */
+typedef enum
+{
+	RECEIVER_CONFLICT_ERROR,	/* fail and restart the worker */
+	RECEIVER_CONFLICT_SKIP,		/* skip the change */
+	RECEIVER_CONFLICT_UPSERT,	/* turn a conflicting INSERT into an UPDATE */
+	RECEIVER_CONFLICT_LWW		/* same as upsert, newest timestamp wins */
+} ReceiverConflictMode;
+
+static const struct config_enum_entry conflict_mode_options[] = {
+	{"error", RECEIVER_CONFLICT_ERROR, false},
+	{"skip", RECEIVER_CONFLICT_SKIP, false},
+	{"upsert", RECEIVER_CONFLICT_UPSERT, false},
+	{"last_writer_wins", RECEIVER_CONFLICT_LWW, false},
+	{NULL, 0, false}
+};
+
 /* GUC variables */
 static char *receiver_database = "postgres";
 static char *receiver_slot = "slot";
 static char *receiver_conn_string = "replication=database dbname=postgres application_name=receiver_raw";
 static int receiver_idle_time = 100;
 static bool receiver_sync_mode = true;
+static int receiver_recv_buffer_size = 0;
+static int receiver_batch_size = 1000;
+static int receiver_conflict_mode = RECEIVER_CONFLICT_ERROR;
+static char *receiver_conflict_timestamp_column = "";
 
 /* Worker name */
 static char *worker_name = "receiver_raw";
@@ -62,6 +98,28 @@ static XLogRecPtr output_applied_lsn = InvalidXLogRecPtr;
 static void fe_sendint64(int64 i, char *buf);
 static int64 fe_recvint64(char *buf);
 
+/*
+ * Change of the batch being applied, kept when conflicts are handled so
+ * as the batch can be replayed after a conflict.
+ */
+typedef struct ReceiverChange
+{
+	char	   *change;			/* query of the change */
+	bool		conflict;		/* failed on a duplicate key? */
+} ReceiverChange;
+
+/* Changes of the current batch, allocated in batch_context */
+static List *batch_changes = NIL;
+static MemoryContext batch_context = NULL;
+
+/* Apply functions */
+static void receiver_raw_apply_change(const char *change);
+static bool receiver_raw_apply_entry(ReceiverChange *entry);
+static void receiver_raw_resolve_conflict(const char *change);
+static void receiver_raw_restart_batch(void);
+static ErrorData *receiver_raw_try_execute(const char *change);
+static char *receiver_raw_build_upsert(const char *change);
+
 static void
 receiver_raw_sigterm(SIGNAL_ARGS)
 {
@@ -202,6 +260,360 @@ feTimestampDifference(int64 start_time, int64 stop_time,
 	}
 }
 
+/*
+ * Execute one change and report its result.
+ */
+static void
+receiver_raw_execute(const char *change)
+{
+	int			rc;
+
+	pgstat_report_activity(STATE_RUNNING, change);
+	SetCurrentStatementStartTimestamp();
+
+	/* Execute query */
+	rc = SPI_execute(change, false, 0);
+
+	if (rc == SPI_OK_INSERT)
+		ereport(DEBUG1, (errmsg("%s: INSERT received correctly: %s",
+								worker_name, change)));
+	else if (rc == SPI_OK_UPDATE)
+		ereport(DEBUG1, (errmsg("%s: UPDATE received correctly: %s",
+								worker_name, change)));
+	else if (rc == SPI_OK_DELETE)
+		ereport(DEBUG1, (errmsg("%s: DELETE received correctly: %s",
+								worker_name, change)));
+	else
+		ereport(LOG, (errmsg("%s: Error when applying change: %s",
+							 worker_name, change)));
+
+	/* A change that touches nothing refers to a missing row */
+	if ((rc == SPI_OK_UPDATE || rc == SPI_OK_DELETE) &&
+		SPI_processed == 0 &&
+		receiver_conflict_mode != RECEIVER_CONFLICT_ERROR)
+		ereport(LOG, (errmsg("%s: skipped change for missing row: %s",
+							 worker_name, change)));
+}
+
+/*
+ * Apply a change within the transaction of the current batch.
+ *
+ * When conflicts are handled, changes are applied without a subtransaction
+ * each, which would overflow the cache of subtransaction IDs of the worker
+ * past a few dozens of changes. Instead, each change is kept for the
+ * duration of the batch. Only a duplicate key is handled as a conflict:
+ * the transaction is then rolled back and the batch is replayed, the
+ * changes already known to conflict being transformed into an upsert
+ * within a subtransaction or skipped, depending on the conflict mode.
+ * Changes of UPDATE or DELETE whose row is missing touch nothing and are
+ * only logged. Any other error fails the batch, as it would without
+ * conflict handling, so as no change is lost.
+ */
+static void
+receiver_raw_apply_change(const char *change)
+{
+	ReceiverChange *entry;
+	MemoryContext oldcontext;
+
+	if (receiver_conflict_mode == RECEIVER_CONFLICT_ERROR)
+	{
+		receiver_raw_execute(change);
+		return;
+	}
+
+	oldcontext = MemoryContextSwitchTo(batch_context);
+	entry = (ReceiverChange *) palloc(sizeof(ReceiverChange));
+	entry->change = pstrdup(change);
+	entry->conflict = false;
+	batch_changes = lappend(batch_changes, entry);
+	MemoryContextSwitchTo(oldcontext);
+
+	if (receiver_raw_apply_entry(entry))
+		return;
+
+	/*
+	 * The transaction has been rolled back, so replay the batch up to this
+	 * change. Each pass marks one more change as conflicting, so this ends.
+	 */
+	for (;;)
+	{
+		ListCell   *lc;
+		bool		applied = true;
+
+		foreach(lc, batch_changes)
+		{
+			if (!receiver_raw_apply_entry((ReceiverChange *) lfirst(lc)))
+			{
+				applied = false;
+				break;
+			}
+		}
+
+		if (applied)
+			break;
+	}
+}
+
+/*
+ * Apply one change of the batch.
+ *
+ * Returns true if the change has been applied or its conflict resolved.
+ * If it fails on a duplicate key, it is marked as conflicting, the
+ * transaction of the batch is restarted and false is returned. Any other
+ * error is thrown again.
+ */
+static bool
+receiver_raw_apply_entry(ReceiverChange *entry)
+{
+	ErrorData  *edata = NULL;
+
+	if (entry->conflict)
+	{
+		receiver_raw_resolve_conflict(entry->change);
+		return true;
+	}
+
+	PG_TRY();
+	{
+		receiver_raw_execute(entry->change);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(batch_context);
+		edata = CopyErrorData();
+		if (edata->sqlerrcode != ERRCODE_UNIQUE_VIOLATION)
+			PG_RE_THROW();
+		FlushErrorState();
+	}
+	PG_END_TRY();
+
+	if (edata == NULL)
+		return true;
+
+	ereport(LOG, (errmsg("%s: conflict when applying change: %s",
+						 worker_name, edata->message)));
+	FreeErrorData(edata);
+
+	entry->conflict = true;
+	receiver_raw_restart_batch();
+	return false;
+}
+
+/*
+ * Resolve a change known to fail on a duplicate key, depending on the
+ * conflict mode. Only the upsert it is transformed into, if any, runs in
+ * a subtransaction, as it may fail on another key.
+ */
+static void
+receiver_raw_resolve_conflict(const char *change)
+{
+	ErrorData  *edata;
+
+	if (receiver_conflict_mode == RECEIVER_CONFLICT_UPSERT ||
+		receiver_conflict_mode == RECEIVER_CONFLICT_LWW)
+	{
+		char	   *upsert = receiver_raw_build_upsert(change);
+
+		if (upsert != NULL)
+		{
+			edata = receiver_raw_try_execute(upsert);
+			if (edata == NULL)
+			{
+				ereport(LOG, (errmsg("%s: resolved conflict with upsert: %s",
+									 worker_name, upsert)));
+				pfree(upsert);
+				return;
+			}
+
+			ereport(LOG, (errmsg("%s: could not apply upsert: %s",
+								 worker_name, edata->message)));
+			FreeErrorData(edata);
+			pfree(upsert);
+		}
+	}
+
+	ereport(LOG, (errmsg("%s: skipped conflicting change: %s",
+						 worker_name, change)));
+}
+
+/*
+ * Roll back the transaction of the current batch after a failed change,
+ * and start a new one to replay it.
+ */
+static void
+receiver_raw_restart_batch(void)
+{
+	AbortCurrentTransaction();
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+}
+
+/*
+ * Execute a change within a subtransaction.
+ *
+ * Returns NULL if the change has been applied, or the error data if it
+ * failed on a duplicate key, in which case the subtransaction is rolled
+ * back. Any other error is thrown again.
+ */
+static ErrorData *
+receiver_raw_try_execute(const char *change)
+{
+	MemoryContext oldcontext = CurrentMemoryContext;
+	ResourceOwner oldowner = CurrentResourceOwner;
+	ErrorData  *edata = NULL;
+
+	BeginInternalSubTransaction(NULL);
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_TRY();
+	{
+		receiver_raw_execute(change);
+
+		ReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(oldcontext);
+		edata = CopyErrorData();
+		FlushErrorState();
+
+		RollbackAndReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
+	}
+	PG_END_TRY();
+
+	if (edata != NULL && edata->sqlerrcode != ERRCODE_UNIQUE_VIOLATION)
+		ReThrowError(edata);
+
+	return edata;
+}
+
+/*
+ * Transform an INSERT generated by decoder_raw into an upsert, updating
+ * all the columns of the existing row in the event of a duplicate key on
+ * the replica identity of the relation. With last_writer_wins, the row is
+ * only updated if the change is newer based on the timestamp column
+ * defined by receiver_raw.conflict_timestamp_column.
+ *
+ * Returns NULL if the change cannot be transformed.
+ */
+static char *
+receiver_raw_build_upsert(const char *change)
+{
+	List	   *parsetree;
+	RawStmt    *rawstmt;
+	InsertStmt *stmt;
+	Oid			relid;
+	Oid			indexoid;
+	Relation	rel;
+	Relation	indexrel;
+	StringInfoData buf;
+	ListCell   *lc;
+	bool		first = true;
+	bool		has_timestamp = false;
+	Bitmapset  *keys = NULL;
+	int			i;
+	int			len;
+
+	parsetree = raw_parser(change);
+	if (list_length(parsetree) != 1)
+		return NULL;
+
+	rawstmt = linitial_node(RawStmt, parsetree);
+	if (!IsA(rawstmt->stmt, InsertStmt))
+		return NULL;
+	stmt = (InsertStmt *) rawstmt->stmt;
+	if (stmt->onConflictClause != NULL || stmt->cols == NIL)
+		return NULL;
+
+	/* Find the columns of the replica identity of the relation */
+	relid = RangeVarGetRelid(stmt->relation, NoLock, true);
+	if (!OidIsValid(relid))
+		return NULL;
+
+	rel = table_open(relid, AccessShareLock);
+	indexoid = RelationGetReplicaIndex(rel);
+	table_close(rel, AccessShareLock);
+
+	if (!OidIsValid(indexoid))
+		return NULL;
+
+	initStringInfo(&buf);
+
+	/* Copy the INSERT query, without its semicolon */
+	len = strlen(change);
+	while (len > 0 &&
+		   (change[len - 1] == ';' || isspace((unsigned char) change[len - 1])))
+		len--;
+	appendBinaryStringInfo(&buf, change, len);
+
+	appendStringInfoString(&buf, " ON CONFLICT (");
+	indexrel = index_open(indexoid, AccessShareLock);
+	for (i = 0; i < indexrel->rd_index->indnkeyatts; i++)
+	{
+		AttrNumber	attnum = indexrel->rd_index->indkey.values[i];
+
+		/* Expressions cannot be part of a replica identity */
+		Assert(attnum > 0);
+
+		if (i > 0)
+			appendStringInfoString(&buf, ", ");
+		appendStringInfoString(&buf,
+							   quote_identifier(get_attname(relid, attnum, false)));
+		keys = bms_add_member(keys, attnum);
+	}
+	index_close(indexrel, AccessShareLock);
+	appendStringInfoString(&buf, ") DO UPDATE SET ");
+
+	/* Update all the columns that are not part of the key */
+	foreach(lc, stmt->cols)
+	{
+		ResTarget  *target = lfirst_node(ResTarget, lc);
+		AttrNumber	attnum = get_attnum(relid, target->name);
+
+		if (strcmp(target->name, receiver_conflict_timestamp_column) == 0)
+			has_timestamp = true;
+
+		if (bms_is_member(attnum, keys))
+			continue;
+
+		if (!first)
+			appendStringInfoString(&buf, ", ");
+		first = false;
+		appendStringInfo(&buf, "%s = EXCLUDED.%s",
+						 quote_identifier(target->name),
+						 quote_identifier(target->name));
+	}
+
+	/* All the columns are part of the key, so there is nothing to update */
+	if (first)
+		return NULL;
+
+	if (receiver_conflict_mode == RECEIVER_CONFLICT_LWW)
+	{
+		if (!has_timestamp)
+		{
+			ereport(LOG, (errmsg("%s: timestamp column \"%s\" not found for last_writer_wins",
+								 worker_name, receiver_conflict_timestamp_column)));
+			return NULL;
+		}
+
+		appendStringInfo(&buf, " WHERE %s.%s < EXCLUDED.%s",
+						 quote_qualified_identifier(get_namespace_name(get_rel_namespace(relid)),
+													get_rel_name(relid)),
+						 quote_identifier(receiver_conflict_timestamp_column),
+						 quote_identifier(receiver_conflict_timestamp_column));
+	}
+
+	return buf.data;
+}
+
 void
 receiver_raw_main(Datum main_arg)
 {
@@ -209,6 +621,7 @@ receiver_raw_main(Datum main_arg)
 	PQExpBuffer query;
 	PGconn *conn;
 	PGresult *res;
+	bool		data_pending = false;
 
 	/* Register functions for SIGTERM/SIGHUP management */
 	pqsignal(SIGHUP, receiver_raw_sighup);
@@ -220,6 +633,11 @@ receiver_raw_main(Datum main_arg)
 	/* Connect to a database */
 	BackgroundWorkerInitializeConnection(receiver_database, NULL, 0);
 
+	/* Changes of a batch kept for a replay, across its transactions */
+	batch_context = AllocSetContextCreate(TopMemoryContext,
+										  "receiver_raw batch",
+										  ALLOCSET_DEFAULT_SIZES);
+
 	/* Establish connection to remote server */
 	conn = PQconnectdb(receiver_conn_string);
 	if (PQstatus(conn) != CONNECTION_OK)
@@ -230,6 +648,23 @@ receiver_raw_main(Datum main_arg)
 		proc_exit(1);
 	}
 
+	/*
+	 * Enlarge the socket receive buffer if requested, so that the server
+	 * is able to push more data without waiting for this worker to consume
+	 * it, which matters when the worker is busy applying a batch. This is
+	 * left alone by default, as setting it disables the autotuning of the
+	 * receive buffer done by some systems, like Linux.
+	 */
+	if (receiver_recv_buffer_size > 0)
+	{
+		int			bufsize = receiver_recv_buffer_size * 1024;
+
+		if (setsockopt(PQsocket(conn), SOL_SOCKET, SO_RCVBUF,
+					   (char *) &bufsize, sizeof(bufsize)) < 0)
+			ereport(LOG, (errmsg("%s: could not set socket receive buffer size: %m",
+								 worker_name)));
+	}
+
 	/* Query buffer for remote connection */
 	query = createPQExpBuffer();
 
@@ -252,15 +687,26 @@ receiver_raw_main(Datum main_arg)
 	while (!got_sigterm)
 	{
 		int rc, hdr_len;
+		int			nmessages = 0;
 		/* Buffer for COPY data */
 		char	*copybuf = NULL;
+		/* Position received up to now in this batch */
+		XLogRecPtr	batch_lsn = InvalidXLogRecPtr;
+		bool		send_feedback = false;
 
-		/* Wait necessary amount of time */
-		rc = WaitLatch(&MyProc->procLatch,
-					   WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
-					   receiver_idle_time * 1L,
-					   PG_WAIT_EXTENSION);
-		ResetLatch(&MyProc->procLatch);
+		/*
+		 * Wait necessary amount of time, except if data has just been
+		 * found on the socket, in which case apply it immediately.
+		 */
+		if (!data_pending)
+		{
+			rc = WaitLatch(&MyProc->procLatch,
+						   WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						   receiver_idle_time * 1L,
+						   PG_WAIT_EXTENSION);
+			ResetLatch(&MyProc->procLatch);
+		}
+		data_pending = false;
 
 		/* Process signals */
 		if (got_sighup)
@@ -278,13 +724,6 @@ receiver_raw_main(Datum main_arg)
 			proc_exit(0);
 		}
 
-		/* Some cleanup */
-		if (copybuf != NULL)
-		{
-			PQfreemem(copybuf);
-			copybuf = NULL;
-		}
-
 		/*
 		 * Begin a transaction before applying any changes. All the changes
 		 * of the same batch are applied within the same transaction.
@@ -294,16 +733,32 @@ receiver_raw_main(Datum main_arg)
 		SPI_connect();
 		PushActiveSnapshot(GetTransactionSnapshot());
 
+		/* Forget the changes of the previous batch */
+		MemoryContextReset(batch_context);
+		batch_changes = NIL;
+
 		/*
-		 * Receive data.
+		 * Receive data. Only the messages already read from the socket by
+		 * libpq are consumed, and at most receiver_raw.batch_size of them,
+		 * so as a batch always ends under a sustained flow of changes, its
+		 * transaction gets committed and signals are processed. The socket
+		 * is only read between two batches.
 		 */
-		while (true)
+		while (nmessages < receiver_batch_size)
 		{
 			XLogRecPtr  walEnd, walStart;
 
+			/* Release the previous message, if any */
+			if (copybuf != NULL)
+			{
+				PQfreemem(copybuf);
+				copybuf = NULL;
+			}
+
 			rc = PQgetCopyData(conn, &copybuf, 1);
 			if (rc <= 0)
 				break;
+			nmessages++;
 
 			/*
 			 * Check message received from server:
@@ -342,24 +797,17 @@ receiver_raw_main(Datum main_arg)
 				}
 				replyRequested = copybuf[pos];
 
-				/* Update written position */
-				output_written_lsn = Max(walEnd, output_written_lsn);
-				output_fsync_lsn = output_written_lsn;
-				output_applied_lsn = output_written_lsn;
+				batch_lsn = Max(walEnd, batch_lsn);
 
 				/*
 				 * If the server requested an immediate reply, send one.
 				 * If sync mode is sent reply in all cases to ensure that
-				 * server knows how far replay has been done.
+				 * server knows how far replay has been done. This is done
+				 * once the batch is committed, so as the positions reported
+				 * never include changes not committed yet.
 				 */
 				if (replyRequested || receiver_sync_mode)
-				{
-					int64 now = feGetCurrentTimestamp();
-
-					/* Leave is feedback is not sent properly */
-					if (!sendFeedback(conn, now))
-						proc_exit(1);
-				}
+					send_feedback = true;
 				continue;
 			}
 			else if (copybuf[0] != 'w')
@@ -384,7 +832,7 @@ receiver_raw_main(Datum main_arg)
 			}
 
 			/* Log some useful information */
-			ereport(LOG, (errmsg("%s: received from server, walStart %X/%X, "
+			ereport(DEBUG1, (errmsg("%s: received from server, walStart %X/%X, "
 								 "and walEnd %X/%X",
 						 worker_name,
 						 (uint32) (walStart >> 32),
@@ -392,30 +840,20 @@ receiver_raw_main(Datum main_arg)
 						 (uint32) (walEnd >> 32),
 						 (uint32) walEnd)));
 
-			/* Apply change to database */
-			pgstat_report_activity(STATE_RUNNING, copybuf + hdr_len);
-			SetCurrentStatementStartTimestamp();
-
-			/* Execute query */
-			rc = SPI_execute(copybuf + hdr_len, false, 0);
-
-			if (rc == SPI_OK_INSERT)
-				ereport(LOG, (errmsg("%s: INSERT received correctly: %s",
-									 worker_name, copybuf + hdr_len)));
-			else if (rc == SPI_OK_UPDATE)
-				ereport(LOG, (errmsg("%s: UPDATE received correctly: %s",
-									 worker_name, copybuf + hdr_len)));
-			else if (rc == SPI_OK_DELETE)
-				ereport(LOG, (errmsg("%s: DELETE received correctly: %s",
-									 worker_name, copybuf + hdr_len)));
-			else
-				ereport(LOG, (errmsg("%s: Error when applying change: %s",
-									 worker_name, copybuf + hdr_len)));
+			/*
+			 * Apply change to database. The query is executed directly from
+			 * the buffer received, without any intermediate copy.
+			 */
+			receiver_raw_apply_change(copybuf + hdr_len);
+
+			batch_lsn = Max(walEnd, batch_lsn);
+		}
 
-			/* Update written position */
-			output_written_lsn = Max(walEnd, output_written_lsn);
-			output_fsync_lsn = output_written_lsn;
-			output_applied_lsn = output_written_lsn;
+		/* Last message of the batch, if any */
+		if (copybuf != NULL)
+		{
+			PQfreemem(copybuf);
+			copybuf = NULL;
 		}
 
 		/* Finish process */
@@ -424,6 +862,30 @@ receiver_raw_main(Datum main_arg)
 		CommitTransactionCommand();
 		pgstat_report_activity(STATE_IDLE, NULL);
 
+		/* Changes of the batch are committed, update positions */
+		output_written_lsn = Max(batch_lsn, output_written_lsn);
+		output_fsync_lsn = output_written_lsn;
+		output_applied_lsn = output_written_lsn;
+
+		if (send_feedback)
+		{
+			int64 now = feGetCurrentTimestamp();
+
+			/* Leave is feedback is not sent properly */
+			if (!sendFeedback(conn, now))
+				proc_exit(1);
+		}
+
+		/*
+		 * The batch is full, more messages may be waiting in libpq. Process
+		 * them immediately after looking at signals.
+		 */
+		if (rc > 0)
+		{
+			data_pending = true;
+			continue;
+		}
+
 		/* No data, move to next loop */
 		if (rc == 0)
 		{
@@ -487,6 +949,7 @@ receiver_raw_main(Datum main_arg)
 									 worker_name)));
 				proc_exit(1);
 			}
+			data_pending = true;
 			continue;
 		}
 
@@ -567,6 +1030,42 @@ receiver_raw_load_params(void)
 							 true,
 							 PGC_SIGHUP,
 							 0, NULL, NULL, NULL);
+
+	/* Size of socket receive buffer */
+	DefineCustomIntVariable("receiver_raw.recv_buffer_size",
+							"Size of the socket receive buffer (kB).",
+							"Default value set to 0, using the system default.",
+							&receiver_recv_buffer_size,
+							0, 0, INT_MAX / 1024,
+							PGC_POSTMASTER,
+							GUC_UNIT_KB, NULL, NULL, NULL);
+
+	/* Maximum number of messages applied in a batch */
+	DefineCustomIntVariable("receiver_raw.batch_size",
+							"Maximum number of messages applied in one transaction.",
+							"Default value set to 1000.",
+							&receiver_batch_size,
+							1000, 1, INT_MAX,
+							PGC_SIGHUP,
+							0, NULL, NULL, NULL);
+
+	/* Conflict handling */
+	DefineCustomEnumVariable("receiver_raw.conflict_mode",
+							 "Action taken when a change fails to apply.",
+							 "Default value is \"error\".",
+							 &receiver_conflict_mode,
+							 RECEIVER_CONFLICT_ERROR,
+							 conflict_mode_options,
+							 PGC_SIGHUP,
+							 0, NULL, NULL, NULL);
+
+	DefineCustomStringVariable("receiver_raw.conflict_timestamp_column",
+							   "Timestamp column used by last_writer_wins.",
+							   NULL,
+							   &receiver_conflict_timestamp_column,
+							   "",
+							   PGC_SIGHUP,
+							   0, NULL, NULL, NULL);
 }
 
 /*
@@ -0,0 +1,660 @@
+/*-------------------------------------------------------------------------
+ *
+ * archive_index.c
+ *		On-disk index of the WAL segments present in the archives.
+ *
+ * The index is a file stored in the directory wal_utils/ of the data
+ * folder, made of a header followed by fixed-size entries sorted by
+ * timeline and segment number, one for each WAL segment file found in the
+ * archive location defined by PGARCHIVE, partial and compressed segments
+ * included. Lookups use a binary search on the file to find the beginning
+ * of the range of segments wanted, then read sequentially the entries up
+ * to the end of the range, without any system call on the archives
+ * themselves.
+ *
+ * The index is refreshed incrementally by a scan of the archive directory,
+ * where only the files not already known are looked at with stat(), as
+ * archived segments are not supposed to change once in place. Entries of
+ * files removed from the archives are discarded. Refreshes are serialized
+ * with a lock common to all the databases, as they all write the same
+ * temporary file before moving it in place.
+ *
+ * Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  wal_utils/archive_index.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "access/htup_details.h"
+#include "access/xlog.h"
+#include "access/xlog_internal.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/fd.h"
+#include "storage/lock.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+#include "utils/pg_lsn.h"
+#include "utils/timestamp.h"
+
+#include "wal_utils.h"
+
+/* Location of the index, relative to the data folder */
+#define ARCHIVE_INDEX_DIR		"wal_utils"
+#define ARCHIVE_INDEX_FILE		ARCHIVE_INDEX_DIR "/archive.index"
+#define ARCHIVE_INDEX_TMP_FILE	ARCHIVE_INDEX_FILE ".tmp"
+
+#define ARCHIVE_INDEX_MAGIC		0x57554149	/* "WUAI" */
+#define ARCHIVE_INDEX_VERSION	1
+
+/* Number of entries read or written at once */
+#define ARCHIVE_INDEX_BATCH		1024
+
+typedef struct ArchiveIndexHeader
+{
+	uint32		magic;
+	uint32		version;
+	int			wal_segsz;		/* segment size the index is built with */
+	uint32		padding;
+	uint64		nentries;		/* number of entries following */
+	char		archive_path[MAXPGPATH];	/* archives indexed */
+} ArchiveIndexHeader;
+
+/*
+ * Entry of the index. The file name is not stored, as it can be rebuilt
+ * from the other fields.
+ */
+typedef struct ArchiveIndexEntry
+{
+	TimeLineID	tli;
+	uint8		partial;		/* ".partial" segment? */
+	uint8		compression;	/* ArchiveCompression, from the extension */
+	uint16		padding;
+	XLogSegNo	segno;
+	int64		size;
+	pg_time_t	mtime;
+} ArchiveIndexEntry;
+
+/*
+ * State of archive_index_lookup() across calls.
+ */
+typedef struct ArchiveIndexScan
+{
+	int			fd;				/* index file, -1 if closed */
+	uint64		nentries;		/* number of entries in the index */
+	uint64		next;			/* next entry to read */
+	bool		has_end;		/* is there an end to the range? */
+	ArchiveIndexEntry end;		/* end of the range, included */
+	int			nbuf;			/* number of entries in buffer */
+	int			bufpos;			/* next entry to return in buffer */
+	ArchiveIndexEntry buf[ARCHIVE_INDEX_BATCH];
+} ArchiveIndexScan;
+
+PG_FUNCTION_INFO_V1(archive_index_refresh);
+PG_FUNCTION_INFO_V1(archive_index_lookup);
+
+/*
+ * Compare two entries on their position in the WAL history only.
+ */
+static int
+archive_index_cmp_position(const ArchiveIndexEntry *a,
+						   const ArchiveIndexEntry *b)
+{
+	if (a->tli != b->tli)
+		return a->tli < b->tli ? -1 : 1;
+	if (a->segno != b->segno)
+		return a->segno < b->segno ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Compare two entries on their position then on the file they refer to,
+ * as a segment can exist in the archives under multiple forms.
+ */
+static int
+archive_index_cmp(const void *a, const void *b)
+{
+	const ArchiveIndexEntry *ea = (const ArchiveIndexEntry *) a;
+	const ArchiveIndexEntry *eb = (const ArchiveIndexEntry *) b;
+	int			res = archive_index_cmp_position(ea, eb);
+
+	if (res != 0)
+		return res;
+	if (ea->partial != eb->partial)
+		return ea->partial < eb->partial ? -1 : 1;
+	if (ea->compression != eb->compression)
+		return ea->compression < eb->compression ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Parse the name of a file in the archives, filling in the fields of the
+ * entry identifying it. Returns false if the file is not a WAL segment.
+ */
+static bool
+archive_index_parse_name(const char *filename, ArchiveIndexEntry *entry)
+{
+	const char *suffix;
+	ArchiveCompression compression = ARCHIVE_COMPRESSION_NONE;
+
+	if (strspn(filename, "0123456789ABCDEF") != XLOG_FNAME_LEN)
+		return false;
+
+	memset(entry, 0, sizeof(ArchiveIndexEntry));
+
+	suffix = filename + XLOG_FNAME_LEN;
+	if (strncmp(suffix, ".partial", 8) == 0)
+	{
+		entry->partial = true;
+		suffix += 8;
+	}
+	if (*suffix != '\0' &&
+		!archive_compression_from_extension(suffix, &compression))
+		return false;
+	entry->compression = (uint8) compression;
+
+	XLogFromFileName(filename, &entry->tli, &entry->segno, wal_segment_size);
+	return true;
+}
+
+/*
+ * Build the file name of an index entry.
+ */
+static void
+archive_index_file_name(const ArchiveIndexEntry *entry, char *filename)
+{
+	const char *extension;
+
+	XLogFileName(filename, entry->tli, entry->segno, wal_segment_size);
+	if (entry->partial)
+		strcat(filename, ".partial");
+	extension = archive_compression_extension((ArchiveCompression) entry->compression);
+	if (extension)
+		strcat(filename, extension);
+}
+
+/*
+ * Read exactly len bytes at the given offset of the index.
+ */
+static void
+archive_index_pread(int fd, void *buf, size_t len, off_t offset)
+{
+	ssize_t		nbytes;
+
+	nbytes = pg_pread(fd, buf, len, offset);
+	if (nbytes < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read file \"%s\": %m", ARCHIVE_INDEX_FILE)));
+	if ((size_t) nbytes != len)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("could not read file \"%s\": read %d of %zu",
+						ARCHIVE_INDEX_FILE, (int) nbytes, len)));
+}
+
+/*
+ * Open the index and check its header. Returns -1 if the index does not
+ * exist or does not match the current configuration and missing_ok is
+ * true.
+ */
+static int
+archive_index_open(ArchiveIndexHeader *header, bool missing_ok)
+{
+	int			fd;
+	struct stat fst;
+
+	fd = OpenTransientFile(ARCHIVE_INDEX_FILE, O_RDONLY | PG_BINARY);
+	if (fd < 0)
+	{
+		if (errno == ENOENT && missing_ok)
+			return -1;
+		if (errno == ENOENT)
+			ereport(ERROR,
+					(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+					 errmsg("archive index does not exist"),
+					 errhint("Build it with archive_index_refresh().")));
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m", ARCHIVE_INDEX_FILE)));
+	}
+
+	if (fstat(fd, &fst) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not stat file \"%s\": %m", ARCHIVE_INDEX_FILE)));
+
+	archive_index_pread(fd, header, sizeof(ArchiveIndexHeader), 0);
+
+	if (header->magic != ARCHIVE_INDEX_MAGIC ||
+		header->version != ARCHIVE_INDEX_VERSION ||
+		fst.st_size != sizeof(ArchiveIndexHeader) +
+		header->nentries * sizeof(ArchiveIndexEntry))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("archive index file \"%s\" is corrupted",
+						ARCHIVE_INDEX_FILE),
+				 errhint("Remove it and rebuild it with archive_index_refresh().")));
+
+	/*
+	 * An index built for other archives or another segment size cannot be
+	 * reused.
+	 */
+	if (header->wal_segsz != wal_segment_size ||
+		strcmp(header->archive_path, archive_get_path()) != 0)
+	{
+		if (missing_ok)
+		{
+			CloseTransientFile(fd);
+			return -1;
+		}
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("archive index has been built for another archive location"),
+				 errhint("Rebuild it with archive_index_refresh().")));
+	}
+
+	return fd;
+}
+
+/*
+ * Write all the entries of the index into a temporary file, then move it
+ * in place.
+ */
+static void
+archive_index_write(ArchiveIndexEntry *entries, uint64 nentries)
+{
+	ArchiveIndexHeader header;
+	int			fd;
+	uint64		i;
+
+	memset(&header, 0, sizeof(ArchiveIndexHeader));
+	header.magic = ARCHIVE_INDEX_MAGIC;
+	header.version = ARCHIVE_INDEX_VERSION;
+	header.wal_segsz = wal_segment_size;
+	header.nentries = nentries;
+	strlcpy(header.archive_path, archive_get_path(), MAXPGPATH);
+
+	if (MakePGDirectory(ARCHIVE_INDEX_DIR) < 0 && errno != EEXIST)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create directory \"%s\": %m",
+						ARCHIVE_INDEX_DIR)));
+
+	fd = OpenTransientFile(ARCHIVE_INDEX_TMP_FILE,
+						   O_WRONLY | O_CREAT | O_TRUNC | PG_BINARY);
+	if (fd < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create file \"%s\": %m",
+						ARCHIVE_INDEX_TMP_FILE)));
+
+	errno = 0;
+	if (write(fd, &header, sizeof(header)) != sizeof(header))
+		goto write_error;
+
+	for (i = 0; i < nentries; i += ARCHIVE_INDEX_BATCH)
+	{
+		size_t		len = Min(nentries - i, ARCHIVE_INDEX_BATCH) *
+			sizeof(ArchiveIndexEntry);
+
+		errno = 0;
+		if (write(fd, entries + i, len) != len)
+			goto write_error;
+	}
+
+	if (pg_fsync(fd) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not fsync file \"%s\": %m",
+						ARCHIVE_INDEX_TMP_FILE)));
+	CloseTransientFile(fd);
+
+	(void) durable_rename(ARCHIVE_INDEX_TMP_FILE, ARCHIVE_INDEX_FILE, ERROR);
+	return;
+
+write_error:
+	/* if write didn't set errno, assume problem is no disk space */
+	if (errno == 0)
+		errno = ENOSPC;
+	ereport(ERROR,
+			(errcode_for_file_access(),
+			 errmsg("could not write file \"%s\": %m",
+					ARCHIVE_INDEX_TMP_FILE)));
+}
+
+/*
+ * archive_index_refresh
+ *
+ * Scan the archives to refresh their index, creating it if necessary.
+ * Returns the number of entries in the index, and the number of entries
+ * added and removed.
+ */
+Datum
+archive_index_refresh(PG_FUNCTION_ARGS)
+{
+	char	   *archive_path;
+	ArchiveIndexHeader header;
+	ArchiveIndexEntry *old_entries = NULL;
+	bool	   *old_seen = NULL;
+	uint64		nold = 0;
+	ArchiveIndexEntry *new_entries;
+	uint64		nnew = 0;
+	uint64		maxnew = ARCHIVE_INDEX_BATCH;
+	ArchiveIndexEntry *entries;
+	uint64		nentries = 0;
+	uint64		nremoved = 0;
+	uint64		i,
+				j;
+	DIR		   *dir;
+	struct dirent *de;
+	int			fd;
+	LOCKTAG		tag;
+	TupleDesc	tupdesc;
+	Datum		values[3];
+	bool		nulls[3];
+
+	if (!superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 (errmsg("must be superuser to index archives"))));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	archive_path = archive_get_path();
+
+	/*
+	 * Serialize the refreshes until the end of the transaction, with an
+	 * advisory lock whose database is invalid, so as it conflicts across
+	 * databases and with no lock taken with pg_advisory_xact_lock().
+	 */
+	SET_LOCKTAG_ADVISORY(tag, InvalidOid, ARCHIVE_INDEX_MAGIC, 0, 2);
+	(void) LockAcquire(&tag, ExclusiveLock, false, false);
+
+	/* Load the existing index, if it can be reused */
+	fd = archive_index_open(&header, true);
+	if (fd >= 0)
+	{
+		nold = header.nentries;
+		old_entries = (ArchiveIndexEntry *)
+			palloc_extended(Max(nold, 1) * sizeof(ArchiveIndexEntry),
+							MCXT_ALLOC_HUGE);
+		old_seen = (bool *) palloc_extended(Max(nold, 1) * sizeof(bool),
+											MCXT_ALLOC_HUGE | MCXT_ALLOC_ZERO);
+		for (i = 0; i < nold; i += ARCHIVE_INDEX_BATCH)
+			archive_index_pread(fd, old_entries + i,
+								Min(nold - i, ARCHIVE_INDEX_BATCH) *
+								sizeof(ArchiveIndexEntry),
+								sizeof(ArchiveIndexHeader) +
+								i * sizeof(ArchiveIndexEntry));
+		CloseTransientFile(fd);
+	}
+
+	/*
+	 * Scan the archives. Files already known are only marked as seen, and
+	 * new files are looked at to get their size and modification time.
+	 */
+	new_entries = (ArchiveIndexEntry *)
+		palloc_extended(maxnew * sizeof(ArchiveIndexEntry), MCXT_ALLOC_HUGE);
+
+	dir = AllocateDir(archive_path);
+	while ((de = ReadDir(dir, archive_path)) != NULL)
+	{
+		ArchiveIndexEntry entry;
+		ArchiveIndexEntry *found;
+		char		path[MAXPGPATH];
+		struct stat fst;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (!archive_index_parse_name(de->d_name, &entry))
+			continue;
+
+		if (nold > 0)
+		{
+			found = (ArchiveIndexEntry *) bsearch(&entry, old_entries, nold,
+												  sizeof(ArchiveIndexEntry),
+												  archive_index_cmp);
+			if (found != NULL)
+			{
+				old_seen[found - old_entries] = true;
+				continue;
+			}
+		}
+
+		snprintf(path, MAXPGPATH, "%s/%s", archive_path, de->d_name);
+		if (stat(path, &fst) < 0)
+		{
+			/* the file may have been removed in-between */
+			if (errno == ENOENT)
+				continue;
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not stat file \"%s\": %m", path)));
+		}
+		if (!S_ISREG(fst.st_mode))
+			continue;
+
+		entry.size = (int64) fst.st_size;
+		entry.mtime = (pg_time_t) fst.st_mtime;
+
+		if (nnew >= maxnew)
+		{
+			maxnew *= 2;
+			new_entries = (ArchiveIndexEntry *)
+				repalloc_huge(new_entries, maxnew * sizeof(ArchiveIndexEntry));
+		}
+		new_entries[nnew++] = entry;
+	}
+	FreeDir(dir);
+
+	/* Merge the entries still present with the new ones */
+	qsort(new_entries, nnew, sizeof(ArchiveIndexEntry), archive_index_cmp);
+
+	entries = (ArchiveIndexEntry *)
+		palloc_extended(Max(nold + nnew, 1) * sizeof(ArchiveIndexEntry),
+						MCXT_ALLOC_HUGE);
+	i = 0;
+	j = 0;
+	while (i < nold || j < nnew)
+	{
+		if (i < nold && !old_seen[i])
+		{
+			nremoved++;
+			i++;
+			continue;
+		}
+
+		if (j >= nnew ||
+			(i < nold && archive_index_cmp(&old_entries[i], &new_entries[j]) < 0))
+			entries[nentries++] = old_entries[i++];
+		else
+			entries[nentries++] = new_entries[j++];
+	}
+
+	archive_index_write(entries, nentries);
+
+	MemSet(nulls, 0, sizeof(nulls));
+	values[0] = Int64GetDatum((int64) nentries);
+	values[1] = Int64GetDatum((int64) nnew);
+	values[2] = Int64GetDatum((int64) nremoved);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * Callback closing the index read by archive_index_lookup(), in the event
+ * of the scan finishing before reaching the end of the range.
+ */
+static void
+archive_index_lookup_shutdown(Datum arg)
+{
+	ArchiveIndexScan *scan = (ArchiveIndexScan *) DatumGetPointer(arg);
+
+	if (scan->fd >= 0)
+	{
+		CloseTransientFile(scan->fd);
+		scan->fd = -1;
+	}
+}
+
+/*
+ * Parse a segment name given as bound of a range to look up.
+ */
+static void
+archive_index_parse_bound(text *segname, ArchiveIndexEntry *entry)
+{
+	char	   *name = text_to_cstring(segname);
+
+	if (!IsXLogFileName(name))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid WAL segment name \"%s\"", name)));
+
+	memset(entry, 0, sizeof(ArchiveIndexEntry));
+	XLogFromFileName(name, &entry->tli, &entry->segno, wal_segment_size);
+	pfree(name);
+}
+
+/*
+ * archive_index_lookup
+ *
+ * Return the entries of the archive index between two segments, both
+ * included. A NULL bound means that the range is not limited on this
+ * side. The beginning of the range is found with a binary search on the
+ * index, then the entries are read in batches up to the end of the range.
+ */
+Datum
+archive_index_lookup(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	ArchiveIndexScan *scan;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldcontext;
+		TupleDesc	tupdesc;
+		ArchiveIndexHeader header;
+		ArchiveIndexEntry start;
+		bool		has_start = !PG_ARGISNULL(0);
+		uint64		low,
+					high;
+
+		if (has_start)
+			archive_index_parse_bound(PG_GETARG_TEXT_PP(0), &start);
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		scan = (ArchiveIndexScan *) palloc0(sizeof(ArchiveIndexScan));
+		scan->has_end = !PG_ARGISNULL(1);
+		if (scan->has_end)
+			archive_index_parse_bound(PG_GETARG_TEXT_PP(1), &scan->end);
+
+		if (!superuser())
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+					 (errmsg("must be superuser to look at archive index"))));
+
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		scan->fd = archive_index_open(&header, false);
+		scan->nentries = header.nentries;
+
+		/* Find the first entry not before the start of the range */
+		low = 0;
+		high = scan->nentries;
+		while (has_start && low < high)
+		{
+			uint64		mid = low + (high - low) / 2;
+			ArchiveIndexEntry entry;
+
+			archive_index_pread(scan->fd, &entry, sizeof(ArchiveIndexEntry),
+								sizeof(ArchiveIndexHeader) +
+								mid * sizeof(ArchiveIndexEntry));
+			if (archive_index_cmp_position(&entry, &start) < 0)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		scan->next = low;
+
+		/* Close the index if the scan is stopped before its end */
+		if (rsinfo != NULL && IsA(rsinfo, ReturnSetInfo))
+			RegisterExprContextCallback(rsinfo->econtext,
+										archive_index_lookup_shutdown,
+										PointerGetDatum(scan));
+
+		funcctx->user_fctx = scan;
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	scan = (ArchiveIndexScan *) funcctx->user_fctx;
+
+	/* Load the next batch of entries if need be */
+	if (scan->bufpos >= scan->nbuf && scan->next < scan->nentries)
+	{
+		scan->nbuf = (int) Min(scan->nentries - scan->next,
+							   ARCHIVE_INDEX_BATCH);
+		archive_index_pread(scan->fd, scan->buf,
+							scan->nbuf * sizeof(ArchiveIndexEntry),
+							sizeof(ArchiveIndexHeader) +
+							scan->next * sizeof(ArchiveIndexEntry));
+		scan->next += scan->nbuf;
+		scan->bufpos = 0;
+	}
+
+	if (scan->bufpos < scan->nbuf)
+	{
+		ArchiveIndexEntry *entry = &scan->buf[scan->bufpos++];
+
+		if (!scan->has_end ||
+			archive_index_cmp_position(entry, &scan->end) <= 0)
+		{
+			Datum		values[6];
+			bool		nulls[6];
+			char		filename[MAXFNAMELEN];
+			XLogRecPtr	start_lsn;
+			HeapTuple	tuple;
+
+			archive_index_file_name(entry, filename);
+			XLogSegNoOffsetToRecPtr(entry->segno, 0, wal_segment_size,
+									start_lsn);
+
+			MemSet(nulls, 0, sizeof(nulls));
+			values[0] = CStringGetTextDatum(filename);
+			values[1] = Int32GetDatum((int32) entry->tli);
+			values[2] = LSNGetDatum(start_lsn);
+			values[3] = Int64GetDatum(entry->size);
+			values[4] = CStringGetTextDatum(archive_compression_name((ArchiveCompression) entry->compression));
+			values[5] = TimestampTzGetDatum(time_t_to_timestamptz(entry->mtime));
+
+			tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+			SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+		}
+	}
+
+	/*
+	 * All done, close the index. The callback is removed as well, as its
+	 * state is freed with the memory context of the function.
+	 */
+	archive_index_lookup_shutdown(PointerGetDatum(scan));
+	if (rsinfo != NULL && IsA(rsinfo, ReturnSetInfo))
+		UnregisterExprContextCallback(rsinfo->econtext,
+									  archive_index_lookup_shutdown,
+									  PointerGetDatum(scan));
+	SRF_RETURN_DONE(funcctx);
+}
@@ -0,0 +1,545 @@
+/*-------------------------------------------------------------------------
+ *
+ * archive_prefetch.c
+ *		Prefetch of archived WAL segments ahead of recovery.
+ *
+ * A background worker walks through a list of segments, as generated by
+ * archive_build_segment_list(), and loads into the OS cache the segments
+ * of the archive location defined by PGARCHIVE that recovery is going to
+ * need next, based on the replay position of the standby. This way,
+ * restore_command finds the segments in memory instead of paying for the
+ * latency of the archive storage for each segment.
+ *
+ * Statistics about the prefetching are kept in shared memory, requiring
+ * the library to be loaded with shared_preload_libraries.
+ *
+ * Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  wal_utils/archive_prefetch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "access/htup_details.h"
+#include "access/xlog.h"
+#include "access/xlog_internal.h"
+#include "catalog/pg_type.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+
+#include "wal_utils.h"
+
+/* Nap time of the worker between two checks of the replay position (ms) */
+#define ARCHIVE_PREFETCH_NAPTIME	100
+
+/* Size of the buffer used when posix_fadvise() is not available */
+#define ARCHIVE_PREFETCH_BUFSIZE	(128 * 1024)
+
+/*
+ * Shared state of the prefetch worker, with its statistics. A hit is a
+ * segment prefetched before recovery needed it, and a miss a segment that
+ * recovery needed before it could be prefetched. Segments missing in the
+ * archives are tracked separately.
+ */
+typedef struct ArchivePrefetchState
+{
+	slock_t		mutex;			/* protects all the fields below */
+	pid_t		pid;			/* PID of worker, 0 if not running */
+	pid_t		starter_pid;	/* PID of backend starting a worker, 0 if none */
+	int			total;			/* number of segments in list */
+	int			replayed;		/* number of segments replayed */
+	int			prefetched;		/* number of segments prefetched */
+	int64		hits;
+	int64		misses;
+	int64		missing;		/* segments not found in archives */
+	char		last_prefetched[MAXFNAMELEN];
+} ArchivePrefetchState;
+
+static ArchivePrefetchState *prefetch_state = NULL;
+
+/*
+ * Dynamic shared memory segment used to pass the list of segments to the
+ * worker, made of this header followed by the segment names. The segment
+ * is pinned until the worker attaches to it, and the pin is released by
+ * whichever of the worker or the backend starting it gets to it first, as
+ * the worker may exit before its startup is noticed.
+ */
+typedef struct ArchivePrefetchList
+{
+	slock_t		mutex;			/* protects pinned and pid */
+	bool		pinned;			/* is the segment still pinned? */
+	pid_t		pid;			/* PID of the worker, once attached */
+	int			depth;			/* number of segments to prefetch ahead */
+	int			nsegs;			/* number of segments in list */
+	char		segs[FLEXIBLE_ARRAY_MEMBER][MAXFNAMELEN];
+} ArchivePrefetchList;
+
+/* Status of each segment in the list of the worker */
+#define PREFETCH_TODO		0	/* not prefetched yet */
+#define PREFETCH_DONE		1	/* prefetched */
+#define PREFETCH_MISSING	2	/* not found in archives, retried */
+
+/* Hooks */
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* Signal handling */
+static volatile sig_atomic_t got_sigterm = false;
+
+void archive_prefetch_main(Datum main_arg) pg_attribute_noreturn();
+
+PG_FUNCTION_INFO_V1(archive_prefetch_start);
+PG_FUNCTION_INFO_V1(archive_prefetch_stats);
+
+static void
+archive_prefetch_sigterm(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sigterm = true;
+	SetLatch(MyLatch);
+	errno = save_errno;
+}
+
+/*
+ * Allocate or attach to the shared state of the prefetch worker.
+ */
+static void
+archive_prefetch_shmem_startup(void)
+{
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	prefetch_state = ShmemInitStruct("wal_utils archive prefetch",
+									 sizeof(ArchivePrefetchState),
+									 &found);
+	if (!found)
+	{
+		MemSet(prefetch_state, 0, sizeof(ArchivePrefetchState));
+		SpinLockInit(&prefetch_state->mutex);
+	}
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Reserve shared memory for the prefetch worker, called when loading the
+ * library with shared_preload_libraries.
+ */
+void
+archive_prefetch_init(void)
+{
+	RequestAddinShmemSpace(MAXALIGN(sizeof(ArchivePrefetchState)));
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = archive_prefetch_shmem_startup;
+}
+
+/*
+ * Cleanup of the shared state when the worker exits, including before it
+ * has attached to its list, so as a new worker can be started.
+ */
+static void
+archive_prefetch_shmem_exit(int code, Datum arg)
+{
+	SpinLockAcquire(&prefetch_state->mutex);
+	prefetch_state->pid = 0;
+	prefetch_state->starter_pid = 0;
+	SpinLockRelease(&prefetch_state->mutex);
+}
+
+/*
+ * Forget that this backend is starting a worker, when it could not be
+ * started. This is left alone if the worker has already cleared it, and
+ * another backend has started a new worker since.
+ */
+static void
+archive_prefetch_clear_starter(void)
+{
+	SpinLockAcquire(&prefetch_state->mutex);
+	if (prefetch_state->starter_pid == MyProcPid)
+		prefetch_state->starter_pid = 0;
+	SpinLockRelease(&prefetch_state->mutex);
+}
+
+/*
+ * Load the given archived segment into the OS cache. Returns false if the
+ * segment could not be found.
+ */
+static bool
+archive_prefetch_segment(char *segname)
+{
+	char	   *filepath = check_and_build_filepath(segname);
+	int			fd;
+
+	fd = OpenTransientFile(filepath, O_RDONLY | PG_BINARY);
+	if (fd < 0)
+	{
+		if (errno != ENOENT)
+			ereport(LOG,
+					(errcode_for_file_access(),
+					 errmsg("could not open file \"%s\" for reading: %m",
+							filepath)));
+		pfree(filepath);
+		return false;
+	}
+
+#if defined(USE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+	/* Let the kernel read the file asynchronously */
+	(void) posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#else
+	{
+		char	   *buf = palloc(ARCHIVE_PREFETCH_BUFSIZE);
+
+		/* Read the whole file so as it lands in the OS cache */
+		while (read(fd, buf, ARCHIVE_PREFETCH_BUFSIZE) > 0)
+			CHECK_FOR_INTERRUPTS();
+		pfree(buf);
+	}
+#endif
+
+	CloseTransientFile(fd);
+	pfree(filepath);
+	return true;
+}
+
+/*
+ * Main routine of the prefetch worker, taking in input the handle of the
+ * dynamic shared memory segment holding the list of segments.
+ */
+void
+archive_prefetch_main(Datum main_arg)
+{
+	dsm_segment *seg;
+	ArchivePrefetchList *list;
+	char	   *status;
+	int			pos = 0;
+	bool		unpin;
+
+	pqsignal(SIGTERM, archive_prefetch_sigterm);
+	BackgroundWorkerUnblockSignals();
+	on_shmem_exit(archive_prefetch_shmem_exit, (Datum) 0);
+
+	seg = dsm_attach(DatumGetUInt32(main_arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+
+	/* This worker is now the only user of the list */
+	list = (ArchivePrefetchList *) dsm_segment_address(seg);
+	SpinLockAcquire(&list->mutex);
+	unpin = list->pinned;
+	list->pinned = false;
+	list->pid = MyProcPid;
+	SpinLockRelease(&list->mutex);
+	if (unpin)
+		dsm_unpin_segment(dsm_segment_handle(seg));
+	status = palloc0(list->nsegs);
+
+	SpinLockAcquire(&prefetch_state->mutex);
+	prefetch_state->pid = MyProcPid;
+	prefetch_state->starter_pid = 0;
+	SpinLockRelease(&prefetch_state->mutex);
+
+	while (!got_sigterm)
+	{
+		XLogRecPtr	replay_lsn;
+		XLogSegNo	replay_segno;
+		int			i;
+
+		CHECK_FOR_INTERRUPTS();
+
+		/* Nothing to do once recovery has finished */
+		if (!RecoveryInProgress())
+			break;
+
+		replay_lsn = GetXLogReplayRecPtr(NULL);
+		XLByteToSeg(replay_lsn, replay_segno, wal_segment_size);
+
+		/*
+		 * Move past the segments already replayed, checking if they have
+		 * been prefetched in time.
+		 */
+		while (pos < list->nsegs)
+		{
+			TimeLineID	tli;
+			XLogSegNo	segno;
+
+			XLogFromFileName(list->segs[pos], &tli, &segno, wal_segment_size);
+			if (segno >= replay_segno)
+				break;
+
+			SpinLockAcquire(&prefetch_state->mutex);
+			if (status[pos] == PREFETCH_DONE)
+				prefetch_state->hits++;
+			else
+				prefetch_state->misses++;
+			prefetch_state->replayed++;
+			SpinLockRelease(&prefetch_state->mutex);
+			pos++;
+		}
+
+		if (pos >= list->nsegs)
+			break;
+
+		/* Prefetch the segments within the window ahead of replay */
+		for (i = pos; i < list->nsegs && i < pos + list->depth; i++)
+		{
+			if (status[i] == PREFETCH_DONE)
+				continue;
+
+			if (archive_prefetch_segment(list->segs[i]))
+			{
+				SpinLockAcquire(&prefetch_state->mutex);
+				prefetch_state->prefetched++;
+				strlcpy(prefetch_state->last_prefetched, list->segs[i],
+						MAXFNAMELEN);
+				SpinLockRelease(&prefetch_state->mutex);
+				status[i] = PREFETCH_DONE;
+			}
+			else if (status[i] == PREFETCH_TODO)
+			{
+				/* Report a missing segment only once */
+				SpinLockAcquire(&prefetch_state->mutex);
+				prefetch_state->missing++;
+				SpinLockRelease(&prefetch_state->mutex);
+				status[i] = PREFETCH_MISSING;
+			}
+		}
+
+		(void) WaitLatch(MyLatch,
+						 WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						 ARCHIVE_PREFETCH_NAPTIME,
+						 PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+	}
+
+	dsm_detach(seg);
+	proc_exit(0);
+}
+
+/*
+ * archive_prefetch_start
+ *
+ * Start a background worker prefetching the given list of segments ahead
+ * of the replay position of recovery, up to the given number of segments.
+ * Returns the PID of the worker.
+ */
+Datum
+archive_prefetch_start(PG_FUNCTION_ARGS)
+{
+	ArrayType  *segs_array = PG_GETARG_ARRAYTYPE_P(0);
+	int32		depth = PG_GETARG_INT32(1);
+	Datum	   *segs;
+	bool	   *nulls;
+	int			nsegs;
+	int			i;
+	dsm_segment *seg;
+	ArchivePrefetchList *list;
+	BackgroundWorker worker;
+	BackgroundWorkerHandle *handle;
+	BgwHandleStatus status;
+	pid_t		pid;
+
+	if (!superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 (errmsg("must be superuser to prefetch archives"))));
+
+	if (prefetch_state == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("wal_utils must be loaded via shared_preload_libraries")));
+
+	if (depth <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("prefetch depth must be greater than zero")));
+
+	deconstruct_array(segs_array, TEXTOID, -1, false, TYPALIGN_INT,
+					  &segs, &nulls, &nsegs);
+	if (nsegs == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("list of segments to prefetch is empty")));
+
+	/* Build the list passed to the worker */
+	seg = dsm_create(offsetof(ArchivePrefetchList, segs) +
+					 mul_size(nsegs, MAXFNAMELEN), 0);
+	list = (ArchivePrefetchList *) dsm_segment_address(seg);
+	SpinLockInit(&list->mutex);
+	list->pinned = false;
+	list->pid = 0;
+	list->depth = depth;
+	list->nsegs = nsegs;
+	for (i = 0; i < nsegs; i++)
+	{
+		char	   *segname;
+
+		if (nulls[i])
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					 errmsg("list of segments cannot contain NULL values")));
+
+		segname = TextDatumGetCString(segs[i]);
+		if (!IsXLogFileName(segname))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("invalid WAL segment name \"%s\"", segname)));
+		strlcpy(list->segs[i], segname, MAXFNAMELEN);
+		pfree(segname);
+	}
+
+	/*
+	 * Only one worker at a time, which resets the statistics. The backend
+	 * registering a worker marks itself as such until the worker attaches
+	 * to its list, so as concurrent calls cannot start a second worker.
+	 */
+	SpinLockAcquire(&prefetch_state->mutex);
+	if (prefetch_state->pid != 0)
+	{
+		pid = prefetch_state->pid;
+		SpinLockRelease(&prefetch_state->mutex);
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("archive prefetch worker already running with PID %d",
+						(int) pid)));
+	}
+	if (prefetch_state->starter_pid != 0)
+	{
+		pid = prefetch_state->starter_pid;
+		SpinLockRelease(&prefetch_state->mutex);
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("archive prefetch worker already being started by PID %d",
+						(int) pid)));
+	}
+	prefetch_state->starter_pid = MyProcPid;
+	prefetch_state->total = nsegs;
+	prefetch_state->replayed = 0;
+	prefetch_state->prefetched = 0;
+	prefetch_state->hits = 0;
+	prefetch_state->misses = 0;
+	prefetch_state->missing = 0;
+	prefetch_state->last_prefetched[0] = '\0';
+	SpinLockRelease(&prefetch_state->mutex);
+
+	MemSet(&worker, 0, sizeof(BackgroundWorker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "wal_utils");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN, "archive_prefetch_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "wal_utils archive prefetch");
+	snprintf(worker.bgw_type, BGW_MAXLEN, "wal_utils archive prefetch");
+	worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(seg));
+	worker.bgw_notify_pid = MyProcPid;
+
+	/* Keep the list around until the worker attaches to it */
+	dsm_pin_segment(seg);
+	list->pinned = true;
+
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+	{
+		dsm_unpin_segment(dsm_segment_handle(seg));
+		archive_prefetch_clear_starter();
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+				 errmsg("could not register background process"),
+				 errhint("You may need to increase max_worker_processes.")));
+	}
+
+	status = WaitForBackgroundWorkerStartup(handle, &pid);
+	if (status != BGWH_STARTED)
+	{
+		bool		unpin;
+
+		/*
+		 * The worker may have already gone through its list and exited, in
+		 * which case it has released the pin itself, and the prefetch is
+		 * finished. Otherwise it never attached to the list.
+		 */
+		SpinLockAcquire(&list->mutex);
+		unpin = list->pinned;
+		list->pinned = false;
+		pid = list->pid;
+		SpinLockRelease(&list->mutex);
+		archive_prefetch_clear_starter();
+
+		if (unpin)
+		{
+			dsm_unpin_segment(dsm_segment_handle(seg));
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+					 errmsg("could not start background process"),
+					 errhint("More details may be available in the server log.")));
+		}
+	}
+
+	dsm_detach(seg);
+
+	PG_RETURN_INT32((int32) pid);
+}
+
+/*
+ * archive_prefetch_stats
+ *
+ * Report the statistics of the last prefetch worker started.
+ */
+Datum
+archive_prefetch_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[8];
+	bool		nulls[8];
+	ArchivePrefetchState state;
+
+	if (prefetch_state == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("wal_utils must be loaded via shared_preload_libraries")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	SpinLockAcquire(&prefetch_state->mutex);
+	memcpy(&state, prefetch_state, sizeof(ArchivePrefetchState));
+	SpinLockRelease(&prefetch_state->mutex);
+
+	MemSet(nulls, 0, sizeof(nulls));
+	if (state.pid == 0)
+		nulls[0] = true;
+	else
+		values[0] = Int32GetDatum((int32) state.pid);
+	values[1] = Int32GetDatum(state.total);
+	values[2] = Int32GetDatum(state.replayed);
+	values[3] = Int32GetDatum(state.prefetched);
+	values[4] = Int64GetDatum(state.hits);
+	values[5] = Int64GetDatum(state.misses);
+	values[6] = Int64GetDatum(state.missing);
+	if (state.last_prefetched[0] == '\0')
+		nulls[7] = true;
+	else
+		values[7] = CStringGetTextDatum(state.last_prefetched);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
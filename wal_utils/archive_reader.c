@@ -0,0 +1,611 @@
+/*-------------------------------------------------------------------------
+ *
+ * archive_reader.c
+ *		Sequential reader of files in the archives, decompressing them
+ *		on-the-fly if they are compressed.
+ *
+ * The compression method is detected from the magic number at the start
+ * of a file. gzip is supported if PostgreSQL has been built with zlib,
+ * LZ4 (frame format) and zstd if their libraries have been found when
+ * building wal_utils, defining WAL_UTILS_LZ4 and WAL_UTILS_ZSTD.
+ * Decompression is done in a streaming fashion with fixed-size buffers,
+ * so the memory used does not depend on the size of the files read.
+ *
+ * Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  wal_utils/archive_reader.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef WAL_UTILS_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef WAL_UTILS_ZSTD
+#include <zstd.h>
+#endif
+
+#include "storage/fd.h"
+#include "utils/memutils.h"
+
+#include "wal_utils.h"
+
+/* Size of the buffer used to read compressed data */
+#define ARCHIVE_READER_BUFSIZE	(128 * 1024)
+
+struct ArchiveReader
+{
+	MemoryContext mcxt;			/* context of the reader's allocations */
+	char	   *filepath;		/* file read */
+	int			fd;				/* file descriptor, -1 if closed */
+	ArchiveCompression compression;
+	off_t		rawpos;			/* next position to read in the file */
+	bool		eof;			/* end of data reached */
+	bool		frame_done;		/* last compressed frame fully decoded? */
+
+	/* Buffer of compressed data */
+	char	   *inbuf;
+	size_t		inlen;			/* bytes available in inbuf */
+	size_t		inpos;			/* next byte to consume in inbuf */
+
+	/* Decompression states */
+#ifdef HAVE_LIBZ
+	z_stream	zstream;
+	bool		zstream_init;
+#endif
+#ifdef WAL_UTILS_LZ4
+	LZ4F_dctx  *lz4_ctx;
+#endif
+#ifdef WAL_UTILS_ZSTD
+	ZSTD_DCtx  *zstd_ctx;
+#endif
+};
+
+/* Extensions of compressed files, tried by archive_find_file() */
+static const char *const archive_extensions[] = {
+	".gz", ".lz4", ".zst", NULL
+};
+
+#ifdef HAVE_LIBZ
+/*
+ * Allocation routines for zlib, allocating its state in the memory
+ * context of the reader.
+ */
+static voidpf
+archive_zalloc(voidpf opaque, uInt items, uInt size)
+{
+	return MemoryContextAlloc((MemoryContext) opaque, (Size) items * size);
+}
+
+static void
+archive_zfree(voidpf opaque, voidpf address)
+{
+	pfree(address);
+}
+#endif
+
+/*
+ * Release the decompression states allocated by the libraries, called
+ * when the reader is closed or when its memory context goes away, like
+ * on error.
+ */
+static void
+archive_reader_cleanup(void *arg)
+{
+	ArchiveReader *reader = (ArchiveReader *) arg;
+
+#ifdef WAL_UTILS_LZ4
+	if (reader->lz4_ctx != NULL)
+	{
+		LZ4F_freeDecompressionContext(reader->lz4_ctx);
+		reader->lz4_ctx = NULL;
+	}
+#endif
+#ifdef WAL_UTILS_ZSTD
+	if (reader->zstd_ctx != NULL)
+	{
+		ZSTD_freeDCtx(reader->zstd_ctx);
+		reader->zstd_ctx = NULL;
+	}
+#endif
+}
+
+/*
+ * Detect the compression method of a file from its magic number.
+ */
+static ArchiveCompression
+archive_detect_compression(int fd, const char *filepath)
+{
+	unsigned char magic[4];
+	ssize_t		nbytes;
+
+	nbytes = pg_pread(fd, magic, sizeof(magic), 0);
+	if (nbytes < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read file \"%s\": %m", filepath)));
+
+	if (nbytes >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+		return ARCHIVE_COMPRESSION_GZIP;
+	if (nbytes == 4 && magic[0] == 0x04 && magic[1] == 0x22 &&
+		magic[2] == 0x4D && magic[3] == 0x18)
+		return ARCHIVE_COMPRESSION_LZ4;
+	if (nbytes == 4 && magic[0] == 0x28 && magic[1] == 0xB5 &&
+		magic[2] == 0x2F && magic[3] == 0xFD)
+		return ARCHIVE_COMPRESSION_ZSTD;
+
+	return ARCHIVE_COMPRESSION_NONE;
+}
+
+/*
+ * Get the name of a compression method.
+ */
+const char *
+archive_compression_name(ArchiveCompression compression)
+{
+	switch (compression)
+	{
+		case ARCHIVE_COMPRESSION_NONE:
+			return "none";
+		case ARCHIVE_COMPRESSION_GZIP:
+			return "gzip";
+		case ARCHIVE_COMPRESSION_LZ4:
+			return "lz4";
+		case ARCHIVE_COMPRESSION_ZSTD:
+			return "zstd";
+	}
+
+	return "unknown";			/* keep compiler quiet */
+}
+
+/*
+ * Get the file extension used for a compression method, or NULL if the
+ * method has none.
+ */
+const char *
+archive_compression_extension(ArchiveCompression compression)
+{
+	switch (compression)
+	{
+		case ARCHIVE_COMPRESSION_NONE:
+			return NULL;
+		case ARCHIVE_COMPRESSION_GZIP:
+			return ".gz";
+		case ARCHIVE_COMPRESSION_LZ4:
+			return ".lz4";
+		case ARCHIVE_COMPRESSION_ZSTD:
+			return ".zst";
+	}
+
+	return NULL;				/* keep compiler quiet */
+}
+
+/*
+ * Get the compression method matching a file extension, including its
+ * leading dot. Returns false if the extension is unknown.
+ */
+bool
+archive_compression_from_extension(const char *extension,
+								   ArchiveCompression *compression)
+{
+	if (strcmp(extension, ".gz") == 0)
+		*compression = ARCHIVE_COMPRESSION_GZIP;
+	else if (strcmp(extension, ".lz4") == 0)
+		*compression = ARCHIVE_COMPRESSION_LZ4;
+	else if (strcmp(extension, ".zst") == 0)
+		*compression = ARCHIVE_COMPRESSION_ZSTD;
+	else
+		return false;
+
+	return true;
+}
+
+/*
+ * Find a file in the archives, trying first the name given then the
+ * same name with the extension of each compression method supported.
+ * Returns the full path of the file found, or NULL.
+ */
+char *
+archive_find_file(char *filename)
+{
+	char	   *filepath = check_and_build_filepath(filename);
+	struct stat fst;
+	int			i;
+
+	if (stat(filepath, &fst) == 0)
+		return filepath;
+
+	for (i = 0; archive_extensions[i] != NULL; i++)
+	{
+		char	   *path = psprintf("%s%s", filepath, archive_extensions[i]);
+
+		if (stat(path, &fst) == 0)
+		{
+			pfree(filepath);
+			return path;
+		}
+		pfree(path);
+	}
+
+	pfree(filepath);
+	return NULL;
+}
+
+/*
+ * Open a file for reading, detecting its compression method. The reader
+ * is allocated in the current memory context.
+ */
+ArchiveReader *
+archive_reader_open(const char *filepath)
+{
+	ArchiveReader *reader;
+	MemoryContextCallback *callback;
+
+	reader = (ArchiveReader *) palloc0(sizeof(ArchiveReader));
+	reader->mcxt = CurrentMemoryContext;
+	reader->filepath = pstrdup(filepath);
+
+	reader->fd = OpenTransientFile(filepath, O_RDONLY | PG_BINARY);
+	if (reader->fd < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\" for reading: %m",
+						filepath)));
+
+	reader->compression = archive_detect_compression(reader->fd, filepath);
+	if (reader->compression == ARCHIVE_COMPRESSION_NONE)
+		return reader;
+
+	/* Cleanup of the library states if the reader goes away on error */
+	callback = (MemoryContextCallback *) palloc0(sizeof(MemoryContextCallback));
+	callback->func = archive_reader_cleanup;
+	callback->arg = reader;
+	MemoryContextRegisterResetCallback(reader->mcxt, callback);
+
+	reader->inbuf = palloc(ARCHIVE_READER_BUFSIZE);
+
+	switch (reader->compression)
+	{
+		case ARCHIVE_COMPRESSION_NONE:
+			break;
+
+		case ARCHIVE_COMPRESSION_GZIP:
+#ifdef HAVE_LIBZ
+			reader->zstream.zalloc = archive_zalloc;
+			reader->zstream.zfree = archive_zfree;
+			reader->zstream.opaque = (voidpf) reader->mcxt;
+
+			/* 15 + 32 for automatic detection of gzip header */
+			if (inflateInit2(&reader->zstream, 15 + 32) != Z_OK)
+				ereport(ERROR,
+						(errmsg("could not initialize gzip decompression for file \"%s\"",
+								filepath)));
+			reader->zstream_init = true;
+			break;
+#else
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("could not read file \"%s\" compressed with %s",
+							filepath, "gzip"),
+					 errdetail("This build does not support compression with %s.",
+							   "gzip")));
+#endif
+			break;
+
+		case ARCHIVE_COMPRESSION_LZ4:
+#ifdef WAL_UTILS_LZ4
+			{
+				LZ4F_errorCode_t status;
+
+				status = LZ4F_createDecompressionContext(&reader->lz4_ctx,
+														 LZ4F_VERSION);
+				if (LZ4F_isError(status))
+					ereport(ERROR,
+							(errmsg("could not initialize LZ4 decompression for file \"%s\": %s",
+									filepath, LZ4F_getErrorName(status))));
+			}
+#else
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("could not read file \"%s\" compressed with %s",
+							filepath, "lz4"),
+					 errdetail("This build does not support compression with %s.",
+							   "lz4")));
+#endif
+			break;
+
+		case ARCHIVE_COMPRESSION_ZSTD:
+#ifdef WAL_UTILS_ZSTD
+			reader->zstd_ctx = ZSTD_createDCtx();
+			if (reader->zstd_ctx == NULL)
+				ereport(ERROR,
+						(errmsg("could not initialize zstd decompression for file \"%s\"",
+								filepath)));
+#else
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("could not read file \"%s\" compressed with %s",
+							filepath, "zstd"),
+					 errdetail("This build does not support compression with %s.",
+							   "zstd")));
+#endif
+			break;
+	}
+
+	return reader;
+}
+
+/*
+ * Get the compression method of the file read.
+ */
+ArchiveCompression
+archive_reader_compression(ArchiveReader *reader)
+{
+	return reader->compression;
+}
+
+/*
+ * Get the size of the file read, as stored on disk.
+ */
+int64
+archive_reader_raw_size(ArchiveReader *reader)
+{
+	struct stat fst;
+
+	if (fstat(reader->fd, &fst) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not stat file \"%s\": %m", reader->filepath)));
+
+	return (int64) fst.st_size;
+}
+
+/*
+ * Get the size of the data of the file read, once decompressed. For a
+ * compressed file, this requires decompressing all of it, so this is
+ * meant to be called on a reader just opened, which is at the end of the
+ * data on return.
+ */
+int64
+archive_reader_data_size(ArchiveReader *reader)
+{
+	char	   *scratch;
+	int64		size = 0;
+	size_t		nbytes;
+
+	if (reader->compression == ARCHIVE_COMPRESSION_NONE)
+		return archive_reader_raw_size(reader);
+
+	scratch = palloc(ARCHIVE_READER_BUFSIZE);
+	do
+	{
+		nbytes = archive_reader_read(reader, scratch, ARCHIVE_READER_BUFSIZE);
+		size += nbytes;
+	} while (nbytes == ARCHIVE_READER_BUFSIZE);
+	pfree(scratch);
+
+	return size;
+}
+
+/*
+ * Load more compressed data into the input buffer if all of it has been
+ * consumed. Returns false if the end of the file has been reached.
+ */
+static bool
+archive_reader_fill(ArchiveReader *reader)
+{
+	ssize_t		nbytes;
+
+	if (reader->inpos < reader->inlen)
+		return true;
+
+	nbytes = pg_pread(reader->fd, reader->inbuf, ARCHIVE_READER_BUFSIZE,
+					  reader->rawpos);
+	if (nbytes < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read file \"%s\": %m", reader->filepath)));
+
+	reader->rawpos += nbytes;
+	reader->inlen = (size_t) nbytes;
+	reader->inpos = 0;
+	return nbytes > 0;
+}
+
+/*
+ * Read up to len bytes of data from the file, decompressing it if need be.
+ * Returns the number of bytes read, which is lower than len only once the
+ * end of the data has been reached.
+ */
+size_t
+archive_reader_read(ArchiveReader *reader, char *buf, size_t len)
+{
+	size_t		done = 0;
+
+	while (done < len && !reader->eof)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		if (reader->compression == ARCHIVE_COMPRESSION_NONE)
+		{
+			ssize_t		nbytes;
+
+			nbytes = pg_pread(reader->fd, buf + done, len - done,
+							  reader->rawpos);
+			if (nbytes < 0)
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not read file \"%s\": %m",
+								reader->filepath)));
+			if (nbytes == 0)
+				reader->eof = true;
+			reader->rawpos += nbytes;
+			done += nbytes;
+			continue;
+		}
+
+		if (!archive_reader_fill(reader))
+		{
+			/* Input is exhausted, this had better be at a frame boundary */
+			if (!reader->frame_done)
+				ereport(ERROR,
+						(errcode(ERRCODE_DATA_CORRUPTED),
+						 errmsg("unexpected end of compressed file \"%s\"",
+								reader->filepath)));
+			reader->eof = true;
+			break;
+		}
+
+		switch (reader->compression)
+		{
+			case ARCHIVE_COMPRESSION_NONE:
+				break;
+
+			case ARCHIVE_COMPRESSION_GZIP:
+#ifdef HAVE_LIBZ
+				{
+					z_stream   *zs = &reader->zstream;
+					size_t		avail_in = reader->inlen - reader->inpos;
+					int			ret;
+
+					zs->next_in = (Bytef *) reader->inbuf + reader->inpos;
+					zs->avail_in = (uInt) avail_in;
+					zs->next_out = (Bytef *) buf + done;
+					zs->avail_out = (uInt) (len - done);
+
+					ret = inflate(zs, Z_NO_FLUSH);
+					if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+						ereport(ERROR,
+								(errcode(ERRCODE_DATA_CORRUPTED),
+								 errmsg("could not decompress file \"%s\": %s",
+										reader->filepath,
+										zs->msg ? zs->msg : "unknown error")));
+
+					reader->inpos += avail_in - zs->avail_in;
+					done = len - zs->avail_out;
+					reader->frame_done = (ret == Z_STREAM_END);
+
+					/* There may be more gzip members in the same file */
+					if (ret == Z_STREAM_END)
+						inflateReset(zs);
+				}
+#endif
+				break;
+
+			case ARCHIVE_COMPRESSION_LZ4:
+#ifdef WAL_UTILS_LZ4
+				{
+					size_t		srcsize = reader->inlen - reader->inpos;
+					size_t		dstsize = len - done;
+					size_t		ret;
+
+					ret = LZ4F_decompress(reader->lz4_ctx, buf + done, &dstsize,
+										  reader->inbuf + reader->inpos,
+										  &srcsize, NULL);
+					if (LZ4F_isError(ret))
+						ereport(ERROR,
+								(errcode(ERRCODE_DATA_CORRUPTED),
+								 errmsg("could not decompress file \"%s\": %s",
+										reader->filepath,
+										LZ4F_getErrorName(ret))));
+
+					reader->inpos += srcsize;
+					done += dstsize;
+					reader->frame_done = (ret == 0);
+				}
+#endif
+				break;
+
+			case ARCHIVE_COMPRESSION_ZSTD:
+#ifdef WAL_UTILS_ZSTD
+				{
+					ZSTD_inBuffer in;
+					ZSTD_outBuffer out;
+					size_t		ret;
+
+					in.src = reader->inbuf;
+					in.size = reader->inlen;
+					in.pos = reader->inpos;
+					out.dst = buf;
+					out.size = len;
+					out.pos = done;
+
+					ret = ZSTD_decompressStream(reader->zstd_ctx, &out, &in);
+					if (ZSTD_isError(ret))
+						ereport(ERROR,
+								(errcode(ERRCODE_DATA_CORRUPTED),
+								 errmsg("could not decompress file \"%s\": %s",
+										reader->filepath,
+										ZSTD_getErrorName(ret))));
+
+					reader->inpos = in.pos;
+					done = out.pos;
+					reader->frame_done = (ret == 0);
+				}
+#endif
+				break;
+		}
+	}
+
+	return done;
+}
+
+/*
+ * Skip the given amount of data. For compressed files, this requires
+ * decompressing everything up to the wanted position.
+ */
+void
+archive_reader_skip(ArchiveReader *reader, int64 nbytes)
+{
+	char	   *scratch;
+
+	if (reader->compression == ARCHIVE_COMPRESSION_NONE)
+	{
+		reader->rawpos += (off_t) nbytes;
+		return;
+	}
+
+	scratch = palloc(ARCHIVE_READER_BUFSIZE);
+	while (nbytes > 0 && !reader->eof)
+	{
+		size_t		toread = (size_t) Min(nbytes, ARCHIVE_READER_BUFSIZE);
+
+		nbytes -= archive_reader_read(reader, scratch, toread);
+	}
+	pfree(scratch);
+}
+
+/*
+ * Close a reader, releasing all its resources.
+ */
+void
+archive_reader_close(ArchiveReader *reader)
+{
+	if (reader->fd < 0)
+		return;
+
+	CloseTransientFile(reader->fd);
+	reader->fd = -1;
+
+#ifdef HAVE_LIBZ
+	if (reader->zstream_init)
+	{
+		inflateEnd(&reader->zstream);
+		reader->zstream_init = false;
+	}
+#endif
+	archive_reader_cleanup(reader);
+
+	if (reader->inbuf)
+		pfree(reader->inbuf);
+	reader->inbuf = NULL;
+}
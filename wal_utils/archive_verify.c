@@ -0,0 +1,520 @@
+/*-------------------------------------------------------------------------
+ *
+ * archive_verify.c
+ *		Parallel verification of the integrity of archived WAL segments.
+ *
+ * The list of segments to verify is built as for
+ * archive_build_segment_list() and stored in a dynamic shared memory
+ * segment, with one result slot per segment. A pool of dynamic background
+ * workers then grabs segments from the list using an atomic counter, so
+ * the work is balanced across the workers whatever the time spent on each
+ * segment. Each segment is read in memory, decompressed if necessary, and
+ * checked with an XLogReader, validating all its page headers and the CRC
+ * of each record beginning in it.
+ *
+ * Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  wal_utils/archive_verify.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "access/htup_details.h"
+#include "access/xlog.h"
+#include "access/xlog_internal.h"
+#include "access/xlogreader.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+#include "storage/fd.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+#include "utils/pg_lsn.h"
+
+#include "wal_utils.h"
+
+/* Maximum length of the details reported for a segment */
+#define ARCHIVE_VERIFY_DETAIL_LEN	128
+
+/* Status of a segment */
+#define VERIFY_PENDING		0	/* not verified */
+#define VERIFY_OK			1	/* valid */
+#define VERIFY_MISSING		2	/* not found in archives */
+#define VERIFY_CORRUPTED	3	/* invalid page header or record */
+#define VERIFY_ERROR		4	/* failure while reading the segment */
+
+/* Result of the verification of a segment */
+typedef struct ArchiveVerifyResult
+{
+	char		segname[MAXFNAMELEN];
+	int			status;
+	int64		nrecords;		/* number of records validated */
+	char		detail[ARCHIVE_VERIFY_DETAIL_LEN];
+} ArchiveVerifyResult;
+
+/*
+ * Dynamic shared memory segment shared between the backend and its
+ * workers.
+ */
+typedef struct ArchiveVerifyShared
+{
+	uint32		nsegs;			/* number of segments to verify */
+	pg_atomic_uint32 next;		/* next segment to verify */
+	ArchiveVerifyResult results[FLEXIBLE_ARRAY_MEMBER];
+} ArchiveVerifyShared;
+
+/* Private data of the XLogReader, pointing to a segment in memory */
+typedef struct ArchiveVerifyPrivate
+{
+	char	   *buf;			/* contents of the segment */
+	XLogRecPtr	startptr;		/* position of the beginning of segment */
+} ArchiveVerifyPrivate;
+
+/* State of archive_verify_segments() across calls */
+typedef struct ArchiveVerifyState
+{
+	uint32		nsegs;
+	ArchiveVerifyResult *results;
+} ArchiveVerifyState;
+
+/* Signal handling */
+static volatile sig_atomic_t got_sigterm = false;
+
+void archive_verify_main(Datum main_arg) pg_attribute_noreturn();
+
+PG_FUNCTION_INFO_V1(archive_verify_segments);
+
+static void
+archive_verify_sigterm(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sigterm = true;
+	SetLatch(MyLatch);
+	errno = save_errno;
+}
+
+/*
+ * Get the name of the status of a segment.
+ */
+static const char *
+archive_verify_status_name(int status)
+{
+	switch (status)
+	{
+		case VERIFY_OK:
+			return "ok";
+		case VERIFY_MISSING:
+			return "missing";
+		case VERIFY_CORRUPTED:
+			return "corrupted";
+		case VERIFY_ERROR:
+			return "error";
+	}
+
+	return "not verified";
+}
+
+/* XLogReader callback function, to read a WAL page of the segment */
+static int
+archive_verify_read_page(XLogReaderState *xlogreader,
+						 XLogRecPtr targetPagePtr, int reqLen,
+						 XLogRecPtr targetRecPtr, char *readBuf)
+{
+	ArchiveVerifyPrivate *private =
+		(ArchiveVerifyPrivate *) xlogreader->private_data;
+
+	/* Records continuing on the next segment are not checked */
+	if (targetPagePtr < private->startptr ||
+		targetPagePtr + XLOG_BLCKSZ > private->startptr + wal_segment_size)
+		return -1;
+
+	memcpy(readBuf, private->buf + (targetPagePtr - private->startptr),
+		   XLOG_BLCKSZ);
+	return XLOG_BLCKSZ;
+}
+
+/*
+ * Check if a portion of a segment is only made of zeros, which is what
+ * follows the end of WAL in a segment.
+ */
+static bool
+archive_verify_is_zero(const char *buf, Size len)
+{
+	Size		i;
+
+	for (i = 0; i < len; i++)
+	{
+		if (buf[i] != 0)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Verify a segment, returning its status. The number of records validated
+ * and details about a corruption are saved in the result.
+ */
+static int
+archive_verify_segment(ArchiveVerifyResult *result)
+{
+	char	   *filepath;
+	ArchiveReader *reader;
+	char	   *buf;
+	size_t		nbytes;
+	char		extra;
+	TimeLineID	tli;
+	XLogSegNo	segno;
+	ArchiveVerifyPrivate private;
+	XLogReaderState *xlogreader;
+	XLogRecPtr	first_record;
+	XLogRecord *record;
+	char	   *errormsg;
+	uint32		offset;
+
+	filepath = archive_find_file(result->segname);
+	if (filepath == NULL)
+		return VERIFY_MISSING;
+
+	/* Load the whole segment, decompressing it if need be */
+	buf = palloc(wal_segment_size);
+	reader = archive_reader_open(filepath);
+	nbytes = archive_reader_read(reader, buf, wal_segment_size);
+	if (nbytes == (size_t) wal_segment_size &&
+		archive_reader_read(reader, &extra, 1) > 0)
+		nbytes++;
+	archive_reader_close(reader);
+
+	if (nbytes != (size_t) wal_segment_size)
+	{
+		snprintf(result->detail, ARCHIVE_VERIFY_DETAIL_LEN,
+				 "unexpected segment size, expected %d bytes",
+				 wal_segment_size);
+		return VERIFY_CORRUPTED;
+	}
+
+	XLogFromFileName(result->segname, &tli, &segno, wal_segment_size);
+	private.buf = buf;
+	XLogSegNoOffsetToRecPtr(segno, 0, wal_segment_size, private.startptr);
+
+	xlogreader = XLogReaderAllocate(wal_segment_size, NULL,
+									archive_verify_read_page, &private);
+	if (xlogreader == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory"),
+				 errdetail("Failed while allocating a WAL reading processor.")));
+
+	/*
+	 * Check all the page headers. The first page full of zeros marks the end
+	 * of WAL, possible in the last segment of a timeline.
+	 */
+	for (offset = 0; offset < wal_segment_size; offset += XLOG_BLCKSZ)
+	{
+		if (archive_verify_is_zero(buf + offset, XLOG_BLCKSZ))
+		{
+			if (offset == 0 ||
+				!archive_verify_is_zero(buf + offset,
+										wal_segment_size - offset))
+			{
+				snprintf(result->detail, ARCHIVE_VERIFY_DETAIL_LEN,
+						 "unexpected zero page at offset %u", offset);
+				return VERIFY_CORRUPTED;
+			}
+			break;
+		}
+
+		if (!XLogReaderValidatePageHeader(xlogreader,
+										  private.startptr + offset,
+										  buf + offset))
+		{
+			strlcpy(result->detail, xlogreader->errormsg_buf,
+					ARCHIVE_VERIFY_DETAIL_LEN);
+			return VERIFY_CORRUPTED;
+		}
+	}
+
+	/*
+	 * Then check all the records beginning in this segment. A segment may
+	 * have none if it is only used by the continuation of a record.
+	 */
+	first_record = XLogFindNextRecord(xlogreader, private.startptr);
+	if (XLogRecPtrIsInvalid(first_record))
+	{
+		XLogReaderFree(xlogreader);
+		return VERIFY_OK;
+	}
+
+	XLogBeginRead(xlogreader, first_record);
+	while ((record = XLogReadRecord(xlogreader, &errormsg)) != NULL)
+		result->nrecords++;
+
+	if (errormsg)
+	{
+		XLogRecPtr	endptr = xlogreader->EndRecPtr;
+
+		/* The rest of the segment should be empty at the end of WAL */
+		if (endptr < private.startptr ||
+			endptr >= private.startptr + wal_segment_size ||
+			!archive_verify_is_zero(buf + (endptr - private.startptr),
+									wal_segment_size -
+									(endptr - private.startptr)))
+		{
+			strlcpy(result->detail, errormsg, ARCHIVE_VERIFY_DETAIL_LEN);
+			return VERIFY_CORRUPTED;
+		}
+
+		snprintf(result->detail, ARCHIVE_VERIFY_DETAIL_LEN,
+				 "end of WAL at %X/%X",
+				 (uint32) (endptr >> 32), (uint32) endptr);
+	}
+
+	XLogReaderFree(xlogreader);
+	return VERIFY_OK;
+}
+
+/*
+ * Main routine of a verification worker, taking in input the handle of the
+ * dynamic shared memory segment holding the list of segments.
+ */
+void
+archive_verify_main(Datum main_arg)
+{
+	dsm_segment *seg;
+	ArchiveVerifyShared *shared;
+	MemoryContext verify_context;
+
+	pqsignal(SIGTERM, archive_verify_sigterm);
+	BackgroundWorkerUnblockSignals();
+
+	seg = dsm_attach(DatumGetUInt32(main_arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+	shared = (ArchiveVerifyShared *) dsm_segment_address(seg);
+
+	verify_context = AllocSetContextCreate(TopMemoryContext,
+										   "archive verification",
+										   ALLOCSET_DEFAULT_SIZES);
+
+	while (!got_sigterm)
+	{
+		uint32		next = pg_atomic_fetch_add_u32(&shared->next, 1);
+		ArchiveVerifyResult *result;
+		MemoryContext oldcontext;
+
+		if (next >= shared->nsegs)
+			break;
+		result = &shared->results[next];
+
+		oldcontext = MemoryContextSwitchTo(verify_context);
+
+		/*
+		 * Failures while reading a segment are reported for this segment
+		 * only, letting the worker move on with the next ones.
+		 */
+		PG_TRY();
+		{
+			result->status = archive_verify_segment(result);
+		}
+		PG_CATCH();
+		{
+			ErrorData  *edata;
+
+			MemoryContextSwitchTo(verify_context);
+			edata = CopyErrorData();
+			FlushErrorState();
+
+			/* Close the files left open */
+			AtEOXact_Files(false);
+
+			result->status = VERIFY_ERROR;
+			strlcpy(result->detail, edata->message, ARCHIVE_VERIFY_DETAIL_LEN);
+		}
+		PG_END_TRY();
+
+		MemoryContextSwitchTo(oldcontext);
+		MemoryContextReset(verify_context);
+	}
+
+	dsm_detach(seg);
+	proc_exit(0);
+}
+
+/*
+ * Stop the workers when the backend detaches from the list of segments,
+ * which happens as well if the query is cancelled.
+ */
+static void
+archive_verify_detach(dsm_segment *seg, Datum arg)
+{
+	ArchiveVerifyShared *shared = (ArchiveVerifyShared *) DatumGetPointer(arg);
+
+	pg_atomic_write_u32(&shared->next, shared->nsegs);
+}
+
+/*
+ * archive_verify_segments
+ *
+ * Verify the archived segments needed to go from an origin timeline and
+ * LSN to a target timeline and LSN, using the given number of background
+ * workers. Returns the status of each segment.
+ */
+Datum
+archive_verify_segments(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	ArchiveVerifyState *state;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldcontext;
+		TupleDesc	tupdesc;
+		SegmentListState *list;
+		char		xlogfname[MAXFNAMELEN];
+		char	  (*segs)[MAXFNAMELEN];
+		uint32		nsegs = 0;
+		uint32		maxsegs = 1024;
+		int32		nworkers;
+		int			nlaunched = 0;
+		BackgroundWorkerHandle **handles;
+		dsm_segment *seg;
+		ArchiveVerifyShared *shared;
+		uint32		i;
+
+		if (PG_ARGISNULL(0) || PG_ARGISNULL(1) ||
+			PG_ARGISNULL(2) || PG_ARGISNULL(3))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("origin or target data cannot be NULL")));
+
+		nworkers = PG_ARGISNULL(5) ? 0 : PG_GETARG_INT32(5);
+		if (nworkers <= 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("number of workers must be greater than zero")));
+
+		if (!superuser())
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+					 (errmsg("must be superuser to verify archives"))));
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		/* Build the list of segments to verify */
+		list = archive_segment_list_start(PG_GETARG_INT32(0),
+										  PG_GETARG_LSN(1),
+										  PG_GETARG_INT32(2),
+										  PG_GETARG_LSN(3),
+										  PG_ARGISNULL(4) ? NULL :
+										  TextDatumGetCString(PG_GETARG_DATUM(4)));
+		segs = palloc(maxsegs * MAXFNAMELEN);
+		while (archive_segment_list_next(list, xlogfname))
+		{
+			if (nsegs >= maxsegs)
+			{
+				maxsegs *= 2;
+				segs = repalloc_huge(segs, (Size) maxsegs * MAXFNAMELEN);
+			}
+			strlcpy(segs[nsegs++], xlogfname, MAXFNAMELEN);
+		}
+
+		seg = dsm_create(add_size(offsetof(ArchiveVerifyShared, results),
+								  mul_size(nsegs, sizeof(ArchiveVerifyResult))),
+						 0);
+		shared = (ArchiveVerifyShared *) dsm_segment_address(seg);
+		shared->nsegs = nsegs;
+		pg_atomic_init_u32(&shared->next, 0);
+		for (i = 0; i < nsegs; i++)
+		{
+			MemSet(&shared->results[i], 0, sizeof(ArchiveVerifyResult));
+			strlcpy(shared->results[i].segname, segs[i], MAXFNAMELEN);
+		}
+		pfree(segs);
+		on_dsm_detach(seg, archive_verify_detach, PointerGetDatum(shared));
+
+		/* Start the workers, no need for more than one per segment */
+		nworkers = Min(nworkers, (int32) nsegs);
+		nworkers = Min(nworkers, max_worker_processes);
+		handles = palloc(sizeof(BackgroundWorkerHandle *) * nworkers);
+		for (i = 0; i < (uint32) nworkers; i++)
+		{
+			BackgroundWorker worker;
+
+			MemSet(&worker, 0, sizeof(BackgroundWorker));
+			worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+			worker.bgw_start_time = BgWorkerStart_ConsistentState;
+			worker.bgw_restart_time = BGW_NEVER_RESTART;
+			snprintf(worker.bgw_library_name, BGW_MAXLEN, "wal_utils");
+			snprintf(worker.bgw_function_name, BGW_MAXLEN, "archive_verify_main");
+			snprintf(worker.bgw_name, BGW_MAXLEN, "wal_utils archive verify");
+			snprintf(worker.bgw_type, BGW_MAXLEN, "wal_utils archive verify");
+			worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(seg));
+			worker.bgw_notify_pid = MyProcPid;
+
+			/* Use the workers that could be registered */
+			if (!RegisterDynamicBackgroundWorker(&worker, &handles[nlaunched]))
+				break;
+			nlaunched++;
+		}
+
+		if (nlaunched == 0 && nsegs > 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+					 errmsg("could not register background process"),
+					 errhint("You may need to increase max_worker_processes.")));
+
+		/* Wait for all the workers to finish */
+		for (i = 0; i < nlaunched; i++)
+			(void) WaitForBackgroundWorkerShutdown(handles[i]);
+
+		state = (ArchiveVerifyState *) palloc(sizeof(ArchiveVerifyState));
+		state->nsegs = nsegs;
+		state->results = palloc_extended(Max(nsegs, 1) *
+										 sizeof(ArchiveVerifyResult),
+										 MCXT_ALLOC_HUGE);
+		memcpy(state->results, shared->results,
+			   nsegs * sizeof(ArchiveVerifyResult));
+		dsm_detach(seg);
+
+		funcctx->user_fctx = state;
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = (ArchiveVerifyState *) funcctx->user_fctx;
+
+	if (funcctx->call_cntr < state->nsegs)
+	{
+		ArchiveVerifyResult *result = &state->results[funcctx->call_cntr];
+		Datum		values[4];
+		bool		nulls[4];
+		HeapTuple	tuple;
+
+		MemSet(nulls, 0, sizeof(nulls));
+		values[0] = CStringGetTextDatum(result->segname);
+		values[1] = CStringGetTextDatum(archive_verify_status_name(result->status));
+		values[2] = Int64GetDatum(result->nrecords);
+		if (result->detail[0] == '\0')
+			nulls[3] = true;
+		else
+			values[3] = CStringGetTextDatum(result->detail);
+
+		tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+	}
+
+	SRF_RETURN_DONE(funcctx);
+}
@@ -0,0 +1,229 @@
+/*-------------------------------------------------------------------------
+ *
+ * history_cache.c
+ *		Cache in shared memory of parsed timeline history files.
+ *
+ * Parsing a timeline history file each time it is given to a function
+ * is costly for tools calling these functions many times in a row with
+ * the same history. This keeps the results of the parsing in a fixed set
+ * of slots in shared memory, shared by all the sessions, keyed by the
+ * contents of the history file. The CRC-32C and the length of the contents
+ * are only used to skip quickly the slots that cannot match, the contents
+ * being compared before using a slot so as a collision of checksums never
+ * returns the entries of another history. The least recently used slot is
+ * replaced when the cache is full.
+ *
+ * The cache is only available when the library is loaded with
+ * shared_preload_libraries. Callers parse history files by themselves
+ * otherwise.
+ *
+ * Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  wal_utils/history_cache.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+
+#include "wal_utils.h"
+
+/* Number of histories cached */
+#define HISTORY_CACHE_SLOTS			64
+
+/* Maximum number of entries of a history to be cached */
+#define HISTORY_CACHE_MAX_ENTRIES	256
+
+/* Maximum length of the contents of a history to be cached */
+#define HISTORY_CACHE_MAX_LEN		8192
+
+typedef struct HistoryCacheSlot
+{
+	bool		used;			/* is this slot in use? */
+	pg_crc32c	crc;			/* CRC-32C of history contents */
+	uint32		len;			/* length of history contents */
+	pg_atomic_uint64 last_used; /* for the replacement of slots */
+	int			nentries;
+	TimeLineHistoryEntry entries[HISTORY_CACHE_MAX_ENTRIES];
+	char		contents[HISTORY_CACHE_MAX_LEN];	/* history contents */
+} HistoryCacheSlot;
+
+typedef struct HistoryCache
+{
+	LWLock	   *lock;			/* protects the slots */
+	pg_atomic_uint64 clock;		/* incremented at each access */
+	HistoryCacheSlot slots[HISTORY_CACHE_SLOTS];
+} HistoryCache;
+
+static HistoryCache *history_cache = NULL;
+
+/* Hooks */
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/*
+ * Allocate or attach to the shared cache.
+ */
+static void
+history_cache_shmem_startup(void)
+{
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	history_cache = ShmemInitStruct("wal_utils history cache",
+									sizeof(HistoryCache),
+									&found);
+	if (!found)
+	{
+		int			i;
+
+		MemSet(history_cache, 0, sizeof(HistoryCache));
+		history_cache->lock =
+			&(GetNamedLWLockTranche("wal_utils history cache"))->lock;
+		pg_atomic_init_u64(&history_cache->clock, 0);
+		for (i = 0; i < HISTORY_CACHE_SLOTS; i++)
+			pg_atomic_init_u64(&history_cache->slots[i].last_used, 0);
+	}
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Reserve shared memory for the cache, called when loading the library
+ * with shared_preload_libraries.
+ */
+void
+history_cache_init(void)
+{
+	RequestAddinShmemSpace(MAXALIGN(sizeof(HistoryCache)));
+	RequestNamedLWLockTranche("wal_utils history cache", 1);
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = history_cache_shmem_startup;
+}
+
+/*
+ * Compute the checksum of the contents of a history file, used to find
+ * the slots of the cache that may hold it.
+ */
+pg_crc32c
+history_cache_checksum(const char *buffer, uint32 len)
+{
+	pg_crc32c	crc;
+
+	INIT_CRC32C(crc);
+	COMP_CRC32C(crc, buffer, len);
+	FIN_CRC32C(crc);
+
+	return crc;
+}
+
+/*
+ * Check if a slot holds the given history contents.
+ */
+static inline bool
+history_cache_match(HistoryCacheSlot *slot, pg_crc32c crc,
+					const char *buffer, uint32 len)
+{
+	return slot->used && slot->crc == crc && slot->len == len &&
+		memcmp(slot->contents, buffer, len) == 0;
+}
+
+/*
+ * Look for a history in the cache. If found, returns true with a copy of
+ * its entries allocated in the current memory context.
+ */
+bool
+history_cache_lookup(pg_crc32c crc, const char *buffer, uint32 len,
+					 TimeLineHistoryEntry **entries, int *nentries)
+{
+	int			i;
+	bool		found = false;
+
+	if (history_cache == NULL || len > HISTORY_CACHE_MAX_LEN)
+		return false;
+
+	LWLockAcquire(history_cache->lock, LW_SHARED);
+	for (i = 0; i < HISTORY_CACHE_SLOTS; i++)
+	{
+		HistoryCacheSlot *slot = &history_cache->slots[i];
+
+		if (!history_cache_match(slot, crc, buffer, len))
+			continue;
+
+		*nentries = slot->nentries;
+		*entries = (TimeLineHistoryEntry *)
+			palloc(sizeof(TimeLineHistoryEntry) * Max(slot->nentries, 1));
+		memcpy(*entries, slot->entries,
+			   sizeof(TimeLineHistoryEntry) * slot->nentries);
+		pg_atomic_write_u64(&slot->last_used,
+							pg_atomic_add_fetch_u64(&history_cache->clock, 1));
+		found = true;
+		break;
+	}
+	LWLockRelease(history_cache->lock);
+
+	return found;
+}
+
+/*
+ * Save a parsed history in the cache, replacing the least recently used
+ * slot if the cache is full. Histories too large are not cached.
+ */
+void
+history_cache_insert(pg_crc32c crc, const char *buffer, uint32 len,
+					 TimeLineHistoryEntry *entries, int nentries)
+{
+	HistoryCacheSlot *victim = NULL;
+	int			i;
+
+	if (history_cache == NULL || nentries > HISTORY_CACHE_MAX_ENTRIES ||
+		len > HISTORY_CACHE_MAX_LEN)
+		return;
+
+	LWLockAcquire(history_cache->lock, LW_EXCLUSIVE);
+	for (i = 0; i < HISTORY_CACHE_SLOTS; i++)
+	{
+		HistoryCacheSlot *slot = &history_cache->slots[i];
+
+		/* Already added by a concurrent session */
+		if (history_cache_match(slot, crc, buffer, len))
+		{
+			victim = NULL;
+			break;
+		}
+
+		if (!slot->used)
+		{
+			if (victim == NULL || victim->used)
+				victim = slot;
+		}
+		else if (victim == NULL ||
+				 (victim->used &&
+				  pg_atomic_read_u64(&slot->last_used) <
+				  pg_atomic_read_u64(&victim->last_used)))
+			victim = slot;
+	}
+
+	if (victim != NULL)
+	{
+		victim->used = true;
+		victim->crc = crc;
+		victim->len = len;
+		memcpy(victim->contents, buffer, len);
+		victim->nentries = nentries;
+		memcpy(victim->entries, entries,
+			   sizeof(TimeLineHistoryEntry) * nentries);
+		pg_atomic_write_u64(&victim->last_used,
+							pg_atomic_add_fetch_u64(&history_cache->clock, 1));
+	}
+	LWLockRelease(history_cache->lock);
+}
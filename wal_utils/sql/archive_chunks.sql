@@ -0,0 +1,25 @@
+-- Tests of archive_get_data_chunks() on a file of the archives. This
+-- requires PGARCHIVE to point to the same writable directory for the
+-- server and for this session.
+\set archive_dir `echo "$PGARCHIVE"`
+SELECT :'archive_dir' = '' AS skip_test \gset
+\if :skip_test
+\quit
+\endif
+\set chunks_file :archive_dir '/wal_utils_chunks.data'
+COPY (SELECT 'abcdefghij') TO :'chunks_file';
+-- Chunks of the whole file, generated one at a time
+SELECT (c).chunk_offset, (c).chunk
+  FROM (SELECT archive_get_data_chunks('wal_utils_chunks.data', 4) AS c) s;
+-- Range of the file, with a beginning and a length
+SELECT (c).chunk_offset, (c).chunk
+  FROM (SELECT archive_get_data_chunks('wal_utils_chunks.data', 4, 2, 5) AS c) s;
+-- Negative beginning, from the end of the file
+SELECT (c).chunk_offset, (c).chunk
+  FROM (SELECT archive_get_data_chunks('wal_utils_chunks.data', 4, -3) AS c) s;
+-- Scan stopped before the end of the file
+SELECT archive_get_data_chunks('wal_utils_chunks.data', 4) LIMIT 1;
+-- Same data as archive_get_data()
+SELECT archive_get_data('wal_utils_chunks.data', 2, 5) =
+  (SELECT string_agg(chunk, ''::bytea ORDER BY chunk_offset)
+     FROM archive_get_data_chunks('wal_utils_chunks.data', 4, 2, 5)) AS same_data;
@@ -1,3 +1,16 @@
 -- Sanity check for archive_get_size
 SELECT archive_get_size('../no_parent'); -- error
 SELECT archive_get_size('/no_absolute'); -- error
+-- Sanity checks for archive_get_data_chunks
+SELECT * FROM archive_get_data_chunks('../no_parent'); -- error
+SELECT * FROM archive_get_data_chunks('/no_absolute'); -- error
+SELECT * FROM archive_get_data_chunks('000000010000000000000001', 0); -- error
+-- Sanity checks for archive_get_segment
+SELECT archive_get_segment('../000000010000000000000001'); -- error
+SELECT archive_get_segment('00000001000000000000000Z'); -- error
+-- Sanity checks for archive_index_lookup
+SELECT * FROM archive_index_lookup('00000001000000000000000Z', NULL); -- error
+SELECT * FROM archive_index_lookup(NULL, '000000010000000000000001.gz'); -- error
+-- Sanity checks for archive_verify_segments
+SELECT * FROM archive_verify_segments(1, '0/1', 1, '0/2', NULL, 0); -- error
+SELECT * FROM archive_verify_segments(1, '0/2', 1, '0/1', NULL, 1); -- error
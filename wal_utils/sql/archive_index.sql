@@ -0,0 +1,35 @@
+-- Tests of the index of the archives, with files written into them. This
+-- requires PGARCHIVE to point to the same writable directory for the
+-- server and for this session.
+\set archive_dir `echo "$PGARCHIVE"`
+SELECT :'archive_dir' = '' AS skip_test \gset
+\if :skip_test
+\quit
+\endif
+-- Segments on timeline 126, with a compressed and a partial one
+\set seg_file :archive_dir '/0000007E0000000000000001'
+COPY (SELECT 'x') TO :'seg_file';
+\set seg_file :archive_dir '/0000007E0000000000000002.gz'
+COPY (SELECT 'gz') TO :'seg_file';
+\set seg_file :archive_dir '/0000007E0000000000000003.partial'
+COPY (SELECT 'partial') TO :'seg_file';
+-- Segment on timeline 127
+\set seg_file :archive_dir '/0000007F0000000000000001'
+COPY (SELECT 'other') TO :'seg_file';
+-- Not a segment, ignored
+\set seg_file :archive_dir '/0000007E.history'
+COPY (SELECT 'history') TO :'seg_file';
+SELECT total >= 4 AS total_ok FROM archive_index_refresh();
+-- Nothing new once refreshed
+SELECT added, removed FROM archive_index_refresh();
+-- Lookups by ranges of segments
+SELECT filename, timeline, start_lsn, size, compression
+  FROM archive_index_lookup('0000007E0000000000000000', '0000007EFFFFFFFF000000FF');
+SELECT filename, timeline, start_lsn, size, compression
+  FROM archive_index_lookup('0000007E0000000000000002', '0000007E0000000000000002');
+SELECT filename, timeline, start_lsn, size, compression
+  FROM archive_index_lookup('0000007E0000000000000003', '0000007FFFFFFFFF000000FF');
+SELECT count(*) FROM archive_index_lookup('0000007E0000000000000004', '0000007E000000000000FFFF');
+-- Clean up the archives, removing the entries of the index
+\! cd "$PGARCHIVE" && rm -f 0000007E0000000000000001 0000007E0000000000000002.gz 0000007E0000000000000003.partial 0000007F0000000000000001 0000007E.history
+SELECT added, removed FROM archive_index_refresh();
@@ -41,4 +41,18 @@ SELECT archive_build_segment_list(6, '0/09D4F389'::pg_lsn, 9, '0/259BEB38'::pg_l
 -- error, target and origin timelines have to match without history file
 SELECT archive_build_segment_list(1, '0/1D4F390', 2, '0/189BEB38'::pg_lsn, NULL);
 
+-- Ranges of segments for each timeline, same segments as the lists above
+SELECT r.* FROM history_data,
+  archive_build_segment_ranges(1, '0/06D4F389'::pg_lsn, 8, '0/259BEB38'::pg_lsn, data) r;
+SELECT r.* FROM history_data,
+  archive_build_segment_ranges(3, '0/177BEB38'::pg_lsn, 8, '0/259BEB38'::pg_lsn, data) r;
+SELECT * FROM archive_build_segment_ranges(1, '0/1D4F390', 1, '0/189BEB38'::pg_lsn, NULL);
+SELECT (SELECT sum(r.segments) FROM history_data,
+          archive_build_segment_ranges(3, '0/177BEB38'::pg_lsn, 8, '0/259BEB38'::pg_lsn, data) r) =
+       (SELECT count(*) FROM history_data,
+          archive_build_segment_list(3, '0/177BEB38'::pg_lsn, 8, '0/259BEB38'::pg_lsn, data)) AS same_count;
+-- error, same checks as the list of segments
+SELECT * FROM archive_build_segment_ranges(NULL, '0/0'::pg_lsn, 1, '0/0'::pg_lsn, NULL);
+SELECT * FROM archive_build_segment_ranges(1, '0/1D4F390', 2, '0/189BEB38'::pg_lsn, NULL);
+
 DROP TABLE history_data;
@@ -18,6 +18,9 @@ LANGUAGE C STRICT;
 -- Build a list of WAL segments necessary to join the given origin LSN
 -- and timeline to their targets. Note that the origin needs to be a
 -- direct parent of the target as specified by the history data.
+-- Segments are generated one at a time, so memory is constant when this
+-- is called in the target list of a query. When called in FROM, all the
+-- segments are materialized first.
 CREATE FUNCTION archive_build_segment_list(
 	IN origin_tli int,
 	IN origin_lsn pg_lsn,
@@ -29,14 +32,33 @@ RETURNS SETOF text
 AS 'MODULE_PATHNAME'
 LANGUAGE C;
 
+-- Summary of the list of WAL segments of archive_build_segment_list(),
+-- with one row for each range of consecutive segments on a timeline.
+-- The work done depends only on the number of timelines, whatever the
+-- distance between the origin and the target.
+CREATE FUNCTION archive_build_segment_ranges(
+	IN origin_tli int,
+	IN origin_lsn pg_lsn,
+	IN target_tli int,
+	IN target_lsn pg_lsn,
+	IN history_data text,
+	OUT timeline int,
+	OUT start_segment text,
+	OUT end_segment text,
+	OUT segments bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
 -- Set of routines for archive data fetching
 -- Get data from the archive path. The base path where the lookup is
 -- done uses as environment variable PGARCHIVE which points to a local
 -- path where the archives are located. This should be a variable loaded
 -- by Postgres. Note that there is no restriction on the file name that
--- caller can use here, a segment file could be compressed, and the
--- archive could be used as well to store some custom metadata. The path
--- defined cannot be absolute as well.
+-- caller can use here, and the archive could be used as well to store
+-- some custom metadata. Files compressed with gzip, lz4 or zstd are
+-- detected and decompressed, the offsets referring then to decompressed
+-- data. The path defined cannot be absolute as well.
 CREATE FUNCTION archive_get_data(
 	IN filename text,
 	IN begin_t bigint,
@@ -45,10 +67,117 @@ CREATE FUNCTION archive_get_data(
 RETURNS bytea
 AS 'MODULE_PATHNAME'
 LANGUAGE C STRICT;
--- Get the size of a file in archives.
+-- Get data from the archive path as a set of chunks, each one with its
+-- offset in the file. Chunks are read one at a time, so backend memory
+-- is bounded by the chunk size when this is called in the target list of
+-- a query, which is adapted to the transfer of large files like WAL
+-- segments. When called in FROM, all the chunks are materialized before
+-- the first one is returned. A negative length means that the data is
+-- read up to the end of the file, and a negative beginning is an offset
+-- from the end of the file.
+CREATE FUNCTION archive_get_data_chunks(
+	IN filename text,
+	IN chunk_size int DEFAULT 1048576,
+	IN begin_t bigint DEFAULT 0,
+	IN length_t bigint DEFAULT -1,
+	OUT chunk_offset bigint,
+	OUT chunk bytea)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+-- Get a complete WAL segment from the archive path. The segment can be
+-- compressed with gzip, lz4 or zstd, in which case its file name can
+-- have the extension of its compression method, and it is returned
+-- decompressed.
+CREATE FUNCTION archive_get_segment(
+	IN segname text,
+	OUT data bytea)
+RETURNS bytea
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+-- Get the size of the data of a file in archives. For a file compressed
+-- with gzip, lz4 or zstd, this is the size of the decompressed data, as
+-- for the offsets of archive_get_data(), and all of it is decompressed
+-- to get it.
 CREATE FUNCTION archive_get_size(
 	IN filename text,
 	OUT size bigint)
 RETURNS bigint
 AS 'MODULE_PATHNAME'
 LANGUAGE C STRICT;
+
+-- Verify the integrity of the archived segments needed to go from an
+-- origin timeline and LSN to a target timeline and LSN, as listed by
+-- archive_build_segment_list(). The segments are split across a pool of
+-- background workers, checking the page headers of each segment and the
+-- CRC of each record beginning in it. Returns the status of each segment,
+-- with the number of records validated.
+CREATE FUNCTION archive_verify_segments(
+	IN origin_tli int,
+	IN origin_lsn pg_lsn,
+	IN target_tli int,
+	IN target_lsn pg_lsn,
+	IN history_data text DEFAULT NULL,
+	IN workers int DEFAULT 4,
+	OUT segment text,
+	OUT status text,
+	OUT records bigint,
+	OUT detail text)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+-- Index of the WAL segments in the archive path, stored in the directory
+-- wal_utils/ of the data folder. The index is refreshed with a scan of the archives, where only
+-- the files not already indexed are looked at. Returns the number of
+-- entries in the index, and the number of entries added and removed.
+CREATE FUNCTION archive_index_refresh(
+	OUT total bigint,
+	OUT added bigint,
+	OUT removed bigint)
+RETURNS record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+-- Look at the index of the archives for the segments between two segment
+-- names, both included, ordered by timeline and position. A NULL bound
+-- leaves the range open on its side. The compression is the one of the
+-- file extension.
+CREATE FUNCTION archive_index_lookup(
+	IN start_segment text DEFAULT NULL,
+	IN end_segment text DEFAULT NULL,
+	OUT filename text,
+	OUT timeline int,
+	OUT start_lsn pg_lsn,
+	OUT size bigint,
+	OUT compression text,
+	OUT modification timestamptz)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+-- Prefetch of archived segments, requiring wal_utils to be loaded with
+-- shared_preload_libraries. A background worker loads into the OS cache
+-- the segments of the given list, as generated by
+-- archive_build_segment_list(), up to prefetch_depth segments ahead of the
+-- replay position of recovery. Returns the PID of the worker.
+CREATE FUNCTION archive_prefetch_start(
+	IN wal_segs text[],
+	IN prefetch_depth int DEFAULT 8)
+RETURNS int
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+-- Statistics of the last prefetch worker started. A hit is a segment
+-- prefetched before recovery needed it, a miss a segment needed before
+-- it could be prefetched.
+CREATE FUNCTION archive_prefetch_stats(
+	OUT pid int,
+	OUT segments_total int,
+	OUT segments_replayed int,
+	OUT segments_prefetched int,
+	OUT hits bigint,
+	OUT misses bigint,
+	OUT missing bigint,
+	OUT last_prefetched text)
+RETURNS record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
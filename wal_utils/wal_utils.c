@@ -15,19 +15,25 @@
 #include "fmgr.h"
 
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include "access/htup_details.h"
 #include "access/timeline.h"
 #include "access/xlog.h"
 #include "access/xlog_internal.h"
-#include "catalog/pg_type.h"
 #include "funcapi.h"
 #include "miscadmin.h"
+#include "storage/fd.h"
 #include "utils/builtins.h"
 #include "utils/memutils.h"
 #include "utils/pg_lsn.h"
 
+#include "wal_utils.h"
+
 PG_MODULE_MAGIC;
 
+void _PG_init(void);
+
 static List *parseTimeLineHistory(char *buffer);
 
 /*
@@ -35,8 +41,62 @@ static List *parseTimeLineHistory(char *buffer);
  */
 PG_FUNCTION_INFO_V1(archive_parse_history);
 PG_FUNCTION_INFO_V1(archive_build_segment_list);
+PG_FUNCTION_INFO_V1(archive_build_segment_ranges);
 PG_FUNCTION_INFO_V1(archive_get_size);
 PG_FUNCTION_INFO_V1(archive_get_data);
+PG_FUNCTION_INFO_V1(archive_get_data_chunks);
+PG_FUNCTION_INFO_V1(archive_get_segment);
+
+/*
+ * State of archive_get_data_chunks() across calls.
+ */
+typedef struct ArchiveChunksState
+{
+	char	   *filepath;		/* file read */
+	int			fd;				/* file descriptor, -1 if closed */
+	off_t		offset;			/* position of next chunk */
+	off_t		end;			/* position where to stop reading */
+	int			chunk_size;		/* maximum size of a chunk */
+	bytea	   *chunk;			/* buffer reused for all chunks */
+} ArchiveChunksState;
+
+/*
+ * Parsed history returned by archive_parse_history() across calls.
+ */
+typedef struct ParsedHistory
+{
+	TimeLineHistoryEntry *entries;
+	int			nentries;
+} ParsedHistory;
+
+/*
+ * State of the generation of a list of segments, across calls of
+ * archive_segment_list_next().
+ */
+struct SegmentListState
+{
+	TimeLineHistoryEntry *entries;	/* history entries, with target at end */
+	int			nentries;
+	int			current_entry;	/* entry of the segment to return next */
+	XLogRecPtr	current_seg_lsn;	/* beginning of the next segment */
+	TimeLineID	target_tli;
+	XLogRecPtr	target_lsn;
+	bool		last_done;		/* segment of target LSN returned? */
+};
+
+/*
+ * Entry point of library loading. Shared memory is only available when
+ * the library is loaded with shared_preload_libraries.
+ */
+void
+_PG_init(void)
+{
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	archive_prefetch_init();
+	history_cache_init();
+}
 
 /*
  * parseTimeLineHistory
@@ -125,6 +185,42 @@ parseTimeLineHistory(char *buffer)
 	return entries;
 }
 
+/*
+ * getTimeLineHistory
+ *
+ * Get the entries of a history file, as an array sorted by timeline, with
+ * an extra slot at the end available to the caller. The entries are
+ * looked at in the shared cache of histories first, and saved in it once
+ * parsed if not found.
+ */
+static TimeLineHistoryEntry *
+getTimeLineHistory(char *buffer, int *nentries)
+{
+	uint32		len = strlen(buffer);
+	pg_crc32c	crc = history_cache_checksum(buffer, len);
+	TimeLineHistoryEntry *entries;
+	List	   *list;
+	ListCell   *lc;
+	int			i = 0;
+
+	if (history_cache_lookup(crc, buffer, len, &entries, nentries))
+		return (TimeLineHistoryEntry *)
+			repalloc(entries, sizeof(TimeLineHistoryEntry) * (*nentries + 1));
+
+	/* parse a copy, as the contents are needed intact for the cache */
+	list = parseTimeLineHistory(pnstrdup(buffer, len));
+
+	*nentries = list_length(list);
+	entries = (TimeLineHistoryEntry *)
+		palloc(sizeof(TimeLineHistoryEntry) * (*nentries + 1));
+	foreach(lc, list)
+		entries[i++] = *((TimeLineHistoryEntry *) lfirst(lc));
+	list_free_deep(list);
+
+	history_cache_insert(crc, buffer, len, entries, *nentries);
+	return entries;
+}
+
 
 /*
  * archive_parse_history
@@ -136,83 +232,78 @@ parseTimeLineHistory(char *buffer)
 Datum
 archive_parse_history(PG_FUNCTION_ARGS)
 {
-	char	   *history_buf = TextDatumGetCString(PG_GETARG_DATUM(0));
-	TupleDesc   tupdesc;
-	Tuplestorestate *tupstore;
-	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
-	MemoryContext per_query_ctx;
-	MemoryContext oldcontext;
-	List	   *entries = NIL;
-	ListCell   *entry;
+	FuncCallContext *funcctx;
+	ParsedHistory *history;
 
-	/* check to see if caller supports us returning a tuplestore */
-	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
-		ereport(ERROR,
-				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-				 errmsg("set-valued function called in context that cannot accept a set")));
-	if (!(rsinfo->allowedModes & SFRM_Materialize))
-		ereport(ERROR,
-				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-				 errmsg("materialize mode required, but it is not "
-						"allowed in this context")));
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldcontext;
+		TupleDesc	tupdesc;
+		char	   *history_buf;
 
-	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
-	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
 
-	/* Build tuple descriptor */
-	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
-		elog(ERROR, "return type must be a row type");
+		/* Build tuple descriptor */
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
 
-	tupstore = tuplestore_begin_heap(true, false, work_mem);
-	rsinfo->returnMode = SFRM_Materialize;
-	rsinfo->setResult = tupstore;
-	rsinfo->setDesc = tupdesc;
-	MemoryContextSwitchTo(oldcontext);
+		/* parse the history file */
+		history_buf = TextDatumGetCString(PG_GETARG_DATUM(0));
+		history = (ParsedHistory *) palloc(sizeof(ParsedHistory));
+		history->entries = getTimeLineHistory(history_buf, &history->nentries);
+		funcctx->user_fctx = history;
+
+		MemoryContextSwitchTo(oldcontext);
+	}
 
-	/* parse the history file */
-	entries = parseTimeLineHistory(history_buf);
+	funcctx = SRF_PERCALL_SETUP();
+	history = (ParsedHistory *) funcctx->user_fctx;
 
 	/* represent its data as a set of tuples */
-	foreach(entry, entries)
+	if (funcctx->call_cntr < history->nentries)
 	{
 		Datum		values[3];
 		bool		nulls[3];
-		TimeLineHistoryEntry *history = (TimeLineHistoryEntry *) lfirst(entry);
+		HeapTuple	tuple;
+		TimeLineHistoryEntry *entry = &history->entries[funcctx->call_cntr];
 
 		/* Initialize values and NULL flags arrays */
 		MemSet(values, 0, sizeof(values));
 		MemSet(nulls, 0, sizeof(nulls));
 
 		/* timeline number */
-		values[0] = Int32GetDatum(history->tli);
+		values[0] = Int32GetDatum(entry->tli);
 
 		/* begin position */
-		if (XLogRecPtrIsInvalid(history->begin))
+		if (XLogRecPtrIsInvalid(entry->begin))
 			nulls[1] = true;
 		else
-			values[1] = LSNGetDatum(history->begin);
+			values[1] = LSNGetDatum(entry->begin);
 
 		/* end position */
-		if (XLogRecPtrIsInvalid(history->end))
+		if (XLogRecPtrIsInvalid(entry->end))
 			nulls[2] = true;
 		else
-			values[2] = LSNGetDatum(history->end);
+			values[2] = LSNGetDatum(entry->end);
 
-		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
 	}
 
-	/* clean up and return the tuplestore */
-	tuplestore_donestoring(tupstore);
-
-	return (Datum) 0;
+	SRF_RETURN_DONE(funcctx);
 }
 
 /*
- * archive_build_segment_list
+ * archive_segment_list_start
  *
  * Taking in input an origin timeline and LSN, as well as a target timeline
- * and LSN, build a list of WAL segments able to allow a standby pointing to
- * the origin timeline to reach the target timeline.
+ * and LSN, prepare the generation of a list of WAL segments able to allow
+ * a standby pointing to the origin timeline to reach the target timeline.
+ * The segments are then returned one at a time by
+ * archive_segment_list_next(), so the memory used does not depend on the
+ * distance between the origin and the target.
  *
  * Note that the origin and the target timelines need to be direct parents,
  * and user needs to provide in input a buffer corresponding to a history
@@ -226,67 +317,17 @@ archive_parse_history(PG_FUNCTION_ARGS)
  * the last entry in the history file, as well as it checks if the last
  * timeline entry is higher than the target.
  */
-Datum
-archive_build_segment_list(PG_FUNCTION_ARGS)
+SegmentListState *
+archive_segment_list_start(TimeLineID origin_tli, XLogRecPtr origin_lsn,
+						   TimeLineID target_tli, XLogRecPtr target_lsn,
+						   char *history_buf)
 {
-	TimeLineID	origin_tli;
-	XLogRecPtr	origin_lsn;
-	TimeLineID	target_tli;
-	XLogRecPtr	target_lsn;
-	char	   *history_buf;
-	ReturnSetInfo  *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
-	MemoryContext	per_query_ctx;
-	MemoryContext	oldcontext;
-	TupleDesc		tupdesc;
-	Tuplestorestate *tupstore;
-	List		   *entries = NIL;
-	ListCell	   *entry;
+	SegmentListState *state;
+	TimeLineHistoryEntry *entries;
+	int			nentries = 0;
 	TimeLineHistoryEntry *history;
-	bool			history_match = false;
-	XLogRecPtr		current_seg_lsn;
-	TimeLineID		current_tli;
-	char			xlogfname[MAXFNAMELEN];
-	Datum			values[1];
-	bool			nulls[1];
-	XLogSegNo		logSegNo;
-
-	/* Sanity checks for arguments */
-	if (PG_ARGISNULL(0) || PG_ARGISNULL(1) ||
-		PG_ARGISNULL(2) || PG_ARGISNULL(3))
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-				 errmsg("origin or target data cannot be NULL")));
-
-	origin_tli = PG_GETARG_INT32(0);
-	origin_lsn = PG_GETARG_LSN(1);
-	target_tli = PG_GETARG_INT32(2);
-	target_lsn = PG_GETARG_LSN(3);
-	history_buf = PG_ARGISNULL(4) ? NULL :
-		TextDatumGetCString(PG_GETARG_DATUM(4));
-
-	/* check to see if caller supports us returning a tuplestore */
-	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
-		ereport(ERROR,
-				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-				 errmsg("set-valued function called in context that cannot accept a set")));
-	if (!(rsinfo->allowedModes & SFRM_Materialize))
-		ereport(ERROR,
-				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-				 errmsg("materialize mode required, but it is not "
-						"allowed in this context")));
-
-	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
-	oldcontext = MemoryContextSwitchTo(per_query_ctx);
-	tupdesc = CreateTemplateTupleDesc(1);
-
-	TupleDescInitEntry(tupdesc, (AttrNumber) 1, "wal_segs", TEXTOID, -1, 0);
-
-	tupstore = tuplestore_begin_heap(true, false, work_mem);
-	rsinfo->returnMode = SFRM_Materialize;
-	rsinfo->setResult = tupstore;
-	rsinfo->setDesc = tupdesc;
-
-	MemoryContextSwitchTo(oldcontext);
+	bool		history_match = false;
+	XLogRecPtr	current_seg_lsn;
 
 	/* First do sanity checks on target and origin data */
 	if (origin_lsn > target_lsn)
@@ -304,24 +345,24 @@ archive_build_segment_list(PG_FUNCTION_ARGS)
 						origin_tli, target_tli)));
 
 	/*
-	 * Check parentage of the target and origin timelines if a history file
-	 * has been given by caller.
+	 * Check parentage of the target and origin timelines if a history
+	 * file has been given by caller.
 	 */
 	if (history_buf)
 	{
 		/* parse the history file */
-		entries = parseTimeLineHistory(history_buf);
+		entries = getTimeLineHistory(history_buf, &nentries);
 
-		if (entries == NIL)
+		if (nentries == 0)
 			ereport(ERROR,
 					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 					 errmsg("timeline history found empty after parsing")));
 
 		/*
-		 * Check that the target data is newer than the last entry in the history
-		 * file. Better safe than sorry.
+		 * Check that the target data is newer than the last entry in the
+		 * history file. Better safe than sorry.
 		 */
-		history = (TimeLineHistoryEntry *) llast(entries);
+		history = &entries[nentries - 1];
 		if (history->tli >= target_tli)
 			ereport(ERROR,
 					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
@@ -337,19 +378,30 @@ archive_build_segment_list(PG_FUNCTION_ARGS)
 							(uint32) (target_lsn >> 32),
 							(uint32) target_lsn)));
 		/*
-		 * Check that origin and target are direct parents, we already know that
-		 * the target fits with the history file.
+		 * Check that origin and target are direct parents, we already
+		 * know that the target fits with the history file. Timelines are
+		 * in increasing order in the history, so look for the origin one
+		 * with a binary search.
 		 */
-		foreach(entry, entries)
 		{
-			history = (TimeLineHistoryEntry *) lfirst(entry);
+			int			low = 0;
+			int			high = nentries - 1;
 
-			if (history->begin <= origin_lsn &&
-				history->end >= origin_lsn &&
-				history->tli == origin_tli)
+			while (low <= high)
 			{
-				history_match = true;
-				break;
+				int			mid = low + (high - low) / 2;
+
+				if (entries[mid].tli < origin_tli)
+					low = mid + 1;
+				else if (entries[mid].tli > origin_tli)
+					high = mid - 1;
+				else
+				{
+					history = &entries[mid];
+					history_match = history->begin <= origin_lsn &&
+						history->end >= origin_lsn;
+					break;
+				}
 			}
 		}
 
@@ -359,9 +411,9 @@ archive_build_segment_list(PG_FUNCTION_ARGS)
 					 errmsg("origin data not a direct parent of target")));
 
 		/*
-		 * Abuse this variable as temporary storage, we want the beginning
-		 * of the last, target timeline to match the end of the last timeline
-		 * tracked in the history file.
+		 * Abuse this variable as temporary storage, we want the
+		 * beginning of the last, target timeline to match the end of the
+		 * last timeline tracked in the history file.
 		 */
 		current_seg_lsn = history->end;
 	}
@@ -373,71 +425,298 @@ archive_build_segment_list(PG_FUNCTION_ARGS)
 					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 					 errmsg("origin and target timelines not matching without history file")));
 
+		entries = (TimeLineHistoryEntry *) palloc(sizeof(TimeLineHistoryEntry));
 		current_seg_lsn = origin_lsn;
 	}
 
 	/*
-	 * Before listing the list of files, add a last history entry using the
-	 * target data, this simplifies the logic below to build the segment list.
+	 * Before listing the list of files, add a last history entry using
+	 * the target data, this simplifies the logic below to build the
+	 * segment list.
 	 */
-	history = (TimeLineHistoryEntry *) palloc(sizeof(TimeLineHistoryEntry));
+	history = &entries[nentries++];
 	history->tli = target_tli;
 	history->begin = current_seg_lsn;
 	history->end = target_lsn;
-	entries = lappend(entries, history);
 
-	/*
-	 * Fill in the data by finding all segments between the origin and the
-	 * target. First segment is the one of the origin LSN, with origin
-	 * timeline. Note that when jumping to a new timeline, Postgres
-	 * switches immediately to a new segment with the new timeline, giving
-	 * up on the last, partial segment.
-	 */
+	state = (SegmentListState *) palloc0(sizeof(SegmentListState));
+	state->entries = entries;
+	state->nentries = nentries;
+	state->current_entry = 0;
+	state->target_tli = target_tli;
+	state->target_lsn = target_lsn;
 
 	/* Begin tracking at the beginning of the next segment */
-	current_seg_lsn = origin_lsn + wal_segment_size;
-	current_seg_lsn -= current_seg_lsn % wal_segment_size;
-	current_tli = origin_tli;
+	state->current_seg_lsn = origin_lsn + wal_segment_size;
+	state->current_seg_lsn -= state->current_seg_lsn % wal_segment_size;
 
-	foreach(entry, entries)
-	{
-		history = (TimeLineHistoryEntry *) lfirst(entry);
+	return state;
+}
+
+/*
+ * archive_segment_list_next
+ *
+ * Get the name of the next segment of a list prepared with
+ * archive_segment_list_start(). Returns false once all the segments have
+ * been returned.
+ */
+bool
+archive_segment_list_next(SegmentListState *state, char *xlogfname)
+{
+	TimeLineHistoryEntry *history;
+	XLogSegNo	logSegNo;
 
-		current_tli = history->tli;
+	/*
+	 * Find all segments between the origin and the target. First segment is
+	 * the one of the origin LSN, with origin timeline. Note that when
+	 * jumping to a new timeline, Postgres switches immediately to a new
+	 * segment with the new timeline, giving up on the last, partial segment.
+	 */
+	while (state->current_entry < state->nentries)
+	{
+		history = &state->entries[state->current_entry];
 
 		/* save the segment value */
-		while (current_seg_lsn >= history->begin &&
-			   current_seg_lsn < history->end)
+		if (state->current_seg_lsn >= history->begin &&
+			state->current_seg_lsn < history->end)
 		{
-			XLByteToPrevSeg(current_seg_lsn, logSegNo, wal_segment_size);
-			XLogFileName(xlogfname, current_tli, logSegNo, wal_segment_size);
-			nulls[0] = false;
-			values[0] = CStringGetTextDatum(xlogfname);
-			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+			XLByteToPrevSeg(state->current_seg_lsn, logSegNo, wal_segment_size);
+			XLogFileName(xlogfname, history->tli, logSegNo, wal_segment_size);
 
 			/*
-			 * Add equivalent of one segment, and just track the beginning
-			 * of it.
+			 * Add equivalent of one segment, and just track the beginning of
+			 * it.
 			 */
-			current_seg_lsn += wal_segment_size;
-			current_seg_lsn -= current_seg_lsn % wal_segment_size;
+			state->current_seg_lsn += wal_segment_size;
+			state->current_seg_lsn -= state->current_seg_lsn % wal_segment_size;
+			return true;
 		}
+
+		state->current_entry++;
 	}
 
 	/*
 	 * Add as well the last segment possible, this is needed to reach
 	 * consistency up to the target point.
 	 */
-	XLByteToPrevSeg(target_lsn, logSegNo, wal_segment_size);
-	XLogFileName(xlogfname, target_tli, logSegNo, wal_segment_size);
-	nulls[0] = false;
-	values[0] = CStringGetTextDatum(xlogfname);
-	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	if (!state->last_done)
+	{
+		state->last_done = true;
+		XLByteToPrevSeg(state->target_lsn, logSegNo, wal_segment_size);
+		XLogFileName(xlogfname, state->target_tli, logSegNo, wal_segment_size);
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * archive_segment_list_next_range
+ *
+ * Get the next range of consecutive segments of a list prepared with
+ * archive_segment_list_start(), all on the same timeline, as the first
+ * and the last segment numbers of the range. This returns the same
+ * segments as archive_segment_list_next(), computing each range at once
+ * instead of going through its segments. Returns false once all the
+ * ranges have been returned.
+ */
+bool
+archive_segment_list_next_range(SegmentListState *state, TimeLineID *tli,
+								XLogSegNo *first_segno, XLogSegNo *last_segno)
+{
+	TimeLineHistoryEntry *history;
+	XLogSegNo	target_segno;
+
+	XLByteToPrevSeg(state->target_lsn, target_segno, wal_segment_size);
+
+	while (state->current_entry < state->nentries)
+	{
+		history = &state->entries[state->current_entry];
+
+		/* all the segments beginning within this entry make one range */
+		if (state->current_seg_lsn >= history->begin &&
+			state->current_seg_lsn < history->end)
+		{
+			uint64		count;
+
+			count = (history->end - state->current_seg_lsn +
+					 wal_segment_size - 1) / wal_segment_size;
+
+			*tli = history->tli;
+			XLByteToPrevSeg(state->current_seg_lsn, *first_segno,
+							wal_segment_size);
+			*last_segno = *first_segno + count - 1;
+
+			state->current_seg_lsn += count * wal_segment_size;
+			state->current_entry++;
+
+			/*
+			 * The last segment, of the target LSN, usually follows the
+			 * range of the target timeline.
+			 */
+			if (state->current_entry == state->nentries &&
+				*tli == state->target_tli &&
+				*last_segno + 1 == target_segno)
+			{
+				*last_segno = target_segno;
+				state->last_done = true;
+			}
+			return true;
+		}
+
+		state->current_entry++;
+	}
+
+	if (!state->last_done)
+	{
+		state->last_done = true;
+		*tli = state->target_tli;
+		*first_segno = target_segno;
+		*last_segno = target_segno;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * archive_build_segment_list
+ *
+ * Build a list of WAL segments able to allow a standby pointing to the
+ * origin timeline to reach the target timeline, as of
+ * archive_segment_list_start(). Segments are generated one at a time,
+ * so memory is constant when this is called in the target list of a
+ * query. A function scan in FROM materializes all of them first.
+ */
+Datum
+archive_build_segment_list(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	char		xlogfname[MAXFNAMELEN];
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldcontext;
+		char	   *history_buf;
+
+		/* Sanity checks for arguments */
+		if (PG_ARGISNULL(0) || PG_ARGISNULL(1) ||
+			PG_ARGISNULL(2) || PG_ARGISNULL(3))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("origin or target data cannot be NULL")));
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		history_buf = PG_ARGISNULL(4) ? NULL :
+			TextDatumGetCString(PG_GETARG_DATUM(4));
+		funcctx->user_fctx =
+			archive_segment_list_start(PG_GETARG_INT32(0), PG_GETARG_LSN(1),
+									   PG_GETARG_INT32(2), PG_GETARG_LSN(3),
+									   history_buf);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
 
-	/* clean up and return the tuplestore */
-	tuplestore_donestoring(tupstore);
+	if (archive_segment_list_next((SegmentListState *) funcctx->user_fctx,
+								  xlogfname))
+		SRF_RETURN_NEXT(funcctx, CStringGetTextDatum(xlogfname));
 
-	return (Datum) 0;
+	SRF_RETURN_DONE(funcctx);
+}
+
+/*
+ * archive_build_segment_ranges
+ *
+ * Summarize the list of WAL segments of archive_build_segment_list() as
+ * one row for each range of consecutive segments on the same timeline,
+ * with its first and last segments and its number of segments. Each range
+ * is computed at once, so the time and the memory used only depend on
+ * the number of timelines in the history.
+ */
+Datum
+archive_build_segment_ranges(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	TimeLineID	tli;
+	XLogSegNo	first_segno;
+	XLogSegNo	last_segno;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldcontext;
+		TupleDesc	tupdesc;
+		char	   *history_buf;
+
+		/* Sanity checks for arguments */
+		if (PG_ARGISNULL(0) || PG_ARGISNULL(1) ||
+			PG_ARGISNULL(2) || PG_ARGISNULL(3))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("origin or target data cannot be NULL")));
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		history_buf = PG_ARGISNULL(4) ? NULL :
+			TextDatumGetCString(PG_GETARG_DATUM(4));
+		funcctx->user_fctx =
+			archive_segment_list_start(PG_GETARG_INT32(0), PG_GETARG_LSN(1),
+									   PG_GETARG_INT32(2), PG_GETARG_LSN(3),
+									   history_buf);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+
+	if (archive_segment_list_next_range((SegmentListState *) funcctx->user_fctx,
+										&tli, &first_segno, &last_segno))
+	{
+		Datum		values[4];
+		bool		nulls[4];
+		char		xlogfname[MAXFNAMELEN];
+		HeapTuple	tuple;
+
+		MemSet(nulls, 0, sizeof(nulls));
+		values[0] = Int32GetDatum((int32) tli);
+		XLogFileName(xlogfname, tli, first_segno, wal_segment_size);
+		values[1] = CStringGetTextDatum(xlogfname);
+		XLogFileName(xlogfname, tli, last_segno, wal_segment_size);
+		values[2] = CStringGetTextDatum(xlogfname);
+		values[3] = Int64GetDatum((int64) (last_segno - first_segno + 1));
+
+		tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+	}
+
+	SRF_RETURN_DONE(funcctx);
+}
+
+/*
+ * Get the path of the archives, defined by the environment variable
+ * PGARCHIVE.
+ */
+char *
+archive_get_path(void)
+{
+	char	   *archive_path = getenv("PGARCHIVE");
+
+	if (archive_path == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("archive path is not defined"),
+				 errhint("Check value of environment variable %s",
+						 "PGARCHIVE")));
+
+	return archive_path;
 }
 
 /*
@@ -446,7 +725,7 @@ archive_build_segment_list(PG_FUNCTION_ARGS)
  * a full path name using the path defined for the archives which is
  * enforced by the environment where Postgres is running.
  */
-static char *
+char *
 check_and_build_filepath(char *filename)
 {
 	char	   *filepath;
@@ -461,13 +740,7 @@ check_and_build_filepath(char *filename)
 				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
 				 (errmsg("reference to parent directory (\"..\") not allowed"))));
 
-	archive_path = getenv("PGARCHIVE");
-	if (archive_path == NULL)
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-				 errmsg("archive path is not defined"),
-				 errhint("Check value of environment variable %s",
-						 "PGARCHIVE")));
+	archive_path = archive_get_path();
 
 	filepath = (char *) palloc(MAXPGPATH);
 	snprintf(filepath, MAXPGPATH, "%s/%s", archive_path, filename);
@@ -482,16 +755,20 @@ check_and_build_filepath(char *filename)
  * archive_get_size
  *
  * Look at a file in the archives whose path is defined by the environment
- * variable PGARCHIVE and get its size. This is useful when combined with
- * archive_get_data to evaluate a set of chunks to be used during any
- * data transfer from the archives.
+ * variable PGARCHIVE and get the size of its data, decompressed if the
+ * file is compressed so as it is consistent with the offsets given to
+ * archive_get_data(). This is useful when combined with archive_get_data
+ * to evaluate a set of chunks to be used during any data transfer from
+ * the archives. Getting the size of a compressed file requires to
+ * decompress all of it.
  */
 Datum
 archive_get_size(PG_FUNCTION_ARGS)
 {
 	char	   *filename = text_to_cstring(PG_GETARG_TEXT_PP(0));
 	char	   *filepath;
-	struct stat fst;
+	ArchiveReader *reader;
+	int64		size;
 
 	if (!superuser())
 		ereport(ERROR,
@@ -501,13 +778,11 @@ archive_get_size(PG_FUNCTION_ARGS)
 	filepath = check_and_build_filepath(filename);
 	pfree(filename);
 
-	/* get needed information about the file */
-	if (stat(filepath, &fst) < 0)
-		ereport(ERROR,
-				(errcode_for_file_access(),
-				 errmsg("could not stat file \"%s\": %m", filepath)));
+	reader = archive_reader_open(filepath);
+	size = archive_reader_data_size(reader);
+	archive_reader_close(reader);
 
-	PG_RETURN_INT64((int64) fst.st_size);
+	PG_RETURN_INT64(size);
 }
 
 /*
@@ -515,7 +790,8 @@ archive_get_size(PG_FUNCTION_ARGS)
  *
  * Read a portion of data in an archive folder defined by PGARCHIVE, and
  * return it as bytea. If bytes_to_read is negative or higher than the
- * file's size, read the whole file.
+ * file's size, read the whole file. Compressed files are decompressed
+ * on-the-fly, with offsets referring to the decompressed data.
  *
  * Even if data is returned in binary format, it is always possible to
  * convert it to text using encode(data, 'escape'), which is recommended
@@ -531,7 +807,7 @@ archive_get_data(PG_FUNCTION_ARGS)
 	int64		bytes_to_read = -1;
 	bytea	   *result;
 	size_t		nbytes;
-	FILE	   *file;
+	ArchiveReader *reader;
 
 	if (!superuser())
 		ereport(ERROR,
@@ -546,60 +822,282 @@ archive_get_data(PG_FUNCTION_ARGS)
 				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 				 errmsg("requested length cannot be negative")));
 
+	/* not sure why anyone thought that int64 length was a good idea */
+	if (bytes_to_read > (MaxAllocSize - VARHDRSZ))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("requested length too large")));
+
 	filepath = check_and_build_filepath(filename);
 	pfree(filename);
 
+	reader = archive_reader_open(filepath);
+
 	/*
-	 * Read the file, the whole file is read if bytes_to_read is
-	 * negative.
+	 * A negative offset begins from the end of the file, whose size is
+	 * unknown until all of it has been decompressed.
 	 */
-	if (bytes_to_read < 0)
+	if (seek_offset < 0)
 	{
-		if (seek_offset < 0)
-			bytes_to_read = -seek_offset;
-		else
-		{
-			struct stat fst;
+		int64		size;
 
-			if (stat(filepath, &fst) < 0)
-				ereport(ERROR,
-						(errcode_for_file_access(),
-						 errmsg("could not stat file \"%s\": %m", filepath)));
+		if (archive_reader_compression(reader) != ARCHIVE_COMPRESSION_NONE)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("negative offset not supported for file \"%s\" compressed with %s",
+							filepath,
+							archive_compression_name(archive_reader_compression(reader)))));
 
-			bytes_to_read = fst.st_size - seek_offset;
-		}
+		size = archive_reader_raw_size(reader);
+		if (size + seek_offset < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("could not seek in file \"%s\"", filepath)));
+		seek_offset += size;
 	}
 
-	/* not sure why anyone thought that int64 length was a good idea */
-	if (bytes_to_read > (MaxAllocSize - VARHDRSZ))
+	archive_reader_skip(reader, seek_offset);
+
+	result = (bytea *) palloc((Size) bytes_to_read + VARHDRSZ);
+	nbytes = archive_reader_read(reader, VARDATA(result),
+								 (size_t) bytes_to_read);
+	SET_VARSIZE(result, nbytes + VARHDRSZ);
+
+	archive_reader_close(reader);
+
+	PG_RETURN_BYTEA_P(result);
+}
+
+/*
+ * archive_get_segment
+ *
+ * Read a complete WAL segment in an archive folder defined by PGARCHIVE,
+ * and return it as bytea. The segment is looked at first with its own
+ * name, then with the extension of each compression method supported, in
+ * which case it is decompressed on-the-fly.
+ */
+Datum
+archive_get_segment(PG_FUNCTION_ARGS)
+{
+	char	   *segname = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	char	   *filepath;
+	ArchiveReader *reader;
+	bytea	   *result;
+	Size		size;
+	Size		nbytes = 0;
+
+	if (!superuser())
 		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-				 errmsg("requested length too large")));
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 (errmsg("must be superuser to read files"))));
 
-	if ((file = AllocateFile(filepath, PG_BINARY_R)) == NULL)
+	if (!IsXLogFileName(segname) && !IsPartialXLogFileName(segname))
 		ereport(ERROR,
-				(errcode_for_file_access(),
-				 errmsg("could not open file \"%s\" for reading: %m",
-						filepath)));
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid WAL segment name \"%s\"", segname)));
 
-	if (fseeko(file, (off_t) seek_offset,
-			   (seek_offset >= 0) ? SEEK_SET : SEEK_END) != 0)
+	filepath = archive_find_file(segname);
+	if (filepath == NULL)
 		ereport(ERROR,
-				(errcode_for_file_access(),
-				 errmsg("could not seek in file \"%s\": %m", filepath)));
+				(errcode(ERRCODE_UNDEFINED_FILE),
+				 errmsg("could not find WAL segment \"%s\" in archives",
+						segname)));
+	pfree(segname);
 
-	result = (bytea *) palloc((Size) bytes_to_read + VARHDRSZ);
+	reader = archive_reader_open(filepath);
 
-	nbytes = fread(VARDATA(result), 1, (size_t) bytes_to_read, file);
+	/*
+	 * Segments archived usually have the segment size of the server, still
+	 * enlarge the result if more data is found. Once the buffer is full,
+	 * one more byte is read to check for the end of the file, so as a
+	 * segment of the expected size is not reallocated.
+	 */
+	size = Min((Size) wal_segment_size, MaxAllocSize - VARHDRSZ);
+	result = (bytea *) palloc(size + VARHDRSZ);
 
-	if (ferror(file))
-		ereport(ERROR,
-				(errcode_for_file_access(),
-				 errmsg("could not read file \"%s\": %m", filepath)));
+	for (;;)
+	{
+		char		probe;
 
-	SET_VARSIZE(result, nbytes + VARHDRSZ);
+		nbytes += archive_reader_read(reader, VARDATA(result) + nbytes,
+									  size - nbytes);
+		if (nbytes < size)
+			break;
 
-	FreeFile(file);
+		if (archive_reader_read(reader, &probe, 1) == 0)
+			break;
+
+		if (size >= MaxAllocSize - VARHDRSZ)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+					 errmsg("WAL segment \"%s\" is too large", filepath),
+					 errdetail("The size of a bytea value is limited to %zu bytes.",
+							   (Size) (MaxAllocSize - VARHDRSZ))));
+		size = Min(size * 2, MaxAllocSize - VARHDRSZ);
+		result = (bytea *) repalloc(result, size + VARHDRSZ);
+		VARDATA(result)[nbytes++] = probe;
+	}
+
+	SET_VARSIZE(result, nbytes + VARHDRSZ);
+	archive_reader_close(reader);
 
 	PG_RETURN_BYTEA_P(result);
 }
+
+/*
+ * Callback closing the file read by archive_get_data_chunks(), in the event
+ * of the scan finishing before reaching the end of the file.
+ */
+static void
+archive_get_data_chunks_shutdown(Datum arg)
+{
+	ArchiveChunksState *state = (ArchiveChunksState *) DatumGetPointer(arg);
+
+	if (state->fd >= 0)
+	{
+		CloseTransientFile(state->fd);
+		state->fd = -1;
+	}
+}
+
+/*
+ * archive_get_data_chunks
+ *
+ * Read a portion of data in an archive folder defined by PGARCHIVE, like
+ * archive_get_data(), returning it as a set of chunks with their offset
+ * in the file. Each chunk is read with pread() into the same buffer when
+ * the next row is requested. When called in the target list of a query,
+ * the rows are sent as they are generated, so the memory used by the
+ * backend is bounded by the chunk size whatever the amount of data read,
+ * which is adapted to the transfer of complete WAL segments or of large
+ * files. A function scan in FROM materializes all the rows in a
+ * tuplestore before returning the first one, bounding memory with
+ * work_mem and temporary files instead.
+ */
+Datum
+archive_get_data_chunks(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	ArchiveChunksState *state;
+	ssize_t		nbytes;
+	Size		toread;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldcontext;
+		char	   *filename = text_to_cstring(PG_GETARG_TEXT_PP(0));
+		int32		chunk_size = PG_GETARG_INT32(1);
+		int64		seek_offset = PG_GETARG_INT64(2);
+		int64		bytes_to_read = PG_GETARG_INT64(3);
+		TupleDesc	tupdesc;
+		struct stat fst;
+
+		if (!superuser())
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+					 (errmsg("must be superuser to read files"))));
+
+		if (chunk_size <= 0 || chunk_size > MaxAllocSize - VARHDRSZ)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("chunk size must be between 1 and %d",
+							(int) (MaxAllocSize - VARHDRSZ))));
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		state = (ArchiveChunksState *) palloc0(sizeof(ArchiveChunksState));
+		state->filepath = check_and_build_filepath(filename);
+		state->chunk_size = chunk_size;
+		pfree(filename);
+
+		state->fd = OpenTransientFile(state->filepath, O_RDONLY | PG_BINARY);
+		if (state->fd < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not open file \"%s\" for reading: %m",
+							state->filepath)));
+
+		if (fstat(state->fd, &fst) < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not stat file \"%s\": %m", state->filepath)));
+
+		/* A negative offset begins from the end of the file */
+		if (seek_offset < 0)
+			seek_offset = Max(fst.st_size + seek_offset, 0);
+		state->offset = (off_t) Min(seek_offset, fst.st_size);
+
+		/* Read the whole file if bytes_to_read is negative */
+		if (bytes_to_read < 0 || state->offset + bytes_to_read > fst.st_size)
+			state->end = (off_t) fst.st_size;
+		else
+			state->end = state->offset + (off_t) bytes_to_read;
+
+		state->chunk = (bytea *) palloc(chunk_size + VARHDRSZ);
+
+		/* Close the file if the scan is stopped before its end */
+		if (rsinfo != NULL && IsA(rsinfo, ReturnSetInfo))
+			RegisterExprContextCallback(rsinfo->econtext,
+										archive_get_data_chunks_shutdown,
+										PointerGetDatum(state));
+
+		funcctx->user_fctx = state;
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = (ArchiveChunksState *) funcctx->user_fctx;
+
+	if (state->offset < state->end)
+	{
+		Datum		values[2];
+		bool		nulls[2];
+		HeapTuple	tuple;
+
+		toread = (Size) Min(state->end - state->offset,
+							(off_t) state->chunk_size);
+
+		nbytes = pg_pread(state->fd, VARDATA(state->chunk), toread,
+						  state->offset);
+		if (nbytes < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read file \"%s\": %m",
+							state->filepath)));
+
+		/* The file has been truncated while reading it, so stop here */
+		if (nbytes > 0)
+		{
+			/*
+			 * The buffer is reused for the next chunk, which is fine as the
+			 * tuple built here copies its contents.
+			 */
+			SET_VARSIZE(state->chunk, nbytes + VARHDRSZ);
+
+			MemSet(nulls, 0, sizeof(nulls));
+			values[0] = Int64GetDatum((int64) state->offset);
+			values[1] = PointerGetDatum(state->chunk);
+			tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+
+			state->offset += nbytes;
+			SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+		}
+	}
+
+	/*
+	 * All done, close the file. The callback is removed as well, as its
+	 * state is freed with the memory context of the function.
+	 */
+	archive_get_data_chunks_shutdown(PointerGetDatum(state));
+	if (rsinfo != NULL && IsA(rsinfo, ReturnSetInfo))
+		UnregisterExprContextCallback(rsinfo->econtext,
+									  archive_get_data_chunks_shutdown,
+									  PointerGetDatum(state));
+	SRF_RETURN_DONE(funcctx);
+}
@@ -0,0 +1,79 @@
+/*-------------------------------------------------------------------------
+ *
+ * wal_utils.h
+ *		Declarations shared across the files of wal_utils.
+ *
+ * Copyright (c) 1996-2020, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  wal_utils/wal_utils.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef WAL_UTILS_H
+#define WAL_UTILS_H
+
+#include "access/timeline.h"
+#include "access/xlogdefs.h"
+#include "port/pg_crc32c.h"
+
+/* Compression methods of archived files */
+typedef enum ArchiveCompression
+{
+	ARCHIVE_COMPRESSION_NONE,
+	ARCHIVE_COMPRESSION_GZIP,
+	ARCHIVE_COMPRESSION_LZ4,
+	ARCHIVE_COMPRESSION_ZSTD
+} ArchiveCompression;
+
+/* Opaque state of a reader of archived files */
+typedef struct ArchiveReader ArchiveReader;
+
+/* Opaque state of the generation of a list of segments */
+typedef struct SegmentListState SegmentListState;
+
+/* wal_utils.c */
+extern char *archive_get_path(void);
+extern char *check_and_build_filepath(char *filename);
+extern SegmentListState *archive_segment_list_start(TimeLineID origin_tli,
+													XLogRecPtr origin_lsn,
+													TimeLineID target_tli,
+													XLogRecPtr target_lsn,
+													char *history_buf);
+extern bool archive_segment_list_next(SegmentListState *state,
+									  char *xlogfname);
+extern bool archive_segment_list_next_range(SegmentListState *state,
+											TimeLineID *tli,
+											XLogSegNo *first_segno,
+											XLogSegNo *last_segno);
+
+/* history_cache.c */
+extern void history_cache_init(void);
+extern pg_crc32c history_cache_checksum(const char *buffer, uint32 len);
+extern bool history_cache_lookup(pg_crc32c crc, const char *buffer,
+								 uint32 len,
+								 TimeLineHistoryEntry **entries,
+								 int *nentries);
+extern void history_cache_insert(pg_crc32c crc, const char *buffer,
+								 uint32 len,
+								 TimeLineHistoryEntry *entries,
+								 int nentries);
+
+/* archive_prefetch.c */
+extern void archive_prefetch_init(void);
+
+/* archive_reader.c */
+extern char *archive_find_file(char *filename);
+extern const char *archive_compression_name(ArchiveCompression compression);
+extern const char *archive_compression_extension(ArchiveCompression compression);
+extern bool archive_compression_from_extension(const char *extension,
+											   ArchiveCompression *compression);
+extern ArchiveReader *archive_reader_open(const char *filepath);
+extern ArchiveCompression archive_reader_compression(ArchiveReader *reader);
+extern int64 archive_reader_raw_size(ArchiveReader *reader);
+extern int64 archive_reader_data_size(ArchiveReader *reader);
+extern size_t archive_reader_read(ArchiveReader *reader, char *buf, size_t len);
+extern void archive_reader_skip(ArchiveReader *reader, int64 nbytes);
+extern void archive_reader_close(ArchiveReader *reader);
+
+#endif							/* WAL_UTILS_H */